@@ -0,0 +1,341 @@
+// Copyright 2020 NeuralVFX, Inc. All Rights Reserved.
+
+/**
+* Standalone process hosting the tracking library, so its allocator, thread pools and crashes stay out of Unreal.
+* Started by the plugin's Host backend with the name of a shared memory region the plugin created:
+*   FaceTrackerHost -shm=<Name> -lib=<Path to library> [-affinity=<Core mask>]
+* Builds without the engine:
+*   Windows: cl /O2 /EHsc /std:c++14 FaceTrackerHost.cpp
+*   Linux: g++ -O2 -std=c++14 FaceTrackerHost.cpp -o FaceTrackerHost -ldl -lpthread -lrt
+*/
+
+#include "FaceTrackerShared.h"
+
+#include <chrono>
+#include <climits>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <thread>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <dlfcn.h>
+#include <fcntl.h>
+#include <sched.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+
+/** Library functions, same as the plugin's DLL wrapper */
+typedef int(*__Init)(int& outCameraWidth, int& outCameraHeight, int detectRatio,
+	int camId, float fovZoom, bool draw, bool lockEyesNose);
+typedef void(*__Close)();
+typedef int(*__GetImage)(unsigned char* data, int width, int height);
+typedef void(*__Detect)(FaceTrackerTransform& outFaces, float* outExpression);
+typedef int(*__DetectFaces)(FaceTrackerBatch& outFaces);
+typedef int(*__Reconfigure)(int detectRatio);
+typedef int(*__GetImageYUV)(unsigned char* data, int width, int height, int format);
+
+
+/** Seconds without a plugin heartbeat before the host exits by itself */
+static const double ClientTimeout = 5.0;
+
+
+struct FaceTrackerLibrary
+{
+	__Init Init = nullptr;
+	__Close Close = nullptr;
+	__GetImage GetRawImageBytes = nullptr;
+	__Detect Detect = nullptr;
+	__DetectFaces DetectFaces = nullptr;
+	__Reconfigure Reconfigure = nullptr;
+	__GetImageYUV GetRawImageYUV = nullptr;
+};
+
+
+static double Seconds()
+{
+	return std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+
+static const char* GetArg(int argc, char** argv, const char* Name)
+{
+	size_t Length = strlen(Name);
+	for (int i = 1; i < argc; i++)
+	{
+		if (strncmp(argv[i], Name, Length) == 0)
+		{
+			return argv[i] + Length;
+		}
+	}
+	return nullptr;
+}
+
+
+static FaceTrackerShared* OpenShared(const char* Name)
+{
+#ifdef _WIN32
+	HANDLE Mapping = OpenFileMappingA(FILE_MAP_ALL_ACCESS, FALSE, Name);
+	if (Mapping == NULL)
+	{
+		return nullptr;
+	}
+	return (FaceTrackerShared*)MapViewOfFile(Mapping, FILE_MAP_ALL_ACCESS, 0, 0, sizeof(FaceTrackerShared));
+#else
+	std::string FullName = std::string("/") + Name;
+	int Handle = shm_open(FullName.c_str(), O_RDWR, 0);
+	if (Handle < 0)
+	{
+		return nullptr;
+	}
+	void* Address = mmap(nullptr, sizeof(FaceTrackerShared), PROT_READ | PROT_WRITE, MAP_SHARED, Handle, 0);
+	close(Handle);
+	return Address == MAP_FAILED ? nullptr : (FaceTrackerShared*)Address;
+#endif
+}
+
+
+static bool LoadTrackerLibrary(const char* Path, FaceTrackerLibrary& Lib)
+{
+#ifdef _WIN32
+	HMODULE Handle = LoadLibraryA(Path);
+	auto Find = [Handle](const char* Name) { return (void*)GetProcAddress(Handle, Name); };
+#else
+	void* Handle = dlopen(Path, RTLD_NOW);
+	auto Find = [Handle](const char* Name) { return dlsym(Handle, Name); };
+#endif
+	if (Handle == nullptr)
+	{
+		return false;
+	}
+
+	Lib.Init = (__Init)Find("Init");
+	Lib.Close = (__Close)Find("Close");
+	Lib.GetRawImageBytes = (__GetImage)Find("GetRawImageBytes");
+	Lib.Detect = (__Detect)Find("Detect");
+
+	// Optional, as in the plugin
+	Lib.DetectFaces = (__DetectFaces)Find("DetectFaces");
+	Lib.Reconfigure = (__Reconfigure)Find("Reconfigure");
+	Lib.GetRawImageYUV = (__GetImageYUV)Find("GetRawImageYUV");
+
+	return Lib.Init != nullptr && Lib.Close != nullptr && Lib.GetRawImageBytes != nullptr && Lib.Detect != nullptr;
+}
+
+
+static void SetAffinity(unsigned long long Mask)
+{
+	if (Mask == 0)
+	{
+		return;
+	}
+#ifdef _WIN32
+	SetProcessAffinityMask(GetCurrentProcess(), (DWORD_PTR)Mask);
+#else
+	cpu_set_t Set;
+	CPU_ZERO(&Set);
+	for (int Core = 0; Core < 64; Core++)
+	{
+		if (Mask & (1ull << Core))
+		{
+			CPU_SET(Core, &Set);
+		}
+	}
+	sched_setaffinity(0, sizeof(Set), &Set);
+#endif
+}
+
+
+/** Run the command the plugin left, returns false on quit */
+static bool RunCommand(FaceTrackerShared& Shared, const FaceTrackerLibrary& Lib, bool& bRunning)
+{
+	FaceTrackerControl& Control = Shared.control;
+	uint32_t Command = Control.command.load(std::memory_order_acquire);
+	if (Command == FACE_TRACKER_COMMAND_NONE)
+	{
+		return true;
+	}
+
+	int Result = 1;
+	switch (Command)
+	{
+	case FACE_TRACKER_COMMAND_INIT:
+		Result = Lib.Init(Control.cameraWidth, Control.cameraHeight, Control.detectRatio,
+			Control.camId, Control.fovZoom, Control.draw != 0, Control.lockEyesNose != 0);
+		bRunning = Result != INT_MIN;
+		Control.hostState.store(bRunning ? FACE_TRACKER_HOST_RUNNING : FACE_TRACKER_HOST_FAILED);
+		break;
+
+	case FACE_TRACKER_COMMAND_RECONFIGURE:
+		Result = Lib.Reconfigure != nullptr ? Lib.Reconfigure(Control.detectRatio) : INT_MIN;
+		break;
+
+	case FACE_TRACKER_COMMAND_CLOSE:
+	case FACE_TRACKER_COMMAND_QUIT:
+		if (bRunning)
+		{
+			Lib.Close();
+			bRunning = false;
+		}
+		Control.hostState.store(FACE_TRACKER_HOST_IDLE);
+		break;
+	}
+
+	Control.commandResult = Result;
+	Control.command.store(FACE_TRACKER_COMMAND_NONE, std::memory_order_release);
+	return Command != FACE_TRACKER_COMMAND_QUIT;
+}
+
+
+/** Detect and fetch the image straight into the next slot, then publish it */
+static void Publish(FaceTrackerShared& Shared, const FaceTrackerLibrary& Lib)
+{
+	uint64_t Index = Shared.writeCount.load(std::memory_order_relaxed);
+	FaceTrackerSlot& Slot = Shared.slots[Index % FACE_TRACKER_RING_SLOTS];
+
+	// Odd sequence marks the slot as being written
+	uint64_t Sequence = Slot.sequence.load(std::memory_order_relaxed);
+	Slot.sequence.store(Sequence + 1, std::memory_order_relaxed);
+	std::atomic_thread_fence(std::memory_order_release);
+
+	FaceTrackerBatch& Batch = Slot.batch;
+	Batch.version = 3;
+	Batch.maxFaces = FACE_TRACKER_MAX_FACES;
+	Batch.numFaces = 0;
+	Batch.captureAge = -1;
+	Batch.frameId = 0;
+	Batch.numLandmarks = 0;
+	for (float& Confidence : Batch.confidence)
+	{
+		Confidence = 1.f;
+	}
+	memset(Batch.boxes, 0, sizeof(Batch.boxes));
+
+	double CallTime = Seconds();
+	if (Lib.DetectFaces != nullptr)
+	{
+		Lib.DetectFaces(Batch);
+		Batch.numFaces = Batch.numFaces < 0 ? 0 : Batch.numFaces > FACE_TRACKER_MAX_FACES ? FACE_TRACKER_MAX_FACES : Batch.numFaces;
+		Batch.numLandmarks = Batch.numLandmarks < 0 ? 0 : Batch.numLandmarks > FACE_TRACKER_MAX_LANDMARKS ? FACE_TRACKER_MAX_LANDMARKS : Batch.numLandmarks;
+	}
+	else
+	{
+		// Detect has no face flag, a transform left at zero depth means it found none
+		Batch.transforms[0] = FaceTrackerTransform();
+		Lib.Detect(Batch.transforms[0], Batch.expressions);
+		Batch.trackIds[0] = 0;
+		Batch.numFaces = Batch.transforms[0].tZ != 0 ? 1 : 0;
+	}
+
+	// Without an age from the library, the frame is as old as the detect
+	if (Batch.captureAge < 0)
+	{
+		Batch.captureAge = Seconds() - CallTime;
+	}
+
+	// Image at the size and layout last asked for, BGRA if the library has no YUV
+	uint32_t Size = Shared.control.imageSize.load(std::memory_order_acquire);
+	uint32_t Format = Lib.GetRawImageYUV != nullptr ? Shared.control.imageFormat.load(std::memory_order_acquire) : 0;
+	uint32_t Width = Size >> 16;
+	uint32_t Height = Size & 0xFFFF;
+	uint32_t Bytes = Format == 0 ? Width * Height * 4 : Width * Height * 3 / 2;
+	Slot.imageWidth = 0;
+	Slot.imageHeight = 0;
+	Slot.imageBytes = 0;
+	if (Size != 0 && Bytes <= FACE_TRACKER_MAX_IMAGE_BYTES)
+	{
+		int Result = Format != 0 ?
+			Lib.GetRawImageYUV(Slot.image, Width, Height, (int)Format) : Lib.GetRawImageBytes(Slot.image, Width, Height);
+		if (Result != INT_MIN)
+		{
+			Slot.imageWidth = Width;
+			Slot.imageHeight = Height;
+			Slot.imageFormat = Format;
+			Slot.imageBytes = Bytes;
+		}
+	}
+
+	Slot.sequence.store(Sequence + 2, std::memory_order_release);
+	Shared.writeCount.store(Index + 1, std::memory_order_release);
+}
+
+
+int main(int argc, char** argv)
+{
+	const char* ShmName = GetArg(argc, argv, "-shm=");
+	const char* LibPath = GetArg(argc, argv, "-lib=");
+	const char* Affinity = GetArg(argc, argv, "-affinity=");
+	if (ShmName == nullptr || LibPath == nullptr)
+	{
+		fprintf(stderr, "Usage: FaceTrackerHost -shm=<Name> -lib=<Library> [-affinity=<Core mask>]\n");
+		return 1;
+	}
+
+	FaceTrackerShared* Shared = OpenShared(ShmName);
+	if (Shared == nullptr || Shared->control.version != FACE_TRACKER_SHARED_VERSION)
+	{
+		fprintf(stderr, "Could not open shared memory %s\n", ShmName);
+		return 1;
+	}
+	FaceTrackerControl& Control = Shared->control;
+
+	FaceTrackerLibrary Lib;
+	if (!LoadTrackerLibrary(LibPath, Lib))
+	{
+		fprintf(stderr, "Could not load %s\n", LibPath);
+		Control.hostState.store(FACE_TRACKER_HOST_FAILED);
+		return 1;
+	}
+	Control.hasDetectFaces = Lib.DetectFaces != nullptr;
+	Control.hasYUV = Lib.GetRawImageYUV != nullptr;
+
+	SetAffinity(Affinity != nullptr ? strtoull(Affinity, nullptr, 0) : 0);
+	Control.hostState.store(FACE_TRACKER_HOST_IDLE);
+
+	bool bRunning = false;
+	uint64_t LastClientHeartbeat = Control.clientHeartbeat.load();
+	double LastClientTime = Seconds();
+	while (true)
+	{
+		Control.hostHeartbeat.fetch_add(1, std::memory_order_relaxed);
+		if (!RunCommand(*Shared, Lib, bRunning))
+		{
+			break;
+		}
+
+		// Plugin is gone, don't keep the camera open
+		uint64_t ClientHeartbeat = Control.clientHeartbeat.load(std::memory_order_relaxed);
+		if (ClientHeartbeat != LastClientHeartbeat)
+		{
+			LastClientHeartbeat = ClientHeartbeat;
+			LastClientTime = Seconds();
+		}
+		else if (Seconds() - LastClientTime > ClientTimeout)
+		{
+			fprintf(stderr, "Plugin stopped responding, exiting\n");
+			break;
+		}
+
+		// Detect only what the plugin asked for, it may be holding detects under a rate cap
+		uint64_t Requests = Control.detectRequests.load(std::memory_order_acquire);
+		if (bRunning && Shared->writeCount.load(std::memory_order_relaxed) < Requests)
+		{
+			Publish(*Shared, Lib);
+		}
+		else
+		{
+			std::this_thread::sleep_for(std::chrono::microseconds(bRunning ? 200 : 1000));
+		}
+	}
+
+	if (bRunning)
+	{
+		Lib.Close();
+	}
+	return 0;
+}
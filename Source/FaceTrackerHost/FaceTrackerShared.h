@@ -0,0 +1,145 @@
+// Copyright 2020 NeuralVFX, Inc. All Rights Reserved.
+
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+
+
+/**
+* Shared memory layout between the plugin and FaceTrackerHost.
+* Plain C++ so the host builds without the engine - the plugin creates the region, the host opens it.
+* Results go through a single producer, single consumer ring of slots, each guarded by a sequence
+* number which is odd while the host writes it, so the plugin never reads a half written slot.
+*/
+
+/** Layout version, host refuses a region of another version */
+#define FACE_TRACKER_SHARED_VERSION 3
+
+/** Slots in the ring - the host writes the next while the plugin still copies the image of the last */
+#define FACE_TRACKER_RING_SLOTS 4
+
+/** Largest image a slot holds, 1024x1024 BGRA */
+#define FACE_TRACKER_MAX_IMAGE_BYTES (1024 * 1024 * 4)
+
+/** Matches FACE_BATCH_MAX_FACES of the plugin */
+#define FACE_TRACKER_MAX_FACES 8
+
+/** Matches FACE_BATCH_MAX_LANDMARKS of the plugin */
+#define FACE_TRACKER_MAX_LANDMARKS 68
+
+
+/** Same layout as the plugin's TransformData */
+struct FaceTrackerTransform
+{
+	float tX, tY, tZ;
+	float rfX, rfY, rfZ;
+	float ruX, ruY, ruZ;
+};
+
+
+/** Same layout as the plugin's FaceBatchData, so the DLL's DetectFaces writes straight into it */
+struct FaceTrackerBatch
+{
+	int version;
+	int maxFaces;
+	int numFaces;
+	int trackIds[FACE_TRACKER_MAX_FACES];
+	FaceTrackerTransform transforms[FACE_TRACKER_MAX_FACES];
+	float expressions[FACE_TRACKER_MAX_FACES * 51];
+	double captureAge;
+	long long frameId;
+	float confidence[FACE_TRACKER_MAX_FACES];
+	float boxes[FACE_TRACKER_MAX_FACES * 4];
+	int numLandmarks;
+	float landmarks[FACE_TRACKER_MAX_FACES * FACE_TRACKER_MAX_LANDMARKS * 2];
+};
+
+
+/** Lifecycle of the host, written by the host */
+enum FaceTrackerHostState : uint32_t
+{
+	FACE_TRACKER_HOST_STARTING = 0,
+	FACE_TRACKER_HOST_IDLE,
+	FACE_TRACKER_HOST_RUNNING,
+	FACE_TRACKER_HOST_FAILED
+};
+
+
+/** Request from the plugin, cleared back to NONE by the host once done */
+enum FaceTrackerCommand : uint32_t
+{
+	FACE_TRACKER_COMMAND_NONE = 0,
+	FACE_TRACKER_COMMAND_INIT,
+	FACE_TRACKER_COMMAND_RECONFIGURE,
+	FACE_TRACKER_COMMAND_CLOSE,
+	FACE_TRACKER_COMMAND_QUIT
+};
+
+
+/** Commands and settings, written by the plugin unless noted */
+struct FaceTrackerControl
+{
+	/** Set by the plugin when it creates the region */
+	uint32_t version;
+
+	/** Written by the host */
+	std::atomic<uint32_t> hostState;
+
+	/** Bumped by each side every loop, the other side treats a stalled counter as a dead process */
+	std::atomic<uint64_t> hostHeartbeat;
+	std::atomic<uint64_t> clientHeartbeat;
+
+	/** Results the plugin asked for, the host only detects while it has published fewer, so it never outruns the plugin's rate cap */
+	std::atomic<uint64_t> detectRequests;
+
+	/** Arguments are written before the command, the result by the host before it clears the command */
+	std::atomic<uint32_t> command;
+	int32_t commandResult;
+
+	/** Init arguments, camera size is written back by the host */
+	int32_t cameraWidth;
+	int32_t cameraHeight;
+	int32_t detectRatio;
+	int32_t camId;
+	float fovZoom;
+	int32_t draw;
+	int32_t lockEyesNose;
+
+	/** Whether the library has DetectFaces and GetRawImageYUV, written by the host */
+	int32_t hasDetectFaces;
+	int32_t hasYUV;
+
+	/** Image the host fetches with each result - width and height packed in 16 bits each, zero for none */
+	std::atomic<uint32_t> imageSize;
+	std::atomic<uint32_t> imageFormat;
+};
+
+
+/** One published result */
+struct FaceTrackerSlot
+{
+	/** Odd while the host writes, the slot is consistent if it reads the same even value before and after */
+	std::atomic<uint64_t> sequence;
+
+	FaceTrackerBatch batch;
+
+	/** Image fetched right after the detect, zero size if none */
+	int32_t imageWidth;
+	int32_t imageHeight;
+	uint32_t imageFormat;
+	uint32_t imageBytes;
+	alignas(64) uint8_t image[FACE_TRACKER_MAX_IMAGE_BYTES];
+};
+
+
+/** Whole region */
+struct FaceTrackerShared
+{
+	FaceTrackerControl control;
+
+	/** Results published so far, the newest is in slot (writeCount - 1) % FACE_TRACKER_RING_SLOTS */
+	alignas(64) std::atomic<uint64_t> writeCount;
+
+	FaceTrackerSlot slots[FACE_TRACKER_RING_SLOTS];
+};
@@ -1,5 +1,6 @@
 // Copyright Epic Games, Inc. All Rights Reserved.
 
+using System.IO;
 using UnrealBuildTool;
 
 public class FacialPoseEstimation : ModuleRules
@@ -17,6 +18,7 @@ public class FacialPoseEstimation : ModuleRules
 		
 		PrivateIncludePaths.AddRange(
 			new string[] {
+				Path.Combine(ModuleDirectory, "..", "FaceTrackerHost"),
 				// ... add other private include paths required here ...
 			}
 			);
@@ -26,6 +28,7 @@ public class FacialPoseEstimation : ModuleRules
 			new string[]
 			{
 				"Core",
+				"LiveLinkInterface",
 				// ... add other public dependencies that you statically link with here ...
 			}
 			);
@@ -34,10 +37,18 @@ public class FacialPoseEstimation : ModuleRules
 		PrivateDependencyModuleNames.AddRange(
 			new string[]
 			{
+				"AssetRegistry",
 				"CoreUObject",
 				"Engine",
+				"ImageWrapper",
+				"Json",
+				"Networking",
+				"Projects",
+				"RenderCore",
+				"RHI",
 				"Slate",
 				"SlateCore",
+				"Sockets",
 				// ... add private dependencies that you statically link with here ...	
 			}
 			);
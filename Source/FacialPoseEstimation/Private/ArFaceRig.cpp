@@ -9,8 +9,18 @@
 #include "Materials/MaterialInstance.h"
 #include "Materials/MaterialInstanceDynamic.h"
 #include "Engine/Texture2D.h"
+#include "Animation/MorphTarget.h"
 #include "GenericPlatform/GenericPlatformMath.h"
 #include "Kismet/KismetMathLibrary.h"
+#include "RenderingThread.h"
+#include "Misc/App.h"
+#include "UObject/UObjectArray.h"
+#include "FacialPoseStats.h"
+#include "FaceSmoothingSubsystem.h"
+#include "ILiveLinkClient.h"
+#include "Roles/LiveLinkAnimationRole.h"
+#include "Roles/LiveLinkAnimationTypes.h"
+#include "Features/IModularFeatures.h"
 
 
 AArFaceRig::AArFaceRig()
@@ -36,17 +46,6 @@ AArFaceRig::AArFaceRig()
 	static ConstructorHelpers::FObjectFinder<UMaterial>MaterialAsset(*ViewMatStr);
 	PlaneMesh->SetMaterial(0, MaterialAsset.Object);
 
-	// Set default matrices - used to convert OpenCV matrix to Unreal
-	Mat = FMatrix::Identity;
-	Mat.M[0][0] = 1, Mat.M[0][1] = 0, Mat.M[0][2] = 0;
-	Mat.M[1][0] = 0, Mat.M[1][1] = 0, Mat.M[1][2] = 1;
-	Mat.M[2][0] = 0, Mat.M[2][1] = -1, Mat.M[2][2] = 0;
-
-	MatB = FMatrix::Identity;
-	MatB.M[0][0] = 0, MatB.M[0][1] = 1, MatB.M[0][2] = 0;
-	MatB.M[1][0] = 0, MatB.M[1][1] = 0, MatB.M[1][2] = 1;
-	MatB.M[2][0] = -1, MatB.M[2][1] = 0, MatB.M[2][2] = 0;
-
 	// Face scale
 	FaceScale = 5.7;
 
@@ -56,18 +55,108 @@ AArFaceRig::AArFaceRig()
 	BlendShapeMomentum = 2.0;
 	BlendShapeBlendMult = .8;
 
-	// Transform blend values
-	PrevRotation = FRotator(0, 0, 0);
-	PrevPosition = FVector(0, 0, 0);
+	// Adaptive filtering, eyes blink faster than the jaw moves
+	FilterType = EFaceFilterType::OneEuro;
+	TranslationFilter.MinCutoff = 1.f;
+	TranslationFilter.Beta = .01f;
+	RotationFilter.MinCutoff = 1.f;
+	RotationFilter.Beta = .5f;
+	ExpressionFilter.MinCutoff = 1.5f;
+	ExpressionFilter.Beta = .8f;
+
+	FFaceFilterGroup Eyes;
+	Eyes.NamePrefix = TEXT("eye");
+	Eyes.Settings.MinCutoff = 3.f;
+	Eyes.Settings.Beta = 2.f;
+	Eyes.Settings.ProcessNoise = 200.f;
+	ExpressionFilterGroups.Add(Eyes);
+
+	FFaceFilterGroup Jaw;
+	Jaw.NamePrefix = TEXT("jaw");
+	Jaw.Settings.MinCutoff = 1.f;
+	Jaw.Settings.Beta = .5f;
+	ExpressionFilterGroups.Add(Jaw);
+
+	LastCaptureTime = 0;
+
+	// Each rig smooths its own faces
+	bBatchSmoothing = false;
+
+	// Pose prediction
+	bPredictPose = true;
+	DisplayLatency = .03;
+	InterpolationDelay = 0;
+	MaxExtrapolation = .1;
+
+	// Faces are driven by tracking frames directly
+	bDriveFromLiveLink = false;
+
+	// Skip morph writes below this change
+	BlendShapeEpsilon = .001;
+
+	// Morph targets are set by name, alongside any animation of the face mesh
+	bDirectMorphWeights = false;
+
+	// Components are posed from the game thread
+	bApplyPoseInAnimation = false;
+
+	// One morph target per expression output
+	Retarget = nullptr;
+
+	// Single face unless more are requested
+	MaxFaces = 1;
+
+	// Every detection counts, lost faces are freed at once
+	MinFaceConfidence = 0;
+	LostFaceHoldTime = 0;
+	LostFaceDecayTime = 0;
 
 	// DLL properties
 	OutCameraWidth = 1920;
 	OutCameraHeight = 1080;
 	DetectRatio = 1;
 	CamId = 0;
+	TrackerIndex = 0;
 	FovZoom = 1;
 	Draw = false;
 	LockEyesNose = true;
+
+	// Quality is fixed unless asked for
+	bAdaptiveQuality = false;
+
+	// Not baking
+	BakeFaceIndex = INDEX_NONE;
+
+	// Tracking starts once the tracker is ready
+	bTrackerReady = false;
+	bTrackerFailed = false;
+	TimeToTrackerReady = -1;
+	TimeToFirstTrackedFrame = -1;
+	BeginPlayTime = 0;
+
+	// Preview image, height follows the camera
+	PreviewWidth = 512;
+	bMatchCameraAspect = true;
+	PreviewHeight = 512;
+	PreviewFormat = EFaceImageFormat::BGRA;
+	YUVViewerMaterial = nullptr;
+
+	// Background texture is built in BeginPlay
+	BackgroundTexture = nullptr;
+	BackgroundUTexture = nullptr;
+	BackgroundVTexture = nullptr;
+	BackgroundMaterial = nullptr;
+	BackgroundWidth = 512;
+	BackgroundHeight = 512;
+	BackgroundFormat = EFaceImageFormat::BGRA;
+	TrackingWidth = 512;
+	TrackingHeight = 512;
+
+	// Stats
+	DroppedFrames = 0;
+	RepeatedFrames = 0;
+	DuplicateFrames = 0;
+	UploadsAvoided = 0;
 }
 
 
@@ -76,23 +165,101 @@ void AArFaceRig::BeginPlay()
 	Super::BeginPlay();
 
 	UcDataStorageGameInstance* GameInst = (UcDataStorageGameInstance*)GetGameInstance();
+	BeginPlayTime = FPlatformTime::Seconds();
 
-	GameInst->CustomStart(OutCameraWidth,
+	// Camera opens and warms up off the game thread, tracking starts once it's ready
+	GameInst->CustomStartAsync(OutCameraWidth,
 		OutCameraHeight,
 		DetectRatio,
 		CamId,
 		FovZoom,
 		Draw,
-		LockEyesNose);
+		LockEyesNose,
+		TrackerIndex);
 
-	// Set blend shape names
-	USkeletalMesh* skelMesh = FaceMesh->SkeletalMesh;
-	BlendShapeArray = skelMesh->K2_GetAllMorphTargetNames();
+	// Resolve blend shape names and their filters
+	BindMorphTargets();
+	BuildFilters();
 
-	// Setup material instance
-	UMaterialInstance* Material = (UMaterialInstance *)PlaneMesh->GetMaterial(0);
-	MasterMaterialRef = Material;
+	// Build faces to bind tracks to
+	CreateFacePool();
 
+	// Curves are named after the morph targets, so the Live Link Pose node drives them as they are
+	if (bDriveFromLiveLink || GameInst->bPublishLiveLink)
+	{
+		if (!GameInst->StartLiveLink(ExpressionChannelNames, Faces.Num()))
+		{
+			bDriveFromLiveLink = false;
+		}
+	}
+
+	// Plain plate at the requested resolution until the tracker is ready
+	FaceMesh->SetVisibility(false);
+	PlaceCamera();
+
+	// Ready, or failed, straight away without async init
+	if (GameInst->IsTrackerReady(TrackerIndex, OutCameraWidth, OutCameraHeight) || GameInst->IsTrackerFailed(TrackerIndex))
+	{
+		BeginTracking();
+	}
+}
+
+
+void AArFaceRig::BeginTracking()
+{
+	UcDataStorageGameInstance* GameInst = (UcDataStorageGameInstance*)GetGameInstance();
+
+	// Camera never opened, keep the plain plate
+	if (GameInst->IsTrackerFailed(TrackerIndex))
+	{
+		bTrackerFailed = true;
+		UE_LOG(LogTemp, Error, TEXT("Tracker %d Failed to Start, not Tracking"), TrackerIndex);
+		OnTrackerFailed.Broadcast();
+		return;
+	}
+
+	bTrackerReady = true;
+	TimeToTrackerReady = FPlatformTime::Seconds() - BeginPlayTime;
+	SET_FLOAT_STAT(STAT_FacialPose_TimeToTrackerReady, TimeToTrackerReady * 1000.f);
+
+	// Preview size, kept even for the half size chroma planes of YUV images
+	TrackingWidth = FMath::Max(PreviewWidth, 2) & ~1;
+	TrackingHeight = bMatchCameraAspect && OutCameraWidth > 0 ?
+		FMath::RoundToInt((float)TrackingWidth * OutCameraHeight / OutCameraWidth) : PreviewHeight;
+	TrackingHeight = FMath::Max(TrackingHeight, 2) & ~1;
+
+	EFaceImageFormat Format = PreviewFormat;
+	if (Format != EFaceImageFormat::BGRA && YUVViewerMaterial == nullptr)
+	{
+		UE_LOG(LogTemp, Warning, TEXT("No YUV Viewer Material, using BGRA Preview"));
+		Format = EFaceImageFormat::BGRA;
+	}
+
+	// Run pipeline off the game thread
+	GameInst->StartTracking(TrackingWidth, TrackingHeight, Format, TrackerIndex);
+	ImagePool = GameInst->GetImagePool(TrackerIndex);
+
+	// Build background texture and material
+	CreateBackground(TrackingWidth, TrackingHeight, Format);
+
+	// Governor starts from the configured quality
+	QualityGovernor.Reset(QualitySettings, { DetectRatio, 1.f, QualitySettings.MaxInferenceRate });
+	if (bAdaptiveQuality)
+	{
+		ApplyQuality();
+	}
+
+	// Camera may have attained another resolution than requested
+	PlaceCamera();
+	FaceMesh->SetVisibility(true);
+
+	UE_LOG(LogTemp, Log, TEXT("Tracker %d Ready %.2fs after BeginPlay"), TrackerIndex, TimeToTrackerReady);
+	OnTrackerReady.Broadcast();
+}
+
+
+void AArFaceRig::PlaceCamera()
+{
 	// Set plane transform
 	PlaneMesh->SetWorldLocationAndRotation(FVector((OutCameraWidth*FovZoom)*100, 0, 0),
 		FQuat(FRotator(0, 90, 90)));
@@ -114,11 +281,170 @@ void AArFaceRig::BeginPlay()
 }
 
 
+/** Transient texture for one background plane, YUV planes hold raw values rather than colour */
+static UTexture2D* CreateBackgroundPlane(int Width, int Height, EPixelFormat PixelFormat)
+{
+	UTexture2D* Texture = UTexture2D::CreateTransient(Width, Height, PixelFormat);
+	Texture->SRGB = PixelFormat == PF_B8G8R8A8;
+	Texture->UpdateResource();
+	return Texture;
+}
+
+
+void AArFaceRig::CreateBackground(int Width, int Height, EFaceImageFormat Format)
+{
+	// Setup material instance
+	UMaterialInstance* Material = (UMaterialInstance *)PlaneMesh->GetMaterial(0);
+	MasterMaterialRef = Material;
+
+	// Build textures and material instance once, updated in place each tick
+	BackgroundMaterial = nullptr;
+	ResizeBackground(Width, Height, Format);
+}
+
+
+void AArFaceRig::ResizeBackground(int Width, int Height, EFaceImageFormat Format)
+{
+	// Pending uploads read the region, let them finish before it changes
+	FlushRenderingCommands();
+
+	// Material only changes between BGRA and YUV
+	bool bYUV = Format != EFaceImageFormat::BGRA;
+	if (BackgroundMaterial == nullptr || bYUV != (BackgroundFormat != EFaceImageFormat::BGRA))
+	{
+		UMaterialInterface* Parent = bYUV ? YUVViewerMaterial : (UMaterialInterface*)MasterMaterialRef;
+		BackgroundMaterial = UMaterialInstanceDynamic::Create(Parent, this);
+		PlaneMesh->SetMaterial(0, BackgroundMaterial);
+	}
+
+	BackgroundWidth = Width;
+	BackgroundHeight = Height;
+	BackgroundFormat = Format;
+	BackgroundRegion = FUpdateTextureRegion2D(0, 0, 0, 0, Width, Height);
+	BackgroundChromaRegion = FUpdateTextureRegion2D(0, 0, 0, 0, Width / 2, Height / 2);
+	BackgroundUTexture = nullptr;
+	BackgroundVTexture = nullptr;
+
+	if (!bYUV)
+	{
+		BackgroundTexture = CreateBackgroundPlane(Width, Height, PF_B8G8R8A8);
+		BackgroundMaterial->SetTextureParameterValue(FName("ViewInput"), (UTexture*)BackgroundTexture);
+	}
+	else
+	{
+		// Full size luma, half size chroma - interleaved for NV12, separate planes for I420
+		bool bInterleaved = Format == EFaceImageFormat::NV12;
+		BackgroundTexture = CreateBackgroundPlane(Width, Height, PF_G8);
+		BackgroundUTexture = CreateBackgroundPlane(Width / 2, Height / 2, bInterleaved ? PF_R8G8 : PF_G8);
+		BackgroundVTexture = bInterleaved ? BackgroundUTexture : CreateBackgroundPlane(Width / 2, Height / 2, PF_G8);
+
+		BackgroundMaterial->SetTextureParameterValue(FName("ViewInputY"), (UTexture*)BackgroundTexture);
+		BackgroundMaterial->SetTextureParameterValue(FName("ViewInputU"), (UTexture*)BackgroundUTexture);
+		BackgroundMaterial->SetTextureParameterValue(FName("ViewInputV"), (UTexture*)BackgroundVTexture);
+		BackgroundMaterial->SetScalarParameterValue(FName("ViewInputInterleaved"), bInterleaved ? 1.f : 0.f);
+	}
+
+	UE_LOG(LogTemp, Log, TEXT("Background %dx%d %s"), Width, Height,
+		*StaticEnum<EFaceImageFormat>()->GetNameStringByValue((int64)Format));
+}
+
+
+void AArFaceRig::ApplyQuality()
+{
+	UcDataStorageGameInstance* GameInst = (UcDataStorageGameInstance*)GetGameInstance();
+	const FFaceQualityState& State = QualityGovernor.GetState();
+
+	// Preview scales down from the size tracking started with
+	DetectRatio = State.DetectRatio;
+	GameInst->ReconfigureTracking(State.DetectRatio,
+		FMath::RoundToInt(TrackingWidth * State.PreviewScale),
+		FMath::RoundToInt(TrackingHeight * State.PreviewScale),
+		State.MaxInferenceRate,
+		TrackerIndex);
+}
+
+
+TArray<FFaceQualityEvent> AArFaceRig::GetQualityEvents()
+{
+	return QualityGovernor.GetEvents();
+}
+
+
+void AArFaceRig::StartBake(int32 FaceIndex)
+{
+	if (!Faces.IsValidIndex(FaceIndex))
+	{
+		UE_LOG(LogTemp, Warning, TEXT("No Face %d to Bake"), FaceIndex);
+		return;
+	}
+
+	// Curves are named as the mesh binds them, retargeted takes bake the retarget curves
+	Baker.Reset(UFaceAnimBakeLibrary::GetExpressionCurveNames(FaceMesh->SkeletalMesh, ExpressionNames), RetargetMatrix);
+	BakeFaceIndex = FaceIndex;
+}
+
+
+UAnimSequence* AArFaceRig::StopBake(const FString& AssetPath, FFaceBakeStats& Stats)
+{
+	BakeFaceIndex = INDEX_NONE;
+
+#if WITH_EDITOR
+	USkeletalMesh* SkelMesh = FaceMesh->SkeletalMesh;
+	return Baker.Bake(SkelMesh != nullptr ? SkelMesh->Skeleton : nullptr, AssetPath, BakeSettings, &Stats);
+#else
+	UE_LOG(LogTemp, Error, TEXT("Baking Animation Needs the Editor"));
+	return nullptr;
+#endif
+}
+
+
+void AArFaceRig::EndPlay(const EEndPlayReason::Type EndPlayReason)
+{
+	// Upload region must outlive any pending texture upload
+	FlushRenderingCommands();
+
+	// Free smoothing slots, so later passes don't call back into this rig
+	UFaceSmoothingSubsystem* Smoothing = GetWorld()->GetSubsystem<UFaceSmoothingSubsystem>();
+	for (FArFaceInstance& Face : Faces)
+	{
+		if (Smoothing != nullptr && Face.SmoothingSlot != INDEX_NONE)
+		{
+			Smoothing->RemoveFace(Face.SmoothingSlot);
+		}
+		Face.SmoothingSlot = INDEX_NONE;
+	}
+
+	Super::EndPlay(EndPlayReason);
+}
+
+
 void AArFaceRig::Tick(float DeltaTime)
 {
 	Super::Tick(DeltaTime);
 
+	// Tracker readiness is polled, nothing here waits on it
+	if (!bTrackerReady && !bTrackerFailed)
+	{
+		UcDataStorageGameInstance* GameInst = (UcDataStorageGameInstance*)GetGameInstance();
+		if (GameInst->IsTrackerReady(TrackerIndex, OutCameraWidth, OutCameraHeight) || GameInst->IsTrackerFailed(TrackerIndex))
+		{
+			BeginTracking();
+		}
+	}
+
 	RunDLL();
+
+	// Step tracking quality towards the frame budget, by what frames really cost - DeltaTime is dilated
+	if (bAdaptiveQuality && bTrackerReady)
+	{
+		QualityGovernor.AddFrame(FApp::GetDeltaTime() * 1000.f);
+		if (QualityGovernor.Update(GetWorld()->GetRealTimeSeconds()))
+		{
+			ApplyQuality();
+		}
+	}
+
+	SET_DWORD_STAT(STAT_FacialPose_UObjectCount, GUObjectArray.GetObjectArrayNumMinusAvailable());
 }
 
 
@@ -128,50 +454,699 @@ void AArFaceRig::SetupPlayerInputComponent(UInputComponent* PlayerInputComponent
 }
 
 
-void AArFaceRig::SetBlendShapes(float* Blendshapes)
+void AArFaceRig::BindMorphTargets()
+{
+	MorphBindings.Reset();
+	ExpressionChannelNames = ExpressionNames;
+	RetargetMatrix.Reset();
+	RetargetValues.Reset();
+	USkeletalMesh* SkelMesh = FaceMesh->SkeletalMesh;
+	if (SkelMesh == nullptr)
+	{
+		return;
+	}
+
+	// Retarget curves bind by their own names, expression names are left to filter groups and Live Link
+	if (Retarget != nullptr)
+	{
+		RetargetMatrix = Retarget->GetMatrix();
+		RetargetValues.SetNumZeroed(RetargetMatrix->GetNumPaddedTargets());
+
+		const TArray<FName>& CurveNames = RetargetMatrix->GetNames();
+		for (int32 i = 0; i < CurveNames.Num(); i++)
+		{
+			int32 MorphIndex = INDEX_NONE;
+			if (CurveNames[i] == NAME_None || SkelMesh->FindMorphTargetAndIndex(CurveNames[i], MorphIndex) == nullptr)
+			{
+				// Anim instances may still drive it as a plain curve
+				if (!bApplyPoseInAnimation)
+				{
+					UE_LOG(LogTemp, Warning, TEXT("No morph target for retarget curve %d: %s"), i, *CurveNames[i].ToString());
+				}
+				continue;
+			}
+			MorphBindings.Add({ i, MorphIndex, CurveNames[i] });
+		}
+		return;
+	}
+
+	// Fall back to the order the morph targets were imported in
+	TArray<FName> Names = ExpressionNames;
+	if (Names.Num() == 0)
+	{
+		UE_LOG(LogTemp, Warning, TEXT("No ExpressionNames set, binding blendshapes by morph target order"));
+		for (const FString& MorphName : SkelMesh->K2_GetAllMorphTargetNames())
+		{
+			Names.Add(FName(*MorphName));
+		}
+	}
+	ExpressionChannelNames = Names;
+
+	// Resolve each expression output to a morph target
+	for (int32 i = 0; i < FMath::Min(Names.Num(), 51); i++)
+	{
+		int32 MorphIndex = INDEX_NONE;
+		if (Names[i] == NAME_None || SkelMesh->FindMorphTargetAndIndex(Names[i], MorphIndex) == nullptr)
+		{
+			UE_LOG(LogTemp, Warning, TEXT("No morph target for expression %d: %s"), i, *Names[i].ToString());
+			continue;
+		}
+		MorphBindings.Add({ i, MorphIndex, Names[i] });
+	}
+}
+
+
+void AArFaceRig::BuildFilters()
+{
+	TranslationFilterParams.SetAll(TranslationFilter);
+	RotationFilterParams.SetAll(RotationFilter);
+
+	// Each expression takes the first group its name starts with
+	ExpressionFilterParams.SetAll(ExpressionFilter);
+	for (int32 i = 0; i < FMath::Min(ExpressionChannelNames.Num(), 51); i++)
+	{
+		FString Name = ExpressionChannelNames[i].ToString();
+		for (const FFaceFilterGroup& Group : ExpressionFilterGroups)
+		{
+			if (!Group.NamePrefix.IsEmpty() && Name.StartsWith(Group.NamePrefix))
+			{
+				ExpressionFilterParams.Set(i, Group.Settings);
+				break;
+			}
+		}
+	}
+}
+
+
+/**
+* Make every bound morph target active on the face's mesh, so SetBlendShapes writes weights by index.
+* Bones are left at the reference pose, as evaluation would rebuild the weights from the mesh's name keyed curves.
+* Called again whenever the mesh dropped them, eg on SetSkeletalMesh.
+*/
+static void BindMorphWeights(FArFaceInstance& Face, const TArray<FArFaceMorphBinding>& Bindings)
 {
-	// Loop through each blendshape and set value
-	int count = 0;
-	for (auto blendshape : BlendShapeArray)
+	USkeletalMesh* SkelMesh = Face.Mesh->SkeletalMesh;
+	if (SkelMesh == nullptr)
+	{
+		return;
+	}
+
+	Face.Mesh->bNoSkeletonUpdate = true;
+	Face.Mesh->ActiveMorphTargets.Reset(Bindings.Num());
+	Face.Mesh->MorphTargetWeights.SetNumZeroed(SkelMesh->MorphTargets.Num());
+	for (const FArFaceMorphBinding& Binding : Bindings)
 	{
-		FaceMesh->SetMorphTarget(FName(blendshape), Blendshapes[count]);
-		count++;
+		if (SkelMesh->MorphTargets.IsValidIndex(Binding.MorphIndex))
+		{
+			Face.Mesh->ActiveMorphTargets.Add(FActiveMorphTarget(SkelMesh->MorphTargets[Binding.MorphIndex], Binding.MorphIndex));
+		}
 	}
 }
 
 
-void AArFaceRig::SetTransforms(FVector Up, FVector Forward, FVector Translation)
+/** Clear smoothing history, so a newly bound face doesn't blend from another person */
+static void ResetFace(FArFaceInstance& Face)
 {
-	// Build matrix
-	Up = Up.GetSafeNormal();
-	Forward = Forward.GetSafeNormal();
+	Face.PrevPosition = FVector(0, 0, 0);
+	Face.PrevRotation = FRotator(0, 0, 0);
+	FMemory::Memzero(Face.BlendValues);
+	FMemory::Memzero(Face.PrevBlendValues);
+	Face.Filter.Reset();
+	Face.PoseHistory.Reset();
+
+	// Force first frame to be written
+	for (float& Applied : Face.AppliedBlendValues)
+	{
+		Applied = -1.f;
+	}
+}
 
-	FMatrix BuiltMatrix = FRotationMatrix::MakeFromYZ(Up, Forward);
-	BuiltMatrix = Mat * BuiltMatrix* MatB;
 
-	// Fix flipped axes
-	FTransform OutTransform(BuiltMatrix);
-	FQuat Quat = OutTransform.GetRotation();
-	FVector Mod = Quat.Euler();
-	Mod.Z = -Mod.Z;
-	FQuat NewRot = FQuat::MakeFromEuler(Mod);
+void AArFaceRig::CreateFacePool()
+{
+	Faces.SetNum(FMath::Clamp(MaxFaces, 1, FACE_BATCH_MAX_FACES));
+
+	// Anim instances read bound expressions as curves of their morph target's name, or every retarget curve
+	AnimPoseSource.Reset();
+	if (bApplyPoseInAnimation)
+	{
+		TArray<FName> CurveNames;
+		if (RetargetMatrix.IsValid())
+		{
+			CurveNames = RetargetMatrix->GetNames();
+		}
+		else
+		{
+			CurveNames.Init(NAME_None, 51);
+			for (const FArFaceMorphBinding& Binding : MorphBindings)
+			{
+				CurveNames[Binding.ExpressionIndex] = Binding.MorphName;
+			}
+		}
+		AnimPoseSource = MakeShared<FFaceAnimPoseSource, ESPMode::ThreadSafe>();
+		AnimPoseSource->SetCurveNames(CurveNames, RetargetMatrix);
+	}
+
+	for (int32 i = 0; i < Faces.Num(); i++)
+	{
+		FArFaceInstance& Face = Faces[i];
+		Face.Index = i;
+		Face.TrackId = INDEX_NONE;
+		Face.DetectionIndex = INDEX_NONE;
+		Face.LostTime = 0;
+		Face.AppliedBlendValues.SetNum(RetargetMatrix.IsValid() ? RetargetMatrix->GetNumTargets() : 51);
+		ResetFace(Face);
+
+		if (i == 0)
+		{
+			Face.Mesh = FaceMesh;
+		}
+		else
+		{
+			// Extra faces copy the mesh and materials of FaceMesh, hidden until bound
+			USkeletalMeshComponent* Mesh = NewObject<USkeletalMeshComponent>(this);
+			Mesh->SetSkeletalMesh(FaceMesh->SkeletalMesh);
+			for (int32 MatIndex = 0; MatIndex < FaceMesh->GetNumMaterials(); MatIndex++)
+			{
+				Mesh->SetMaterial(MatIndex, FaceMesh->GetMaterial(MatIndex));
+			}
+			Mesh->SetVisibility(false);
+			Mesh->RegisterComponent();
+
+			PooledFaceMeshes.Add(Mesh);
+			Face.Mesh = Mesh;
+		}
+		Face.AppliedTransform = Face.Mesh->GetComponentTransform();
+		Face.bAnimPose = false;
+		Face.bDirectMorphWeights = false;
+
+		// Momentum blends every tick on its own, only the filters batch
+		Face.SmoothingSlot = INDEX_NONE;
+		UFaceSmoothingSubsystem* Smoothing = GetWorld()->GetSubsystem<UFaceSmoothingSubsystem>();
+		if (bBatchSmoothing && FilterType != EFaceFilterType::Momentum && Smoothing != nullptr)
+		{
+			Face.SmoothingSlot = Smoothing->AddFace(this, i, FilterType, ExpressionFilterParams);
+		}
+
+		if (AnimPoseSource.IsValid())
+		{
+			Face.Mesh->SetAnimInstanceClass(UFaceAnimInstance::StaticClass());
+			UFaceAnimInstance* AnimInstance = Cast<UFaceAnimInstance>(Face.Mesh->GetAnimInstance());
+			if (AnimInstance == nullptr)
+			{
+				UE_LOG(LogTemp, Warning, TEXT("Could not Create Face Anim Instance, posing Face %d on the Game Thread"), i);
+				continue;
+			}
+			AnimInstance->SetPoseSource(AnimPoseSource, i);
+			Face.bAnimPose = true;
+		}
+	}
+
+	// Faces posed on the game thread may get their morph weights written by index, unless something else animates the mesh
+	for (FArFaceInstance& Face : Faces)
+	{
+		if (!bDirectMorphWeights || Face.bAnimPose)
+		{
+			continue;
+		}
+		if (Face.Mesh->GetAnimInstance() != nullptr)
+		{
+			UE_LOG(LogTemp, Warning, TEXT("Face %d Mesh has an Anim Instance, setting its Morph Targets by Name"), Face.Index);
+			continue;
+		}
+		BindMorphWeights(Face, MorphBindings);
+		Face.bDirectMorphWeights = true;
+	}
+}
+
+
+void AArFaceRig::BindFaces(const FaceBatchData& Batch)
+{
+	SCOPE_CYCLE_COUNTER(STAT_FacialPose_BindFaces);
+	TRACE_CPUPROFILER_EVENT_SCOPE(AArFaceRig_BindFaces);
+
+	double Now = FPlatformTime::Seconds();
+
+	// Detections under the confidence threshold are never bound
+	bool bDetectionBound[FACE_BATCH_MAX_FACES] = { false };
+	for (int32 i = 0; i < Batch.numFaces; i++)
+	{
+		bDetectionBound[i] = Batch.confidence[i] < MinFaceConfidence;
+	}
+
+	// Keep faces on the track they already follow
+	for (FArFaceInstance& Face : Faces)
+	{
+		Face.DetectionIndex = INDEX_NONE;
+		if (Face.TrackId == INDEX_NONE)
+		{
+			continue;
+		}
+
+		for (int32 i = 0; i < Batch.numFaces; i++)
+		{
+			if (Batch.trackIds[i] == Face.TrackId && !bDetectionBound[i])
+			{
+				Face.DetectionIndex = i;
+				bDetectionBound[i] = true;
+				break;
+			}
+		}
+
+		if (Face.DetectionIndex != INDEX_NONE)
+		{
+			Face.LostTime = 0;
+			continue;
+		}
+
+		// Track left view, hold the last pose a while as tracks drop out for a few frames on blur or turns
+		if (Face.LostTime == 0)
+		{
+			Face.LostTime = Now;
+		}
+		if (Now - Face.LostTime < LostFaceHoldTime + LostFaceDecayTime)
+		{
+			continue;
+		}
+
+		// Then free the face, FaceMesh stays in place at neutral once decayed
+		if (LostFaceDecayTime > 0)
+		{
+			float Neutral[51] = { 0 };
+			SetBlendShapes(Face, Neutral);
+		}
+		Face.TrackId = INDEX_NONE;
+		Face.LostTime = 0;
+		if (Face.Mesh != FaceMesh)
+		{
+			Face.Mesh->SetVisibility(false);
+		}
+	}
+
+	// Give new tracks a free face, or else the face held longest
+	for (int32 i = 0; i < Batch.numFaces; i++)
+	{
+		if (bDetectionBound[i])
+		{
+			continue;
+		}
+
+		FArFaceInstance* Free = nullptr;
+		for (FArFaceInstance& Face : Faces)
+		{
+			if (Face.TrackId == INDEX_NONE)
+			{
+				Free = &Face;
+				break;
+			}
+			if (Face.DetectionIndex == INDEX_NONE && (Free == nullptr || Face.LostTime < Free->LostTime))
+			{
+				Free = &Face;
+			}
+		}
+
+		if (Free != nullptr)
+		{
+			ResetFace(*Free);
+			if (Free->SmoothingSlot != INDEX_NONE)
+			{
+				GetWorld()->GetSubsystem<UFaceSmoothingSubsystem>()->ResetFace(Free->SmoothingSlot);
+			}
+			Free->TrackId = Batch.trackIds[i];
+			Free->DetectionIndex = i;
+			Free->LostTime = 0;
+			Free->Mesh->SetVisibility(true);
+		}
+	}
+}
+
+
+void AArFaceRig::UpdateDetections(const FaceBatchData& Batch)
+{
+	int32 NumLandmarks = FMath::Clamp(Batch.numLandmarks, 0, FACE_BATCH_MAX_LANDMARKS);
+	for (FArFaceInstance& Face : Faces)
+	{
+		FFaceDetection& Detection = Face.Detection;
+		Detection.bPresent = Face.DetectionIndex != INDEX_NONE;
+		if (!Detection.bPresent)
+		{
+			continue;
+		}
+
+		int32 i = Face.DetectionIndex;
+		Detection.Confidence = Batch.confidence[i];
+
+		const float* Box = &Batch.boxes[i * 4];
+		Detection.Box = Box[2] > 0 && Box[3] > 0 ?
+			FBox2D(FVector2D(Box[0], Box[1]), FVector2D(Box[0] + Box[2], Box[1] + Box[3])) :
+			FBox2D(ForceInit);
+
+		// Sized once, then refilled in place
+		const float* Points = &Batch.landmarks[i * FACE_BATCH_MAX_LANDMARKS * 2];
+		Detection.Landmarks.SetNumUninitialized(NumLandmarks, false);
+		for (int32 Point = 0; Point < NumLandmarks; Point++)
+		{
+			Detection.Landmarks[Point] = FVector2D(Points[Point * 2], Points[Point * 2 + 1]);
+		}
+	}
+}
+
+
+FFaceDetection AArFaceRig::GetFaceDetection(int32 FaceIndex) const
+{
+	return Faces.IsValidIndex(FaceIndex) ? Faces[FaceIndex].Detection : FFaceDetection();
+}
+
+
+void AArFaceRig::DecayLostFace(FArFaceInstance& Face, double Now)
+{
+	float Elapsed = (float)(Now - Face.LostTime) - LostFaceHoldTime;
+	if (Elapsed <= 0 || LostFaceDecayTime <= 0)
+	{
+		return;
+	}
+
+	// Expression eases out from the last filtered values, the head stays where it was last seen
+	float Alpha = 1.f - FMath::Clamp(Elapsed / LostFaceDecayTime, 0.f, 1.f);
+	float Decayed[51];
+	for (int32 i = 0; i < 51; i++)
+	{
+		Decayed[i] = Face.BlendValues[i] * Alpha;
+	}
+	SetBlendShapes(Face, Decayed);
+}
+
+
+void AArFaceRig::UpdateFace(FArFaceInstance& Face, const TransformData& Transform, const float* Expression, float DeltaTime, double CaptureTime)
+{
+	// Batched blendshapes come back through ApplySmoothedBlendShapes once every rig has ticked
+	UFaceSmoothingSubsystem* Smoothing = Face.SmoothingSlot != INDEX_NONE ? GetWorld()->GetSubsystem<UFaceSmoothingSubsystem>() : nullptr;
+	if (Smoothing != nullptr)
+	{
+		Smoothing->Submit(Face.SmoothingSlot, Expression, DeltaTime, CaptureTime);
+	}
+	else
+	{
+		SmoothBlendShapes(Face, Expression, DeltaTime);
+	}
+
+	// Copy transforms
+	FVector Translation = Transform.GetTranslation();
+	FVector Up(Transform.ruX, Transform.ruY, Transform.ruZ);
+	FVector Forward(Transform.rfX, Transform.rfY, Transform.rfZ);
+
+	SetTransforms(Face, Up, Forward, Translation, DeltaTime);
+
+	if (Smoothing != nullptr)
+	{
+		return;
+	}
+
+	// Predicted pose is applied each tick from history instead
+	if (IsPredictingPose())
+	{
+		AddPoseSample(Face, CaptureTime);
+		return;
+	}
+
+	SetBlendShapes(Face, Face.BlendValues);
+}
+
+
+void AArFaceRig::ApplySmoothedBlendShapes(int32 FaceIndex, const float* Expression, double CaptureTime)
+{
+	if (!Faces.IsValidIndex(FaceIndex))
+	{
+		return;
+	}
+
+	FArFaceInstance& Face = Faces[FaceIndex];
+	FMemory::Memcpy(Face.BlendValues, Expression, 51 * sizeof(float));
+
+	// Prediction picks the sample up next tick
+	if (IsPredictingPose())
+	{
+		AddPoseSample(Face, CaptureTime);
+		return;
+	}
+
+	SetBlendShapes(Face, Face.BlendValues);
+}
+
+
+void AArFaceRig::AddPoseSample(FArFaceInstance& Face, double CaptureTime)
+{
+	FFacePoseSample Sample;
+	const float* Filtered = Face.Filter.Translation.Value;
+	Sample.Time = CaptureTime;
+	Sample.Translation = FVector(Filtered[0], Filtered[1], Filtered[2]);
+	Sample.Rotation = Face.Filter.Rotation;
+	FMemory::Memcpy(Sample.BlendValues, Face.BlendValues, sizeof(Sample.BlendValues));
+	Face.PoseHistory.Add(Sample);
+}
+
+
+void AArFaceRig::ApplyPredictedPose(FArFaceInstance& Face, double DisplayTime)
+{
+	SCOPE_CYCLE_COUNTER(STAT_FacialPose_PredictPose);
+	TRACE_CPUPROFILER_EVENT_SCOPE(AArFaceRig_ApplyPredictedPose);
+
+	FFacePoseSample Pose;
+	if (!Face.PoseHistory.Sample(DisplayTime, MaxExtrapolation, Pose))
+	{
+		return;
+	}
+
+	// Pose holds still once extrapolation runs out, or with a single sample
+	ApplyTransform(Face, FTransform(Pose.Rotation, Pose.Translation, FVector(FaceScale)));
+	SetBlendShapes(Face, Pose.BlendValues);
+}
+
+
+void AArFaceRig::ApplyLiveLinkPose()
+{
+	SCOPE_CYCLE_COUNTER(STAT_FacialPose_LiveLinkEvaluate);
+	TRACE_CPUPROFILER_EVENT_SCOPE(AArFaceRig_ApplyLiveLinkPose);
+
+	IModularFeatures& ModularFeatures = IModularFeatures::Get();
+	if (!ModularFeatures.IsModularFeatureAvailable(ILiveLinkClient::ModularFeatureName))
+	{
+		return;
+	}
+	ILiveLinkClient& Client = ModularFeatures.GetModularFeature<ILiveLinkClient>(ILiveLinkClient::ModularFeatureName);
+	UcDataStorageGameInstance* GameInst = (UcDataStorageGameInstance*)GetGameInstance();
+
+	for (int32 i = 0; i < Faces.Num(); i++)
+	{
+		FArFaceInstance& Face = Faces[i];
+
+		FLiveLinkSubjectFrameData SubjectFrame;
+		FLiveLinkAnimationFrameData* Pose = nullptr;
+		if (Client.EvaluateFrame_AnyThread(GameInst->GetLiveLinkSubjectName(i), ULiveLinkAnimationRole::StaticClass(), SubjectFrame))
+		{
+			Pose = SubjectFrame.FrameData.Cast<FLiveLinkAnimationFrameData>();
+		}
+
+		// Subject hasn't seen this face yet
+		bool bValid = Pose != nullptr && Pose->Transforms.Num() > 0 && Pose->PropertyValues.Num() >= 51;
+		if (Face.Mesh != FaceMesh)
+		{
+			Face.Mesh->SetVisibility(bValid);
+		}
+		if (!bValid)
+		{
+			continue;
+		}
+
+		FTransform PoseTransform = Pose->Transforms[0];
+		PoseTransform.SetScale3D(FVector(FaceScale));
+		ApplyTransform(Face, PoseTransform);
+		SetBlendShapes(Face, Pose->PropertyValues.GetData());
+	}
+}
+
+
+void AArFaceRig::SmoothBlendShapes(FArFaceInstance& Face, const float* Expression, float DeltaTime)
+{
+	SCOPE_CYCLE_COUNTER(STAT_FacialPose_SmoothBlendShapes);
+	TRACE_CPUPROFILER_EVENT_SCOPE(AArFaceRig_SmoothBlendShapes);
+
+	if (FilterType == EFaceFilterType::Momentum)
+	{
+		// Copy blenshapes
+		for (int i = 0; i < 51; i++)
+		{
+			// Calc momentum
+			float BlendVal = Face.BlendValues[i] + ((Face.BlendValues[i] - Face.PrevBlendValues[i]) * BlendShapeMomentum);
+
+			// Blend with prediction
+			BlendVal = FMath::Lerp(BlendVal, Expression[i], BlendShapeBlendMult);
+
+			Face.PrevBlendValues[i] = Face.BlendValues[i];
+			Face.BlendValues[i] = BlendVal;
+		}
+		return;
+	}
+
+	// Filters run four channels at a time, on aligned input padded to a whole register
+	alignas(16) float In[FACE_FILTER_EXPRESSION_CHANNELS] = { 0 };
+	FMemory::Memcpy(In, Expression, 51 * sizeof(float));
+
+	if (FilterType == EFaceFilterType::OneEuro)
+	{
+		FFaceFilter::OneEuro(ExpressionFilterParams, Face.Filter.Expression, In, DeltaTime);
+	}
+	else
+	{
+		FFaceFilter::Kalman(ExpressionFilterParams, Face.Filter.Expression, In, DeltaTime);
+	}
+
+	FMemory::Memcpy(Face.BlendValues, Face.Filter.Expression.Value, 51 * sizeof(float));
+}
+
+
+void AArFaceRig::SetBlendShapes(FArFaceInstance& Face, float* Blendshapes)
+{
+	SCOPE_CYCLE_COUNTER(STAT_FacialPose_SetBlendShapes);
+	TRACE_CPUPROFILER_EVENT_SCOPE(AArFaceRig_SetBlendShapes);
+
+	// Takes capture exactly what is applied, the transform was applied just before
+	if (Face.Index == BakeFaceIndex)
+	{
+		Baker.AddSample(GetWorld()->GetTimeSeconds(), Face.AppliedTransform.GetRelativeTransform(GetActorTransform()), Blendshapes);
+	}
+
+	// Anim instance writes the curves, a copy is all the game thread does
+	if (Face.bAnimPose)
+	{
+		AnimPoseSource->SetBlendValues(Face.Index, Blendshapes);
+		return;
+	}
+
+	// Bindings index retarget curves instead of expression outputs
+	const float* Values = Blendshapes;
+	if (RetargetMatrix.IsValid())
+	{
+		SCOPE_CYCLE_COUNTER(STAT_FacialPose_Retarget);
+		RetargetMatrix->Evaluate(Blendshapes, RetargetValues.GetData());
+		Values = RetargetValues.GetData();
+	}
+
+	// Write each bound blendshape which changed enough to matter
+	if (!Face.bDirectMorphWeights)
+	{
+		for (const FArFaceMorphBinding& Binding : MorphBindings)
+		{
+			float Value = Values[Binding.ExpressionIndex];
+			float& Applied = Face.AppliedBlendValues[Binding.ExpressionIndex];
+			if (FMath::Abs(Value - Applied) > BlendShapeEpsilon)
+			{
+				Face.Mesh->SetMorphTarget(Binding.MorphName, Value);
+				Applied = Value;
+			}
+		}
+		return;
+	}
+
+	// Mesh dropped the active morph targets, bind them again and write every weight
+	if (Face.Mesh->ActiveMorphTargets.Num() != MorphBindings.Num())
+	{
+		BindMorphWeights(Face, MorphBindings);
+		for (float& Applied : Face.AppliedBlendValues)
+		{
+			Applied = -1.f;
+		}
+	}
+
+	// Otherwise straight into the weight slots
+	TArray<float>& Weights = Face.Mesh->MorphTargetWeights;
+	bool bChanged = false;
+	for (const FArFaceMorphBinding& Binding : MorphBindings)
+	{
+		float Value = Values[Binding.ExpressionIndex];
+		float& Applied = Face.AppliedBlendValues[Binding.ExpressionIndex];
+		if (FMath::Abs(Value - Applied) > BlendShapeEpsilon && Weights.IsValidIndex(Binding.MorphIndex))
+		{
+			Weights[Binding.MorphIndex] = Value;
+			Applied = Value;
+			bChanged = true;
+		}
+	}
+
+	// One render update for all of them
+	if (bChanged)
+	{
+		Face.Mesh->MarkRenderDynamicDataDirty();
+	}
+}
+
+
+void AArFaceRig::ApplyTransform(FArFaceInstance& Face, const FTransform& Transform)
+{
+	if (Transform.Equals(Face.AppliedTransform, KINDA_SMALL_NUMBER))
+	{
+		INC_DWORD_STAT(STAT_FacialPose_TransformWritesSkipped);
+		return;
+	}
+	Face.AppliedTransform = Transform;
+
+	// Component stays put, the anim instance moves the head bone instead
+	if (Face.bAnimPose)
+	{
+		AnimPoseSource->SetTransform(Face.Index, Transform);
+		return;
+	}
+	Face.Mesh->SetWorldTransform(Transform);
+}
+
+
+void AArFaceRig::SetTransforms(FArFaceInstance& Face, FVector Up, FVector Forward, FVector Translation, float DeltaTime)
+{
+	SCOPE_CYCLE_COUNTER(STAT_FacialPose_SetTransforms);
+	TRACE_CPUPROFILER_EVENT_SCOPE(AArFaceRig_SetTransforms);
+
+	FQuat NewRot = TransformData::ToUnrealRotation(Up, Forward);
+
+	if (FilterType != EFaceFilterType::Momentum)
+	{
+		alignas(16) float In[4] = { Translation.X, Translation.Y, Translation.Z, 0 };
+		if (FilterType == EFaceFilterType::OneEuro)
+		{
+			FFaceFilter::OneEuro(TranslationFilterParams, Face.Filter.Translation, In, DeltaTime);
+			FFaceFilter::OneEuroRotation(RotationFilter, Face.Filter, NewRot, DeltaTime);
+		}
+		else
+		{
+			FFaceFilter::Kalman(TranslationFilterParams, Face.Filter.Translation, In, DeltaTime);
+			FFaceFilter::KalmanRotation(RotationFilterParams, Face.Filter, NewRot, DeltaTime);
+		}
+
+		if (!IsPredictingPose())
+		{
+			const float* Filtered = Face.Filter.Translation.Value;
+			ApplyTransform(Face, FTransform(Face.Filter.Rotation,
+				FVector(Filtered[0], Filtered[1], Filtered[2]),
+				FVector(FaceScale)));
+		}
+		return;
+	}
 
 	// Store transform
-	FRotator CurrentRot = FaceMesh->GetComponentRotation();
-	FVector CurrenTran = FaceMesh->GetComponentLocation();
+	FRotator CurrentRot = Face.AppliedTransform.Rotator();
+	FVector CurrenTran = Face.AppliedTransform.GetLocation();
 
 	// Guess next transform
-	FRotator RotGuess = FMath::Lerp(PrevRotation,
+	FRotator RotGuess = FMath::Lerp(Face.PrevRotation,
 		CurrentRot,
 		TransformMomentum);
 
-	FVector TranGuess = FMath::Lerp(PrevPosition,
+	FVector TranGuess = FMath::Lerp(Face.PrevPosition,
 		CurrenTran,
 		TransformMomentum);
 
 	// Store previous frame
-	PrevRotation = CurrentRot;
-	PrevPosition = CurrenTran;
+	Face.PrevRotation = CurrentRot;
+	Face.PrevPosition = CurrenTran;
 
 	// Blend with prediction
 	RotGuess = FMath::Lerp(RotGuess, NewRot.Rotator(), TransformBlendMult);
@@ -183,68 +1158,188 @@ void AArFaceRig::SetTransforms(FVector Up, FVector Forward, FVector Translation)
 		TranGuess,
 		FVector(FaceScale));
 
-	FaceMesh->SetWorldTransform(FinalTransform);
+	ApplyTransform(Face, FinalTransform);
 }
 
 
-void AArFaceRig::SetBackground(TArray<unsigned char, TFixedAllocator<512 * 512 * 4>> Image)
+void AArFaceRig::SetBackground(int32 ImageIndex)
 {
-	// Build material instance
-	UMaterialInstanceDynamic* MatInst = UMaterialInstanceDynamic::Create(MasterMaterialRef, this);
+	SCOPE_CYCLE_COUNTER(STAT_FacialPose_BackgroundUpload);
+	TRACE_CPUPROFILER_EVENT_SCOPE(AArFaceRig_SetBackground);
 
-	// Build texture
-	UTexture2D* Texture = UTexture2D::CreateTransient(512, 512, PF_B8G8R8A8);
-	FTexture2DMipMap& Mip = Texture->PlatformData->Mips[0];
-	void* Data = Mip.BulkData.Lock(LOCK_READ_WRITE);
-	FMemory::Memcpy(Data, Image.GetData(), 512 * 512 * 4);
-	Mip.BulkData.Unlock();
+	// No new image this tick
+	if (ImageIndex == INDEX_NONE)
+	{
+		INC_DWORD_STAT(STAT_FacialPose_UploadsSkipped);
+		UploadsAvoided++;
+		return;
+	}
 
-	// Place texture into material instance parameter
-	Texture->UpdateResource();
-	MatInst->SetTextureParameterValue(FName("ViewInput"), (UTexture*)Texture);
+	// Upload straight from the pooled buffer, and hand it back once the render thread is done
+	TSharedPtr<FFaceImagePool, ESPMode::ThreadSafe> Pool = ImagePool;
+	auto ReleaseImage = [Pool, ImageIndex](uint8* SrcData, const FUpdateTextureRegion2D* Regions)
+	{
+		Pool->Release(ImageIndex);
+	};
+	auto KeepImage = [](uint8* SrcData, const FUpdateTextureRegion2D* Regions) {};
 
-	// Set material
-	PlaneMesh->SetMaterial(0, MatInst);
+	uint8* Image = Pool->GetData(ImageIndex);
+	if (BackgroundFormat == EFaceImageFormat::BGRA)
+	{
+		BackgroundTexture->UpdateTextureRegions(0, 1, &BackgroundRegion, BackgroundWidth * 4, 4, Image, ReleaseImage);
+		return;
+	}
+
+	// Planes upload in order on the render thread, the last one hands the buffer back
+	int32 LumaSize = BackgroundWidth * BackgroundHeight;
+	BackgroundTexture->UpdateTextureRegions(0, 1, &BackgroundRegion, BackgroundWidth, 1, Image, KeepImage);
+	if (BackgroundFormat == EFaceImageFormat::NV12)
+	{
+		BackgroundUTexture->UpdateTextureRegions(0, 1, &BackgroundChromaRegion, BackgroundWidth, 2,
+			Image + LumaSize, ReleaseImage);
+	}
+	else
+	{
+		BackgroundUTexture->UpdateTextureRegions(0, 1, &BackgroundChromaRegion, BackgroundWidth / 2, 1,
+			Image + LumaSize, KeepImage);
+		BackgroundVTexture->UpdateTextureRegions(0, 1, &BackgroundChromaRegion, BackgroundWidth / 2, 1,
+			Image + LumaSize + LumaSize / 4, ReleaseImage);
+	}
+}
+
+
+void AArFaceRig::UpdateLatency(const FFaceTrackingFrame& Frame)
+{
+	InferenceLatency.AddSample(Frame.InferenceMs);
+	CaptureToDisplayLatency.AddSample((FPlatformTime::Seconds() - Frame.CaptureTime) * 1000.0);
+
+	const FFacePoseLatency& Inference = InferenceLatency.GetPercentiles();
+	SET_FLOAT_STAT(STAT_FacialPose_InferenceP50, Inference.P50);
+	SET_FLOAT_STAT(STAT_FacialPose_InferenceP95, Inference.P95);
+	SET_FLOAT_STAT(STAT_FacialPose_InferenceP99, Inference.P99);
+
+	const FFacePoseLatency& CaptureToDisplay = CaptureToDisplayLatency.GetPercentiles();
+	SET_FLOAT_STAT(STAT_FacialPose_CaptureToDisplayP50, CaptureToDisplay.P50);
+	SET_FLOAT_STAT(STAT_FacialPose_CaptureToDisplayP95, CaptureToDisplay.P95);
+	SET_FLOAT_STAT(STAT_FacialPose_CaptureToDisplayP99, CaptureToDisplay.P99);
+}
+
+
+FFacePoseLatency AArFaceRig::GetInferenceLatency()
+{
+	return InferenceLatency.GetPercentiles();
+}
+
+
+FFacePoseLatency AArFaceRig::GetCaptureToDisplayLatency()
+{
+	return CaptureToDisplayLatency.GetPercentiles();
 }
 
 
 void AArFaceRig::RunDLL()
 {
+	SCOPE_CYCLE_COUNTER(STAT_FacialPose_RigUpdate);
+	TRACE_CPUPROFILER_EVENT_SCOPE(AArFaceRig_RunDLL);
+
 	// Open GameInstance
 	UcDataStorageGameInstance * GameInst = (UcDataStorageGameInstance*)GetGameInstance();
 
-	// Prep image data  
-	TArray<unsigned char, TFixedAllocator<512 * 512 * 4>> Image;
-	Image.SetNumZeroed(512 * 512 * 4);
+	// Grab newest frame completed by the tracking worker
+	bool bIsNewFrame = false;
+	FFaceTrackingFrame* Frame = GameInst->GetLatestFrame(bIsNewFrame, TrackerIndex);
+	if (Frame == nullptr)
+	{
+		return;
+	}
 
-	// Prep transform data
-	TransformData outFaces(0, 0, 0, 0, 0, 0, 0, 0, 0);
-	float outExpression[51];
+	// Update stats
+	DroppedFrames = GameInst->GetDroppedFrameCount(TrackerIndex);
+	DuplicateFrames = GameInst->GetDuplicateFrameCount(TrackerIndex);
+	if (!bIsNewFrame)
+	{
+		RepeatedFrames++;
+	}
+	else
+	{
+		UpdateLatency(*Frame);
+		QualityGovernor.AddInference(Frame->InferenceMs);
+	}
 
-	// Get transform and image data
-	GameInst->GetTransform(outFaces, outExpression);
-	GameInst->GetImage(Image.GetData(), 512, 512);
+	// Take ownership of the frame's image
+	int32 ImageIndex = Frame->ImageIndex;
+	Frame->ImageIndex = INDEX_NONE;
 
-	// Copy blenshapes
-	for (int i = 0; i < 51; i++)
+	// Live Link carries the pose, only the background comes from the frame
+	if (bDriveFromLiveLink)
 	{
-		// Calc momentum
-		float BlendVal = BlendValues[i] + ((BlendValues[i] - PrevBlendValues[i]) * BlendShapeMomentum);
+		ApplyLiveLinkPose();
+	}
+	else
+	{
+		// Match faces in view to face instances, unchanged since the last new frame
+		const FaceBatchData& Batch = Frame->Faces;
+		if (bIsNewFrame)
+		{
+			BindFaces(Batch);
+			UpdateDetections(Batch);
+		}
+
+		// Startup metric, from BeginPlay until the first face is posed
+		if (bIsNewFrame && Batch.numFaces > 0 && TimeToFirstTrackedFrame < 0)
+		{
+			TimeToFirstTrackedFrame = FPlatformTime::Seconds() - BeginPlayTime;
+			SET_FLOAT_STAT(STAT_FacialPose_TimeToFirstTrackedFrame, TimeToFirstTrackedFrame * 1000.f);
+			UE_LOG(LogTemp, Log, TEXT("First Tracked Frame %.2fs after BeginPlay"), TimeToFirstTrackedFrame);
+		}
+
+		// Filters only step on new detections, momentum blends every tick
+		float FilterDeltaTime = FMath::Clamp((float)(Frame->CaptureTime - LastCaptureTime), 1.f / 240.f, .25f);
+		if (bIsNewFrame)
+		{
+			LastCaptureTime = Frame->CaptureTime;
+		}
+		bool bRunFilters = bIsNewFrame || FilterType == EFaceFilterType::Momentum;
+
+		// Pose is rendered for when this frame reaches the screen
+		double DisplayTime = FPlatformTime::Seconds() + DisplayLatency - InterpolationDelay;
+		SET_FLOAT_STAT(STAT_FacialPose_PredictionMs, IsPredictingPose() ? (DisplayTime - LastCaptureTime) * 1000.0 : 0);
+
+		// Set blendshapes and transform of each face in view, held faces skip filters and only decay
+		double Now = FPlatformTime::Seconds();
+		for (FArFaceInstance& Face : Faces)
+		{
+			if (Face.DetectionIndex == INDEX_NONE)
+			{
+				if (Face.TrackId != INDEX_NONE)
+				{
+					DecayLostFace(Face, Now);
+				}
+				continue;
+			}
 
-		// Blend with prediction
-		BlendVal = FMath::Lerp(BlendVal, outExpression[i], BlendShapeBlendMult);
+			if (bRunFilters)
+			{
+				UpdateFace(Face,
+					Batch.transforms[Face.DetectionIndex],
+					&Batch.expressions[Face.DetectionIndex * 51],
+					FilterDeltaTime,
+					Frame->CaptureTime);
+			}
 
-		PrevBlendValues[i] = BlendValues[i];
-		BlendValues[i] = BlendVal;
+			if (IsPredictingPose())
+			{
+				ApplyPredictedPose(Face, DisplayTime);
+			}
+		}
 	}
 
-	// Copy transforms
-	FVector Translation(outFaces.tZ, outFaces.tX, -outFaces.tY);
-	FVector Up(outFaces.ruX, outFaces.ruY, outFaces.ruZ);
-	FVector Forward(outFaces.rfX, outFaces.rfY, outFaces.rfZ);
-
-	// Set blendshapes and transform
-	SetTransforms(Up, Forward, Translation);
-	SetBlendShapes(BlendValues);
-	SetBackground(Image);
-}
\ No newline at end of file
+	// Tracking image changed, eg resized by the quality governor, or BGRA after a backend without YUV
+	if (ImageIndex != INDEX_NONE && (Frame->ImageWidth != BackgroundWidth || Frame->ImageHeight != BackgroundHeight ||
+		Frame->ImageFormat != BackgroundFormat))
+	{
+		ResizeBackground(Frame->ImageWidth, Frame->ImageHeight, Frame->ImageFormat);
+	}
+
+	SetBackground(ImageIndex);
+}
@@ -0,0 +1,376 @@
+// Copyright 2020 NeuralVFX, Inc. All Rights Reserved.
+
+#include "FaceAnimBaker.h"
+#include "FaceRecording.h"
+#include "FaceRetarget.h"
+#include "Animation/AnimSequence.h"
+#include "Animation/Skeleton.h"
+#include "AnimationRuntime.h"
+#include "Engine/SkeletalMesh.h"
+#include "Misc/PackageName.h"
+#include "FacialPoseStats.h"
+#if WITH_EDITOR
+#include "AssetRegistryModule.h"
+#endif
+
+
+/** Position of a frame between two keys */
+static float KeyAlpha(int32 First, int32 Last, int32 Frame)
+{
+	return Last > First ? float(Frame - First) / (Last - First) : 0.f;
+}
+
+
+/**
+* Keys of a raw track channel, which in UE 4.26 holds either one key or one key per frame, so subdividing it saves nothing.
+* A channel within tolerance of its first frame keeps that key, any other keeps every frame exactly for compression to reduce.
+*/
+template<typename ValueType, typename GetType, typename ErrorType>
+static void RawTrackKeys(int32 NumFrames, float Tolerance, GetType Get, ErrorType Error, TArray<ValueType>& outKeys)
+{
+	outKeys.Reset();
+	outKeys.Add(Get(0));
+	for (int32 Frame = 1; Frame < NumFrames; Frame++)
+	{
+		if (Error(outKeys[0], Get(Frame)) > Tolerance)
+		{
+			outKeys.Reset(NumFrames);
+			for (int32 i = 0; i < NumFrames; i++)
+			{
+				outKeys.Add(Get(i));
+			}
+			return;
+		}
+	}
+}
+
+
+void FFaceAnimBaker::Reset(const TArray<FName>& InCurveNames, TSharedPtr<const FFaceRetargetMatrix, ESPMode::ThreadSafe> InRetarget)
+{
+	Retarget = InRetarget;
+	CurveNames = Retarget.IsValid() ? Retarget->GetNames() : InCurveNames;
+	CurveNames.SetNum(Retarget.IsValid() ? Retarget->GetNumTargets() : 51);
+
+	Times.Reset();
+	Transforms.Reset();
+	Expressions.Reset();
+}
+
+
+void FFaceAnimBaker::AddSample(double Time, const FTransform& Transform, const float* Expression)
+{
+	if (Times.Num() > 0 && Time <= Times.Last())
+	{
+		return;
+	}
+
+	Times.Add(Time);
+	Transforms.Add(Transform);
+	Expressions.Append(Expression, 51);
+}
+
+
+int32 FFaceAnimBaker::AddRecording(const FFaceSessionReader& Reader, int32 TrackId, float Scale)
+{
+	int32 NumSamples = 0;
+	FaceBatchData Faces;
+	for (int64 Frame = 0; Frame < Reader.GetNumFrames(); Frame++)
+	{
+		double Time = Reader.ReadFrame(Frame, Faces);
+		for (int32 i = 0; i < Faces.numFaces; i++)
+		{
+			if (Faces.trackIds[i] != TrackId)
+			{
+				continue;
+			}
+
+			// Posed as the rig poses an unfiltered face
+			const TransformData& Transform = Faces.transforms[i];
+			FVector Up(Transform.ruX, Transform.ruY, Transform.ruZ);
+			FVector Forward(Transform.rfX, Transform.rfY, Transform.rfZ);
+			AddSample(Time, FTransform(TransformData::ToUnrealRotation(Up, Forward), Transform.GetTranslation(), FVector(Scale)), &Faces.expressions[i * 51]);
+			NumSamples++;
+			break;
+		}
+	}
+	return NumSamples;
+}
+
+
+void FFaceAnimBaker::ReduceKeys(int32 NumFrames, float Tolerance, TFunctionRef<float(int32, int32, int32)> Error, TArray<int32>& outKeys)
+{
+	outKeys.Reset();
+	outKeys.Add(0);
+	if (NumFrames < 2)
+	{
+		return;
+	}
+
+	// Static channel, the first key holds it
+	bool bStatic = true;
+	for (int32 i = 1; i < NumFrames && bStatic; i++)
+	{
+		bStatic = Error(0, 0, i) <= Tolerance;
+	}
+	if (bStatic)
+	{
+		return;
+	}
+
+	// Split each span at its worst frame until every frame is within tolerance
+	TBitArray<> Keep(false, NumFrames);
+	Keep[NumFrames - 1] = true;
+	TArray<TPair<int32, int32>, TInlineAllocator<64>> Spans;
+	Spans.Add(MakeTuple(0, NumFrames - 1));
+	while (Spans.Num() > 0)
+	{
+		TPair<int32, int32> Span = Spans.Pop(false);
+		int32 Worst = INDEX_NONE;
+		float WorstError = Tolerance;
+		for (int32 i = Span.Key + 1; i < Span.Value; i++)
+		{
+			float FrameError = Error(Span.Key, Span.Value, i);
+			if (FrameError > WorstError)
+			{
+				Worst = i;
+				WorstError = FrameError;
+			}
+		}
+
+		if (Worst != INDEX_NONE)
+		{
+			Keep[Worst] = true;
+			Spans.Add(MakeTuple(Span.Key, Worst));
+			Spans.Add(MakeTuple(Worst, Span.Value));
+		}
+	}
+
+	for (TConstSetBitIterator<> It(Keep, 1); It; ++It)
+	{
+		outKeys.Add(It.GetIndex());
+	}
+}
+
+
+#if WITH_EDITOR
+UAnimSequence* FFaceAnimBaker::Bake(USkeleton* Skeleton, const FString& AssetPath, const FFaceBakeSettings& Settings, FFaceBakeStats* outStats) const
+{
+	SCOPE_CYCLE_COUNTER(STAT_FacialPose_Bake);
+	TRACE_CPUPROFILER_EVENT_SCOPE(FFaceAnimBaker_Bake);
+
+	if (Skeleton == nullptr || Times.Num() == 0)
+	{
+		UE_LOG(LogTemp, Warning, TEXT("Nothing to Bake: %s"), *AssetPath);
+		return nullptr;
+	}
+	if (!FPackageName::IsValidLongPackageName(AssetPath))
+	{
+		UE_LOG(LogTemp, Error, TEXT("Invalid Bake Asset Path: %s"), *AssetPath);
+		return nullptr;
+	}
+
+	// Resample onto whole frames, raw tracks and compression expect a fixed rate
+	float SampleRate = FMath::Max(Settings.SampleRate, 1.f);
+	int32 NumFrames = FMath::FloorToInt((Times.Last() - Times[0]) * SampleRate) + 1;
+	int32 NumCurves = CurveNames.Num();
+
+	TArray<FTransform> FrameTransforms;
+	TArray<float> Curves;
+	FrameTransforms.SetNum(NumFrames);
+	Curves.SetNumUninitialized(NumCurves * NumFrames);
+
+	TArray<float, TAlignedHeapAllocator<16>> RetargetValues;
+	RetargetValues.SetNumZeroed(Retarget.IsValid() ? Retarget->GetNumPaddedTargets() : 0);
+
+	int32 Sample = 0;
+	for (int32 Frame = 0; Frame < NumFrames; Frame++)
+	{
+		double Time = Times[0] + Frame / (double)SampleRate;
+		while (Sample + 1 < Times.Num() - 1 && Times[Sample + 1] <= Time)
+		{
+			Sample++;
+		}
+		int32 Next = FMath::Min(Sample + 1, Times.Num() - 1);
+		float Alpha = Next > Sample ? FMath::Clamp(float((Time - Times[Sample]) / (Times[Next] - Times[Sample])), 0.f, 1.f) : 0.f;
+
+		const FTransform& A = Transforms[Sample];
+		const FTransform& B = Transforms[Next];
+		FrameTransforms[Frame] = FTransform(FQuat::Slerp(A.GetRotation(), B.GetRotation(), Alpha),
+			FMath::Lerp(A.GetLocation(), B.GetLocation(), Alpha),
+			FMath::Lerp(A.GetScale3D(), B.GetScale3D(), Alpha));
+
+		float Expression[51];
+		for (int32 i = 0; i < 51; i++)
+		{
+			Expression[i] = FMath::Lerp(Expressions[Sample * 51 + i], Expressions[Next * 51 + i], Alpha);
+		}
+
+		const float* Values = Expression;
+		if (Retarget.IsValid())
+		{
+			Retarget->Evaluate(Expression, RetargetValues.GetData());
+			Values = RetargetValues.GetData();
+		}
+		for (int32 Curve = 0; Curve < NumCurves; Curve++)
+		{
+			Curves[Curve * NumFrames + Frame] = Values[Curve];
+		}
+	}
+
+	// Head pose goes to the bone as the face anim instance would set it, relative to the bone's reference pose
+	const FReferenceSkeleton& RefSkeleton = Skeleton->GetReferenceSkeleton();
+	int32 BoneIndex = Settings.BoneName != NAME_None ? RefSkeleton.FindBoneIndex(Settings.BoneName) : 0;
+	if (BoneIndex == INDEX_NONE)
+	{
+		UE_LOG(LogTemp, Warning, TEXT("No Bone %s in %s, baking to the root"), *Settings.BoneName.ToString(), *Skeleton->GetName());
+		BoneIndex = 0;
+	}
+	int32 ParentIndex = RefSkeleton.GetParentIndex(BoneIndex);
+	FTransform BoneRefPose = FAnimationRuntime::GetComponentSpaceTransformRefPose(RefSkeleton, BoneIndex);
+	FTransform ParentRefPose = ParentIndex != INDEX_NONE ? FAnimationRuntime::GetComponentSpaceTransformRefPose(RefSkeleton, ParentIndex) : FTransform::Identity;
+	for (FTransform& Transform : FrameTransforms)
+	{
+		Transform = (BoneRefPose * Transform).GetRelativeTransform(ParentRefPose);
+	}
+
+	FFaceBakeStats Stats;
+	Stats.NumFrames = NumFrames;
+
+	// Head goes to a raw track, only curves are reduced
+	FRawAnimSequenceTrack Track;
+	RawTrackKeys(NumFrames, Settings.PositionTolerance,
+		[&FrameTransforms](int32 Frame) { return FrameTransforms[Frame].GetLocation(); },
+		[](const FVector& A, const FVector& B) { return FVector::Dist(A, B); }, Track.PosKeys);
+	RawTrackKeys(NumFrames, FMath::DegreesToRadians(Settings.RotationTolerance),
+		[&FrameTransforms](int32 Frame) { return FrameTransforms[Frame].GetRotation(); },
+		[](const FQuat& A, const FQuat& B) { return A.AngularDistance(B); }, Track.RotKeys);
+	RawTrackKeys(NumFrames, KINDA_SMALL_NUMBER,
+		[&FrameTransforms](int32 Frame) { return FrameTransforms[Frame].GetScale3D(); },
+		[](const FVector& A, const FVector& B) { return (A - B).GetAbsMax(); }, Track.ScaleKeys);
+	Stats.PositionKeys = Track.PosKeys.Num();
+	Stats.RotationKeys = Track.RotKeys.Num();
+
+	FString AssetName = FPackageName::GetLongPackageAssetName(AssetPath);
+	UPackage* Package = CreatePackage(*AssetPath);
+	UAnimSequence* Sequence = NewObject<UAnimSequence>(Package, *AssetName, RF_Public | RF_Standalone);
+	Sequence->SetSkeleton(Skeleton);
+	Sequence->SetRawNumberOfFrame(NumFrames);
+	Sequence->SequenceLength = FMath::Max((NumFrames - 1) / SampleRate, MINIMUM_ANIMATION_LENGTH);
+	Sequence->AddNewRawTrack(RefSkeleton.GetBoneName(BoneIndex), &Track);
+
+	// Curves keep their own keys, linearly interpolated
+	for (int32 Curve = 0; Curve < NumCurves; Curve++)
+	{
+		if (CurveNames[Curve] == NAME_None)
+		{
+			continue;
+		}
+
+		const float* Values = &Curves[Curve * NumFrames];
+		TArray<int32> Keys;
+		ReduceKeys(NumFrames, Settings.CurveTolerance, [Values](int32 First, int32 Last, int32 Frame)
+		{
+			return FMath::Abs(FMath::Lerp(Values[First], Values[Last], KeyAlpha(First, Last, Frame)) - Values[Frame]);
+		}, Keys);
+
+		if (Keys.Num() == 1 && FMath::Abs(Values[0]) <= Settings.CurveTolerance && Settings.bDropStaticCurves)
+		{
+			Stats.DroppedCurves++;
+			continue;
+		}
+
+		FSmartName SmartName;
+		Skeleton->AddSmartNameAndModify(USkeleton::AnimCurveMappingName, CurveNames[Curve], SmartName);
+		Skeleton->AccumulateCurveMetaData(CurveNames[Curve], false, true);
+		Sequence->RawCurveData.AddCurveData(SmartName);
+		FFloatCurve* FloatCurve = static_cast<FFloatCurve*>(Sequence->RawCurveData.GetCurveData(SmartName.UID, ERawCurveTrackTypes::RCT_Float));
+		if (FloatCurve == nullptr)
+		{
+			continue;
+		}
+
+		TArray<FRichCurveKey> CurveKeys;
+		CurveKeys.Reserve(Keys.Num());
+		for (int32 Frame : Keys)
+		{
+			FRichCurveKey& Key = CurveKeys.Add_GetRef(FRichCurveKey(Frame / SampleRate, Values[Frame]));
+			Key.InterpMode = RCIM_Linear;
+		}
+		FloatCurve->FloatCurve.SetKeys(CurveKeys);
+
+		Stats.NumCurves++;
+		Stats.CurveKeys += Keys.Num();
+	}
+
+	Sequence->MarkRawDataAsModified();
+	Sequence->OnRawDataChanged();
+	Sequence->MarkPackageDirty();
+	FAssetRegistryModule::AssetCreated(Sequence);
+
+	UE_LOG(LogTemp, Log, TEXT("Baked %s: %d Frames, %d Curves (%d Dropped) with %d Keys, %d Position and %d Rotation Keys"),
+		*AssetPath, Stats.NumFrames, Stats.NumCurves, Stats.DroppedCurves, Stats.CurveKeys, Stats.PositionKeys, Stats.RotationKeys);
+
+	if (outStats != nullptr)
+	{
+		*outStats = Stats;
+	}
+	return Sequence;
+}
+#endif
+
+
+UAnimSequence* UFaceAnimBakeLibrary::BakeRecording(const FString& RecordingPath, int32 TrackId, USkeletalMesh* Mesh, const TArray<FName>& ExpressionNames,
+	UFaceRetargetAsset* Retarget, float FaceScale, const FString& AssetPath, const FFaceBakeSettings& Settings, FFaceBakeStats& Stats)
+{
+#if WITH_EDITOR
+	if (Mesh == nullptr || Mesh->Skeleton == nullptr)
+	{
+		UE_LOG(LogTemp, Error, TEXT("Bake Needs a Mesh with a Skeleton"));
+		return nullptr;
+	}
+
+	FFaceSessionReader Reader;
+	if (!Reader.Open(RecordingPath))
+	{
+		UE_LOG(LogTemp, Error, TEXT("Could not Open Recording: %s"), *RecordingPath);
+		return nullptr;
+	}
+
+	TSharedPtr<const FFaceRetargetMatrix, ESPMode::ThreadSafe> Matrix;
+	if (Retarget != nullptr)
+	{
+		Matrix = Retarget->GetMatrix();
+	}
+
+	FFaceAnimBaker Baker;
+	Baker.Reset(GetExpressionCurveNames(Mesh, ExpressionNames), Matrix);
+	int32 NumSamples = Baker.AddRecording(Reader, TrackId, FaceScale);
+	Reader.Close();
+	if (NumSamples == 0)
+	{
+		UE_LOG(LogTemp, Warning, TEXT("Track %d not in Recording: %s"), TrackId, *RecordingPath);
+		return nullptr;
+	}
+
+	return Baker.Bake(Mesh->Skeleton, AssetPath, Settings, &Stats);
+#else
+	UE_LOG(LogTemp, Error, TEXT("Baking Animation Needs the Editor"));
+	return nullptr;
+#endif
+}
+
+
+TArray<FName> UFaceAnimBakeLibrary::GetExpressionCurveNames(USkeletalMesh* Mesh, const TArray<FName>& ExpressionNames)
+{
+	// Same fallback as the rig, the order the morph targets were imported in
+	TArray<FName> Names = ExpressionNames;
+	if (Names.Num() == 0 && Mesh != nullptr)
+	{
+		for (const FString& MorphName : Mesh->K2_GetAllMorphTargetNames())
+		{
+			Names.Add(FName(*MorphName));
+		}
+	}
+	Names.SetNum(51);
+	return Names;
+}
@@ -0,0 +1,197 @@
+// Copyright 2020 NeuralVFX, Inc. All Rights Reserved.
+
+#include "FaceAnimInstance.h"
+#include "Animation/AnimNodeBase.h"
+#include "Animation/Skeleton.h"
+#include "BonePose.h"
+#include "Misc/ScopeLock.h"
+#include "FacialPoseStats.h"
+
+
+FFaceAnimPoseSource::FFaceAnimPoseSource() :
+	CurveNamesVersion(0)
+{
+}
+
+
+void FFaceAnimPoseSource::SetCurveNames(const TArray<FName>& InCurveNames, TSharedPtr<const FFaceRetargetMatrix, ESPMode::ThreadSafe> InRetarget)
+{
+	FScopeLock ScopeLock(&Lock);
+	CurveNames = InCurveNames;
+	Retarget = InRetarget;
+	CurveNamesVersion++;
+}
+
+
+bool FFaceAnimPoseSource::GetCurveNames(uint32& InOutVersion, TArray<FName>& outCurveNames, TSharedPtr<const FFaceRetargetMatrix, ESPMode::ThreadSafe>& outRetarget) const
+{
+	FScopeLock ScopeLock(&Lock);
+	if (InOutVersion == CurveNamesVersion)
+	{
+		return false;
+	}
+	outCurveNames = CurveNames;
+	outRetarget = Retarget;
+	InOutVersion = CurveNamesVersion;
+	return true;
+}
+
+
+void FFaceAnimPoseSource::SetTransform(int32 Face, const FTransform& Transform)
+{
+	if (Face < 0 || Face >= FACE_BATCH_MAX_FACES)
+	{
+		return;
+	}
+
+	FScopeLock ScopeLock(&Lock);
+	Poses[Face].Transform = Transform;
+	Poses[Face].bHasTransform = true;
+}
+
+
+void FFaceAnimPoseSource::SetBlendValues(int32 Face, const float* BlendValues)
+{
+	if (Face < 0 || Face >= FACE_BATCH_MAX_FACES)
+	{
+		return;
+	}
+
+	FScopeLock ScopeLock(&Lock);
+	FMemory::Memcpy(Poses[Face].BlendValues, BlendValues, 51 * sizeof(float));
+}
+
+
+bool FFaceAnimPoseSource::GetPose(int32 Face, FFaceAnimPose& outPose) const
+{
+	if (Face < 0 || Face >= FACE_BATCH_MAX_FACES)
+	{
+		return false;
+	}
+
+	FScopeLock ScopeLock(&Lock);
+	outPose = Poses[Face];
+	return true;
+}
+
+
+void FFaceAnimInstanceProxy::PreUpdate(UAnimInstance* InAnimInstance, float DeltaSeconds)
+{
+	FAnimInstanceProxy::PreUpdate(InAnimInstance, DeltaSeconds);
+
+	UFaceAnimInstance* FaceInstance = CastChecked<UFaceAnimInstance>(InAnimInstance);
+	Source = FaceInstance->Source;
+	FaceIndex = FaceInstance->FaceIndex;
+	HeadBoneName = FaceInstance->HeadBoneName;
+
+	// Names only change when the rig binds its morph targets, so lookups stay off the per-frame path
+	TArray<FName> CurveNames;
+	USkeleton* Skeleton = GetSkeleton();
+	if (!Source.IsValid() || Skeleton == nullptr || !Source->GetCurveNames(CurveNamesVersion, CurveNames, Retarget))
+	{
+		return;
+	}
+
+	RetargetValues.SetNumZeroed(Retarget.IsValid() ? Retarget->GetNumPaddedTargets() : 0);
+	CurveUIDs.SetNum(Retarget.IsValid() ? Retarget->GetNumTargets() : FMath::Min(CurveNames.Num(), 51));
+	for (int32 i = 0; i < CurveUIDs.Num(); i++)
+	{
+		CurveUIDs[i] = CurveNames[i] == NAME_None ? SmartName::MaxUID :
+			Skeleton->GetUIDByName(USkeleton::AnimCurveMappingName, CurveNames[i]);
+		if (CurveNames[i] != NAME_None && CurveUIDs[i] == SmartName::MaxUID)
+		{
+			UE_LOG(LogTemp, Warning, TEXT("No skeleton curve for expression %d: %s"), i, *CurveNames[i].ToString());
+		}
+	}
+}
+
+
+void FFaceAnimInstanceProxy::Update(float DeltaSeconds)
+{
+	SCOPE_CYCLE_COUNTER(STAT_FacialPose_AnimUpdate);
+	TRACE_CPUPROFILER_EVENT_SCOPE(FFaceAnimInstanceProxy_Update);
+
+	// Latest pose the rig wrote, evaluation uses this copy so it never waits on the game thread
+	if (Source.IsValid())
+	{
+		Source->GetPose(FaceIndex, Pose);
+	}
+}
+
+
+bool FFaceAnimInstanceProxy::Evaluate(FPoseContext& Output)
+{
+	SCOPE_CYCLE_COUNTER(STAT_FacialPose_AnimEvaluate);
+	TRACE_CPUPROFILER_EVENT_SCOPE(FFaceAnimInstanceProxy_Evaluate);
+
+	Output.ResetToRefPose();
+	if (!Source.IsValid())
+	{
+		return true;
+	}
+
+	const FBoneContainer& RequiredBones = Output.Pose.GetBoneContainer();
+	if (Pose.bHasTransform)
+	{
+		FCompactPoseBoneIndex HeadIndex(0);
+		int32 MeshIndex = HeadBoneName != NAME_None ? RequiredBones.GetPoseBoneIndexForBoneName(HeadBoneName) : INDEX_NONE;
+		if (MeshIndex != INDEX_NONE)
+		{
+			HeadIndex = RequiredBones.MakeCompactPoseIndex(FMeshPoseBoneIndex(MeshIndex));
+		}
+		if (!HeadIndex.IsValid())
+		{
+			HeadIndex = FCompactPoseBoneIndex(0);
+		}
+
+		// Face transform is in world space, it moves the head as the rig would move the whole component
+		FCSPose<FCompactPose> ComponentPose;
+		ComponentPose.InitPose(Output.Pose);
+		FTransform FaceTransform = Pose.Transform.GetRelativeTransform(GetComponentTransform());
+		FTransform HeadTransform = ComponentPose.GetComponentSpaceTransform(HeadIndex) * FaceTransform;
+
+		FCompactPoseBoneIndex ParentIndex = RequiredBones.GetParentBoneIndex(HeadIndex);
+		Output.Pose[HeadIndex] = ParentIndex.IsValid() ?
+			HeadTransform.GetRelativeTransform(ComponentPose.GetComponentSpaceTransform(ParentIndex)) : HeadTransform;
+	}
+
+	// Retargeting runs here too, off the game thread
+	const float* Values = Pose.BlendValues;
+	if (Retarget.IsValid())
+	{
+		SCOPE_CYCLE_COUNTER(STAT_FacialPose_Retarget);
+		Retarget->Evaluate(Pose.BlendValues, RetargetValues.GetData());
+		Values = RetargetValues.GetData();
+	}
+
+	// Morph target curves are applied to the mesh after evaluation
+	for (int32 i = 0; i < CurveUIDs.Num(); i++)
+	{
+		if (CurveUIDs[i] != SmartName::MaxUID)
+		{
+			Output.Curve.Set(CurveUIDs[i], Values[i]);
+		}
+	}
+
+	return true;
+}
+
+
+UFaceAnimInstance::UFaceAnimInstance()
+{
+	HeadBoneName = NAME_None;
+	FaceIndex = 0;
+}
+
+
+void UFaceAnimInstance::SetPoseSource(TSharedPtr<FFaceAnimPoseSource, ESPMode::ThreadSafe> InSource, int32 InFaceIndex)
+{
+	Source = InSource;
+	FaceIndex = InFaceIndex;
+}
+
+
+FAnimInstanceProxy* UFaceAnimInstance::CreateAnimInstanceProxy()
+{
+	return new FFaceAnimInstanceProxy(this);
+}
@@ -0,0 +1,170 @@
+// Copyright 2020 NeuralVFX, Inc. All Rights Reserved.
+
+#include "FaceFilter.h"
+#include "Math/VectorRegister.h"
+
+
+/** Smoothing factor of a low pass filter - r / (1 + r), with r = 2 * PI * Cutoff * DeltaTime */
+static FORCEINLINE VectorRegister LowPassAlpha(const VectorRegister& Cutoff, const VectorRegister& TwoPiDeltaTime)
+{
+	VectorRegister R = VectorMultiply(Cutoff, TwoPiDeltaTime);
+	return VectorMultiply(R, VectorReciprocalAccurate(VectorAdd(R, GlobalVectorConstants::FloatOne)));
+}
+
+
+static float LowPassAlpha(float Cutoff, float DeltaTime)
+{
+	float R = 2.f * PI * Cutoff * DeltaTime;
+	return R / (1.f + R);
+}
+
+
+void FFaceFilter::OneEuro(const float* MinCutoff, const float* Beta, const float* DerivativeCutoff,
+	float* Value, float* Derivative, bool& bInitialized, const float* In, int32 NumChannels, float DeltaTime)
+{
+	// First sample passes straight through
+	if (!bInitialized)
+	{
+		FMemory::Memcpy(Value, In, NumChannels * sizeof(float));
+		FMemory::Memzero(Derivative, NumChannels * sizeof(float));
+		bInitialized = true;
+		return;
+	}
+
+	const VectorRegister InvDeltaTime = VectorSetFloat1(1.f / DeltaTime);
+	const VectorRegister TwoPiDeltaTime = VectorSetFloat1(2.f * PI * DeltaTime);
+
+	for (int32 i = 0; i < NumChannels; i += 4)
+	{
+		VectorRegister X = VectorLoadAligned(In + i);
+		VectorRegister PrevX = VectorLoadAligned(Value + i);
+		VectorRegister PrevDX = VectorLoadAligned(Derivative + i);
+
+		// Smoothed speed
+		VectorRegister DX = VectorMultiply(VectorSubtract(X, PrevX), InvDeltaTime);
+		VectorRegister AlphaD = LowPassAlpha(VectorLoadAligned(DerivativeCutoff + i), TwoPiDeltaTime);
+		DX = VectorMultiplyAdd(AlphaD, VectorSubtract(DX, PrevDX), PrevDX);
+
+		// Cutoff rises with speed
+		VectorRegister Cutoff = VectorMultiplyAdd(VectorLoadAligned(Beta + i), VectorAbs(DX), VectorLoadAligned(MinCutoff + i));
+		VectorRegister Alpha = LowPassAlpha(Cutoff, TwoPiDeltaTime);
+		X = VectorMultiplyAdd(Alpha, VectorSubtract(X, PrevX), PrevX);
+
+		VectorStoreAligned(X, Value + i);
+		VectorStoreAligned(DX, Derivative + i);
+	}
+}
+
+
+void FFaceFilter::Kalman(const float* ProcessNoise, const float* MeasurementNoise,
+	float* Value, float* Velocity, float* P00, float* P01, float* P11, bool& bInitialized,
+	const float* In, int32 NumChannels, float DeltaTime)
+{
+	// Start at the first measurement, at rest, with its noise as uncertainty
+	if (!bInitialized)
+	{
+		FMemory::Memcpy(Value, In, NumChannels * sizeof(float));
+		FMemory::Memzero(Velocity, NumChannels * sizeof(float));
+		FMemory::Memcpy(P00, MeasurementNoise, NumChannels * sizeof(float));
+		FMemory::Memzero(P01, NumChannels * sizeof(float));
+		FMemory::Memcpy(P11, ProcessNoise, NumChannels * sizeof(float));
+		bInitialized = true;
+		return;
+	}
+
+	// Process noise of a constant velocity model driven by random acceleration
+	const VectorRegister Dt = VectorSetFloat1(DeltaTime);
+	const VectorRegister Q00 = VectorSetFloat1(DeltaTime * DeltaTime * DeltaTime / 3.f);
+	const VectorRegister Q01 = VectorSetFloat1(DeltaTime * DeltaTime / 2.f);
+	const VectorRegister Two = VectorSetFloat1(2.f);
+
+	for (int32 i = 0; i < NumChannels; i += 4)
+	{
+		VectorRegister Q = VectorLoadAligned(ProcessNoise + i);
+		VectorRegister X = VectorLoadAligned(Value + i);
+		VectorRegister V = VectorLoadAligned(Velocity + i);
+		VectorRegister A = VectorLoadAligned(P00 + i);
+		VectorRegister B = VectorLoadAligned(P01 + i);
+		VectorRegister C = VectorLoadAligned(P11 + i);
+
+		// Predict
+		X = VectorMultiplyAdd(V, Dt, X);
+		A = VectorAdd(A, VectorMultiplyAdd(Dt, VectorMultiplyAdd(Dt, C, VectorMultiply(Two, B)), VectorMultiply(Q, Q00)));
+		B = VectorAdd(B, VectorMultiplyAdd(Dt, C, VectorMultiply(Q, Q01)));
+		C = VectorMultiplyAdd(Q, Dt, C);
+
+		// Correct with measurement
+		VectorRegister InvS = VectorReciprocalAccurate(VectorAdd(A, VectorLoadAligned(MeasurementNoise + i)));
+		VectorRegister K0 = VectorMultiply(A, InvS);
+		VectorRegister K1 = VectorMultiply(B, InvS);
+		VectorRegister Residual = VectorSubtract(VectorLoadAligned(In + i), X);
+
+		X = VectorMultiplyAdd(K0, Residual, X);
+		V = VectorMultiplyAdd(K1, Residual, V);
+
+		VectorRegister OneMinusK0 = VectorSubtract(GlobalVectorConstants::FloatOne, K0);
+		C = VectorSubtract(C, VectorMultiply(K1, B));
+		B = VectorMultiply(OneMinusK0, B);
+		A = VectorMultiply(OneMinusK0, A);
+
+		VectorStoreAligned(X, Value + i);
+		VectorStoreAligned(V, Velocity + i);
+		VectorStoreAligned(A, P00 + i);
+		VectorStoreAligned(B, P01 + i);
+		VectorStoreAligned(C, P11 + i);
+	}
+}
+
+
+void FFaceFilter::OneEuroRotation(const FFaceFilterSettings& Settings, FFaceFilterState& State, const FQuat& Measured, float DeltaTime)
+{
+	if (!State.bRotationInitialized)
+	{
+		State.Rotation = Measured;
+		State.RotationSpeed = 0;
+		State.bRotationInitialized = true;
+		return;
+	}
+
+	// Angular speed, smoothed
+	float Speed = State.Rotation.AngularDistance(Measured) / DeltaTime;
+	State.RotationSpeed += LowPassAlpha(Settings.DerivativeCutoff, DeltaTime) * (Speed - State.RotationSpeed);
+
+	// Slerp takes the shortest path, so sign flips of the measurement don't matter
+	float Alpha = LowPassAlpha(Settings.MinCutoff + Settings.Beta * State.RotationSpeed, DeltaTime);
+	State.Rotation = FQuat::Slerp(State.Rotation, Measured, Alpha).GetNormalized();
+}
+
+
+void FFaceFilter::KalmanRotation(const FFaceVectorFilterParams& Params, FFaceFilterState& State, const FQuat& Measured, float DeltaTime)
+{
+	if (!State.bRotationInitialized)
+	{
+		State.Rotation = Measured;
+		State.RotationError.Reset();
+		State.bRotationInitialized = true;
+	}
+
+	// Measured rotation relative to the estimate, as a rotation vector
+	FQuat Delta = State.Rotation.Inverse() * Measured;
+	if (Delta.W < 0)
+	{
+		Delta = Delta * -1.f;
+	}
+
+	FVector Axis;
+	float Angle;
+	Delta.ToAxisAndAngle(Axis, Angle);
+
+	alignas(16) float Error[4] = { Axis.X * Angle, Axis.Y * Angle, Axis.Z * Angle, 0 };
+	Kalman(Params, State.RotationError, Error, DeltaTime);
+
+	// Fold the corrected error into the estimate, velocity carries over
+	FVector Correction(State.RotationError.Value[0], State.RotationError.Value[1], State.RotationError.Value[2]);
+	float CorrectionAngle = Correction.Size();
+	if (CorrectionAngle > SMALL_NUMBER)
+	{
+		State.Rotation = (State.Rotation * FQuat(Correction / CorrectionAngle, CorrectionAngle)).GetNormalized();
+	}
+	FMemory::Memzero(State.RotationError.Value);
+}
@@ -0,0 +1,428 @@
+// Copyright 2020 NeuralVFX, Inc. All Rights Reserved.
+
+#include "FaceHostBackend.h"
+#include "FaceTrackerShared.h"
+#include "HAL/PlatformTime.h"
+#include "Misc/Paths.h"
+#include "FacialPoseStats.h"
+
+
+static_assert(sizeof(FaceTrackerBatch) == sizeof(FaceBatchData), "Host batch must match FaceBatchData");
+static_assert(sizeof(FaceTrackerTransform) == sizeof(TransformData), "Host transform must match TransformData");
+static_assert(FACE_TRACKER_MAX_FACES == FACE_BATCH_MAX_FACES, "Host and plugin must agree on face count");
+static_assert(FACE_TRACKER_MAX_LANDMARKS == FACE_BATCH_MAX_LANDMARKS, "Host and plugin must agree on landmark count");
+
+
+/** Seconds allowed for the host to start, to load the camera and networks, and for the first inference after that */
+static const float HostStartTimeout = 10.f;
+static const float HostInitTimeout = 60.f;
+static const float HostFirstResultTimeout = 60.f;
+
+
+UFaceHostBackend::UFaceHostBackend()
+{
+	AffinityMask = 0;
+	HostTimeout = 5.f;
+	bRestartHost = true;
+
+	Region = nullptr;
+	Shared = nullptr;
+	ReadCount = 0;
+	ReadSlot = nullptr;
+	ReadSequence = 0;
+	LastHostHeartbeat = 0;
+	LastHostWriteCount = 0;
+	LastHostHeartbeatTime = 0;
+	LastRestartTime = -HostTimeout;
+
+	bInitialized = false;
+	CameraWidth = 0;
+	CameraHeight = 0;
+	DetectRatio = 1;
+	CamId = 0;
+	FovZoom = 1;
+	bDraw = false;
+	bLockEyesNose = true;
+}
+
+
+void UFaceHostBackend::BeginDestroy()
+{
+	StopHost();
+	if (Region != nullptr)
+	{
+		FPlatformMemory::UnmapNamedSharedMemoryRegion(Region);
+		Region = nullptr;
+		Shared = nullptr;
+	}
+	Super::BeginDestroy();
+}
+
+
+bool UFaceHostBackend::StartHost()
+{
+	// Region outlives host restarts, one per Unreal process
+	if (Region == nullptr)
+	{
+		FString RegionName = FString::Printf(TEXT("FacialPoseTracker%u"), FPlatformProcess::GetCurrentProcessId());
+		Region = FPlatformMemory::MapNamedSharedMemoryRegion(RegionName, true,
+			FPlatformMemory::ESharedMemoryAccess::Read | FPlatformMemory::ESharedMemoryAccess::Write, sizeof(FaceTrackerShared));
+		if (Region == nullptr)
+		{
+			UE_LOG(LogTemp, Error, TEXT("Could not Create Shared Memory: %s"), *RegionName);
+			return false;
+		}
+		Shared = (FaceTrackerShared*)Region->GetAddress();
+	}
+
+	// Fresh ring and control block for each host, a host killed inside Publish leaves its slot odd
+	FMemory::Memzero(Shared, sizeof(FaceTrackerControl));
+	Shared->control.version = FACE_TRACKER_SHARED_VERSION;
+	Shared->writeCount.store(0);
+	for (FaceTrackerSlot& Slot : Shared->slots)
+	{
+		Slot.sequence.store(0);
+	}
+	ReadCount = 0;
+	ReadSlot = nullptr;
+
+	FString Params = FString::Printf(TEXT("-shm=%s -lib=\"%s\" -affinity=%lld"),
+		*Region->GetName(), *FPaths::ConvertRelativePathToFull(LibraryPath), AffinityMask);
+	HostProcess = FPlatformProcess::CreateProc(*HostPath, *Params, true, true, true, nullptr, 0, nullptr, nullptr);
+	if (!HostProcess.IsValid())
+	{
+		UE_LOG(LogTemp, Error, TEXT("Could not Launch Tracker Host: %s"), *HostPath);
+		return false;
+	}
+
+	// Host reports idle once the library is loaded
+	double Deadline = FPlatformTime::Seconds() + HostStartTimeout;
+	while (Shared->control.hostState.load() == FACE_TRACKER_HOST_STARTING)
+	{
+		if (!FPlatformProcess::IsProcRunning(HostProcess) || FPlatformTime::Seconds() > Deadline)
+		{
+			break;
+		}
+		Shared->control.clientHeartbeat.fetch_add(1);
+		FPlatformProcess::Sleep(.001f);
+	}
+	if (Shared->control.hostState.load() != FACE_TRACKER_HOST_IDLE)
+	{
+		UE_LOG(LogTemp, Error, TEXT("Tracker Host Failed to Load: %s"), *LibraryPath);
+		StopHost();
+		return false;
+	}
+
+	LastHostHeartbeat = Shared->control.hostHeartbeat.load();
+	LastHostWriteCount = 0;
+	LastHostHeartbeatTime = FPlatformTime::Seconds();
+	UE_LOG(LogTemp, Log, TEXT("Tracker Host Started: %s"), *Params);
+	return true;
+}
+
+
+void UFaceHostBackend::StopHost()
+{
+	if (!HostProcess.IsValid())
+	{
+		return;
+	}
+
+	if (FPlatformProcess::IsProcRunning(HostProcess))
+	{
+		SendCommand(FACE_TRACKER_COMMAND_QUIT, HostTimeout);
+		FPlatformProcess::Sleep(.01f);
+	}
+	if (FPlatformProcess::IsProcRunning(HostProcess))
+	{
+		FPlatformProcess::TerminateProc(HostProcess, true);
+	}
+	FPlatformProcess::CloseProc(HostProcess);
+	HostProcess.Reset();
+}
+
+
+void UFaceHostBackend::SimulateHostCrash()
+{
+	if (Shared == nullptr || !HostProcess.IsValid())
+	{
+		return;
+	}
+
+	FPlatformProcess::TerminateProc(HostProcess, true);
+	FPlatformProcess::WaitForProc(HostProcess);
+
+	// Slot the host would have written next stays marked as being written
+	FaceTrackerSlot& Slot = Shared->slots[Shared->writeCount.load() % FACE_TRACKER_RING_SLOTS];
+	Slot.sequence.fetch_or(1);
+}
+
+
+bool UFaceHostBackend::RestartHost()
+{
+	// Don't spin on a host which fails straight away
+	double Now = FPlatformTime::Seconds();
+	if (!bRestartHost || Now - LastRestartTime < HostTimeout)
+	{
+		return false;
+	}
+	LastRestartTime = Now;
+	RestartCount.Increment();
+	UE_LOG(LogTemp, Warning, TEXT("Tracker Host Stopped Responding, Restarting"));
+
+	StopHost();
+	if (!StartHost())
+	{
+		return false;
+	}
+	if (!bInitialized)
+	{
+		return true;
+	}
+
+	int Width = CameraWidth;
+	int Height = CameraHeight;
+	return CallInitCV(Width, Height, DetectRatio, CamId, FovZoom, bDraw, bLockEyesNose) != INT_MIN;
+}
+
+
+int UFaceHostBackend::SendCommand(uint32 Command, float Timeout)
+{
+	if (Shared == nullptr || !HostProcess.IsValid())
+	{
+		return INT_MIN;
+	}
+
+	FaceTrackerControl& Control = Shared->control;
+	Control.command.store(Command, std::memory_order_release);
+
+	double Deadline = FPlatformTime::Seconds() + Timeout;
+	while (Control.command.load(std::memory_order_acquire) != FACE_TRACKER_COMMAND_NONE)
+	{
+		if (!FPlatformProcess::IsProcRunning(HostProcess) || FPlatformTime::Seconds() > Deadline)
+		{
+			return INT_MIN;
+		}
+		Control.clientHeartbeat.fetch_add(1, std::memory_order_relaxed);
+		FPlatformProcess::Sleep(.001f);
+	}
+	return Control.commandResult;
+}
+
+
+bool UFaceHostBackend::IsHostAlive()
+{
+	if (!HostProcess.IsValid() || !FPlatformProcess::IsProcRunning(HostProcess))
+	{
+		return false;
+	}
+
+	// Host only beats between detects, so a new result counts as one too
+	double Now = FPlatformTime::Seconds();
+	uint64 Heartbeat = Shared->control.hostHeartbeat.load(std::memory_order_relaxed);
+	uint64 WriteCount = Shared->writeCount.load(std::memory_order_relaxed);
+	if (Heartbeat != LastHostHeartbeat || WriteCount != LastHostWriteCount)
+	{
+		LastHostHeartbeat = Heartbeat;
+		LastHostWriteCount = WriteCount;
+		LastHostHeartbeatTime = Now;
+	}
+
+	// First detect after Init may load models and warm up the library, it isn't held to HostTimeout
+	float Timeout = WriteCount == 0 ? FMath::Max(HostTimeout, HostFirstResultTimeout) : HostTimeout;
+	return Now - LastHostHeartbeatTime < Timeout;
+}
+
+
+int UFaceHostBackend::CallInitCV(int& outCameraWidth, int& outCameraHeight, int detectRatio,
+	int camId, float fovZoom, bool draw, bool lockEyesNose)
+{
+	SCOPE_CYCLE_COUNTER(STAT_FacialPose_DLLInit);
+	TRACE_CPUPROFILER_EVENT_SCOPE(FacialPose_HostInit);
+
+	if (!HostProcess.IsValid() && !StartHost())
+	{
+		return INT_MIN;
+	}
+
+	FaceTrackerControl& Control = Shared->control;
+	Control.cameraWidth = outCameraWidth;
+	Control.cameraHeight = outCameraHeight;
+	Control.detectRatio = detectRatio;
+	Control.camId = camId;
+	Control.fovZoom = fovZoom;
+	Control.draw = draw;
+	Control.lockEyesNose = lockEyesNose;
+
+	int Result = SendCommand(FACE_TRACKER_COMMAND_INIT, HostInitTimeout);
+	if (Result == INT_MIN)
+	{
+		UE_LOG(LogTemp, Error, TEXT("Tracker Host Failed to Init"));
+		return INT_MIN;
+	}
+
+	outCameraWidth = Control.cameraWidth;
+	outCameraHeight = Control.cameraHeight;
+
+	// Kept to init a restarted host the same way
+	bInitialized = true;
+	CameraWidth = outCameraWidth;
+	CameraHeight = outCameraHeight;
+	DetectRatio = detectRatio;
+	CamId = camId;
+	FovZoom = fovZoom;
+	bDraw = draw;
+	bLockEyesNose = lockEyesNose;
+
+	return Result;
+}
+
+
+int UFaceHostBackend::CallCloseCV()
+{
+	SCOPE_CYCLE_COUNTER(STAT_FacialPose_DLLClose);
+
+	bInitialized = false;
+	SendCommand(FACE_TRACKER_COMMAND_CLOSE, HostTimeout);
+	StopHost();
+	UE_LOG(LogTemp, Log, TEXT("Tracker Host Closed"));
+
+	return 1;
+}
+
+
+int UFaceHostBackend::CallDetectFaces(FaceBatchData& outFaces)
+{
+	SCOPE_CYCLE_COUNTER(STAT_FacialPose_DLLDetectFaces);
+	TRACE_CPUPROFILER_EVENT_SCOPE(FacialPose_HostDetectFaces);
+
+	outFaces.numFaces = 0;
+	outFaces.captureAge = -1;
+	outFaces.frameId = 0;
+	if (Shared == nullptr)
+	{
+		return INT_MIN;
+	}
+
+	// Ask for one result past the last one read, the host is idle until then
+	Shared->control.detectRequests.store(ReadCount + 1, std::memory_order_release);
+
+	while (true)
+	{
+		Shared->control.clientHeartbeat.fetch_add(1, std::memory_order_relaxed);
+
+		// Wait for the host to publish something new
+		uint64 Count = Shared->writeCount.load(std::memory_order_acquire);
+		if (Count == ReadCount)
+		{
+			if (!IsHostAlive())
+			{
+				RestartHost();
+				return INT_MIN;
+			}
+			FPlatformProcess::Sleep(.0005f);
+			continue;
+		}
+
+		// Newest slot, retried if the host laps it while it is read
+		FaceTrackerSlot& Slot = Shared->slots[(Count - 1) % FACE_TRACKER_RING_SLOTS];
+		uint64 Sequence = Slot.sequence.load(std::memory_order_acquire);
+		if (Sequence & 1)
+		{
+			continue;
+		}
+		FMemory::Memcpy(&outFaces, &Slot.batch, sizeof(FaceBatchData));
+		std::atomic_thread_fence(std::memory_order_acquire);
+		if (Slot.sequence.load(std::memory_order_relaxed) != Sequence)
+		{
+			continue;
+		}
+
+		ReadCount = Count;
+		ReadSlot = &Slot;
+		ReadSequence = Sequence;
+		return 1;
+	}
+}
+
+
+int UFaceHostBackend::CallDetect(TransformData& outTransform, float* outExpression)
+{
+	FaceBatchData Faces;
+	int Result = CallDetectFaces(Faces);
+	if (Result == INT_MIN || Faces.numFaces == 0)
+	{
+		return Result;
+	}
+
+	outTransform = Faces.transforms[0];
+	FMemory::Memcpy(outExpression, Faces.expressions, 51 * sizeof(float));
+	return Result;
+}
+
+
+int UFaceHostBackend::CallReconfigure(int detectRatio)
+{
+	SCOPE_CYCLE_COUNTER(STAT_FacialPose_DLLReconfigure);
+
+	if (Shared == nullptr)
+	{
+		return INT_MIN;
+	}
+
+	// Also used if the host is restarted
+	Shared->control.detectRatio = detectRatio;
+	int Result = SendCommand(FACE_TRACKER_COMMAND_RECONFIGURE, HostTimeout);
+	if (Result != INT_MIN)
+	{
+		DetectRatio = detectRatio;
+	}
+	return Result;
+}
+
+
+bool UFaceHostBackend::CopyImage(unsigned char* image, int width, int height, uint32 format)
+{
+	if (Shared == nullptr)
+	{
+		return false;
+	}
+
+	// Ask for this size from now on, the current slot may still have the old one
+	Shared->control.imageSize.store(((uint32)width << 16) | (uint32)height, std::memory_order_release);
+	Shared->control.imageFormat.store(format, std::memory_order_release);
+
+	if (ReadSlot == nullptr || ReadSlot->imageWidth != width || ReadSlot->imageHeight != height || ReadSlot->imageFormat != format)
+	{
+		return false;
+	}
+
+	// Image is copied once, out of the ring into the caller's upload buffer
+	FMemory::Memcpy(image, ReadSlot->image, ReadSlot->imageBytes);
+	std::atomic_thread_fence(std::memory_order_acquire);
+	return ReadSlot->sequence.load(std::memory_order_relaxed) == ReadSequence;
+}
+
+
+int UFaceHostBackend::CallGetImageCV(unsigned char* image, int width, int height)
+{
+	SCOPE_CYCLE_COUNTER(STAT_FacialPose_DLLGetImage);
+	TRACE_CPUPROFILER_EVENT_SCOPE(FacialPose_HostGetImage);
+
+	return CopyImage(image, width, height, (uint32)EFaceImageFormat::BGRA) ? 1 : -1;
+}
+
+
+int UFaceHostBackend::CallGetImageYUV(unsigned char* image, int width, int height, EFaceImageFormat format)
+{
+	// Host tells once it has loaded the library whether it has YUV images
+	if (Shared == nullptr || !Shared->control.hasYUV || format == EFaceImageFormat::BGRA)
+	{
+		return INT_MIN;
+	}
+
+	SCOPE_CYCLE_COUNTER(STAT_FacialPose_DLLGetImage);
+	TRACE_CPUPROFILER_EVENT_SCOPE(FacialPose_HostGetImage);
+
+	return CopyImage(image, width, height, (uint32)format) ? 1 : -1;
+}
@@ -0,0 +1,76 @@
+// Copyright 2020 NeuralVFX, Inc. All Rights Reserved.
+
+#include "FaceImagePool.h"
+#include "FacialPoseStats.h"
+
+
+FFaceImagePool::FFaceImagePool(int32 InNumBuffers, int32 InBufferSize) :
+	BufferSize(InBufferSize), FreeMask(0)
+{
+	check(InNumBuffers > 0 && InNumBuffers <= 32);
+
+	// All allocation happens here, never per frame
+	for (int32 i = 0; i < InNumBuffers; i++)
+	{
+		Buffers.Add((uint8*)FMemory::Malloc(BufferSize, 64));
+		FreeMask |= (1 << i);
+	}
+
+	INC_DWORD_STAT_BY(STAT_FacialPose_ImageAllocations, InNumBuffers);
+	INC_MEMORY_STAT_BY(STAT_FacialPose_ImagePoolMemory, InNumBuffers * BufferSize);
+}
+
+
+FFaceImagePool::~FFaceImagePool()
+{
+	for (uint8* Buffer : Buffers)
+	{
+		FMemory::Free(Buffer);
+	}
+
+	DEC_MEMORY_STAT_BY(STAT_FacialPose_ImagePoolMemory, Buffers.Num() * BufferSize);
+}
+
+
+int32 FFaceImagePool::Acquire()
+{
+	while (true)
+	{
+		int32 Mask = FPlatformAtomics::AtomicRead(&FreeMask);
+		if (Mask == 0)
+		{
+			return INDEX_NONE;
+		}
+
+		// Claim lowest free buffer
+		int32 Index = FMath::CountTrailingZeros((uint32)Mask);
+		int32 NewMask = Mask & ~(1 << Index);
+		if (FPlatformAtomics::InterlockedCompareExchange(&FreeMask, NewMask, Mask) == Mask)
+		{
+			return Index;
+		}
+	}
+}
+
+
+void FFaceImagePool::Release(int32 Index)
+{
+	check(Index >= 0 && Index < Buffers.Num());
+
+	while (true)
+	{
+		int32 Mask = FPlatformAtomics::AtomicRead(&FreeMask);
+		int32 NewMask = Mask | (1 << Index);
+		if (FPlatformAtomics::InterlockedCompareExchange(&FreeMask, NewMask, Mask) == Mask)
+		{
+			return;
+		}
+	}
+}
+
+
+int32 FFaceImagePool::GetNumInUse() const
+{
+	int32 Mask = FPlatformAtomics::AtomicRead(&FreeMask);
+	return Buffers.Num() - FMath::CountBits((uint64)(uint32)Mask);
+}
@@ -0,0 +1,47 @@
+// Copyright 2020 NeuralVFX, Inc. All Rights Reserved.
+
+#include "FaceLatencyHistogram.h"
+
+
+FFaceLatencyHistogram::FFaceLatencyHistogram(int32 InWindowSize) :
+	WindowSize(FMath::Max(InWindowSize, 1)), NextSample(0), bDirty(false)
+{
+	Samples.Reserve(WindowSize);
+	Sorted.Reserve(WindowSize);
+}
+
+
+void FFaceLatencyHistogram::AddSample(float Ms)
+{
+	if (Samples.Num() < WindowSize)
+	{
+		Samples.Add(Ms);
+	}
+	else
+	{
+		Samples[NextSample] = Ms;
+	}
+	NextSample = (NextSample + 1) % WindowSize;
+	bDirty = true;
+}
+
+
+const FFacePoseLatency& FFaceLatencyHistogram::GetPercentiles()
+{
+	if (!bDirty || Samples.Num() == 0)
+	{
+		return Cached;
+	}
+
+	// Window is small, a sort is cheaper than keeping buckets
+	Sorted = Samples;
+	Sorted.Sort();
+
+	int32 Last = Sorted.Num() - 1;
+	Cached.P50 = Sorted[FMath::RoundToInt(Last * .50f)];
+	Cached.P95 = Sorted[FMath::RoundToInt(Last * .95f)];
+	Cached.P99 = Sorted[FMath::RoundToInt(Last * .99f)];
+	bDirty = false;
+
+	return Cached;
+}
@@ -0,0 +1,119 @@
+// Copyright 2020 NeuralVFX, Inc. All Rights Reserved.
+
+#include "FaceLiveLinkSource.h"
+#include "ILiveLinkClient.h"
+#include "Roles/LiveLinkAnimationRole.h"
+#include "Roles/LiveLinkAnimationTypes.h"
+#include "Misc/ScopeLock.h"
+#include "FacialPoseStats.h"
+
+
+const FName FFaceLiveLinkSource::HeadBoneName(TEXT("head"));
+
+
+FFaceLiveLinkSource::FFaceLiveLinkSource(FName InSubjectName, const TArray<FName>& InCurveNames, int32 InMaxSubjects) :
+	Client(nullptr), SubjectName(InSubjectName), MaxSubjects(FMath::Clamp(InMaxSubjects, 1, FACE_BATCH_MAX_FACES))
+{
+	// Every expression needs a curve, unnamed ones keep their index
+	CurveNames.SetNum(51);
+	for (int32 i = 0; i < 51; i++)
+	{
+		bool bNamed = InCurveNames.IsValidIndex(i) && InCurveNames[i] != NAME_None;
+		CurveNames[i] = bNamed ? InCurveNames[i] : FName(*FString::Printf(TEXT("Expression%02d"), i));
+	}
+}
+
+
+FName FFaceLiveLinkSource::GetSubjectName(FName BaseName, int32 Index)
+{
+	return Index == 0 ? BaseName : FName(*FString::Printf(TEXT("%s_%d"), *BaseName.ToString(), Index));
+}
+
+
+void FFaceLiveLinkSource::ReceiveClient(ILiveLinkClient* InClient, FGuid InSourceGuid)
+{
+	FScopeLock Lock(&ClientLock);
+	Client = InClient;
+	SourceGuid = InSourceGuid;
+
+	// Skeleton and curve names are fixed, so every subject is described once up front
+	for (int32 i = 0; i < MaxSubjects; i++)
+	{
+		FLiveLinkStaticDataStruct StaticData(FLiveLinkSkeletonStaticData::StaticStruct());
+		FLiveLinkSkeletonStaticData& Skeleton = *StaticData.Cast<FLiveLinkSkeletonStaticData>();
+		Skeleton.SetBoneNames({ HeadBoneName });
+		Skeleton.SetBoneParents({ INDEX_NONE });
+		Skeleton.PropertyNames = CurveNames;
+
+		Client->PushSubjectStaticData_AnyThread(FLiveLinkSubjectKey(SourceGuid, GetSubjectName(SubjectName, i)),
+			ULiveLinkAnimationRole::StaticClass(), MoveTemp(StaticData));
+	}
+}
+
+
+void FFaceLiveLinkSource::PushFrame(const FaceBatchData& Faces, double CaptureTime, uint64 FrameId)
+{
+	SCOPE_CYCLE_COUNTER(STAT_FacialPose_LiveLinkPush);
+	TRACE_CPUPROFILER_EVENT_SCOPE(FacialPose_LiveLinkPush);
+
+	FScopeLock Lock(&ClientLock);
+	if (Client == nullptr)
+	{
+		return;
+	}
+
+	// Faces out of view push nothing, their subjects hold the last frame
+	for (int32 i = 0; i < FMath::Min(Faces.numFaces, MaxSubjects); i++)
+	{
+		FLiveLinkFrameDataStruct FrameData(FLiveLinkAnimationFrameData::StaticStruct());
+		FLiveLinkAnimationFrameData& Frame = *FrameData.Cast<FLiveLinkAnimationFrameData>();
+
+		// Capture time is already platform time, so no offset to the source clock
+		Frame.WorldTime = FLiveLinkWorldTime(CaptureTime, 0.0);
+		Frame.MetaData.StringMetaData.Add(TEXT("FrameId"), LexToString(FrameId));
+		Frame.MetaData.StringMetaData.Add(TEXT("TrackId"), LexToString(Faces.trackIds[i]));
+
+		const TransformData& Transform = Faces.transforms[i];
+		Frame.Transforms.Add(FTransform(Transform.GetRotation(), Transform.GetTranslation()));
+		Frame.PropertyValues.Append(&Faces.expressions[i * 51], 51);
+
+		Client->PushSubjectFrameData_AnyThread(FLiveLinkSubjectKey(SourceGuid, GetSubjectName(SubjectName, i)),
+			MoveTemp(FrameData));
+	}
+	NumFramesPushed.Increment();
+}
+
+
+bool FFaceLiveLinkSource::IsSourceStillValid() const
+{
+	FScopeLock Lock(&ClientLock);
+	return Client != nullptr;
+}
+
+
+bool FFaceLiveLinkSource::RequestSourceShutdown()
+{
+	// Worker may still push, it finds no client from here on
+	FScopeLock Lock(&ClientLock);
+	Client = nullptr;
+	return true;
+}
+
+
+FText FFaceLiveLinkSource::GetSourceType() const
+{
+	return NSLOCTEXT("FacialPoseEstimation", "LiveLinkSourceType", "Facial Pose Estimation");
+}
+
+
+FText FFaceLiveLinkSource::GetSourceMachineName() const
+{
+	return FText::FromString(FPlatformProcess::ComputerName());
+}
+
+
+FText FFaceLiveLinkSource::GetSourceStatus() const
+{
+	return FText::Format(NSLOCTEXT("FacialPoseEstimation", "LiveLinkSourceStatus", "Active, {0} frames"),
+		FText::AsNumber(NumFramesPushed.GetValue()));
+}
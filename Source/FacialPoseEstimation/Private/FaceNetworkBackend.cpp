@@ -0,0 +1,147 @@
+// Copyright 2020 NeuralVFX, Inc. All Rights Reserved.
+
+#include "FaceNetworkBackend.h"
+#include "HAL/PlatformTime.h"
+#include "Sockets.h"
+#include "SocketSubsystem.h"
+#include "IPAddress.h"
+#include "Common/UdpSocketBuilder.h"
+#include "Interfaces/IPv4/IPv4Address.h"
+#include "FacialPoseStats.h"
+
+
+UFaceNetworkBackend::UFaceNetworkBackend()
+{
+	Port = 7830;
+	ReceiveTimeout = .1f;
+
+	Socket = nullptr;
+	LatestReceiveTime = 0;
+	FMemory::Memzero(LatestHeader);
+}
+
+
+void UFaceNetworkBackend::BeginDestroy()
+{
+	CallCloseCV();
+	Super::BeginDestroy();
+}
+
+
+int UFaceNetworkBackend::CallInitCV(int& outCameraWidth, int& outCameraHeight, int detectRatio,
+	int camId, float fovZoom, bool draw, bool lockEyesNose)
+{
+	CallCloseCV();
+
+	Socket = FUdpSocketBuilder(TEXT("FacePoseReceiver"))
+		.AsNonBlocking()
+		.AsReusable()
+		.BoundToAddress(FIPv4Address::Any)
+		.BoundToPort(Port)
+		.WithReceiveBufferSize(256 * 1024)
+		.Build();
+	if (Socket == nullptr)
+	{
+		UE_LOG(LogTemp, Error, TEXT("Could not Listen for Tracking on Port %d"), Port);
+		return INT_MIN;
+	}
+	Sender = ISocketSubsystem::Get(PLATFORM_SOCKETSUBSYSTEM)->CreateInternetAddr();
+
+	// Fresh decoder, the stream is picked up at its next keyframe
+	Decoder = FFaceStreamDecoder();
+	Latest = FaceBatchData();
+	LatestReceiveTime = 0;
+
+	UE_LOG(LogTemp, Log, TEXT("Listening for Tracking on Port %d"), Port);
+	return 1;
+}
+
+
+int UFaceNetworkBackend::CallCloseCV()
+{
+	if (Socket != nullptr)
+	{
+		Socket->Close();
+		ISocketSubsystem::Get(PLATFORM_SOCKETSUBSYSTEM)->DestroySocket(Socket);
+		Socket = nullptr;
+		UE_LOG(LogTemp, Log, TEXT("Stopped Listening for Tracking"));
+	}
+	return 1;
+}
+
+
+int UFaceNetworkBackend::CallDetectFaces(FaceBatchData& outFaces)
+{
+	if (Socket == nullptr)
+	{
+		outFaces.numFaces = 0;
+		return INT_MIN;
+	}
+
+	// Decode everything that arrived in order, so keyframes are never skipped, and keep the newest
+	bool bReceived = false;
+	double Deadline = FPlatformTime::Seconds() + ReceiveTimeout;
+	while (!bReceived)
+	{
+		double Remaining = Deadline - FPlatformTime::Seconds();
+		if (Remaining <= 0 || !Socket->Wait(ESocketWaitConditions::WaitForRead, FTimespan::FromSeconds(Remaining)))
+		{
+			break;
+		}
+
+		SCOPE_CYCLE_COUNTER(STAT_FacialPose_NetworkReceive);
+		TRACE_CPUPROFILER_EVENT_SCOPE(FacialPose_NetworkReceive);
+
+		int32 BytesRead = 0;
+		while (Socket->RecvFrom(Packet, FACE_STREAM_MAX_PACKET, BytesRead, *Sender))
+		{
+			uint32 Lost = Decoder.GetNumLost();
+			if (Decoder.Decode(Packet, BytesRead, Latest, LatestHeader))
+			{
+				LatestReceiveTime = FPlatformTime::Seconds();
+				bReceived = true;
+			}
+			INC_DWORD_STAT_BY(STAT_FacialPose_NetworkPacketsLost, Decoder.GetNumLost() - Lost);
+		}
+	}
+
+	// Same frame id again when nothing new came, which the worker skips as a duplicate
+	FMemory::Memcpy(&outFaces, &Latest, sizeof(FaceBatchData));
+	outFaces.captureAge = LatestReceiveTime > 0 ? LatestHeader.CaptureAge + (FPlatformTime::Seconds() - LatestReceiveTime) : -1;
+
+	return 1;
+}
+
+
+int UFaceNetworkBackend::CallDetect(TransformData& outTransform, float* outExpression)
+{
+	FaceBatchData Faces;
+	int Result = CallDetectFaces(Faces);
+	if (Faces.numFaces > 0)
+	{
+		outTransform = Faces.transforms[0];
+		FMemory::Memcpy(outExpression, Faces.expressions, 51 * sizeof(float));
+	}
+
+	return Result;
+}
+
+
+int UFaceNetworkBackend::CallReconfigure(int detectRatio)
+{
+	// Detect ratio is up to the sending machine
+	return 1;
+}
+
+
+int UFaceNetworkBackend::CallGetImageCV(unsigned char* image, int width, int height)
+{
+	FMemory::Memset(image, 128, width * height * 4);
+	return 1;
+}
+
+
+int UFaceNetworkBackend::CallGetImageYUV(unsigned char* image, int width, int height, EFaceImageFormat format)
+{
+	return INT_MIN;
+}
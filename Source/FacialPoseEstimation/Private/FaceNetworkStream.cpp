@@ -0,0 +1,405 @@
+// Copyright 2020 NeuralVFX, Inc. All Rights Reserved.
+
+#include "FaceNetworkStream.h"
+#include "HAL/PlatformTime.h"
+#include "Misc/Guid.h"
+#include "Sockets.h"
+#include "SocketSubsystem.h"
+#include "IPAddress.h"
+#include "Common/UdpSocketBuilder.h"
+#include "Interfaces/IPv4/IPv4Endpoint.h"
+#include "FacialPoseStats.h"
+
+
+/** Fixed-point steps per unit - 0.01 of translation, about 0.0035 degrees of direction, 1/4096 of expression */
+static const float TranslationScale = 100.f;
+static const float DirectionScale = 16384.f;
+static const float ExpressionScale = 4096.f;
+
+/** Header as written, without struct padding */
+static const int32 HeaderSize = 40;
+
+
+static float GetChannelScale(int32 Channel)
+{
+	return Channel < 3 ? TranslationScale : Channel < 9 ? DirectionScale : ExpressionScale;
+}
+
+
+static void QuantizeFace(const FaceBatchData& Faces, int32 Face, int32* outChannels)
+{
+	const TransformData& Transform = Faces.transforms[Face];
+	const float Values[9] = {
+		Transform.tX, Transform.tY, Transform.tZ,
+		Transform.rfX, Transform.rfY, Transform.rfZ,
+		Transform.ruX, Transform.ruY, Transform.ruZ };
+
+	for (int32 i = 0; i < 9; i++)
+	{
+		outChannels[i] = FMath::RoundToInt(Values[i] * GetChannelScale(i));
+	}
+	const float* Expression = Faces.expressions + Face * 51;
+	for (int32 i = 0; i < 51; i++)
+	{
+		outChannels[9 + i] = FMath::RoundToInt(FMath::Clamp(Expression[i], 0.f, 1.f) * ExpressionScale);
+	}
+}
+
+
+static void DequantizeFace(const int32* Channels, FaceBatchData& outFaces, int32 Face)
+{
+	TransformData& Transform = outFaces.transforms[Face];
+	Transform.tX = Channels[0] / TranslationScale;
+	Transform.tY = Channels[1] / TranslationScale;
+	Transform.tZ = Channels[2] / TranslationScale;
+	Transform.rfX = Channels[3] / DirectionScale;
+	Transform.rfY = Channels[4] / DirectionScale;
+	Transform.rfZ = Channels[5] / DirectionScale;
+	Transform.ruX = Channels[6] / DirectionScale;
+	Transform.ruY = Channels[7] / DirectionScale;
+	Transform.ruZ = Channels[8] / DirectionScale;
+
+	float* Expression = outFaces.expressions + Face * 51;
+	for (int32 i = 0; i < 51; i++)
+	{
+		Expression[i] = Channels[9 + i] / ExpressionScale;
+	}
+}
+
+
+/** Little endian writes and bounds checked reads of packet fields */
+struct FStreamWriter
+{
+	uint8* Data;
+	int32 Pos;
+
+	template<typename T>
+	void Write(T Value)
+	{
+		FMemory::Memcpy(Data + Pos, &Value, sizeof(T));
+		Pos += sizeof(T);
+	}
+
+	/** Zigzag varint, small values of either sign take one byte */
+	void WriteVarint(int32 Value)
+	{
+		uint32 Zigzag = ((uint32)Value << 1) ^ (uint32)(Value >> 31);
+		while (Zigzag >= 0x80)
+		{
+			Data[Pos++] = (uint8)(Zigzag | 0x80);
+			Zigzag >>= 7;
+		}
+		Data[Pos++] = (uint8)Zigzag;
+	}
+};
+
+
+struct FStreamReader
+{
+	const uint8* Data;
+	int32 Pos;
+	int32 Size;
+	bool bError;
+
+	template<typename T>
+	T Read()
+	{
+		T Value = 0;
+		if (Pos + (int32)sizeof(T) > Size)
+		{
+			bError = true;
+			return Value;
+		}
+		FMemory::Memcpy(&Value, Data + Pos, sizeof(T));
+		Pos += sizeof(T);
+		return Value;
+	}
+
+	int32 ReadVarint()
+	{
+		uint32 Zigzag = 0;
+		for (int32 Shift = 0; Shift < 35; Shift += 7)
+		{
+			if (Pos >= Size)
+			{
+				break;
+			}
+			uint8 Byte = Data[Pos++];
+			Zigzag |= (uint32)(Byte & 0x7F) << Shift;
+			if ((Byte & 0x80) == 0)
+			{
+				return (int32)(Zigzag >> 1) ^ -(int32)(Zigzag & 1);
+			}
+		}
+		bError = true;
+		return 0;
+	}
+};
+
+
+FFaceStreamEncoder::FFaceStreamEncoder(int32 InKeyframeInterval) :
+	KeyframeInterval(FMath::Max(InKeyframeInterval, 1)), PacketsSinceKeyframe(KeyframeInterval), NextSequence(1), SessionId(FGuid::NewGuid().A), KeyframeSequence(0), KeyframeNumFaces(0)
+{
+	FMemory::Memzero(KeyframeTrackIds, sizeof(KeyframeTrackIds));
+	FMemory::Memzero(KeyframeChannels, sizeof(KeyframeChannels));
+}
+
+
+int32 FFaceStreamEncoder::Encode(const FaceBatchData& Faces, double CaptureTime, uint64 FrameId, uint8* outPacket)
+{
+	int32 NumFaces = FMath::Clamp(Faces.numFaces, 0, FACE_BATCH_MAX_FACES);
+	uint32 Sequence = NextSequence++;
+
+	// Deltas only hold up while the faces are the ones in the keyframe
+	bool bKeyframe = ++PacketsSinceKeyframe >= KeyframeInterval || NumFaces > KeyframeNumFaces;
+	for (int32 Face = 0; Face < NumFaces && !bKeyframe; Face++)
+	{
+		bKeyframe = Faces.trackIds[Face] != KeyframeTrackIds[Face];
+	}
+	if (bKeyframe)
+	{
+		PacketsSinceKeyframe = 0;
+		KeyframeSequence = Sequence;
+		KeyframeNumFaces = NumFaces;
+	}
+
+	FStreamWriter Writer = { outPacket, 0 };
+	Writer.Write<uint32>(FACE_STREAM_MAGIC);
+	Writer.Write<uint8>(FACE_STREAM_VERSION);
+	Writer.Write<uint8>(bKeyframe ? FACE_STREAM_KEYFRAME : 0);
+	Writer.Write<uint8>((uint8)NumFaces);
+	Writer.Write<uint8>(0);
+	Writer.Write<uint32>(Sequence);
+	Writer.Write<uint32>(KeyframeSequence);
+	Writer.Write<uint32>(SessionId);
+	Writer.Write<uint64>(FrameId);
+	Writer.Write<double>(CaptureTime);
+	Writer.Write<float>((float)(FPlatformTime::Seconds() - CaptureTime));
+
+	for (int32 Face = 0; Face < NumFaces; Face++)
+	{
+		int32 Channels[FACE_STREAM_CHANNELS];
+		QuantizeFace(Faces, Face, Channels);
+		Writer.WriteVarint(Faces.trackIds[Face]);
+
+		if (bKeyframe)
+		{
+			KeyframeTrackIds[Face] = Faces.trackIds[Face];
+			FMemory::Memcpy(KeyframeChannels[Face], Channels, sizeof(Channels));
+			for (int32 i = 0; i < FACE_STREAM_CHANNELS; i++)
+			{
+				Writer.WriteVarint(Channels[i]);
+			}
+			continue;
+		}
+
+		// Bit per channel which differs from the keyframe, then only those deltas
+		uint64 ChangeMask = 0;
+		for (int32 i = 0; i < FACE_STREAM_CHANNELS; i++)
+		{
+			ChangeMask |= (uint64)(Channels[i] != KeyframeChannels[Face][i]) << i;
+		}
+		Writer.Write<uint64>(ChangeMask);
+		for (int32 i = 0; i < FACE_STREAM_CHANNELS; i++)
+		{
+			if (ChangeMask & (1ull << i))
+			{
+				Writer.WriteVarint(Channels[i] - KeyframeChannels[Face][i]);
+			}
+		}
+	}
+	return Writer.Pos;
+}
+
+
+FFaceStreamDecoder::FFaceStreamDecoder() :
+	bHasKeyframe(false), bHasPacket(false), SessionId(0), LastSequence(0), NumLost(0), NumUndecodable(0), KeyframeSequence(0), KeyframeNumFaces(0)
+{
+	FMemory::Memzero(KeyframeTrackIds, sizeof(KeyframeTrackIds));
+	FMemory::Memzero(KeyframeChannels, sizeof(KeyframeChannels));
+}
+
+
+bool FFaceStreamDecoder::Decode(const uint8* Packet, int32 Size, FaceBatchData& outFaces, FFaceStreamHeader& outHeader)
+{
+	if (Size < HeaderSize)
+	{
+		return false;
+	}
+
+	FStreamReader Reader = { Packet, 0, Size, false };
+	FFaceStreamHeader Header;
+	Header.Magic = Reader.Read<uint32>();
+	Header.Version = Reader.Read<uint8>();
+	Header.Flags = Reader.Read<uint8>();
+	Header.NumFaces = Reader.Read<uint8>();
+	Header.Reserved = Reader.Read<uint8>();
+	Header.Sequence = Reader.Read<uint32>();
+	Header.KeyframeSequence = Reader.Read<uint32>();
+	Header.SessionId = Reader.Read<uint32>();
+	Header.FrameId = Reader.Read<uint64>();
+	Header.CaptureTime = Reader.Read<double>();
+	Header.CaptureAge = Reader.Read<float>();
+	if (Header.Magic != FACE_STREAM_MAGIC || Header.Version != FACE_STREAM_VERSION || Header.NumFaces > FACE_BATCH_MAX_FACES)
+	{
+		return false;
+	}
+
+	// A sender restart starts over, its sequence and keyframes have nothing to do with the last session's
+	if (bHasPacket && Header.SessionId != SessionId)
+	{
+		bHasPacket = false;
+		bHasKeyframe = false;
+	}
+
+	// Late packets are older than what the rig already has
+	if (bHasPacket && (int32)(Header.Sequence - LastSequence) <= 0)
+	{
+		return false;
+	}
+	if (bHasPacket)
+	{
+		NumLost += Header.Sequence - LastSequence - 1;
+	}
+	bHasPacket = true;
+	SessionId = Header.SessionId;
+	LastSequence = Header.Sequence;
+
+	bool bKeyframe = (Header.Flags & FACE_STREAM_KEYFRAME) != 0;
+	if (!bKeyframe && (!bHasKeyframe || Header.KeyframeSequence != KeyframeSequence || Header.NumFaces > KeyframeNumFaces))
+	{
+		NumUndecodable++;
+		return false;
+	}
+
+	int32 TrackIds[FACE_BATCH_MAX_FACES];
+	for (int32 Face = 0; Face < Header.NumFaces; Face++)
+	{
+		TrackIds[Face] = Reader.ReadVarint();
+		int32* FaceChannels = Channels[Face];
+		if (bKeyframe)
+		{
+			for (int32 i = 0; i < FACE_STREAM_CHANNELS; i++)
+			{
+				FaceChannels[i] = Reader.ReadVarint();
+			}
+			continue;
+		}
+
+		uint64 ChangeMask = Reader.Read<uint64>();
+		for (int32 i = 0; i < FACE_STREAM_CHANNELS; i++)
+		{
+			int32 Delta = (ChangeMask & (1ull << i)) ? Reader.ReadVarint() : 0;
+			FaceChannels[i] = KeyframeChannels[Face][i] + Delta;
+		}
+	}
+	if (Reader.bError)
+	{
+		return false;
+	}
+
+	// Whole packet read, now it may become the reference
+	if (bKeyframe)
+	{
+		bHasKeyframe = true;
+		KeyframeSequence = Header.Sequence;
+		KeyframeNumFaces = Header.NumFaces;
+		FMemory::Memcpy(KeyframeTrackIds, TrackIds, Header.NumFaces * sizeof(int32));
+		FMemory::Memcpy(KeyframeChannels, Channels, Header.NumFaces * sizeof(Channels[0]));
+	}
+
+	outFaces.numFaces = Header.NumFaces;
+	outFaces.frameId = (long long)Header.FrameId;
+	for (int32 Face = 0; Face < Header.NumFaces; Face++)
+	{
+		outFaces.trackIds[Face] = TrackIds[Face];
+		DequantizeFace(Channels[Face], outFaces, Face);
+	}
+	outHeader = Header;
+	return true;
+}
+
+
+FFaceNetworkPublisher::FFaceNetworkPublisher(int32 InKeyframeInterval) :
+	Socket(nullptr), Encoder(InKeyframeInterval), BytesSent(0)
+{
+}
+
+
+FFaceNetworkPublisher::~FFaceNetworkPublisher()
+{
+	Close();
+}
+
+
+bool FFaceNetworkPublisher::Open(const FString& Destinations)
+{
+	Close();
+
+	TArray<FString> Entries;
+	Destinations.ParseIntoArray(Entries, TEXT(","));
+	for (const FString& Entry : Entries)
+	{
+		FIPv4Endpoint Endpoint;
+		if (!FIPv4Endpoint::Parse(Entry.TrimStartAndEnd(), Endpoint))
+		{
+			UE_LOG(LogTemp, Warning, TEXT("Invalid Stream Endpoint: %s"), *Entry);
+			continue;
+		}
+		Endpoints.Add(Endpoint.ToInternetAddr());
+	}
+	if (Endpoints.Num() == 0)
+	{
+		UE_LOG(LogTemp, Error, TEXT("No Stream Endpoints in: %s"), *Destinations);
+		return false;
+	}
+
+	Socket = FUdpSocketBuilder(TEXT("FacePosePublisher"))
+		.AsNonBlocking()
+		.AsReusable()
+		.WithBroadcast()
+		.WithSendBufferSize(64 * 1024)
+		.Build();
+	if (Socket == nullptr)
+	{
+		UE_LOG(LogTemp, Error, TEXT("Could not Create Stream Socket"));
+		Endpoints.Empty();
+		return false;
+	}
+
+	UE_LOG(LogTemp, Log, TEXT("Streaming Tracking to: %s"), *Destinations);
+	return true;
+}
+
+
+void FFaceNetworkPublisher::Close()
+{
+	if (Socket != nullptr)
+	{
+		Socket->Close();
+		ISocketSubsystem::Get(PLATFORM_SOCKETSUBSYSTEM)->DestroySocket(Socket);
+		Socket = nullptr;
+	}
+	Endpoints.Empty();
+}
+
+
+void FFaceNetworkPublisher::PushFrame(const FaceBatchData& Faces, double CaptureTime, uint64 FrameId)
+{
+	SCOPE_CYCLE_COUNTER(STAT_FacialPose_NetworkSend);
+	TRACE_CPUPROFILER_EVENT_SCOPE(FacialPose_NetworkSend);
+
+	if (Socket == nullptr)
+	{
+		return;
+	}
+
+	int32 Size = Encoder.Encode(Faces, CaptureTime, FrameId, Packet);
+	for (const TSharedRef<FInternetAddr>& Endpoint : Endpoints)
+	{
+		int32 Sent = 0;
+		Socket->SendTo(Packet, Size, Sent, *Endpoint);
+	}
+	BytesSent += Size;
+	INC_DWORD_STAT_BY(STAT_FacialPose_NetworkBytesSent, Size);
+}
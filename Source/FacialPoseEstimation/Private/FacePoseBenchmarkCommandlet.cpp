@@ -0,0 +1,490 @@
+// Copyright 2020 NeuralVFX, Inc. All Rights Reserved.
+
+#include "FacePoseBenchmarkCommandlet.h"
+#include "ArFaceRig.h"
+#include "FaceSyntheticBackend.h"
+#include "FaceHostBackend.h"
+#include "FaceImagePool.h"
+#include "FaceRetarget.h"
+#include "FaceSmoothingSubsystem.h"
+#include "Engine/World.h"
+#include "RenderingThread.h"
+#include "UObject/UObjectArray.h"
+#include "HAL/PlatformTime.h"
+#include "HAL/MemoryBase.h"
+#include "Interfaces/IPluginManager.h"
+#include "Misc/FileHelper.h"
+#include "Misc/Paths.h"
+#include "Dom/JsonObject.h"
+#include "Serialization/JsonSerializer.h"
+#include "Serialization/JsonWriter.h"
+
+
+/**
+* Forwards to the real allocator, counting allocations of the thread which measures, while it measures.
+* Installed once and never removed, so other threads which read GMalloc around the swap always call a live allocator.
+*/
+class FFacePoseCountingMalloc : public FMalloc
+{
+public:
+
+	/** Put the counting allocator in front of GMalloc, once per process */
+	static void Install()
+	{
+		static FFacePoseCountingMalloc* Instance = nullptr;
+		if (Instance == nullptr)
+		{
+			Instance = new FFacePoseCountingMalloc(GMalloc);
+			GMalloc = Instance;
+		}
+	}
+
+	virtual void* Malloc(SIZE_T Count, uint32 Alignment) override
+	{
+		if (bCounting)
+		{
+			Allocations++;
+		}
+		return Inner->Malloc(Count, Alignment);
+	}
+
+	virtual void* Realloc(void* Original, SIZE_T Count, uint32 Alignment) override
+	{
+		if (bCounting)
+		{
+			Allocations++;
+		}
+		return Inner->Realloc(Original, Count, Alignment);
+	}
+
+	virtual void Free(void* Original) override { Inner->Free(Original); }
+	virtual SIZE_T QuantizeSize(SIZE_T Count, uint32 Alignment) override { return Inner->QuantizeSize(Count, Alignment); }
+	virtual bool GetAllocationSize(void* Original, SIZE_T& SizeOut) override { return Inner->GetAllocationSize(Original, SizeOut); }
+	virtual void Trim(bool bTrimThreadCaches) override { Inner->Trim(bTrimThreadCaches); }
+	virtual bool IsInternallyThreadSafe() const override { return Inner->IsInternallyThreadSafe(); }
+	virtual const TCHAR* GetDescriptiveName() override { return TEXT("FacePoseCountingMalloc"); }
+
+	/** Whether this thread's allocations are counted, and how many were */
+	static thread_local bool bCounting;
+	static thread_local int64 Allocations;
+
+private:
+
+	FFacePoseCountingMalloc(FMalloc* InInner) : Inner(InInner) {}
+
+	FMalloc* Inner;
+};
+
+thread_local bool FFacePoseCountingMalloc::bCounting = false;
+thread_local int64 FFacePoseCountingMalloc::Allocations = 0;
+
+
+/** Accumulated time of one pipeline stage */
+struct FFacePoseStageTimer
+{
+	FFacePoseStageTimer() : Cycles(0) {}
+
+	uint64 Cycles;
+
+	/** Mean milliseconds per frame */
+	double GetMs(int NumFrames) const
+	{
+		return FPlatformTime::ToMilliseconds64(Cycles) / FMath::Max(NumFrames, 1);
+	}
+};
+
+
+UFacePoseBenchmarkCommandlet::UFacePoseBenchmarkCommandlet()
+{
+	IsClient = false;
+	IsEditor = false;
+	IsServer = false;
+	LogToConsole = true;
+}
+
+
+/** Parse a comma separated list of ints from the command line */
+static TArray<int> ParseIntList(const FString& Params, const TCHAR* Key, TArray<int> Default)
+{
+	FString Value;
+	if (!FParse::Value(*Params, Key, Value))
+	{
+		return Default;
+	}
+
+	TArray<FString> Parts;
+	Value.ParseIntoArray(Parts, TEXT(","));
+
+	TArray<int> Result;
+	for (const FString& Part : Parts)
+	{
+		Result.Add(FCString::Atoi(*Part));
+	}
+	return Result;
+}
+
+
+int32 UFacePoseBenchmarkCommandlet::Main(const FString& Params)
+{
+	int NumFrames = 300;
+	FParse::Value(*Params, TEXT("frames="), NumFrames);
+
+	FString OutputPath = FPaths::ProjectSavedDir() / TEXT("FacePoseBenchmark.json");
+	FParse::Value(*Params, TEXT("output="), OutputPath);
+
+	TArray<int> RigCounts = ParseIntList(Params, TEXT("rigs="), { 1, 10, 100 });
+	TArray<int> ImageSizes = ParseIntList(Params, TEXT("sizes="), { 256, 512, 1024 });
+	TArray<int> CurveCounts = ParseIntList(Params, TEXT("curves="), { 51, 256, 1024 });
+	TArray<int> SmoothingCounts = ParseIntList(Params, TEXT("smoothing="), { 1, 10, 100, 1000 });
+
+	// Run every scenario
+	TArray<TSharedPtr<FJsonValue>> Scenarios;
+	for (int NumRigs : RigCounts)
+	{
+		for (int ImageSize : ImageSizes)
+		{
+			UE_LOG(LogTemp, Display, TEXT("FacePoseBenchmark: %d rigs, %dx%d image"), NumRigs, ImageSize, ImageSize);
+			Scenarios.Add(MakeShared<FJsonValueObject>(RunScenario(NumRigs, ImageSize, NumFrames)));
+		}
+	}
+
+	TArray<TSharedPtr<FJsonValue>> Retargets;
+	for (int NumCurves : CurveCounts)
+	{
+		UE_LOG(LogTemp, Display, TEXT("FacePoseBenchmark: retarget to %d curves"), NumCurves);
+		Retargets.Add(MakeShared<FJsonValueObject>(RunRetarget(NumCurves, NumFrames)));
+	}
+
+	TArray<TSharedPtr<FJsonValue>> Smoothings;
+	for (int NumRigs : SmoothingCounts)
+	{
+		UE_LOG(LogTemp, Display, TEXT("FacePoseBenchmark: smoothing %d rigs"), NumRigs);
+		Smoothings.Add(MakeShared<FJsonValueObject>(RunSmoothing(NumRigs, NumFrames)));
+	}
+
+	// Tag result with plugin version, to compare between releases
+	TSharedPtr<FJsonObject> Root = MakeShared<FJsonObject>();
+	TSharedPtr<IPlugin> Plugin = IPluginManager::Get().FindPlugin(TEXT("FacialPoseEstimation"));
+	Root->SetStringField(TEXT("plugin_version"), Plugin.IsValid() ? Plugin->GetDescriptor().VersionName : TEXT("unknown"));
+	Root->SetNumberField(TEXT("frames"), NumFrames);
+	Root->SetArrayField(TEXT("scenarios"), Scenarios);
+	Root->SetArrayField(TEXT("retarget"), Retargets);
+	Root->SetArrayField(TEXT("smoothing"), Smoothings);
+
+	// Host restart needs a real library and camera, so only when asked for
+	FString HostPath, LibraryPath;
+	if (FParse::Value(*Params, TEXT("host="), HostPath) && FParse::Value(*Params, TEXT("lib="), LibraryPath))
+	{
+		int CamId = 0;
+		FParse::Value(*Params, TEXT("camera="), CamId);
+		UE_LOG(LogTemp, Display, TEXT("FacePoseBenchmark: host restart"));
+		TSharedPtr<FJsonObject> HostRestart = RunHostRestart(HostPath, LibraryPath, CamId, NumFrames);
+		Root->SetObjectField(TEXT("host_restart"), HostRestart);
+		if (!HostRestart->GetBoolField(TEXT("recovered")))
+		{
+			UE_LOG(LogTemp, Error, TEXT("FacePoseBenchmark: Tracker Host did not Recover from a Crash"));
+		}
+	}
+
+	FString Json;
+	TSharedRef<TJsonWriter<>> Writer = TJsonWriterFactory<>::Create(&Json);
+	FJsonSerializer::Serialize(Root.ToSharedRef(), Writer);
+
+	if (!FFileHelper::SaveStringToFile(Json, *OutputPath))
+	{
+		UE_LOG(LogTemp, Error, TEXT("FacePoseBenchmark: Could not Write %s"), *OutputPath);
+		return 1;
+	}
+
+	UE_LOG(LogTemp, Display, TEXT("FacePoseBenchmark: Wrote %s"), *OutputPath);
+	return 0;
+}
+
+
+TSharedPtr<FJsonObject> UFacePoseBenchmarkCommandlet::RunScenario(int NumRigs, int ImageSize, int NumFrames)
+{
+	UWorld* World = UWorld::CreateWorld(EWorldType::Game, false);
+
+	// Blueprint carries the face mesh, fall back to the bare class
+	UClass* RigClass = LoadClass<AArFaceRig>(nullptr, TEXT("/FacialPoseEstimation/Blueprints/ArFaceRig_BP.ArFaceRig_BP_C"));
+	if (RigClass == nullptr)
+	{
+		RigClass = AArFaceRig::StaticClass();
+	}
+
+	// Synthetic source, as fast as possible with no simulated cost
+	UFaceSyntheticBackend* Backend = NewObject<UFaceSyntheticBackend>();
+	Backend->FrameRate = 0;
+	Backend->DetectCostMs = 0;
+	Backend->NumFaces = 1;
+
+	int CameraWidth = 1920;
+	int CameraHeight = 1080;
+	Backend->CallInitCV(CameraWidth, CameraHeight, 1, 0, 1, false, true);
+
+	TSharedPtr<FFaceImagePool, ESPMode::ThreadSafe> Pool =
+		MakeShared<FFaceImagePool, ESPMode::ThreadSafe>(4, ImageSize * ImageSize * 4);
+
+	// Spawn rigs, doing what BeginPlay would minus the game instance
+	TArray<AArFaceRig*> Rigs;
+	for (int i = 0; i < NumRigs; i++)
+	{
+		AArFaceRig* Rig = World->SpawnActor<AArFaceRig>(RigClass);
+		Rig->MaxFaces = 1;
+		// Stages are timed one by one, so transforms must be written by SetTransforms
+		Rig->bPredictPose = false;
+		Rig->ImagePool = Pool;
+		Rig->BindMorphTargets();
+		Rig->BuildFilters();
+		Rig->CreateFacePool();
+		Rig->CreateBackground(ImageSize, ImageSize);
+		Rigs.Add(Rig);
+	}
+	FlushRenderingCommands();
+
+	FFacePoseStageTimer Detect, ImageFetch, Smoothing, Transforms, BlendShapes, Background;
+	FaceBatchData Batch;
+	const float FrameDeltaTime = 1.f / 30.f;
+
+	// Count UObjects from here on, and allocations of the measured calls on this thread
+	FFacePoseCountingMalloc::Install();
+	FFacePoseCountingMalloc::Allocations = 0;
+	int32 StartObjects = GUObjectArray.GetObjectArrayNumMinusAvailable();
+
+	for (int Frame = 0; Frame < NumFrames; Frame++)
+	{
+		FFacePoseCountingMalloc::bCounting = true;
+		uint64 Start = FPlatformTime::Cycles64();
+		Backend->CallDetectFaces(Batch);
+		Detect.Cycles += FPlatformTime::Cycles64() - Start;
+
+		Start = FPlatformTime::Cycles64();
+		int32 ImageIndex = Pool->Acquire();
+		Backend->CallGetImageCV(Pool->GetData(ImageIndex), ImageSize, ImageSize);
+		Pool->Release(ImageIndex);
+		ImageFetch.Cycles += FPlatformTime::Cycles64() - Start;
+
+		for (AArFaceRig* Rig : Rigs)
+		{
+			Start = FPlatformTime::Cycles64();
+			Rig->BindFaces(Batch);
+			FArFaceInstance& Face = Rig->Faces[0];
+			Rig->SmoothBlendShapes(Face, Batch.expressions, FrameDeltaTime);
+			Smoothing.Cycles += FPlatformTime::Cycles64() - Start;
+
+			const TransformData& Transform = Batch.transforms[0];
+			Start = FPlatformTime::Cycles64();
+			Rig->SetTransforms(Face,
+				FVector(Transform.ruX, Transform.ruY, Transform.ruZ),
+				FVector(Transform.rfX, Transform.rfY, Transform.rfZ),
+				FVector(Transform.tZ, Transform.tX, -Transform.tY),
+				FrameDeltaTime);
+			Transforms.Cycles += FPlatformTime::Cycles64() - Start;
+
+			Start = FPlatformTime::Cycles64();
+			Rig->SetBlendShapes(Face, Face.BlendValues);
+			BlendShapes.Cycles += FPlatformTime::Cycles64() - Start;
+
+			// Pool runs dry while the render thread holds uploads, wait outside the timer
+			ImageIndex = Pool->Acquire();
+			if (ImageIndex == INDEX_NONE)
+			{
+				FFacePoseCountingMalloc::bCounting = false;
+				FlushRenderingCommands();
+				FFacePoseCountingMalloc::bCounting = true;
+				ImageIndex = Pool->Acquire();
+			}
+			Start = FPlatformTime::Cycles64();
+			Rig->SetBackground(ImageIndex);
+			Background.Cycles += FPlatformTime::Cycles64() - Start;
+		}
+
+		FFacePoseCountingMalloc::bCounting = false;
+		FlushRenderingCommands();
+	}
+
+	int32 EndObjects = GUObjectArray.GetObjectArrayNumMinusAvailable();
+
+	// Report
+	TSharedPtr<FJsonObject> Stages = MakeShared<FJsonObject>();
+	Stages->SetNumberField(TEXT("detect_ms"), Detect.GetMs(NumFrames));
+	Stages->SetNumberField(TEXT("image_fetch_ms"), ImageFetch.GetMs(NumFrames));
+	Stages->SetNumberField(TEXT("smoothing_ms"), Smoothing.GetMs(NumFrames));
+	Stages->SetNumberField(TEXT("set_transforms_ms"), Transforms.GetMs(NumFrames));
+	Stages->SetNumberField(TEXT("set_blendshapes_ms"), BlendShapes.GetMs(NumFrames));
+	Stages->SetNumberField(TEXT("set_background_ms"), Background.GetMs(NumFrames));
+
+	TSharedPtr<FJsonObject> Result = MakeShared<FJsonObject>();
+	Result->SetNumberField(TEXT("rigs"), NumRigs);
+	Result->SetNumberField(TEXT("image_size"), ImageSize);
+	Result->SetObjectField(TEXT("stages"), Stages);
+	Result->SetNumberField(TEXT("allocations_per_frame"), (double)FFacePoseCountingMalloc::Allocations / NumFrames);
+	Result->SetNumberField(TEXT("uobjects_per_frame"), (double)(EndObjects - StartObjects) / NumFrames);
+
+	// Tear down
+	Backend->CallCloseCV();
+	World->DestroyWorld(false);
+	CollectGarbage(GARBAGE_COLLECTION_KEEPFLAGS);
+
+	return Result;
+}
+
+
+TSharedPtr<FJsonObject> UFacePoseBenchmarkCommandlet::RunRetarget(int NumCurves, int NumFrames)
+{
+	// Each curve mixes four outputs, about what a hand made rig mapping has
+	TArray<FFaceRetargetCurve> Curves;
+	Curves.SetNum(NumCurves);
+	for (int i = 0; i < NumCurves; i++)
+	{
+		Curves[i].Name = FName(*FString::Printf(TEXT("Curve%d"), i));
+		for (int j = 0; j < 4; j++)
+		{
+			FFaceRetargetWeight Weight;
+			Weight.Source = (i * 7 + j * 13) % 51;
+			Weight.Weight = .25f + j * .1f;
+			Curves[i].Weights.Add(Weight);
+		}
+	}
+
+	FFaceRetargetMatrix Matrix;
+	Matrix.Compile(Curves);
+
+	alignas(16) float Source[FACE_FILTER_EXPRESSION_CHANNELS];
+	TArray<float, TAlignedHeapAllocator<16>> Values;
+	Values.SetNumZeroed(Matrix.GetNumPaddedTargets());
+
+	FFacePoseStageTimer Evaluate;
+	for (int Frame = 0; Frame < NumFrames; Frame++)
+	{
+		for (int i = 0; i < 51; i++)
+		{
+			Source[i] = FMath::Frac(Frame * .01f + i * .02f);
+		}
+
+		uint64 Start = FPlatformTime::Cycles64();
+		Matrix.Evaluate(Source, Values.GetData());
+		Evaluate.Cycles += FPlatformTime::Cycles64() - Start;
+	}
+
+	TSharedPtr<FJsonObject> Result = MakeShared<FJsonObject>();
+	Result->SetNumberField(TEXT("curves"), NumCurves);
+	Result->SetNumberField(TEXT("weights"), Matrix.GetNumWeights());
+	Result->SetNumberField(TEXT("evaluate_ms"), Evaluate.GetMs(NumFrames));
+	return Result;
+}
+
+
+TSharedPtr<FJsonObject> UFacePoseBenchmarkCommandlet::RunSmoothing(int NumRigs, int NumFrames)
+{
+	FFaceExpressionFilterParams Params;
+	const float FrameDeltaTime = 1.f / 30.f;
+
+	// Filter state spread over rigs, as each AArFaceRig keeps it
+	TArray<TUniquePtr<FFaceExpressionFilterState>> RigStates;
+	FFaceBatchFilter Batch;
+	for (int i = 0; i < NumRigs; i++)
+	{
+		RigStates.Add(MakeUnique<FFaceExpressionFilterState>());
+		Batch.Add(EFaceFilterType::OneEuro, Params);
+	}
+
+	alignas(16) float In[FACE_FILTER_EXPRESSION_CHANNELS] = { 0 };
+	FFacePoseStageTimer PerRig, Batched, Parallel;
+	for (int Frame = 0; Frame < NumFrames; Frame++)
+	{
+		for (int i = 0; i < 51; i++)
+		{
+			In[i] = FMath::Frac(Frame * .01f + i * .02f);
+		}
+
+		uint64 Start = FPlatformTime::Cycles64();
+		for (TUniquePtr<FFaceExpressionFilterState>& State : RigStates)
+		{
+			FFaceFilter::OneEuro(Params, *State, In, FrameDeltaTime);
+		}
+		PerRig.Cycles += FPlatformTime::Cycles64() - Start;
+
+		// Submitting is part of the batched cost, rigs copy their input in
+		Start = FPlatformTime::Cycles64();
+		for (int i = 0; i < NumRigs; i++)
+		{
+			Batch.Submit(i, In, FrameDeltaTime);
+		}
+		Batch.Filter(false, NumRigs);
+		Batched.Cycles += FPlatformTime::Cycles64() - Start;
+
+		Start = FPlatformTime::Cycles64();
+		for (int i = 0; i < NumRigs; i++)
+		{
+			Batch.Submit(i, In, FrameDeltaTime);
+		}
+		Batch.Filter(true, 64);
+		Parallel.Cycles += FPlatformTime::Cycles64() - Start;
+	}
+
+	TSharedPtr<FJsonObject> Result = MakeShared<FJsonObject>();
+	Result->SetNumberField(TEXT("rigs"), NumRigs);
+	Result->SetNumberField(TEXT("per_rig_ms"), PerRig.GetMs(NumFrames));
+	Result->SetNumberField(TEXT("batched_ms"), Batched.GetMs(NumFrames));
+	Result->SetNumberField(TEXT("parallel_ms"), Parallel.GetMs(NumFrames));
+	return Result;
+}
+
+
+TSharedPtr<FJsonObject> UFacePoseBenchmarkCommandlet::RunHostRestart(const FString& HostPath, const FString& LibraryPath, int CamId, int NumFrames)
+{
+	UFaceHostBackend* Backend = NewObject<UFaceHostBackend>();
+	Backend->HostPath = HostPath;
+	Backend->LibraryPath = LibraryPath;
+	Backend->bRestartHost = true;
+
+	TSharedPtr<FJsonObject> Result = MakeShared<FJsonObject>();
+	int CameraWidth = 0;
+	int CameraHeight = 0;
+	if (Backend->CallInitCV(CameraWidth, CameraHeight, 1, CamId, 1, false, true) == INT_MIN)
+	{
+		Result->SetBoolField(TEXT("recovered"), false);
+		return Result;
+	}
+
+	// Detects before the crash, and after it until enough came through or the host stays down
+	FaceBatchData Batch;
+	int FramesBefore = 0;
+	for (int Frame = 0; Frame < NumFrames / 2; Frame++)
+	{
+		FramesBefore += Backend->CallDetectFaces(Batch) == 1 ? 1 : 0;
+	}
+
+	Backend->SimulateHostCrash();
+	double CrashTime = FPlatformTime::Seconds();
+	double RecoverTime = -1;
+
+	int FramesAfter = 0;
+	int FailedDetects = 0;
+	double Deadline = CrashTime + Backend->HostTimeout * 2 + 60.0;
+	while (FramesAfter < NumFrames / 2 && FPlatformTime::Seconds() < Deadline)
+	{
+		if (Backend->CallDetectFaces(Batch) != 1)
+		{
+			FailedDetects++;
+			FPlatformProcess::Sleep(.01f);
+			continue;
+		}
+		if (RecoverTime < 0)
+		{
+			RecoverTime = FPlatformTime::Seconds();
+		}
+		FramesAfter++;
+	}
+
+	Result->SetNumberField(TEXT("frames_before"), FramesBefore);
+	Result->SetNumberField(TEXT("frames_after"), FramesAfter);
+	Result->SetNumberField(TEXT("failed_detects"), FailedDetects);
+	Result->SetNumberField(TEXT("restarts"), Backend->GetRestartCount());
+	Result->SetNumberField(TEXT("recover_ms"), RecoverTime < 0 ? -1 : (RecoverTime - CrashTime) * 1000.0);
+	Result->SetBoolField(TEXT("recovered"), Backend->GetRestartCount() > 0 && FramesAfter == NumFrames / 2);
+
+	Backend->CallCloseCV();
+	return Result;
+}
@@ -0,0 +1,96 @@
+// Copyright 2020 NeuralVFX, Inc. All Rights Reserved.
+
+#include "FacePoseHistory.h"
+
+
+FFacePoseHistory::FFacePoseHistory()
+{
+	Reset();
+}
+
+
+void FFacePoseHistory::Reset()
+{
+	Newest = MaxSamples - 1;
+	NumSamples = 0;
+}
+
+
+void FFacePoseHistory::Add(const FFacePoseSample& Sample)
+{
+	// Keep history ordered, a late sample has nothing to add
+	if (NumSamples > 0 && Sample.Time <= GetByAge(0).Time)
+	{
+		return;
+	}
+
+	Newest = (Newest + 1) % MaxSamples;
+	Samples[Newest] = Sample;
+	NumSamples = FMath::Min(NumSamples + 1, MaxSamples);
+}
+
+
+bool FFacePoseHistory::Sample(double Time, float MaxExtrapolation, FFacePoseSample& outSample) const
+{
+	if (NumSamples == 0)
+	{
+		return false;
+	}
+
+	const FFacePoseSample& Latest = GetByAge(0);
+	if (NumSamples == 1)
+	{
+		outSample = Latest;
+		return true;
+	}
+
+	// Past the newest sample, carry on along the last two
+	if (Time >= Latest.Time)
+	{
+		const FFacePoseSample& Prev = GetByAge(1);
+		double Ahead = FMath::Min(Time - Latest.Time, (double)MaxExtrapolation);
+		Blend(Prev, Latest, 1.f + Ahead / (Latest.Time - Prev.Time), outSample);
+		outSample.Time = Latest.Time + Ahead;
+		return true;
+	}
+
+	// Between two samples
+	for (int32 Age = 1; Age < NumSamples; Age++)
+	{
+		const FFacePoseSample& Older = GetByAge(Age);
+		if (Time >= Older.Time)
+		{
+			const FFacePoseSample& Newer = GetByAge(Age - 1);
+			Blend(Older, Newer, (Time - Older.Time) / (Newer.Time - Older.Time), outSample);
+			outSample.Time = Time;
+			return true;
+		}
+	}
+
+	// Before the oldest sample
+	outSample = GetByAge(NumSamples - 1);
+	return true;
+}
+
+
+void FFacePoseHistory::Blend(const FFacePoseSample& A, const FFacePoseSample& B, float Alpha, FFacePoseSample& outSample)
+{
+	outSample.Translation = FMath::Lerp(A.Translation, B.Translation, Alpha);
+
+	// Scale the rotation from A to B, which unlike Slerp also works past B
+	FQuat Delta = A.Rotation.Inverse() * B.Rotation;
+	if (Delta.W < 0)
+	{
+		Delta = Delta * -1.f;
+	}
+	FVector Axis;
+	float Angle;
+	Delta.ToAxisAndAngle(Axis, Angle);
+	outSample.Rotation = (A.Rotation * FQuat(Axis, Angle * Alpha)).GetNormalized();
+
+	// Blendshapes stay in range when extrapolated
+	for (int i = 0; i < 51; i++)
+	{
+		outSample.BlendValues[i] = FMath::Clamp(FMath::Lerp(A.BlendValues[i], B.BlendValues[i], Alpha), 0.f, 1.f);
+	}
+}
@@ -0,0 +1,429 @@
+// Copyright 2020 NeuralVFX, Inc. All Rights Reserved.
+
+#include "FacePoseProcessCommandlet.h"
+#include "cDataStorageWrapper.h"
+#include "FaceFilter.h"
+#include "FaceRecording.h"
+#include "Async/Async.h"
+#include "Async/ParallelFor.h"
+#include "HAL/FileManager.h"
+#include "HAL/PlatformTime.h"
+#include "HAL/ThreadSafeCounter64.h"
+#include "IImageWrapper.h"
+#include "IImageWrapperModule.h"
+#include "Misc/FileHelper.h"
+#include "Misc/Paths.h"
+#include "Modules/ModuleManager.h"
+#include "Dom/JsonObject.h"
+#include "Serialization/JsonSerializer.h"
+#include "Serialization/JsonWriter.h"
+
+
+/** Transform channels filtered offline - translation, forward and up, padded to whole registers */
+#define FACE_PROCESS_TRANSFORM_CHANNELS 12
+
+
+/** Frames moving through the pipeline together, each stage owns one batch at a time */
+struct FFaceProcessBatch
+{
+	int32 First;
+	int32 Count;
+
+	/** BGRA image per frame, buffers are reused across batches */
+	TArray<TArray<uint8>> Images;
+	TArray<bool> Decoded;
+	TArray<FaceBatchData> Faces;
+};
+
+
+/** Offline filter state of one track */
+struct FFaceProcessTrack
+{
+	TFaceFilterState<FACE_PROCESS_TRANSFORM_CHANNELS> Transform;
+	FFaceExpressionFilterState Expression;
+
+	/** Last frame the track was seen, tracks that left view start over */
+	int32 LastFrame;
+
+	FFaceProcessTrack() :
+		LastFrame(INDEX_NONE) {}
+};
+
+
+UFacePoseProcessCommandlet::UFacePoseProcessCommandlet()
+{
+	IsClient = false;
+	IsEditor = false;
+	IsServer = false;
+	LogToConsole = true;
+}
+
+
+/** Frames of an image sequence, from a folder or a wildcard pattern, in name order */
+static TArray<FString> FindSequence(const FString& Input)
+{
+	FString Folder = Input;
+	FString Pattern = TEXT("*.*");
+	if (Input.Contains(TEXT("*")))
+	{
+		Folder = FPaths::GetPath(Input);
+		Pattern = FPaths::GetCleanFilename(Input);
+	}
+
+	TArray<FString> Names;
+	IFileManager::Get().FindFiles(Names, *(Folder / Pattern), true, false);
+	Names.Sort();
+
+	TArray<FString> Paths;
+	for (const FString& Name : Names)
+	{
+		FString Extension = FPaths::GetExtension(Name).ToLower();
+		if (Extension == TEXT("png") || Extension == TEXT("jpg") || Extension == TEXT("jpeg") || Extension == TEXT("bmp"))
+		{
+			Paths.Add(Folder / Name);
+		}
+	}
+	return Paths;
+}
+
+
+/**
+* Decode one frame into a BGRA buffer.
+* @return Whether the frame decoded at the sequence's size.
+*/
+static bool DecodeFrame(IImageWrapperModule& ImageWrapperModule, const FString& Path, int32 Width, int32 Height, TArray<uint8>& outImage)
+{
+	TArray<uint8> Compressed;
+	if (!FFileHelper::LoadFileToArray(Compressed, *Path))
+	{
+		return false;
+	}
+
+	EImageFormat Format = ImageWrapperModule.DetectImageFormat(Compressed.GetData(), Compressed.Num());
+	TSharedPtr<IImageWrapper> Wrapper = ImageWrapperModule.CreateImageWrapper(Format);
+	if (!Wrapper.IsValid() || !Wrapper->SetCompressed(Compressed.GetData(), Compressed.Num()))
+	{
+		return false;
+	}
+	if (Wrapper->GetWidth() != Width || Wrapper->GetHeight() != Height)
+	{
+		UE_LOG(LogTemp, Warning, TEXT("FacePoseProcess: %s is %dx%d, expected %dx%d"), *Path, Wrapper->GetWidth(), Wrapper->GetHeight(), Width, Height);
+		return false;
+	}
+	return Wrapper->GetRaw(ERGBFormat::BGRA, 8, outImage);
+}
+
+
+int32 UFacePoseProcessCommandlet::Main(const FString& Params)
+{
+	FString Input;
+	FString OutputPath;
+	if (!FParse::Value(*Params, TEXT("input="), Input) || !FParse::Value(*Params, TEXT("output="), OutputPath))
+	{
+		UE_LOG(LogTemp, Error, TEXT("FacePoseProcess: Needs -input=<folder or pattern> and -output=<file>"));
+		return 1;
+	}
+
+	float Fps = 30.f;
+	int32 BatchSize = 8;
+	int32 DetectRatio = 1;
+	float FovZoom = 1.f;
+	int32 PreviewInterval = 0;
+	int32 PreviewSize = 256;
+	FString FilterName = TEXT("OneEuro");
+	FString CsvPath;
+	FString ReportPath;
+	FParse::Value(*Params, TEXT("fps="), Fps);
+	FParse::Value(*Params, TEXT("batch="), BatchSize);
+	FParse::Value(*Params, TEXT("detectratio="), DetectRatio);
+	FParse::Value(*Params, TEXT("fovzoom="), FovZoom);
+	FParse::Value(*Params, TEXT("preview="), PreviewInterval);
+	FParse::Value(*Params, TEXT("previewsize="), PreviewSize);
+	FParse::Value(*Params, TEXT("filter="), FilterName);
+	FParse::Value(*Params, TEXT("csv="), CsvPath);
+	FParse::Value(*Params, TEXT("report="), ReportPath);
+	Fps = FMath::Max(Fps, 1.f);
+	BatchSize = FMath::Clamp(BatchSize, 1, 256);
+
+	// Containers need a decoder the engine doesn't ship for commandlets, frames are extracted first
+	FString Extension = FPaths::GetExtension(Input).ToLower();
+	if (Extension == TEXT("mp4") || Extension == TEXT("mov") || Extension == TEXT("avi") || Extension == TEXT("mkv"))
+	{
+		UE_LOG(LogTemp, Error, TEXT("FacePoseProcess: Video files are read as image sequences, extract frames first, eg ffmpeg -i %s frames/%%06d.png"), *Input);
+		return 1;
+	}
+
+	TArray<FString> Frames = FindSequence(Input);
+	if (Frames.Num() == 0)
+	{
+		UE_LOG(LogTemp, Error, TEXT("FacePoseProcess: No Frames Found: %s"), *Input);
+		return 1;
+	}
+
+	// Sequence size comes from the first frame
+	IImageWrapperModule& ImageWrapperModule = FModuleManager::LoadModuleChecked<IImageWrapperModule>(FName("ImageWrapper"));
+	int32 Width = 0;
+	int32 Height = 0;
+	{
+		TArray<uint8> Compressed;
+		FFileHelper::LoadFileToArray(Compressed, *Frames[0]);
+		TSharedPtr<IImageWrapper> Wrapper = ImageWrapperModule.CreateImageWrapper(ImageWrapperModule.DetectImageFormat(Compressed.GetData(), Compressed.Num()));
+		if (!Wrapper.IsValid() || !Wrapper->SetCompressed(Compressed.GetData(), Compressed.Num()))
+		{
+			UE_LOG(LogTemp, Error, TEXT("FacePoseProcess: Could not Decode %s"), *Frames[0]);
+			return 1;
+		}
+		Width = Wrapper->GetWidth();
+		Height = Wrapper->GetHeight();
+	}
+
+	// Networks only, no camera
+	UcDataStorageWrapper* Library = NewObject<UcDataStorageWrapper>();
+	Library->AddToRoot();
+#if PLATFORM_WINDOWS
+	FString Folder = "facial-pose-estimation-unreal/Binaries/Win64";
+	FString LibName = "facial-pose-estimation-libtorch.dll";
+#else
+	FString Folder = "facial-pose-estimation-unreal/Binaries/Linux";
+	FString LibName = "libfacial-pose-estimation-libtorch.so";
+#endif
+	if (!Library->ImportDLL(Folder, LibName) || !Library->ImportMethods() || !Library->HasDetectImages())
+	{
+		UE_LOG(LogTemp, Error, TEXT("FacePoseProcess: Needs a DLL exporting DetectImages"));
+		Library->RemoveFromRoot();
+		return 1;
+	}
+	int CameraWidth = Width;
+	int CameraHeight = Height;
+	if (Library->CallInitCV(CameraWidth, CameraHeight, DetectRatio, -1, FovZoom, false, true) == INT_MIN)
+	{
+		UE_LOG(LogTemp, Error, TEXT("FacePoseProcess: Could not Initialize Networks"));
+		Library->RemoveFromRoot();
+		return 1;
+	}
+
+	FFaceSessionRecorder Recorder;
+	if (!Recorder.Open(OutputPath, FACE_BATCH_MAX_FACES, false, PreviewInterval, PreviewSize))
+	{
+		UE_LOG(LogTemp, Error, TEXT("FacePoseProcess: Could not Write %s"), *OutputPath);
+		Library->CallCloseCV();
+		Library->RemoveFromRoot();
+		return 1;
+	}
+
+	// Curves, one row per face per frame
+	if (!CsvPath.IsEmpty())
+	{
+		FString CsvHeader = TEXT("frame,time,track,tx,ty,tz,rfx,rfy,rfz,rux,ruy,ruz");
+		for (int32 i = 0; i < 51; i++)
+		{
+			CsvHeader += FString::Printf(TEXT(",e%d"), i);
+		}
+		FFileHelper::SaveStringToFile(CsvHeader + LINE_TERMINATOR, *CsvPath);
+	}
+
+	// Offline filters see every frame, so they run with fixed tuning and the sequence's frame time
+	EFaceFilterType FilterType = FilterName == TEXT("Kalman") ? EFaceFilterType::Kalman : EFaceFilterType::OneEuro;
+	bool bFilter = FilterName != TEXT("None");
+	TFaceFilterParams<FACE_PROCESS_TRANSFORM_CHANNELS> TransformParams;
+	FFaceExpressionFilterParams ExpressionParams;
+	TMap<int32, FFaceProcessTrack> Tracks;
+	const float FrameTime = 1.f / Fps;
+
+	// One batch decoding, one in inference and one filtering and writing
+	FFaceProcessBatch Batches[3];
+	for (FFaceProcessBatch& Batch : Batches)
+	{
+		Batch.Images.SetNum(BatchSize);
+		Batch.Decoded.SetNum(BatchSize);
+		Batch.Faces.SetNum(BatchSize);
+	}
+
+	FThreadSafeCounter64 DecodeCycles;
+	uint64 InferenceCycles = 0;
+	FThreadSafeCounter64 PostCycles;
+	int32 NumFailed = 0;
+
+	auto Decode = [&](FFaceProcessBatch& Batch)
+	{
+		uint64 Start = FPlatformTime::Cycles64();
+		ParallelFor(Batch.Count, [&](int32 i)
+		{
+			Batch.Decoded[i] = DecodeFrame(ImageWrapperModule, Frames[Batch.First + i], Width, Height, Batch.Images[i]);
+			if (!Batch.Decoded[i])
+			{
+				// Grey frame keeps the batch whole, its faces are dropped after inference
+				Batch.Images[i].SetNumUninitialized(Width * Height * 4);
+				FMemory::Memset(Batch.Images[i].GetData(), 128, Width * Height * 4);
+			}
+		});
+		DecodeCycles.Add(FPlatformTime::Cycles64() - Start);
+	};
+
+	auto PostProcess = [&](FFaceProcessBatch& Batch)
+	{
+		uint64 Start = FPlatformTime::Cycles64();
+		FString Csv;
+		for (int32 i = 0; i < Batch.Count; i++)
+		{
+			int32 FrameIndex = Batch.First + i;
+			FaceBatchData& Faces = Batch.Faces[i];
+			if (!Batch.Decoded[i])
+			{
+				Faces.numFaces = 0;
+				NumFailed++;
+			}
+			Faces.frameId = FrameIndex;
+
+			for (int32 f = 0; f < Faces.numFaces && bFilter; f++)
+			{
+				FFaceProcessTrack& Track = Tracks.FindOrAdd(Faces.trackIds[f]);
+				if (Track.LastFrame != FrameIndex - 1)
+				{
+					Track.Transform.Reset();
+					Track.Expression.Reset();
+				}
+				Track.LastFrame = FrameIndex;
+
+				// Axes are filtered as plain vectors and renormalized
+				TransformData& Transform = Faces.transforms[f];
+				alignas(16) float In[FACE_PROCESS_TRANSFORM_CHANNELS] = { Transform.tX, Transform.tY, Transform.tZ,
+					Transform.rfX, Transform.rfY, Transform.rfZ, Transform.ruX, Transform.ruY, Transform.ruZ };
+				alignas(16) float Expression[FACE_FILTER_EXPRESSION_CHANNELS] = { 0 };
+				FMemory::Memcpy(Expression, &Faces.expressions[f * 51], 51 * sizeof(float));
+				if (FilterType == EFaceFilterType::Kalman)
+				{
+					FFaceFilter::Kalman(TransformParams, Track.Transform, In, FrameTime);
+					FFaceFilter::Kalman(ExpressionParams, Track.Expression, Expression, FrameTime);
+				}
+				else
+				{
+					FFaceFilter::OneEuro(TransformParams, Track.Transform, In, FrameTime);
+					FFaceFilter::OneEuro(ExpressionParams, Track.Expression, Expression, FrameTime);
+				}
+
+				const float* Out = Track.Transform.Value;
+				FVector Forward = FVector(Out[3], Out[4], Out[5]).GetSafeNormal();
+				FVector Up = FVector(Out[6], Out[7], Out[8]).GetSafeNormal();
+				Transform = TransformData(Out[0], Out[1], Out[2], Forward.X, Forward.Y, Forward.Z, Up.X, Up.Y, Up.Z);
+				FMemory::Memcpy(&Faces.expressions[f * 51], Track.Expression.Value, 51 * sizeof(float));
+			}
+
+			double Time = FrameIndex / (double)Fps;
+			Recorder.WriteFrame(Time, Faces, Batch.Images[i].GetData(), Width, Height);
+
+			for (int32 f = 0; f < Faces.numFaces && !CsvPath.IsEmpty(); f++)
+			{
+				const TransformData& Transform = Faces.transforms[f];
+				Csv += FString::Printf(TEXT("%d,%.6f,%d,%f,%f,%f,%f,%f,%f,%f,%f,%f"), FrameIndex, Time, Faces.trackIds[f],
+					Transform.tX, Transform.tY, Transform.tZ, Transform.rfX, Transform.rfY, Transform.rfZ, Transform.ruX, Transform.ruY, Transform.ruZ);
+				for (int32 e = 0; e < 51; e++)
+				{
+					Csv += FString::Printf(TEXT(",%f"), Faces.expressions[f * 51 + e]);
+				}
+				Csv += LINE_TERMINATOR;
+			}
+		}
+
+		if (!Csv.IsEmpty())
+		{
+			FFileHelper::SaveStringToFile(Csv, *CsvPath, FFileHelper::EEncodingOptions::AutoDetect, &IFileManager::Get(), FILEWRITE_Append);
+		}
+		PostCycles.Add(FPlatformTime::Cycles64() - Start);
+	};
+
+	UE_LOG(LogTemp, Display, TEXT("FacePoseProcess: %d frames at %dx%d, batches of %d"), Frames.Num(), Width, Height, BatchSize);
+
+	// Stages overlap - while a batch is in inference, the next one decodes and the previous one is filtered and written
+	double StartTime = FPlatformTime::Seconds();
+	int32 NumBatches = FMath::DivideAndRoundUp(Frames.Num(), BatchSize);
+	TArray<const unsigned char*> ImagePointers;
+	ImagePointers.SetNum(BatchSize);
+	TFuture<void> DecodeDone;
+	TFuture<void> PostDone;
+
+	auto LaunchDecode = [&](int32 BatchIndex)
+	{
+		FFaceProcessBatch& Batch = Batches[BatchIndex % 3];
+		Batch.First = BatchIndex * BatchSize;
+		Batch.Count = FMath::Min(BatchSize, Frames.Num() - Batch.First);
+		DecodeDone = Async(EAsyncExecution::ThreadPool, [&Decode, &Batch]() { Decode(Batch); });
+	};
+
+	LaunchDecode(0);
+	for (int32 BatchIndex = 0; BatchIndex < NumBatches; BatchIndex++)
+	{
+		FFaceProcessBatch& Batch = Batches[BatchIndex % 3];
+		DecodeDone.Wait();
+
+		// Its slot was last filtered two batches ago, which finished before the previous batch started filtering
+		if (BatchIndex + 1 < NumBatches)
+		{
+			LaunchDecode(BatchIndex + 1);
+		}
+
+		uint64 Start = FPlatformTime::Cycles64();
+		for (int32 i = 0; i < Batch.Count; i++)
+		{
+			ImagePointers[i] = Batch.Images[i].GetData();
+		}
+		if (Library->CallDetectImages(ImagePointers.GetData(), Batch.Count, Width, Height, Batch.Faces.GetData()) == INT_MIN)
+		{
+			UE_LOG(LogTemp, Warning, TEXT("FacePoseProcess: Detect Failed on Frames %d to %d"), Batch.First, Batch.First + Batch.Count - 1);
+		}
+		InferenceCycles += FPlatformTime::Cycles64() - Start;
+
+		// Filters run in frame order, one batch at a time
+		if (PostDone.IsValid())
+		{
+			PostDone.Wait();
+		}
+		PostDone = Async(EAsyncExecution::ThreadPool, [&PostProcess, &Batch]() { PostProcess(Batch); });
+
+		if ((BatchIndex + 1) % 32 == 0)
+		{
+			double Elapsed = FPlatformTime::Seconds() - StartTime;
+			UE_LOG(LogTemp, Display, TEXT("FacePoseProcess: %d / %d frames, %.1f fps"), Batch.First + Batch.Count, Frames.Num(), (Batch.First + Batch.Count) / Elapsed);
+		}
+	}
+	if (PostDone.IsValid())
+	{
+		PostDone.Wait();
+	}
+	double Elapsed = FPlatformTime::Seconds() - StartTime;
+
+	Recorder.Close();
+	Library->CallCloseCV();
+	Library->RemoveFromRoot();
+
+	// Throughput, and where the time went per frame - decode and filtering overlap inference
+	double FramesPerSecond = Frames.Num() / FMath::Max(Elapsed, 1e-6);
+	double DecodeMs = FPlatformTime::ToMilliseconds64(DecodeCycles.GetValue()) / Frames.Num();
+	double InferenceMs = FPlatformTime::ToMilliseconds64(InferenceCycles) / Frames.Num();
+	double PostMs = FPlatformTime::ToMilliseconds64(PostCycles.GetValue()) / Frames.Num();
+	UE_LOG(LogTemp, Display, TEXT("FacePoseProcess: %d frames in %.2fs, %.1f fps - decode %.2f ms, inference %.2f ms, filter and write %.2f ms per frame, %d frames failed to decode"),
+		Frames.Num(), Elapsed, FramesPerSecond, DecodeMs, InferenceMs, PostMs, NumFailed);
+	UE_LOG(LogTemp, Display, TEXT("FacePoseProcess: Wrote %s"), *OutputPath);
+
+	if (!ReportPath.IsEmpty())
+	{
+		TSharedPtr<FJsonObject> Report = MakeShared<FJsonObject>();
+		Report->SetNumberField(TEXT("frames"), Frames.Num());
+		Report->SetNumberField(TEXT("width"), Width);
+		Report->SetNumberField(TEXT("height"), Height);
+		Report->SetNumberField(TEXT("batch"), BatchSize);
+		Report->SetNumberField(TEXT("seconds"), Elapsed);
+		Report->SetNumberField(TEXT("fps"), FramesPerSecond);
+		Report->SetNumberField(TEXT("decode_ms"), DecodeMs);
+		Report->SetNumberField(TEXT("inference_ms"), InferenceMs);
+		Report->SetNumberField(TEXT("filter_write_ms"), PostMs);
+		Report->SetNumberField(TEXT("failed_frames"), NumFailed);
+
+		FString Json;
+		TSharedRef<TJsonWriter<>> Writer = TJsonWriterFactory<>::Create(&Json);
+		FJsonSerializer::Serialize(Report.ToSharedRef(), Writer);
+		FFileHelper::SaveStringToFile(Json, *ReportPath);
+	}
+
+	return 0;
+}
@@ -0,0 +1,165 @@
+// Copyright 2020 NeuralVFX, Inc. All Rights Reserved.
+
+#include "FaceQualityGovernor.h"
+
+
+/** Preview scale and inference rate change by these steps */
+static const float PreviewScaleStep = .25f;
+static const float InferenceRateStep = 5.f;
+
+
+FFaceQualityGovernor::FFaceQualityGovernor()
+{
+	Reset(FFaceQualitySettings(), { 1, 1.f, 60.f });
+}
+
+
+void FFaceQualityGovernor::Reset(const FFaceQualitySettings& InSettings, const FFaceQualityState& InitialState)
+{
+	Settings = InSettings;
+	Settings.MaxDetectRatio = FMath::Max(Settings.MaxDetectRatio, Settings.MinDetectRatio);
+	Settings.MaxInferenceRate = FMath::Max(Settings.MaxInferenceRate, Settings.MinInferenceRate);
+
+	State.DetectRatio = FMath::Clamp(InitialState.DetectRatio, Settings.MinDetectRatio, Settings.MaxDetectRatio);
+	State.PreviewScale = FMath::Clamp(InitialState.PreviewScale, Settings.MinPreviewScale, 1.f);
+	State.MaxInferenceRate = FMath::Clamp(InitialState.MaxInferenceRate, Settings.MinInferenceRate, Settings.MaxInferenceRate);
+
+	FrameMsSum = 0;
+	NumFrames = 0;
+	InferenceMsSum = 0;
+	NumInferences = 0;
+	LastDecisionTime = 0;
+	Events.Reset();
+}
+
+
+void FFaceQualityGovernor::AddFrame(float FrameMs)
+{
+	FrameMsSum += FrameMs;
+	NumFrames++;
+}
+
+
+void FFaceQualityGovernor::AddInference(float InferenceMs)
+{
+	InferenceMsSum += InferenceMs;
+	NumInferences++;
+}
+
+
+bool FFaceQualityGovernor::Update(float Time)
+{
+	if (Time - LastDecisionTime < Settings.EvaluationInterval || NumFrames == 0)
+	{
+		return false;
+	}
+
+	float FrameMs = FrameMsSum / NumFrames;
+	float InferenceMs = NumInferences > 0 ? InferenceMsSum / NumInferences : 0;
+
+	// Start a fresh window either way
+	FrameMsSum = 0;
+	NumFrames = 0;
+	InferenceMsSum = 0;
+	NumInferences = 0;
+	LastDecisionTime = Time;
+
+	bool bFrameOver = FrameMs > Settings.TargetFrameMs * (1.f + Settings.Hysteresis);
+	bool bInferenceOver = InferenceMs > Settings.InferenceBudgetMs * (1.f + Settings.Hysteresis);
+	if (bFrameOver || bInferenceOver)
+	{
+		return Degrade(Time, FrameMs, InferenceMs, !bFrameOver);
+	}
+
+	bool bFrameUnder = FrameMs < Settings.TargetFrameMs * (1.f - Settings.Hysteresis);
+	bool bInferenceUnder = InferenceMs < Settings.InferenceBudgetMs * (1.f - Settings.Hysteresis);
+	if (bFrameUnder && bInferenceUnder)
+	{
+		return Improve(Time, FrameMs, InferenceMs);
+	}
+	return false;
+}
+
+
+bool FFaceQualityGovernor::Degrade(float Time, float FrameMs, float InferenceMs, bool bInferenceOnly)
+{
+	// Smaller detection image is the cheapest quality to give up
+	if (State.DetectRatio < Settings.MaxDetectRatio)
+	{
+		AddEvent(Time, TEXT("DetectRatio"), State.DetectRatio, State.DetectRatio + 1, FrameMs, InferenceMs);
+		State.DetectRatio++;
+		return true;
+	}
+
+	// Preview and rate only cost frame time
+	if (bInferenceOnly)
+	{
+		return false;
+	}
+
+	if (State.PreviewScale > Settings.MinPreviewScale)
+	{
+		float NewScale = FMath::Max(State.PreviewScale - PreviewScaleStep, Settings.MinPreviewScale);
+		AddEvent(Time, TEXT("PreviewScale"), State.PreviewScale, NewScale, FrameMs, InferenceMs);
+		State.PreviewScale = NewScale;
+		return true;
+	}
+
+	if (State.MaxInferenceRate > Settings.MinInferenceRate)
+	{
+		float NewRate = FMath::Max(State.MaxInferenceRate - InferenceRateStep, Settings.MinInferenceRate);
+		AddEvent(Time, TEXT("MaxInferenceRate"), State.MaxInferenceRate, NewRate, FrameMs, InferenceMs);
+		State.MaxInferenceRate = NewRate;
+		return true;
+	}
+	return false;
+}
+
+
+bool FFaceQualityGovernor::Improve(float Time, float FrameMs, float InferenceMs)
+{
+	// Undo in reverse order of Degrade
+	if (State.MaxInferenceRate < Settings.MaxInferenceRate)
+	{
+		float NewRate = FMath::Min(State.MaxInferenceRate + InferenceRateStep, Settings.MaxInferenceRate);
+		AddEvent(Time, TEXT("MaxInferenceRate"), State.MaxInferenceRate, NewRate, FrameMs, InferenceMs);
+		State.MaxInferenceRate = NewRate;
+		return true;
+	}
+
+	if (State.PreviewScale < 1.f)
+	{
+		float NewScale = FMath::Min(State.PreviewScale + PreviewScaleStep, 1.f);
+		AddEvent(Time, TEXT("PreviewScale"), State.PreviewScale, NewScale, FrameMs, InferenceMs);
+		State.PreviewScale = NewScale;
+		return true;
+	}
+
+	if (State.DetectRatio > Settings.MinDetectRatio)
+	{
+		AddEvent(Time, TEXT("DetectRatio"), State.DetectRatio, State.DetectRatio - 1, FrameMs, InferenceMs);
+		State.DetectRatio--;
+		return true;
+	}
+	return false;
+}
+
+
+void FFaceQualityGovernor::AddEvent(float Time, FName Setting, float OldValue, float NewValue, float FrameMs, float InferenceMs)
+{
+	UE_LOG(LogTemp, Log, TEXT("Quality Governor: %s %g -> %g (Frame %.1f ms, Inference %.1f ms)"),
+		*Setting.ToString(), OldValue, NewValue, FrameMs, InferenceMs);
+
+	if (Events.Num() == MaxEvents)
+	{
+		Events.RemoveAt(0);
+	}
+
+	FFaceQualityEvent& Event = Events.AddDefaulted_GetRef();
+	Event.Time = Time;
+	Event.Setting = Setting;
+	Event.OldValue = OldValue;
+	Event.NewValue = NewValue;
+	Event.FrameMs = FrameMs;
+	Event.InferenceMs = InferenceMs;
+}
@@ -0,0 +1,336 @@
+// Copyright 2020 NeuralVFX, Inc. All Rights Reserved.
+
+#include "FaceRecording.h"
+#include "HAL/PlatformFilemanager.h"
+#include "GenericPlatform/GenericPlatformFile.h"
+#include "Async/MappedFileHandle.h"
+
+
+static_assert(sizeof(FFaceRecordingHeader) == 48, "Recording header layout changed");
+
+/** Frames per chunk, previews of a chunk are stored right after its frames */
+static const uint32 RecordingFramesPerChunk = 256;
+
+
+/** Size of one face inside a frame record */
+static uint32 GetFaceRecordSize(uint32 Flags)
+{
+	uint32 ExpressionSize = (Flags & FACE_RECORDING_QUANTIZED) ? sizeof(uint16) : sizeof(float);
+	return sizeof(int32) + 9 * sizeof(float) + 51 * ExpressionSize;
+}
+
+
+/** Number of previews stored in each chunk */
+static uint32 GetPreviewsPerChunk(const FFaceRecordingHeader& Header)
+{
+	return Header.PreviewInterval > 0 ? FMath::DivideAndRoundUp(Header.FramesPerChunk, Header.PreviewInterval) : 0;
+}
+
+
+FFaceSessionRecorder::FFaceSessionRecorder() :
+	File(nullptr), FramesInChunk(0)
+{
+	FMemory::Memzero(Header);
+}
+
+
+FFaceSessionRecorder::~FFaceSessionRecorder()
+{
+	Close();
+}
+
+
+bool FFaceSessionRecorder::Open(const FString& Path, int InMaxFaces, bool bQuantize, int InPreviewInterval, int InPreviewSize)
+{
+	Close();
+
+	File = FPlatformFileManager::Get().GetPlatformFile().OpenWrite(*Path);
+	if (File == nullptr)
+	{
+		UE_LOG(LogTemp, Error, TEXT("Could not Open Recording: %s"), *Path);
+		return false;
+	}
+
+	// Describe layout
+	Header.Magic = FACE_RECORDING_MAGIC;
+	Header.Version = FACE_RECORDING_VERSION;
+	Header.Flags = bQuantize ? FACE_RECORDING_QUANTIZED : 0;
+	Header.MaxFaces = FMath::Clamp(InMaxFaces, 1, FACE_BATCH_MAX_FACES);
+	Header.FramesPerChunk = RecordingFramesPerChunk;
+	Header.PreviewInterval = FMath::Max(InPreviewInterval, 0);
+	Header.PreviewWidth = Header.PreviewInterval > 0 ? InPreviewSize : 0;
+	Header.PreviewHeight = Header.PreviewWidth;
+	Header.RecordSize = sizeof(double) + sizeof(int32) + Header.MaxFaces * GetFaceRecordSize(Header.Flags);
+	Header.ChunkSize = Header.FramesPerChunk * Header.RecordSize
+		+ GetPreviewsPerChunk(Header) * Header.PreviewWidth * Header.PreviewHeight * 4;
+	Header.NumFrames = 0;
+
+	File->Write((const uint8*)&Header, sizeof(Header));
+
+	// Chunk is allocated once and reused
+	Chunk.SetNumZeroed(Header.ChunkSize);
+	FramesInChunk = 0;
+
+	UE_LOG(LogTemp, Log, TEXT("Recording Opened: %s"), *Path);
+	return true;
+}
+
+
+void FFaceSessionRecorder::WriteFrame(double Time, const FaceBatchData& Faces, const uint8* Image, int Width, int Height, EFaceImageFormat Format)
+{
+	if (File == nullptr)
+	{
+		return;
+	}
+
+	// Frame record
+	uint8* Record = Chunk.GetData() + FramesInChunk * Header.RecordSize;
+	int32 NumFaces = FMath::Min<int32>(Faces.numFaces, Header.MaxFaces);
+	FMemory::Memcpy(Record, &Time, sizeof(double));
+	Record += sizeof(double);
+	FMemory::Memcpy(Record, &NumFaces, sizeof(int32));
+	Record += sizeof(int32);
+
+	for (uint32 Face = 0; Face < Header.MaxFaces; Face++)
+	{
+		// Unused faces stay zeroed
+		if ((int32)Face >= NumFaces)
+		{
+			FMemory::Memzero(Record, GetFaceRecordSize(Header.Flags));
+			Record += GetFaceRecordSize(Header.Flags);
+			continue;
+		}
+
+		FMemory::Memcpy(Record, &Faces.trackIds[Face], sizeof(int32));
+		Record += sizeof(int32);
+		FMemory::Memcpy(Record, &Faces.transforms[Face], 9 * sizeof(float));
+		Record += 9 * sizeof(float);
+
+		const float* Expression = &Faces.expressions[Face * 51];
+		if (Header.Flags & FACE_RECORDING_QUANTIZED)
+		{
+			for (int i = 0; i < 51; i++)
+			{
+				uint16 Value = (uint16)FMath::RoundToInt(FMath::Clamp(Expression[i], 0.f, 1.f) * 65535.f);
+				FMemory::Memcpy(Record, &Value, sizeof(uint16));
+				Record += sizeof(uint16);
+			}
+		}
+		else
+		{
+			FMemory::Memcpy(Record, Expression, 51 * sizeof(float));
+			Record += 51 * sizeof(float);
+		}
+	}
+
+	// Nearest-neighbour preview every PreviewInterval frames
+	if (Header.PreviewInterval > 0 && FramesInChunk % Header.PreviewInterval == 0)
+	{
+		uint32 PreviewBytes = Header.PreviewWidth * Header.PreviewHeight * 4;
+		uint8* Preview = Chunk.GetData() + Header.FramesPerChunk * Header.RecordSize
+			+ (FramesInChunk / Header.PreviewInterval) * PreviewBytes;
+
+		if (Image != nullptr && Format != EFaceImageFormat::BGRA)
+		{
+			// Y plane is a full size greyscale image
+			for (uint32 y = 0; y < Header.PreviewHeight; y++)
+			{
+				const uint8* SrcRow = Image + (y * Height / Header.PreviewHeight) * Width;
+				for (uint32 x = 0; x < Header.PreviewWidth; x++)
+				{
+					uint8 Luma = SrcRow[x * Width / Header.PreviewWidth];
+					uint8* Dst = Preview + (y * Header.PreviewWidth + x) * 4;
+					Dst[0] = Dst[1] = Dst[2] = Luma;
+					Dst[3] = 255;
+				}
+			}
+		}
+		else if (Image != nullptr)
+		{
+			for (uint32 y = 0; y < Header.PreviewHeight; y++)
+			{
+				const uint8* SrcRow = Image + (y * Height / Header.PreviewHeight) * Width * 4;
+				for (uint32 x = 0; x < Header.PreviewWidth; x++)
+				{
+					FMemory::Memcpy(Preview + (y * Header.PreviewWidth + x) * 4,
+						SrcRow + (x * Width / Header.PreviewWidth) * 4, 4);
+				}
+			}
+		}
+		else
+		{
+			FMemory::Memzero(Preview, PreviewBytes);
+		}
+	}
+
+	FramesInChunk++;
+	if (FramesInChunk == Header.FramesPerChunk)
+	{
+		FlushChunk();
+	}
+}
+
+
+void FFaceSessionRecorder::FlushChunk()
+{
+	if (FramesInChunk == 0)
+	{
+		return;
+	}
+
+	// Chunks are always written whole, so frame offsets stay fixed
+	File->Write(Chunk.GetData(), Chunk.Num());
+	Header.NumFrames += FramesInChunk;
+	FramesInChunk = 0;
+
+	// Keep header current, so a crash only loses the open chunk
+	int64 End = File->Tell();
+	File->Seek(0);
+	File->Write((const uint8*)&Header, sizeof(Header));
+	File->Seek(End);
+}
+
+
+void FFaceSessionRecorder::Close()
+{
+	if (File == nullptr)
+	{
+		return;
+	}
+
+	FlushChunk();
+	File->Flush();
+	delete File;
+	File = nullptr;
+
+	UE_LOG(LogTemp, Log, TEXT("Recording Closed, Frames: %llu"), Header.NumFrames);
+}
+
+
+FFaceSessionReader::FFaceSessionReader() :
+	MappedFile(nullptr), MappedRegion(nullptr), Data(nullptr), NumFrames(0)
+{
+	FMemory::Memzero(Header);
+}
+
+
+FFaceSessionReader::~FFaceSessionReader()
+{
+	Close();
+}
+
+
+bool FFaceSessionReader::Open(const FString& Path)
+{
+	Close();
+
+	MappedFile = FPlatformFileManager::Get().GetPlatformFile().OpenMapped(*Path);
+	if (MappedFile == nullptr || MappedFile->GetFileSize() < (int64)sizeof(FFaceRecordingHeader))
+	{
+		UE_LOG(LogTemp, Error, TEXT("Could not Map Recording: %s"), *Path);
+		Close();
+		return false;
+	}
+
+	MappedRegion = MappedFile->MapRegion(0, MappedFile->GetFileSize());
+	if (MappedRegion == nullptr)
+	{
+		UE_LOG(LogTemp, Error, TEXT("Could not Map Recording: %s"), *Path);
+		Close();
+		return false;
+	}
+	Data = MappedRegion->GetMappedPtr();
+
+	// Validate header
+	FMemory::Memcpy(&Header, Data, sizeof(Header));
+	if (Header.Magic != FACE_RECORDING_MAGIC || Header.Version != FACE_RECORDING_VERSION || Header.ChunkSize == 0)
+	{
+		UE_LOG(LogTemp, Error, TEXT("Not a Recording: %s"), *Path);
+		Close();
+		return false;
+	}
+
+	// Trust only chunks which are fully on disk
+	int64 NumChunks = (MappedFile->GetFileSize() - sizeof(Header)) / Header.ChunkSize;
+	NumFrames = FMath::Min<int64>(Header.NumFrames, NumChunks * Header.FramesPerChunk);
+
+	UE_LOG(LogTemp, Log, TEXT("Recording Mapped: %s, Frames: %lld"), *Path, NumFrames);
+	return true;
+}
+
+
+void FFaceSessionReader::Close()
+{
+	delete MappedRegion;
+	MappedRegion = nullptr;
+	delete MappedFile;
+	MappedFile = nullptr;
+	Data = nullptr;
+	NumFrames = 0;
+}
+
+
+const uint8* FFaceSessionReader::GetRecord(int64 Index) const
+{
+	int64 ChunkIndex = Index / Header.FramesPerChunk;
+	int64 FrameInChunk = Index % Header.FramesPerChunk;
+	return Data + sizeof(Header) + ChunkIndex * Header.ChunkSize + FrameInChunk * Header.RecordSize;
+}
+
+
+double FFaceSessionReader::ReadFrame(int64 Index, FaceBatchData& outFaces) const
+{
+	const uint8* Record = GetRecord(Index);
+
+	double Time;
+	int32 NumFaces;
+	FMemory::Memcpy(&Time, Record, sizeof(double));
+	Record += sizeof(double);
+	FMemory::Memcpy(&NumFaces, Record, sizeof(int32));
+	Record += sizeof(int32);
+
+	outFaces.numFaces = FMath::Clamp<int32>(NumFaces, 0, Header.MaxFaces);
+	for (int32 Face = 0; Face < outFaces.numFaces; Face++)
+	{
+		FMemory::Memcpy(&outFaces.trackIds[Face], Record, sizeof(int32));
+		Record += sizeof(int32);
+		FMemory::Memcpy(&outFaces.transforms[Face], Record, 9 * sizeof(float));
+		Record += 9 * sizeof(float);
+
+		float* Expression = &outFaces.expressions[Face * 51];
+		if (Header.Flags & FACE_RECORDING_QUANTIZED)
+		{
+			for (int i = 0; i < 51; i++)
+			{
+				uint16 Value;
+				FMemory::Memcpy(&Value, Record, sizeof(uint16));
+				Expression[i] = Value / 65535.f;
+				Record += sizeof(uint16);
+			}
+		}
+		else
+		{
+			FMemory::Memcpy(Expression, Record, 51 * sizeof(float));
+			Record += 51 * sizeof(float);
+		}
+	}
+
+	return Time;
+}
+
+
+const uint8* FFaceSessionReader::GetPreview(int64 Index) const
+{
+	if (Header.PreviewInterval == 0)
+	{
+		return nullptr;
+	}
+
+	int64 ChunkIndex = Index / Header.FramesPerChunk;
+	int64 FrameInChunk = Index % Header.FramesPerChunk;
+	uint32 PreviewBytes = Header.PreviewWidth * Header.PreviewHeight * 4;
+
+	return Data + sizeof(Header) + ChunkIndex * Header.ChunkSize
+		+ Header.FramesPerChunk * Header.RecordSize
+		+ (FrameInChunk / Header.PreviewInterval) * PreviewBytes;
+}
@@ -0,0 +1,170 @@
+// Copyright 2020 NeuralVFX, Inc. All Rights Reserved.
+
+#include "FaceReplayBackend.h"
+#include "HAL/PlatformProcess.h"
+#include "HAL/PlatformTime.h"
+
+
+/** Seconds between returns of the held last frame, once a recording which doesn't loop has ended */
+static const float HeldFrameInterval = 1.f / 30.f;
+
+
+UFaceReplayBackend::UFaceReplayBackend()
+{
+	Speed = 1;
+	bLoop = true;
+
+	FrameIndex = 0;
+	CurrentFrame = INDEX_NONE;
+	PendingSeek = INDEX_NONE;
+	StartWallTime = 0;
+	StartFrameTime = 0;
+}
+
+
+void UFaceReplayBackend::SeekToFrame(int64 Index)
+{
+	FPlatformAtomics::InterlockedExchange(&PendingSeek, FMath::Max<int64>(Index, 0));
+}
+
+
+int UFaceReplayBackend::CallInitCV(int& outCameraWidth, int& outCameraHeight, int detectRatio,
+	int camId, float fovZoom, bool draw, bool lockEyesNose)
+{
+	if (!Reader.Open(FilePath))
+	{
+		return INT_MIN;
+	}
+
+	FrameIndex = 0;
+	CurrentFrame = INDEX_NONE;
+	StartWallTime = -1;
+
+	return 1;
+}
+
+
+int UFaceReplayBackend::CallCloseCV()
+{
+	Reader.Close();
+	UE_LOG(LogTemp, Log, TEXT("Replay Closed"));
+
+	return 1;
+}
+
+
+int UFaceReplayBackend::CallDetectFaces(FaceBatchData& outFaces)
+{
+	outFaces.numFaces = 0;
+	int64 NumFrames = Reader.GetNumFrames();
+	if (NumFrames == 0)
+	{
+		return INT_MIN;
+	}
+
+	// Apply seek, restarting the clock
+	int64 Seek = FPlatformAtomics::InterlockedExchange(&PendingSeek, (int64)INDEX_NONE);
+	if (Seek != INDEX_NONE)
+	{
+		FrameIndex = FMath::Min(Seek, NumFrames - 1);
+		StartWallTime = -1;
+	}
+
+	// End of recording, the clock restarts with the first frame
+	if (FrameIndex >= NumFrames && bLoop)
+	{
+		FrameIndex = 0;
+		StartWallTime = -1;
+	}
+
+	// Otherwise the last frame is held until a seek, paced like a camera which stopped moving so detects don't spin
+	if (FrameIndex >= NumFrames)
+	{
+		FPlatformProcess::Sleep(HeldFrameInterval);
+		Reader.ReadFrame(NumFrames - 1, outFaces);
+		outFaces.captureAge = 0;
+		outFaces.frameId = NumFrames;
+		CurrentFrame = NumFrames - 1;
+		return 1;
+	}
+
+	double FrameTime = Reader.ReadFrame(FrameIndex, outFaces);
+
+	// Wait until the frame is due
+	double Now = FPlatformTime::Seconds();
+	if (StartWallTime < 0)
+	{
+		StartWallTime = Now;
+		StartFrameTime = FrameTime;
+	}
+	if (Speed > 0)
+	{
+		double DueTime = StartWallTime + (FrameTime - StartFrameTime) / Speed;
+		if (DueTime > Now)
+		{
+			FPlatformProcess::Sleep(DueTime - Now);
+		}
+	}
+
+	// Frame counts as captured when it is due
+	outFaces.captureAge = 0;
+	outFaces.frameId = FrameIndex + 1;
+
+	CurrentFrame = FrameIndex;
+	FrameIndex++;
+
+	return 1;
+}
+
+
+int UFaceReplayBackend::CallDetect(TransformData& outTransform, float* outExpression)
+{
+	FaceBatchData Faces;
+	int Result = CallDetectFaces(Faces);
+	if (Faces.numFaces > 0)
+	{
+		outTransform = Faces.transforms[0];
+		FMemory::Memcpy(outExpression, Faces.expressions, 51 * sizeof(float));
+	}
+
+	return Result;
+}
+
+
+int UFaceReplayBackend::CallReconfigure(int detectRatio)
+{
+	// Results are recorded, nothing to tune
+	return 1;
+}
+
+
+int UFaceReplayBackend::CallGetImageCV(unsigned char* image, int width, int height)
+{
+	const uint8* Preview = CurrentFrame != INDEX_NONE ? Reader.GetPreview(CurrentFrame) : nullptr;
+	if (Preview == nullptr)
+	{
+		FMemory::Memset(image, 128, width * height * 4);
+		return 1;
+	}
+
+	// Nearest-neighbour upscale of the preview
+	const FFaceRecordingHeader& Header = Reader.GetHeader();
+	for (int y = 0; y < height; y++)
+	{
+		const uint8* SrcRow = Preview + (y * Header.PreviewHeight / height) * Header.PreviewWidth * 4;
+		uint8* DstRow = image + y * width * 4;
+		for (int x = 0; x < width; x++)
+		{
+			FMemory::Memcpy(DstRow + x * 4, SrcRow + (x * Header.PreviewWidth / width) * 4, 4);
+		}
+	}
+
+	return 1;
+}
+
+
+int UFaceReplayBackend::CallGetImageYUV(unsigned char* image, int width, int height, EFaceImageFormat format)
+{
+	// Previews are stored as BGRA
+	return INT_MIN;
+}
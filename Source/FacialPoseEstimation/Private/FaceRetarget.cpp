@@ -0,0 +1,135 @@
+// Copyright 2020 NeuralVFX, Inc. All Rights Reserved.
+
+#include "FaceRetarget.h"
+#include "Math/VectorRegister.h"
+
+
+void FFaceRetargetMatrix::Compile(const TArray<FFaceRetargetCurve>& Curves)
+{
+	Names.Reset(Curves.Num());
+	RowStart.Reset(Curves.Num() + 1);
+	Columns.Reset();
+	Weights.Reset();
+	Gain.Reset();
+	Offset.Reset();
+	Min.Reset();
+	Max.Reset();
+
+	RowStart.Add(0);
+	for (const FFaceRetargetCurve& Curve : Curves)
+	{
+		// Merge weights per source first, so each source appears once in a row
+		float Row[51] = { 0 };
+		for (const FFaceRetargetWeight& Each : Curve.Weights)
+		{
+			if (Each.Source < 0 || Each.Source >= 51)
+			{
+				UE_LOG(LogTemp, Warning, TEXT("Retarget Curve %s has Source %d, Expected 0 to 50"), *Curve.Name.ToString(), Each.Source);
+				continue;
+			}
+			Row[Each.Source] += Each.Weight;
+		}
+
+		int32 Start = Columns.Num();
+		for (int32 i = 0; i < 51; i++)
+		{
+			if (Row[i] != 0.f)
+			{
+				Columns.Add(i);
+				Weights.Add(Row[i]);
+			}
+		}
+
+		// Pad the row to whole registers, reading source 0 with no weight
+		while ((Columns.Num() - Start) % 4 != 0)
+		{
+			Columns.Add(0);
+			Weights.Add(0.f);
+		}
+		RowStart.Add(Columns.Num());
+
+		Names.Add(Curve.Name);
+		Gain.Add(Curve.Gain);
+		Offset.Add(Curve.Offset);
+		Min.Add(Curve.Min);
+		Max.Add(Curve.Max);
+	}
+
+	// Padding curves always come out 0
+	while (Gain.Num() % 4 != 0)
+	{
+		Gain.Add(0.f);
+		Offset.Add(0.f);
+		Min.Add(0.f);
+		Max.Add(0.f);
+	}
+}
+
+
+void FFaceRetargetMatrix::Evaluate(const float* Source, float* outValues) const
+{
+	const int32* Column = Columns.GetData();
+	const float* Weight = Weights.GetData();
+
+	// Weighted sum of each row, four weights per multiply-add
+	alignas(16) float Lanes[4];
+	for (int32 Row = 0; Row < Names.Num(); Row++)
+	{
+		VectorRegister Sum = VectorZero();
+		for (int32 i = RowStart[Row]; i < RowStart[Row + 1]; i += 4)
+		{
+			VectorRegister Values = MakeVectorRegister(Source[Column[i]], Source[Column[i + 1]], Source[Column[i + 2]], Source[Column[i + 3]]);
+			Sum = VectorMultiplyAdd(VectorLoadAligned(Weight + i), Values, Sum);
+		}
+		VectorStoreAligned(Sum, Lanes);
+		outValues[Row] = Lanes[0] + Lanes[1] + Lanes[2] + Lanes[3];
+	}
+	for (int32 Row = Names.Num(); Row < Gain.Num(); Row++)
+	{
+		outValues[Row] = 0.f;
+	}
+
+	// Gain, offset and clamp four curves at a time
+	for (int32 i = 0; i < Gain.Num(); i += 4)
+	{
+		VectorRegister Value = VectorMultiplyAdd(VectorLoadAligned(outValues + i), VectorLoadAligned(Gain.GetData() + i), VectorLoadAligned(Offset.GetData() + i));
+		Value = VectorMin(VectorMax(Value, VectorLoadAligned(Min.GetData() + i)), VectorLoadAligned(Max.GetData() + i));
+		VectorStoreAligned(Value, outValues + i);
+	}
+}
+
+
+TSharedPtr<const FFaceRetargetMatrix, ESPMode::ThreadSafe> UFaceRetargetAsset::GetMatrix()
+{
+	if (!Matrix.IsValid())
+	{
+		Compile();
+	}
+	return Matrix;
+}
+
+
+void UFaceRetargetAsset::Compile()
+{
+	TSharedPtr<FFaceRetargetMatrix, ESPMode::ThreadSafe> NewMatrix = MakeShared<FFaceRetargetMatrix, ESPMode::ThreadSafe>();
+	NewMatrix->Compile(Curves);
+	Matrix = NewMatrix;
+
+	UE_LOG(LogTemp, Log, TEXT("Compiled Retarget %s: %d Curves, %d Weights"), *GetName(), NewMatrix->GetNumTargets(), NewMatrix->GetNumWeights());
+}
+
+
+void UFaceRetargetAsset::PostLoad()
+{
+	Super::PostLoad();
+	Compile();
+}
+
+
+#if WITH_EDITOR
+void UFaceRetargetAsset::PostEditChangeProperty(FPropertyChangedEvent& PropertyChangedEvent)
+{
+	Super::PostEditChangeProperty(PropertyChangedEvent);
+	Compile();
+}
+#endif
@@ -0,0 +1,210 @@
+// Copyright 2020 NeuralVFX, Inc. All Rights Reserved.
+
+#include "FaceSmoothingSubsystem.h"
+#include "ArFaceRig.h"
+#include "Async/ParallelFor.h"
+#include "Engine/World.h"
+#include "FacialPoseStats.h"
+
+
+int32 FFaceBatchFilter::Add(EFaceFilterType Type, const FFaceExpressionFilterParams& Params)
+{
+	int32 Slot = FreeSlots.Num() > 0 ? FreeSlots.Pop(false) : INDEX_NONE;
+	if (Slot == INDEX_NONE)
+	{
+		// Arrays grow together, a slot at a time
+		Slot = Slots.AddUninitialized();
+		int32 NumChannels = Slots.Num() * FACE_FILTER_EXPRESSION_CHANNELS;
+		for (TArray<float, TAlignedHeapAllocator<16>>* Channels : { &MinCutoff, &Beta, &DerivativeCutoff, &ProcessNoise,
+			&MeasurementNoise, &Input, &Value, &Derivative, &P00, &P01, &P11 })
+		{
+			Channels->SetNumZeroed(NumChannels);
+		}
+	}
+
+	int32 Base = Slot * FACE_FILTER_EXPRESSION_CHANNELS;
+	int32 Size = FACE_FILTER_EXPRESSION_CHANNELS * sizeof(float);
+	FMemory::Memcpy(MinCutoff.GetData() + Base, Params.MinCutoff, Size);
+	FMemory::Memcpy(Beta.GetData() + Base, Params.Beta, Size);
+	FMemory::Memcpy(DerivativeCutoff.GetData() + Base, Params.DerivativeCutoff, Size);
+	FMemory::Memcpy(ProcessNoise.GetData() + Base, Params.ProcessNoise, Size);
+	FMemory::Memcpy(MeasurementNoise.GetData() + Base, Params.MeasurementNoise, Size);
+
+	Slots[Slot] = { Type, 0.f, false, false };
+	return Slot;
+}
+
+
+void FFaceBatchFilter::Remove(int32 Slot)
+{
+	Slots[Slot].bPending = false;
+	FreeSlots.Add(Slot);
+}
+
+
+void FFaceBatchFilter::Reset(int32 Slot)
+{
+	Slots[Slot].bInitialized = false;
+}
+
+
+void FFaceBatchFilter::Submit(int32 Slot, const float* Expression, float DeltaTime)
+{
+	// Padding channel stays 0
+	FMemory::Memcpy(Input.GetData() + Slot * FACE_FILTER_EXPRESSION_CHANNELS, Expression, 51 * sizeof(float));
+	Slots[Slot].DeltaTime = DeltaTime;
+	Slots[Slot].bPending = true;
+}
+
+
+void FFaceBatchFilter::Filter(bool bParallel, int32 SlotsPerChunk)
+{
+	Filtered.Reset();
+	for (int32 i = 0; i < Slots.Num(); i++)
+	{
+		if (Slots[i].bPending)
+		{
+			Filtered.Add(i);
+			Slots[i].bPending = false;
+		}
+	}
+
+	int32 ChunkSize = bParallel ? FMath::Max(SlotsPerChunk, 1) : FMath::Max(Filtered.Num(), 1);
+	int32 NumChunks = FMath::DivideAndRoundUp(Filtered.Num(), ChunkSize);
+	ParallelFor(NumChunks, [this, ChunkSize](int32 Chunk)
+	{
+		FilterRange(Chunk * ChunkSize, FMath::Min((Chunk + 1) * ChunkSize, Filtered.Num()));
+	}, !bParallel);
+}
+
+
+void FFaceBatchFilter::FilterRange(int32 Begin, int32 End)
+{
+	int32 i = Begin;
+	while (i < End)
+	{
+		int32 First = Filtered[i];
+		const FSlot& Head = Slots[First];
+
+		// Neighbouring slots stepping by the same time are one run of channels to the kernel
+		int32 Count = 1;
+		if (Head.bInitialized)
+		{
+			while (i + Count < End && Filtered[i + Count] == First + Count)
+			{
+				const FSlot& Next = Slots[First + Count];
+				if (!Next.bInitialized || Next.Type != Head.Type || Next.DeltaTime != Head.DeltaTime)
+				{
+					break;
+				}
+				Count++;
+			}
+		}
+
+		int32 Base = First * FACE_FILTER_EXPRESSION_CHANNELS;
+		int32 NumChannels = Count * FACE_FILTER_EXPRESSION_CHANNELS;
+		bool& bInitialized = Slots[First].bInitialized;
+		if (Head.Type == EFaceFilterType::Kalman)
+		{
+			FFaceFilter::Kalman(ProcessNoise.GetData() + Base, MeasurementNoise.GetData() + Base,
+				Value.GetData() + Base, Derivative.GetData() + Base, P00.GetData() + Base, P01.GetData() + Base, P11.GetData() + Base,
+				bInitialized, Input.GetData() + Base, NumChannels, Head.DeltaTime);
+		}
+		else
+		{
+			FFaceFilter::OneEuro(MinCutoff.GetData() + Base, Beta.GetData() + Base, DerivativeCutoff.GetData() + Base,
+				Value.GetData() + Base, Derivative.GetData() + Base,
+				bInitialized, Input.GetData() + Base, NumChannels, Head.DeltaTime);
+		}
+
+		i += Count;
+	}
+}
+
+
+UFaceSmoothingSubsystem::UFaceSmoothingSubsystem()
+{
+	bParallel = true;
+	SlotsPerChunk = 64;
+}
+
+
+void UFaceSmoothingSubsystem::Initialize(FSubsystemCollectionBase& Collection)
+{
+	Super::Initialize(Collection);
+	PostActorTickHandle = FWorldDelegates::OnWorldPostActorTick.AddUObject(this, &UFaceSmoothingSubsystem::OnWorldPostActorTick);
+}
+
+
+void UFaceSmoothingSubsystem::Deinitialize()
+{
+	FWorldDelegates::OnWorldPostActorTick.Remove(PostActorTickHandle);
+	Super::Deinitialize();
+}
+
+
+int32 UFaceSmoothingSubsystem::AddFace(AArFaceRig* Rig, int32 FaceIndex, EFaceFilterType Type, const FFaceExpressionFilterParams& Params)
+{
+	int32 Slot = Batch.Add(Type, Params);
+	if (Owners.Num() <= Slot)
+	{
+		Owners.SetNum(Slot + 1);
+	}
+	Owners[Slot] = { Rig, FaceIndex, 0 };
+
+	SET_DWORD_STAT(STAT_FacialPose_BatchedFaces, Batch.Num());
+	return Slot;
+}
+
+
+void UFaceSmoothingSubsystem::RemoveFace(int32 Slot)
+{
+	Batch.Remove(Slot);
+	Owners[Slot].Rig.Reset();
+
+	SET_DWORD_STAT(STAT_FacialPose_BatchedFaces, Batch.Num());
+}
+
+
+void UFaceSmoothingSubsystem::ResetFace(int32 Slot)
+{
+	Batch.Reset(Slot);
+}
+
+
+void UFaceSmoothingSubsystem::Submit(int32 Slot, const float* Expression, float DeltaTime, double CaptureTime)
+{
+	Batch.Submit(Slot, Expression, DeltaTime);
+	Owners[Slot].CaptureTime = CaptureTime;
+}
+
+
+void UFaceSmoothingSubsystem::Update()
+{
+	{
+		SCOPE_CYCLE_COUNTER(STAT_FacialPose_BatchSmoothing);
+		TRACE_CPUPROFILER_EVENT_SCOPE(UFaceSmoothingSubsystem_Filter);
+		Batch.Filter(bParallel, SlotsPerChunk);
+	}
+
+	// Components are only touched from the game thread
+	SCOPE_CYCLE_COUNTER(STAT_FacialPose_BatchScatter);
+	TRACE_CPUPROFILER_EVENT_SCOPE(UFaceSmoothingSubsystem_Scatter);
+	for (int32 Slot : Batch.GetFiltered())
+	{
+		const FOwner& Owner = Owners[Slot];
+		if (AArFaceRig* Rig = Owner.Rig.Get())
+		{
+			Rig->ApplySmoothedBlendShapes(Owner.FaceIndex, Batch.GetValue(Slot), Owner.CaptureTime);
+		}
+	}
+}
+
+
+void UFaceSmoothingSubsystem::OnWorldPostActorTick(UWorld* InWorld, ELevelTick TickType, float DeltaSeconds)
+{
+	if (InWorld == GetWorld())
+	{
+		Update();
+	}
+}
@@ -0,0 +1,149 @@
+// Copyright 2020 NeuralVFX, Inc. All Rights Reserved.
+
+#include "FaceSyntheticBackend.h"
+#include "HAL/PlatformProcess.h"
+#include "HAL/PlatformTime.h"
+
+
+UFaceSyntheticBackend::UFaceSyntheticBackend()
+{
+	FrameRate = 30;
+	DetectCostMs = 0;
+	NumFaces = 1;
+
+	FrameIndex = 0;
+	NextFrameTime = 0;
+	DetectRatio = 1;
+}
+
+
+int UFaceSyntheticBackend::CallInitCV(int& outCameraWidth, int& outCameraHeight, int detectRatio,
+	int camId, float fovZoom, bool draw, bool lockEyesNose)
+{
+	// Keep whatever resolution was asked for
+	FrameIndex = 0;
+	NextFrameTime = FPlatformTime::Seconds();
+	DetectRatio = FMath::Max(detectRatio, 1);
+
+	UE_LOG(LogTemp, Log, TEXT("Synthetic Backend Opened %dx%d"), outCameraWidth, outCameraHeight);
+
+	return 1;
+}
+
+
+int UFaceSyntheticBackend::CallCloseCV()
+{
+	UE_LOG(LogTemp, Log, TEXT("Synthetic Backend Closed"));
+
+	return 1;
+}
+
+
+void UFaceSyntheticBackend::Throttle()
+{
+	// Wait for next frame
+	if (FrameRate > 0)
+	{
+		double Now = FPlatformTime::Seconds();
+		if (NextFrameTime > Now)
+		{
+			FPlatformProcess::Sleep(NextFrameTime - Now);
+		}
+		NextFrameTime = FMath::Max(NextFrameTime, Now) + 1.0 / FrameRate;
+	}
+
+	// Burn inference cost
+	double CostEnd = FPlatformTime::Seconds() + DetectCostMs / (1000.0 * DetectRatio * DetectRatio);
+	while (FPlatformTime::Seconds() < CostEnd)
+	{
+	}
+}
+
+
+void UFaceSyntheticBackend::BuildFace(int Face, TransformData& outTransform, float* outExpression) const
+{
+	float Time = FrameIndex / 30.f + Face * 1.7f;
+
+	// Head sways in front of the camera, side by side per face
+	outTransform.tX = FMath::Sin(Time * .5f) * 5.f + (Face - (NumFaces - 1) * .5f) * 20.f;
+	outTransform.tY = FMath::Sin(Time * .7f) * 3.f;
+	outTransform.tZ = 60.f + FMath::Sin(Time * .3f) * 5.f;
+
+	// Small yaw and pitch around facing the camera
+	float Yaw = FMath::Sin(Time * .9f) * .3f;
+	float Pitch = FMath::Sin(Time * 1.1f) * .15f;
+	outTransform.rfX = FMath::Sin(Yaw);
+	outTransform.rfY = FMath::Sin(Pitch);
+	outTransform.rfZ = -FMath::Cos(Yaw) * FMath::Cos(Pitch);
+	outTransform.ruX = 0;
+	outTransform.ruY = -FMath::Cos(Pitch);
+	outTransform.ruZ = -FMath::Sin(Pitch);
+
+	// Every blendshape on its own phase
+	for (int i = 0; i < 51; i++)
+	{
+		outExpression[i] = .5f + .5f * FMath::Sin(Time * (1.f + i * .05f) + i);
+	}
+}
+
+
+int UFaceSyntheticBackend::CallDetect(TransformData& outTransform, float* outExpression)
+{
+	Throttle();
+	BuildFace(0, outTransform, outExpression);
+	FrameIndex++;
+
+	return 1;
+}
+
+
+int UFaceSyntheticBackend::CallDetectFaces(FaceBatchData& outFaces)
+{
+	Throttle();
+
+	outFaces.numFaces = FMath::Clamp(NumFaces, 0, FACE_BATCH_MAX_FACES);
+	for (int i = 0; i < outFaces.numFaces; i++)
+	{
+		outFaces.trackIds[i] = i;
+		BuildFace(i, outFaces.transforms[i], &outFaces.expressions[i * 51]);
+	}
+
+	// Frame counts as captured before the simulated inference
+	outFaces.captureAge = DetectCostMs / (1000.0 * DetectRatio * DetectRatio);
+	outFaces.frameId = ++FrameIndex;
+
+	return 1;
+}
+
+
+int UFaceSyntheticBackend::CallReconfigure(int detectRatio)
+{
+	DetectRatio = FMath::Max(detectRatio, 1);
+
+	return 1;
+}
+
+
+int UFaceSyntheticBackend::CallGetImageCV(unsigned char* image, int width, int height)
+{
+	// Scrolling BGRA gradient, one memset per row
+	for (int y = 0; y < height; y++)
+	{
+		FMemory::Memset(image + y * width * 4, (uint8)((y + FrameIndex) & 255), width * 4);
+	}
+
+	return 1;
+}
+
+
+int UFaceSyntheticBackend::CallGetImageYUV(unsigned char* image, int width, int height, EFaceImageFormat format)
+{
+	// Same gradient as luma, neutral chroma fills both NV12 and I420 layouts
+	for (int y = 0; y < height; y++)
+	{
+		FMemory::Memset(image + y * width, (uint8)((y + FrameIndex) & 255), width);
+	}
+	FMemory::Memset(image + width * height, 128, width * height / 2);
+
+	return 1;
+}
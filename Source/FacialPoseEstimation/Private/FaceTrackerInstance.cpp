@@ -0,0 +1,242 @@
+// Copyright 2020 NeuralVFX, Inc. All Rights Reserved.
+
+#include "FaceTrackerInstance.h"
+#include "HAL/Event.h"
+#include "HAL/PlatformProcess.h"
+#include "HAL/PlatformTime.h"
+#include "Misc/ScopeLock.h"
+#include "FacialPoseStats.h"
+
+
+FFaceDetectScheduler::FFaceDetectScheduler(UcDataStorageWrapper* InLibrary, float InBatchWindowMs) :
+	Library(InLibrary), BatchWindowMs(InBatchWindowMs), NumTrackers(0), NumTracking(0), bHasLeader(false), LastBatchSize(0)
+{
+}
+
+
+void FFaceDetectScheduler::AddTracker(void* Tracker)
+{
+	// Batch arrays only grow while no batch is in flight
+	FScopeLock InferenceScope(&InferenceLock);
+	FScopeLock ScopeLock(&Lock);
+	NumTrackers++;
+
+	Pending.Reserve(NumTrackers);
+	Batch.Reserve(NumTrackers);
+	BatchTrackers.Reserve(NumTrackers);
+	if (BatchFaces.Num() < NumTrackers)
+	{
+		BatchFaces.SetNum(NumTrackers);
+	}
+}
+
+
+void FFaceDetectScheduler::RemoveTracker(void* Tracker)
+{
+	FScopeLock ScopeLock(&Lock);
+	NumTrackers = FMath::Max(NumTrackers - 1, 0);
+}
+
+
+void FFaceDetectScheduler::SetTrackerTracking(void* Tracker, bool bTracking)
+{
+	FScopeLock ScopeLock(&Lock);
+	NumTracking = FMath::Max(NumTracking + (bTracking ? 1 : -1), 0);
+}
+
+
+int FFaceDetectScheduler::Detect(void* Tracker, FaceBatchData& outFaces)
+{
+	FRequest Request = { Tracker, &outFaces, INT_MIN, FPlatformProcess::GetSynchEventFromPool() };
+
+	bool bLeader = false;
+	{
+		FScopeLock ScopeLock(&Lock);
+		Pending.Add(&Request);
+		bLeader = !bHasLeader;
+		bHasLeader = true;
+	}
+
+	if (bLeader)
+	{
+		// Give the other tracking cameras a moment to join, unless all of them already have
+		double Deadline = FPlatformTime::Seconds() + BatchWindowMs / 1000.0;
+		while (FPlatformTime::Seconds() < Deadline)
+		{
+			{
+				FScopeLock ScopeLock(&Lock);
+				if (Pending.Num() >= NumTracking)
+				{
+					break;
+				}
+			}
+			FPlatformProcess::Sleep(.0002f);
+		}
+
+		// Requests keep joining while the previous batch is in the DLL
+		FScopeLock InferenceScope(&InferenceLock);
+		{
+			FScopeLock ScopeLock(&Lock);
+			Batch = Pending;
+			Pending.Reset();
+			bHasLeader = false;
+		}
+
+		BatchTrackers.Reset();
+		for (FRequest* Each : Batch)
+		{
+			BatchTrackers.Add(Each->Tracker);
+		}
+		LastBatchSize = Batch.Num();
+		SET_DWORD_STAT(STAT_FacialPose_TrackersPerBatch, LastBatchSize);
+
+		int Result = Library->CallDetectTrackers(BatchTrackers.GetData(), Batch.Num(), BatchFaces.GetData());
+
+		// Hand results back, the leader's own is among them
+		for (int32 i = 0; i < Batch.Num(); i++)
+		{
+			FMemory::Memcpy(Batch[i]->Faces, &BatchFaces[i], sizeof(FaceBatchData));
+			Batch[i]->Result = Result;
+			Batch[i]->Done->Trigger();
+		}
+	}
+
+	Request.Done->Wait();
+	FPlatformProcess::ReturnSynchEventToPool(Request.Done);
+
+	return Request.Result;
+}
+
+
+UFaceTrackerInstance::UFaceTrackerInstance()
+{
+	Library = nullptr;
+	Tracker = nullptr;
+	bOpen = false;
+	bTracking = false;
+}
+
+
+bool UFaceTrackerInstance::Create(UcDataStorageWrapper* InLibrary, TSharedPtr<FFaceDetectScheduler, ESPMode::ThreadSafe> InScheduler)
+{
+	Destroy();
+
+	Library = InLibrary;
+	Scheduler = InScheduler;
+	Tracker = Library != nullptr ? Library->CallCreateTracker() : nullptr;
+	if (Tracker == nullptr)
+	{
+		UE_LOG(LogTemp, Error, TEXT("Could not Create Tracker Instance"));
+		return false;
+	}
+	return true;
+}
+
+
+void UFaceTrackerInstance::Destroy()
+{
+	if (Tracker == nullptr)
+	{
+		return;
+	}
+
+	CallCloseCV();
+	Library->CallDestroyTracker(Tracker);
+	Tracker = nullptr;
+}
+
+
+void UFaceTrackerInstance::BeginDestroy()
+{
+	Destroy();
+	Super::BeginDestroy();
+}
+
+
+void UFaceTrackerInstance::SetTracking(bool bInTracking)
+{
+	// Only an open camera is worth waiting for
+	bInTracking = bInTracking && bOpen;
+	if (bInTracking == bTracking)
+	{
+		return;
+	}
+	bTracking = bInTracking;
+	Scheduler->SetTrackerTracking(Tracker, bTracking);
+}
+
+
+int UFaceTrackerInstance::CallInitCV(int& outCameraWidth, int& outCameraHeight, int detectRatio,
+	int camId, float fovZoom, bool draw, bool lockEyesNose)
+{
+	if (Tracker == nullptr)
+	{
+		return INT_MIN;
+	}
+
+	int Result = Library->CallInitTracker(Tracker, outCameraWidth, outCameraHeight, detectRatio, camId, fovZoom, draw, lockEyesNose);
+	if (Result != INT_MIN && !bOpen)
+	{
+		bOpen = true;
+		Scheduler->AddTracker(Tracker);
+	}
+	return Result;
+}
+
+
+int UFaceTrackerInstance::CallCloseCV()
+{
+	if (!bOpen)
+	{
+		return 1;
+	}
+
+	// Batches stop waiting for this camera first
+	SetTracking(false);
+	bOpen = false;
+	Scheduler->RemoveTracker(Tracker);
+	return Library->CallCloseTracker(Tracker);
+}
+
+
+int UFaceTrackerInstance::CallDetectFaces(FaceBatchData& outFaces)
+{
+	if (!bOpen)
+	{
+		outFaces.numFaces = 0;
+		return INT_MIN;
+	}
+	return Scheduler->Detect(Tracker, outFaces);
+}
+
+
+int UFaceTrackerInstance::CallDetect(TransformData& outTransform, float* outExpression)
+{
+	FaceBatchData Faces;
+	int Result = CallDetectFaces(Faces);
+	if (Faces.numFaces > 0)
+	{
+		outTransform = Faces.transforms[0];
+		FMemory::Memcpy(outExpression, Faces.expressions, 51 * sizeof(float));
+	}
+
+	return Result;
+}
+
+
+int UFaceTrackerInstance::CallReconfigure(int detectRatio)
+{
+	return Library != nullptr ? Library->CallReconfigureTracker(Tracker, detectRatio) : INT_MIN;
+}
+
+
+int UFaceTrackerInstance::CallGetImageCV(unsigned char* image, int width, int height)
+{
+	return Library != nullptr ? Library->CallGetTrackerImage(Tracker, image, width, height) : INT_MIN;
+}
+
+
+int UFaceTrackerInstance::CallGetImageYUV(unsigned char* image, int width, int height, EFaceImageFormat format)
+{
+	return Library != nullptr ? Library->CallGetTrackerImageYUV(Tracker, image, width, height, format) : INT_MIN;
+}
@@ -0,0 +1,286 @@
+// Copyright 2020 NeuralVFX, Inc. All Rights Reserved.
+
+#include "FaceTrackingWorker.h"
+#include "FacePoseBackend.h"
+#include "HAL/RunnableThread.h"
+#include "HAL/PlatformProcess.h"
+#include "Misc/ScopeLock.h"
+#include "Misc/Crc.h"
+#include "FacialPoseStats.h"
+
+/** Three triple buffer slots, two uploads in flight, and one spare */
+static const int32 NumPooledImages = 6;
+
+/** Seconds to back off after a detect returned a frame already published, a backend may return it without blocking */
+static const float DuplicateFrameBackoff = .001f;
+
+
+FFaceTripleBuffer::FFaceTripleBuffer()
+{
+	WriteIndex = 0;
+	SharedIndex = 1;
+	ReadIndex = 2;
+}
+
+
+bool FFaceTripleBuffer::Publish()
+{
+	// Swap write slot into the middle and flag it as unread
+	int32 Old = FPlatformAtomics::InterlockedExchange(&SharedIndex, WriteIndex | DirtyBit);
+	WriteIndex = Old & 3;
+
+	return (Old & DirtyBit) != 0;
+}
+
+
+bool FFaceTripleBuffer::Consume()
+{
+	// Nothing new since the last swap
+	if ((FPlatformAtomics::AtomicRead(&SharedIndex) & DirtyBit) == 0)
+	{
+		return false;
+	}
+
+	// Swap read slot into the middle and clear the unread flag
+	int32 Old = FPlatformAtomics::InterlockedExchange(&SharedIndex, ReadIndex);
+	ReadIndex = Old & 3;
+
+	return true;
+}
+
+
+FFaceTrackingWorker::FFaceTrackingWorker(IFacePoseBackend* InBackend, int InImageWidth, int InImageHeight, EFaceImageFormat InImageFormat) :
+	Backend(InBackend), Thread(nullptr), ImageWidth(InImageWidth), ImageHeight(InImageHeight), ImageFormat(InImageFormat), LastFrameId(0), LastFaceHash(0), NextSequence(1), StartTime(FPlatformTime::Seconds())
+{
+	// Preallocate images so the worker never allocates
+	ImagePool = MakeShared<FFaceImagePool, ESPMode::ThreadSafe>(NumPooledImages, ImageWidth * ImageHeight * 4);
+	SetImageSize(ImageWidth, ImageHeight);
+}
+
+
+FFaceTrackingWorker::~FFaceTrackingWorker()
+{
+	if (Thread != nullptr)
+	{
+		Thread->Kill(true);
+		delete Thread;
+		Thread = nullptr;
+	}
+}
+
+
+void FFaceTrackingWorker::Start()
+{
+	Thread = FRunnableThread::Create(this, TEXT("FaceTrackingWorker"), 0, TPri_Normal);
+}
+
+
+uint32 FFaceTrackingWorker::Run()
+{
+	double NextDetectTime = 0;
+	while (!bStopRequested)
+	{
+		// Apply settings changed since the last frame
+		int32 DetectRatio = PendingDetectRatio.Set(0);
+		if (DetectRatio > 0 && Backend->CallReconfigure(DetectRatio) == INT_MIN)
+		{
+			UE_LOG(LogTemp, Warning, TEXT("Tracking Backend can't Reconfigure, Detect Ratio unchanged"));
+		}
+		int32 ImageSize = RequestedImageSize.GetValue();
+
+		// Hold detects under the rate cap
+		double Now = FPlatformTime::Seconds();
+		if (NextDetectTime > Now)
+		{
+			FPlatformProcess::Sleep(NextDetectTime - Now);
+		}
+		NextDetectTime = FMath::Max(NextDetectTime, Now) + MinDetectIntervalUs.GetValue() / 1000000.0;
+
+		// Fill the slot owned by the writer
+		FFaceTrackingFrame& Slot = Buffer.GetWriteSlot();
+		Slot.ImageWidth = ImageSize >> 16;
+		Slot.ImageHeight = ImageSize & 0xFFFF;
+		{
+			SCOPE_CYCLE_COUNTER(STAT_FacialPose_Detect);
+			TRACE_CPUPROFILER_EVENT_SCOPE(FacialPose_Detect);
+			double CallTime = FPlatformTime::Seconds();
+
+			Backend->CallDetectFaces(Slot.Faces);
+
+			// Backend reports how old the camera frame is, which also counts capture and queueing
+			double ReturnTime = FPlatformTime::Seconds();
+			Slot.CaptureTime = Slot.Faces.captureAge >= 0 ? ReturnTime - Slot.Faces.captureAge : CallTime;
+
+			// Cost per face should drop as more faces share a batch
+			double DetectMs = (ReturnTime - CallTime) * 1000.0;
+			Slot.InferenceMs = DetectMs;
+			SET_DWORD_STAT(STAT_FacialPose_NumFaces, Slot.Faces.numFaces);
+			SET_FLOAT_STAT(STAT_FacialPose_DetectPerFace, DetectMs / FMath::Max(Slot.Faces.numFaces, 1));
+		}
+
+		// Camera hasn't moved on, the rig already has this frame and its image
+		if (IsDuplicateFrame(Slot.Faces))
+		{
+			DuplicateFrames.Increment();
+			INC_DWORD_STAT(STAT_FacialPose_DuplicateFrames);
+			FPlatformProcess::Sleep(DuplicateFrameBackoff);
+			continue;
+		}
+
+		// Reuse buffer of a dropped frame, otherwise take a fresh one from the pool
+		if (Slot.ImageIndex == INDEX_NONE)
+		{
+			Slot.ImageIndex = ImagePool->Acquire();
+		}
+
+		// DLL writes straight into the pooled buffer
+		if (Slot.ImageIndex != INDEX_NONE)
+		{
+			TRACE_CPUPROFILER_EVENT_SCOPE(FacialPose_GetImage);
+			uint8* Image = ImagePool->GetData(Slot.ImageIndex);
+
+			// YUV planes skip the colour conversion, BGRA for good if the backend can't
+			if (ImageFormat != EFaceImageFormat::BGRA &&
+				Backend->CallGetImageYUV(Image, Slot.ImageWidth, Slot.ImageHeight, ImageFormat) == INT_MIN)
+			{
+				UE_LOG(LogTemp, Warning, TEXT("Tracking Backend has no YUV Images, using BGRA"));
+				ImageFormat = EFaceImageFormat::BGRA;
+			}
+			if (ImageFormat == EFaceImageFormat::BGRA)
+			{
+				Backend->CallGetImageCV(Image, Slot.ImageWidth, Slot.ImageHeight);
+			}
+		}
+		else
+		{
+			INC_DWORD_STAT(STAT_FacialPose_ImageFetchesSkipped);
+		}
+		Slot.ImageFormat = ImageFormat;
+		Slot.Sequence = NextSequence++;
+		Slot.FrameId = Slot.Faces.frameId > 0 ? (uint64)Slot.Faces.frameId : Slot.Sequence;
+
+		// Record result
+		{
+			FScopeLock Lock(&RecorderLock);
+			if (Recorder.IsValid())
+			{
+				const uint8* Image = Slot.ImageIndex != INDEX_NONE ? ImagePool->GetData(Slot.ImageIndex) : nullptr;
+				Recorder->WriteFrame(Slot.CaptureTime - StartTime, Slot.Faces, Image, Slot.ImageWidth, Slot.ImageHeight, Slot.ImageFormat);
+			}
+		}
+
+		// Animation reads this from its own threads, no need to wait for the game thread
+		{
+			FScopeLock Lock(&LiveLinkLock);
+			if (LiveLinkSource.IsValid())
+			{
+				LiveLinkSource->PushFrame(Slot.Faces, Slot.CaptureTime, Slot.FrameId);
+			}
+		}
+
+		// Remote rigs get it before the local one
+		{
+			FScopeLock Lock(&NetworkLock);
+			if (NetworkPublisher.IsValid())
+			{
+				NetworkPublisher->PushFrame(Slot.Faces, Slot.CaptureTime, Slot.FrameId);
+			}
+		}
+
+		// Hand over to the game thread
+		if (Buffer.Publish())
+		{
+			DroppedFrames.Increment();
+		}
+
+		FPlatformProcess::Sleep(0);
+	}
+	return 0;
+}
+
+
+bool FFaceTrackingWorker::IsDuplicateFrame(const FaceBatchData& Faces)
+{
+	if (Faces.frameId > 0)
+	{
+		bool bDuplicate = Faces.frameId == LastFrameId;
+		LastFrameId = Faces.frameId;
+		return bDuplicate;
+	}
+
+	// Without faces there is nothing to compare, and the image may still change
+	if (Faces.numFaces == 0)
+	{
+		LastFaceHash = 0;
+		return false;
+	}
+
+	uint32 Hash = FCrc::MemCrc32(Faces.trackIds, Faces.numFaces * sizeof(int));
+	Hash = FCrc::MemCrc32(Faces.transforms, Faces.numFaces * sizeof(TransformData), Hash);
+	Hash = FCrc::MemCrc32(Faces.expressions, Faces.numFaces * 51 * sizeof(float), Hash);
+
+	bool bDuplicate = Hash == LastFaceHash;
+	LastFaceHash = Hash;
+	return bDuplicate;
+}
+
+
+void FFaceTrackingWorker::SetRecorder(TSharedPtr<FFaceSessionRecorder> InRecorder)
+{
+	FScopeLock Lock(&RecorderLock);
+	Recorder = InRecorder;
+}
+
+
+void FFaceTrackingWorker::SetLiveLinkSource(TSharedPtr<FFaceLiveLinkSource> InSource)
+{
+	FScopeLock Lock(&LiveLinkLock);
+	LiveLinkSource = InSource;
+}
+
+
+void FFaceTrackingWorker::SetNetworkPublisher(TSharedPtr<FFaceNetworkPublisher> InPublisher)
+{
+	FScopeLock Lock(&NetworkLock);
+	NetworkPublisher = InPublisher;
+}
+
+
+void FFaceTrackingWorker::SetImageSize(int Width, int Height)
+{
+	Width = FMath::Clamp(Width, 2, ImageWidth) & ~1;
+	Height = FMath::Clamp(Height, 2, ImageHeight) & ~1;
+	RequestedImageSize.Set((Width << 16) | Height);
+}
+
+
+void FFaceTrackingWorker::SetDetectRatio(int DetectRatio)
+{
+	PendingDetectRatio.Set(FMath::Max(DetectRatio, 1));
+}
+
+
+void FFaceTrackingWorker::SetMaxInferenceRate(float Rate)
+{
+	MinDetectIntervalUs.Set(Rate > 0 ? FMath::RoundToInt(1000000.f / Rate) : 0);
+}
+
+
+void FFaceTrackingWorker::Stop()
+{
+	bStopRequested = true;
+}
+
+
+FFaceTrackingFrame* FFaceTrackingWorker::GetLatestFrame(bool& bIsNewFrame)
+{
+	bIsNewFrame = Buffer.Consume();
+	SET_DWORD_STAT(STAT_FacialPose_ImageBuffersInUse, ImagePool->GetNumInUse());
+
+	FFaceTrackingFrame& Frame = Buffer.GetReadSlot();
+	if (Frame.Sequence == 0)
+	{
+		return nullptr;
+	}
+	return &Frame;
+}
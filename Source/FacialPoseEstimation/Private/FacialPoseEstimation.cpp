@@ -1,6 +1,55 @@
 // Copyright Epic Games, Inc. All Rights Reserved.
 
 #include "FacialPoseEstimation.h"
+#include "FacialPoseStats.h"
+
+DEFINE_STAT(STAT_FacialPose_DLLInit);
+DEFINE_STAT(STAT_FacialPose_DLLClose);
+DEFINE_STAT(STAT_FacialPose_DLLDetect);
+DEFINE_STAT(STAT_FacialPose_DLLDetectFaces);
+DEFINE_STAT(STAT_FacialPose_DLLGetImage);
+DEFINE_STAT(STAT_FacialPose_DLLReconfigure);
+DEFINE_STAT(STAT_FacialPose_Detect);
+DEFINE_STAT(STAT_FacialPose_NumFaces);
+DEFINE_STAT(STAT_FacialPose_DetectPerFace);
+DEFINE_STAT(STAT_FacialPose_DuplicateFrames);
+DEFINE_STAT(STAT_FacialPose_TrackersPerBatch);
+DEFINE_STAT(STAT_FacialPose_RigUpdate);
+DEFINE_STAT(STAT_FacialPose_BindFaces);
+DEFINE_STAT(STAT_FacialPose_SmoothBlendShapes);
+DEFINE_STAT(STAT_FacialPose_SetTransforms);
+DEFINE_STAT(STAT_FacialPose_SetBlendShapes);
+DEFINE_STAT(STAT_FacialPose_PredictPose);
+DEFINE_STAT(STAT_FacialPose_TransformWritesSkipped);
+DEFINE_STAT(STAT_FacialPose_PredictionMs);
+DEFINE_STAT(STAT_FacialPose_InferenceP50);
+DEFINE_STAT(STAT_FacialPose_InferenceP95);
+DEFINE_STAT(STAT_FacialPose_InferenceP99);
+DEFINE_STAT(STAT_FacialPose_CaptureToDisplayP50);
+DEFINE_STAT(STAT_FacialPose_CaptureToDisplayP95);
+DEFINE_STAT(STAT_FacialPose_CaptureToDisplayP99);
+DEFINE_STAT(STAT_FacialPose_LiveLinkPush);
+DEFINE_STAT(STAT_FacialPose_LiveLinkEvaluate);
+DEFINE_STAT(STAT_FacialPose_NetworkSend);
+DEFINE_STAT(STAT_FacialPose_NetworkReceive);
+DEFINE_STAT(STAT_FacialPose_NetworkBytesSent);
+DEFINE_STAT(STAT_FacialPose_NetworkPacketsLost);
+DEFINE_STAT(STAT_FacialPose_BatchSmoothing);
+DEFINE_STAT(STAT_FacialPose_BatchScatter);
+DEFINE_STAT(STAT_FacialPose_BatchedFaces);
+DEFINE_STAT(STAT_FacialPose_Retarget);
+DEFINE_STAT(STAT_FacialPose_Bake);
+DEFINE_STAT(STAT_FacialPose_TimeToTrackerReady);
+DEFINE_STAT(STAT_FacialPose_TimeToFirstTrackedFrame);
+DEFINE_STAT(STAT_FacialPose_AnimUpdate);
+DEFINE_STAT(STAT_FacialPose_AnimEvaluate);
+DEFINE_STAT(STAT_FacialPose_BackgroundUpload);
+DEFINE_STAT(STAT_FacialPose_UploadsSkipped);
+DEFINE_STAT(STAT_FacialPose_ImagePoolMemory);
+DEFINE_STAT(STAT_FacialPose_ImageAllocations);
+DEFINE_STAT(STAT_FacialPose_ImageBuffersInUse);
+DEFINE_STAT(STAT_FacialPose_ImageFetchesSkipped);
+DEFINE_STAT(STAT_FacialPose_UObjectCount);
 
 #define LOCTEXT_NAMESPACE "FFacialPoseEstimationModule"
 
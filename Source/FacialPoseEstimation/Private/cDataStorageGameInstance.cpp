@@ -1,20 +1,285 @@
 // Copyright 2020 NeuralVFX, Inc. All Rights Reserved.
 
 #include "cDataStorageGameInstance.h"
+#include "FaceSyntheticBackend.h"
+#include "FaceReplayBackend.h"
+#include "FaceHostBackend.h"
+#include "FaceNetworkBackend.h"
+#include "Async/Async.h"
+#include "HAL/PlatformTime.h"
+#include "Misc/CommandLine.h"
+#include "Misc/Paths.h"
+#include "Misc/Parse.h"
+#include "ILiveLinkClient.h"
+#include "Features/IModularFeatures.h"
+
+
+UcDataStorageGameInstance::UcDataStorageGameInstance()
+{
+	BackendType = EFacePoseBackendType::Library;
+	SyntheticFrameRate = 30;
+	SyntheticDetectCostMs = 0;
+	SyntheticNumFaces = 1;
+	ReplaySpeed = 1;
+	HostAffinityMask = 0;
+	NetworkListenPort = 7830;
+	NetworkKeyframeInterval = 30;
+	TrackerBatchWindowMs = 4;
+	bPublishLiveLink = false;
+	LiveLinkSubjectName = TEXT("ArFace");
+	bAsyncInit = true;
+	WarmupInferences = 3;
+
+	m_refDataStorageUtil = nullptr;
+	m_bBackendReady = false;
+}
 
 
 void UcDataStorageGameInstance::Init()
 {
-	// Init DLL
 	Super::Init();
-	if (ImportDataStorageLibrary())
+
+	// Command line picks backend on build agents
+	FString BackendName;
+	if (FParse::Value(FCommandLine::Get(), TEXT("FacePoseBackend="), BackendName))
+	{
+		BackendType = BackendName == TEXT("Synthetic") ? EFacePoseBackendType::Synthetic :
+			BackendName == TEXT("Replay") ? EFacePoseBackendType::Replay :
+			BackendName == TEXT("Host") ? EFacePoseBackendType::Host :
+			BackendName == TEXT("Network") ? EFacePoseBackendType::Network : EFacePoseBackendType::Library;
+	}
+	if (FParse::Value(FCommandLine::Get(), TEXT("FacePoseReplay="), ReplayPath))
+	{
+		BackendType = EFacePoseBackendType::Replay;
+	}
+	if (FParse::Value(FCommandLine::Get(), TEXT("FacePoseListen="), NetworkListenPort))
 	{
+		BackendType = EFacePoseBackendType::Network;
+	}
+	FParse::Value(FCommandLine::Get(), TEXT("FacePoseStream="), NetworkStreamDestinations);
+	if (FParse::Param(FCommandLine::Get(), TEXT("FacePoseLiveLink")))
+	{
+		bPublishLiveLink = true;
+	}
+	if (FParse::Param(FCommandLine::Get(), TEXT("FacePoseSyncInit")))
+	{
+		bAsyncInit = false;
+	}
+	FParse::Value(FCommandLine::Get(), TEXT("FacePoseWarmup="), WarmupInferences);
+
+	if (BackendType == EFacePoseBackendType::Synthetic)
+	{
+		m_bBackendReady = CreateSyntheticBackend();
+		return;
+	}
+
+	if (BackendType == EFacePoseBackendType::Replay)
+	{
+		m_bBackendReady = CreateReplayBackend();
+		return;
+	}
+
+	if (BackendType == EFacePoseBackendType::Host)
+	{
+		m_bBackendReady = CreateHostBackend();
+		return;
+	}
+
+	if (BackendType == EFacePoseBackendType::Network)
+	{
+		m_bBackendReady = CreateNetworkBackend();
+		return;
+	}
+
+	// Init DLL
+	m_bBackendReady = ImportDataStorageLibrary();
+	if (m_bBackendReady)
+	{
+		m_backend = m_refDataStorageUtil;
 		UE_LOG(LogTemp, Log, TEXT("OpenCV DLL Loaded"));
+	}
 
+	// Main camera is an instance too, so it batches with any other camera
+	if (m_bBackendReady && m_refDataStorageUtil->HasTrackerInstances())
+	{
+		m_detectScheduler = MakeShared<FFaceDetectScheduler, ESPMode::ThreadSafe>(m_refDataStorageUtil, TrackerBatchWindowMs);
+		UFaceTrackerInstance* Main = CreateTrackerInstance();
+		if (Main != nullptr)
+		{
+			m_backend = Main;
+		}
+	}
+
+	// Networks load while the level does, needs a DLL which loads them without a camera (the DetectImages contract)
+	if (m_bBackendReady && bAsyncInit && m_refDataStorageUtil->HasDetectImages())
+	{
+		UcDataStorageWrapper* Library = m_refDataStorageUtil;
+		m_preloadTask = Async(EAsyncExecution::Thread, [this, Library]()
+		{
+			double Start = FPlatformTime::Seconds();
+			int Width = 640;
+			int Height = 480;
+			if (Library->CallInitCV(Width, Height, 1, -1, 1, false, true) == INT_MIN)
+			{
+				UE_LOG(LogTemp, Warning, TEXT("Could not Preload Networks, loading them with the Camera"));
+				return;
+			}
+			m_bPreloadOpen = true;
+			UE_LOG(LogTemp, Log, TEXT("Preloaded Networks in %.2fs"), FPlatformTime::Seconds() - Start);
+		});
 	}
 }
 
 
+bool UcDataStorageGameInstance::CreateSyntheticBackend()
+{
+	UFaceSyntheticBackend* Synthetic = NewObject<UFaceSyntheticBackend>(this);
+	if (Synthetic == NULL)
+	{
+		UE_LOG(LogTemp, Error, TEXT("Could not Create the Synthetic Backend"));
+		return false;
+	}
+
+	Synthetic->FrameRate = SyntheticFrameRate;
+	Synthetic->DetectCostMs = SyntheticDetectCostMs;
+	Synthetic->NumFaces = SyntheticNumFaces;
+	FParse::Value(FCommandLine::Get(), TEXT("FacePoseRate="), Synthetic->FrameRate);
+	FParse::Value(FCommandLine::Get(), TEXT("FacePoseCostMs="), Synthetic->DetectCostMs);
+	FParse::Value(FCommandLine::Get(), TEXT("FacePoseFaces="), Synthetic->NumFaces);
+
+	m_backend = Synthetic;
+	UE_LOG(LogTemp, Log, TEXT("Synthetic Backend Created"));
+
+	return true;
+}
+
+
+bool UcDataStorageGameInstance::CreateReplayBackend()
+{
+	UFaceReplayBackend* Replay = NewObject<UFaceReplayBackend>(this);
+	if (Replay == NULL)
+	{
+		UE_LOG(LogTemp, Error, TEXT("Could not Create the Replay Backend"));
+		return false;
+	}
+
+	Replay->FilePath = ReplayPath;
+	Replay->Speed = ReplaySpeed;
+	FParse::Value(FCommandLine::Get(), TEXT("FacePoseReplaySpeed="), Replay->Speed);
+
+	m_backend = Replay;
+	UE_LOG(LogTemp, Log, TEXT("Replay Backend Created: %s"), *ReplayPath);
+
+	return true;
+}
+
+
+bool UcDataStorageGameInstance::CreateHostBackend()
+{
+	UFaceHostBackend* Host = NewObject<UFaceHostBackend>(this);
+	if (Host == NULL)
+	{
+		UE_LOG(LogTemp, Error, TEXT("Could not Create the Host Backend"));
+		return false;
+	}
+
+	// Host executable sits next to the library
+#if PLATFORM_WINDOWS
+	FString Folder = FPaths::ProjectPluginsDir() + "facial-pose-estimation-unreal/Binaries/Win64/";
+	Host->HostPath = Folder + "FaceTrackerHost.exe";
+	Host->LibraryPath = Folder + "facial-pose-estimation-libtorch.dll";
+#else
+	FString Folder = FPaths::ProjectPluginsDir() + "facial-pose-estimation-unreal/Binaries/Linux/";
+	Host->HostPath = Folder + "FaceTrackerHost";
+	Host->LibraryPath = Folder + "libfacial-pose-estimation-libtorch.so";
+#endif
+	Host->HostPath = FPaths::ConvertRelativePathToFull(Host->HostPath);
+	if (!FPaths::FileExists(Host->HostPath))
+	{
+		UE_LOG(LogTemp, Error, TEXT("Tracker Host Not Found: %s"), *Host->HostPath);
+		return false;
+	}
+
+	Host->AffinityMask = HostAffinityMask;
+	FParse::Value(FCommandLine::Get(), TEXT("FacePoseHostAffinity="), Host->AffinityMask);
+
+	m_backend = Host;
+	UE_LOG(LogTemp, Log, TEXT("Host Backend Created: %s"), *Host->HostPath);
+
+	return true;
+}
+
+
+bool UcDataStorageGameInstance::CreateNetworkBackend()
+{
+	UFaceNetworkBackend* Network = NewObject<UFaceNetworkBackend>(this);
+	if (Network == NULL)
+	{
+		UE_LOG(LogTemp, Error, TEXT("Could not Create the Network Backend"));
+		return false;
+	}
+
+	Network->Port = NetworkListenPort;
+
+	m_backend = Network;
+	UE_LOG(LogTemp, Log, TEXT("Network Backend Created, Port: %d"), NetworkListenPort);
+
+	return true;
+}
+
+
+IFacePoseBackend* UcDataStorageGameInstance::GetBackend(int tracker) const
+{
+	if (!m_bBackendReady)
+	{
+		return nullptr;
+	}
+	if (tracker == 0)
+	{
+		return (IFacePoseBackend*)m_backend.GetInterface();
+	}
+	return m_extraTrackers.IsValidIndex(tracker - 1) ? m_extraTrackers[tracker - 1] : nullptr;
+}
+
+
+int UcDataStorageGameInstance::GetMaxTrackers() const
+{
+	return m_detectScheduler.IsValid() ? FACE_MAX_TRACKERS : 1;
+}
+
+
+UFaceTrackerInstance* UcDataStorageGameInstance::CreateTrackerInstance()
+{
+	UFaceTrackerInstance* Instance = NewObject<UFaceTrackerInstance>(this);
+	if (Instance == NULL || !Instance->Create(m_refDataStorageUtil, m_detectScheduler))
+	{
+		UE_LOG(LogTemp, Error, TEXT("Could not Create a Tracker Instance"));
+		return nullptr;
+	}
+	return Instance;
+}
+
+
+FFaceTrackingWorker* UcDataStorageGameInstance::GetWorker(int tracker) const
+{
+	if (tracker == 0)
+	{
+		return m_trackingWorker.Get();
+	}
+	return m_extraWorkers.IsValidIndex(tracker - 1) ? m_extraWorkers[tracker - 1].Get() : nullptr;
+}
+
+
+UFaceTrackerInstance* UcDataStorageGameInstance::GetTrackerInstance(int tracker) const
+{
+	if (tracker == 0)
+	{
+		return Cast<UFaceTrackerInstance>(m_backend.GetObject());
+	}
+	return m_extraTrackers.IsValidIndex(tracker - 1) ? m_extraTrackers[tracker - 1] : nullptr;
+}
+
+
 bool UcDataStorageGameInstance::ImportDataStorageLibrary()
 {
 	// Import the DLL
@@ -25,8 +290,15 @@ bool UcDataStorageGameInstance::ImportDataStorageLibrary()
 		return false;
 	}
 
-	if (!m_refDataStorageUtil->ImportDLL("facial-pose-estimation-unreal/Binaries/Win64",
-		"facial-pose-estimation-libtorch.dll"))
+#if PLATFORM_WINDOWS
+	FString Folder = "facial-pose-estimation-unreal/Binaries/Win64";
+	FString LibName = "facial-pose-estimation-libtorch.dll";
+#else
+	FString Folder = "facial-pose-estimation-unreal/Binaries/Linux";
+	FString LibName = "libfacial-pose-estimation-libtorch.so";
+#endif
+
+	if (!m_refDataStorageUtil->ImportDLL(Folder, LibName))
 	{
 		UE_LOG(LogTemp, Error, TEXT("Failed to Import DLL"));
 		return false;
@@ -43,16 +315,75 @@ bool UcDataStorageGameInstance::ImportDataStorageLibrary()
 
 void UcDataStorageGameInstance::Shutdown()
 {
-	int Result = m_refDataStorageUtil->CallCloseCV();
+	// Startups still opening a camera, or loading networks, finish first
+	for (const TSharedPtr<FFaceTrackerStartup, ESPMode::ThreadSafe>& Startup : m_trackerStartups)
+	{
+		if (Startup.IsValid() && Startup->Task.IsValid())
+		{
+			Startup->Task.Wait();
+		}
+	}
+	if (m_preloadTask.IsValid())
+	{
+		m_preloadTask.Wait();
+	}
+
+	// Worker must be gone before the camera is released
+	for (int32 i = 0; i < m_extraTrackers.Num(); i++)
+	{
+		StopTracking(i + 1);
+		if (m_extraTrackers[i] != nullptr)
+		{
+			m_extraTrackers[i]->CallCloseCV();
+		}
+	}
+	StopTracking();
+	StopLiveLink();
+
+	if (GetBackend() != nullptr)
+	{
+		int Result = GetBackend()->CallCloseCV();
+	}
+	WaitForPreload(nullptr);
 	Super::Shutdown();
 	UE_LOG(LogTemp, Log, TEXT("Release Camera"))
 }
 
 
+IFacePoseBackend* UcDataStorageGameInstance::GetOrCreateBackend(int tracker)
+{
+	// Further cameras need a tracker instance each
+	if (tracker > 0 && m_bBackendReady && GetBackend(tracker) == nullptr)
+	{
+		if (!m_detectScheduler.IsValid() || tracker >= GetMaxTrackers())
+		{
+			UE_LOG(LogTemp, Error, TEXT("Tracking Backend has no Tracker %d, only a single camera"), tracker);
+			return nullptr;
+		}
+		m_extraTrackers.SetNumZeroed(FMath::Max(m_extraTrackers.Num(), tracker));
+		m_extraTrackers[tracker - 1] = CreateTrackerInstance();
+	}
+
+	if (GetBackend(tracker) == nullptr)
+	{
+		UE_LOG(LogTemp, Error, TEXT("No Tracking Backend Loaded"));
+	}
+	return GetBackend(tracker);
+}
+
+
 void UcDataStorageGameInstance::CustomStart(int&outCameraWidth, int&outCameraHeight,
-	int detectRatio, int camId, float fovZoom, bool draw, bool lockEyesNose)
+	int detectRatio, int camId, float fovZoom, bool draw, bool lockEyesNose, int tracker)
 {
-	int Result = m_refDataStorageUtil->CallInitCV(outCameraWidth,
+	if (GetOrCreateBackend(tracker) == nullptr)
+	{
+		return;
+	}
+
+	// Camera can't open while networks are still loading
+	WaitForPreload(GetBackend(tracker));
+
+	int Result = GetBackend(tracker)->CallInitCV(outCameraWidth,
 		outCameraHeight,
 		detectRatio,
 		camId,
@@ -60,19 +391,420 @@ void UcDataStorageGameInstance::CustomStart(int&outCameraWidth, int&outCameraHei
 		draw,
 		lockEyesNose);
 
-	UE_LOG(LogTemp, Log, TEXT("Opened Camera"));
+	if (Result == INT_MIN)
+	{
+		UE_LOG(LogTemp, Error, TEXT("Could not Open Camera %d on Tracker %d"), camId, tracker);
+		return;
+	}
+	UE_LOG(LogTemp, Log, TEXT("Opened Camera %d on Tracker %d"), camId, tracker);
+}
+
+
+void UcDataStorageGameInstance::CustomStartAsync(int cameraWidth, int cameraHeight,
+	int detectRatio, int camId, float fovZoom, bool draw, bool lockEyesNose, int tracker)
+{
+	// Tracker instances are UObjects, so they are created here before the task takes over
+	IFacePoseBackend* Backend = GetOrCreateBackend(tracker);
+	if (Backend == nullptr)
+	{
+		return;
+	}
+
+	// Further rigs on the same tracker share its startup, a second task would init the backend while the first still does
+	if (m_trackerStartups.IsValidIndex(tracker) && m_trackerStartups[tracker].IsValid())
+	{
+		return;
+	}
+
+	TSharedPtr<FFaceTrackerStartup, ESPMode::ThreadSafe> Startup = MakeShared<FFaceTrackerStartup, ESPMode::ThreadSafe>();
+	Startup->CameraWidth = cameraWidth;
+	Startup->CameraHeight = cameraHeight;
+	Startup->StartTime = FPlatformTime::Seconds();
+	Startup->ReadyTime = 0;
+	m_trackerStartups.SetNum(FMath::Max(m_trackerStartups.Num(), tracker + 1));
+	m_trackerStartups[tracker] = Startup;
+
+	// Only backends running inference have first-inference costs, replays and streams would just lose frames
+	int Warmups = BackendType == EFacePoseBackendType::Library || BackendType == EFacePoseBackendType::Host ? FMath::Max(WarmupInferences, 0) : 0;
+
+	if (!bAsyncInit)
+	{
+		RunTrackerStartup(Backend, *Startup, detectRatio, camId, fovZoom, draw, lockEyesNose, Warmups);
+		return;
+	}
+
+	// Shutdown waits for the task, so the game instance outlives it
+	Startup->Task = Async(EAsyncExecution::Thread, [this, Backend, Startup, detectRatio, camId, fovZoom, draw, lockEyesNose, Warmups]()
+	{
+		RunTrackerStartup(Backend, *Startup, detectRatio, camId, fovZoom, draw, lockEyesNose, Warmups);
+	});
+}
+
+
+void UcDataStorageGameInstance::RunTrackerStartup(IFacePoseBackend* backend, FFaceTrackerStartup& startup, int detectRatio, int camId,
+	float fovZoom, bool draw, bool lockEyesNose, int warmups)
+{
+	TRACE_CPUPROFILER_EVENT_SCOPE(UcDataStorageGameInstance_RunTrackerStartup);
+
+	// Camera can't open while networks are still loading
+	WaitForPreload(backend);
+	double NetworksTime = FPlatformTime::Seconds();
+
+	// Warmups would detect on a camera which isn't there, the rig reports the failure instead
+	if (backend->CallInitCV(startup.CameraWidth, startup.CameraHeight, detectRatio, camId, fovZoom, draw, lockEyesNose) == INT_MIN)
+	{
+		startup.ReadyTime = FPlatformTime::Seconds();
+		UE_LOG(LogTemp, Error, TEXT("Could not Open Camera %d after %.2fs"), camId, startup.ReadyTime - startup.StartTime);
+		startup.bFailed = true;
+		return;
+	}
+	double CameraTime = FPlatformTime::Seconds();
+
+	// First detects pay for lazy initialization and first inference, results are thrown away
+	TUniquePtr<FaceBatchData> Faces = MakeUnique<FaceBatchData>();
+	for (int i = 0; i < warmups; i++)
+	{
+		backend->CallDetectFaces(*Faces);
+	}
+
+	startup.ReadyTime = FPlatformTime::Seconds();
+	UE_LOG(LogTemp, Log, TEXT("Camera %d Ready after %.2fs - networks %.2fs, camera %.2fs, %d warmup detects %.2fs"), camId,
+		startup.ReadyTime - startup.StartTime, NetworksTime - startup.StartTime, CameraTime - NetworksTime, warmups, startup.ReadyTime - CameraTime);
+	startup.bReady = true;
+}
+
+
+void UcDataStorageGameInstance::WaitForPreload(IFacePoseBackend* backend)
+{
+	if (m_preloadTask.IsValid())
+	{
+		m_preloadTask.Wait();
+	}
+
+	// Library's global Init isn't called twice without a Close, the camera's Init still finds the model files cached.
+	// With tracker instances it stays open until shutdown, otherwise the library's own Close at shutdown balances it
+	bool bLibraryIsMain = m_refDataStorageUtil != nullptr && m_backend.GetObject() == m_refDataStorageUtil;
+	bool bClose = backend == nullptr ? !bLibraryIsMain : backend == (IFacePoseBackend*)m_refDataStorageUtil;
+	if (bClose && m_bPreloadOpen.AtomicSet(false))
+	{
+		m_refDataStorageUtil->CallCloseCV();
+		UE_LOG(LogTemp, Log, TEXT("Closed Preloaded Networks"));
+	}
+}
+
+
+bool UcDataStorageGameInstance::IsTrackerFailed(int tracker) const
+{
+	return m_trackerStartups.IsValidIndex(tracker) && m_trackerStartups[tracker].IsValid() && m_trackerStartups[tracker]->bFailed;
+}
+
+
+bool UcDataStorageGameInstance::IsTrackerReady(int tracker, int& outCameraWidth, int& outCameraHeight) const
+{
+	if (!m_trackerStartups.IsValidIndex(tracker) || !m_trackerStartups[tracker].IsValid() || !m_trackerStartups[tracker]->bReady)
+	{
+		return false;
+	}
+
+	outCameraWidth = m_trackerStartups[tracker]->CameraWidth;
+	outCameraHeight = m_trackerStartups[tracker]->CameraHeight;
+	return true;
 }
 
 
 void UcDataStorageGameInstance::GetImage(unsigned char* image, int width, int height)
 {
-	int Result = m_refDataStorageUtil->CallGetImageCV(image, width, height);
+	if (GetBackend() != nullptr)
+	{
+		int Result = GetBackend()->CallGetImageCV(image, width, height);
+	}
 }
 
 
 
-void UcDataStorageGameInstance::GetTransform(TransformData& outFaces, float* outExpression)
+bool UcDataStorageGameInstance::GetTransform(TransformData& outTransform, float* outExpression)
 {
-	int Result = m_refDataStorageUtil->CallDetect(outFaces, outExpression);
+	if (GetBackend() == nullptr)
+	{
+		return false;
+	}
+
+	// Whole result, so a face out of view is told apart from a stale pose
+	FaceBatchData Faces;
+	if (GetBackend()->CallDetectFaces(Faces) == INT_MIN || Faces.numFaces == 0)
+	{
+		return false;
+	}
+
+	outTransform = Faces.transforms[0];
+	FMemory::Memcpy(outExpression, Faces.expressions, 51 * sizeof(float));
+	return true;
 }
 
+
+void UcDataStorageGameInstance::StartTracking(int width, int height, EFaceImageFormat format, int tracker)
+{
+	if (GetWorker(tracker) != nullptr || GetBackend(tracker) == nullptr)
+	{
+		return;
+	}
+
+	// Worker would detect on a camera still opening
+	int CameraWidth, CameraHeight;
+	if (m_trackerStartups.IsValidIndex(tracker) && m_trackerStartups[tracker].IsValid() && !IsTrackerReady(tracker, CameraWidth, CameraHeight))
+	{
+		UE_LOG(LogTemp, Warning, TEXT("Tracker %d not Ready, not Starting Tracking"), tracker);
+		return;
+	}
+
+	// Further trackers only feed their rig
+	if (tracker > 0)
+	{
+		m_extraWorkers.SetNum(FMath::Max(m_extraWorkers.Num(), tracker));
+		m_extraWorkers[tracker - 1] = MakeUnique<FFaceTrackingWorker>(GetBackend(tracker), width, height, format);
+		m_extraWorkers[tracker - 1]->Start();
+		GetTrackerInstance(tracker)->SetTracking(true);
+		UE_LOG(LogTemp, Log, TEXT("Started Tracking Worker for Tracker %d"), tracker);
+		return;
+	}
+
+	m_trackingWorker = MakeUnique<FFaceTrackingWorker>(GetBackend(), width, height, format);
+	m_trackingWorker->Start();
+
+	// Batches of the other cameras wait for this one while it tracks
+	if (UFaceTrackerInstance* Instance = GetTrackerInstance(0))
+	{
+		Instance->SetTracking(true);
+	}
+
+	UE_LOG(LogTemp, Log, TEXT("Started Tracking Worker"));
+
+	// Record from the start if asked to
+	FString RecordPath;
+	if (FParse::Value(FCommandLine::Get(), TEXT("FacePoseRecord="), RecordPath))
+	{
+		StartRecording(RecordPath);
+	}
+	else if (m_recorder.IsValid())
+	{
+		m_trackingWorker->SetRecorder(m_recorder);
+	}
+	m_trackingWorker->SetLiveLinkSource(m_liveLinkSource);
+
+	// Stream from the start if asked to
+	if (!NetworkStreamDestinations.IsEmpty() && !m_networkPublisher.IsValid())
+	{
+		StartNetworkStream(NetworkStreamDestinations, NetworkKeyframeInterval);
+	}
+	m_trackingWorker->SetNetworkPublisher(m_networkPublisher);
+}
+
+
+void UcDataStorageGameInstance::StopTracking(int tracker)
+{
+	if (tracker > 0)
+	{
+		if (GetWorker(tracker) != nullptr)
+		{
+			m_extraWorkers[tracker - 1].Reset();
+			GetTrackerInstance(tracker)->SetTracking(false);
+		}
+		return;
+	}
+
+	if (!m_trackingWorker.IsValid())
+	{
+		return;
+	}
+	if (UFaceTrackerInstance* Instance = GetTrackerInstance(0))
+	{
+		Instance->SetTracking(false);
+	}
+
+	UE_LOG(LogTemp, Log, TEXT("Stopped Tracking Worker, Dropped Frames: %d"),
+		m_trackingWorker->GetDroppedFrameCount());
+
+	m_trackingWorker.Reset();
+	StopRecording();
+	StopNetworkStream();
+}
+
+
+void UcDataStorageGameInstance::ReconfigureTracking(int detectRatio, int width, int height, float maxInferenceRate, int tracker)
+{
+	FFaceTrackingWorker* Worker = GetWorker(tracker);
+	if (Worker == nullptr)
+	{
+		return;
+	}
+
+	Worker->SetDetectRatio(detectRatio);
+	Worker->SetImageSize(width, height);
+	Worker->SetMaxInferenceRate(maxInferenceRate);
+}
+
+
+bool UcDataStorageGameInstance::StartRecording(const FString& path, bool bQuantize, int previewInterval, int previewSize, int maxFaces)
+{
+	StopRecording();
+
+	TSharedPtr<FFaceSessionRecorder> Recorder = MakeShared<FFaceSessionRecorder>();
+	if (!Recorder->Open(path, maxFaces, bQuantize, previewInterval, previewSize))
+	{
+		return false;
+	}
+
+	m_recorder = Recorder;
+	if (m_trackingWorker.IsValid())
+	{
+		m_trackingWorker->SetRecorder(m_recorder);
+	}
+	return true;
+}
+
+
+void UcDataStorageGameInstance::StopRecording()
+{
+	if (!m_recorder.IsValid())
+	{
+		return;
+	}
+
+	// Worker lets go first, then the file is closed
+	if (m_trackingWorker.IsValid())
+	{
+		m_trackingWorker->SetRecorder(nullptr);
+	}
+	m_recorder->Close();
+	m_recorder.Reset();
+}
+
+
+bool UcDataStorageGameInstance::StartLiveLink(const TArray<FName>& curveNames, int maxSubjects)
+{
+	if (m_liveLinkSource.IsValid())
+	{
+		return true;
+	}
+
+	// Client is provided by the Live Link plugin
+	IModularFeatures& ModularFeatures = IModularFeatures::Get();
+	if (!ModularFeatures.IsModularFeatureAvailable(ILiveLinkClient::ModularFeatureName))
+	{
+		UE_LOG(LogTemp, Warning, TEXT("Live Link Plugin not Loaded, not Publishing Tracking"));
+		return false;
+	}
+	ILiveLinkClient& Client = ModularFeatures.GetModularFeature<ILiveLinkClient>(ILiveLinkClient::ModularFeatureName);
+
+	m_liveLinkSource = MakeShared<FFaceLiveLinkSource>(LiveLinkSubjectName, curveNames, maxSubjects);
+	m_liveLinkSourceGuid = Client.AddSource(m_liveLinkSource);
+	if (m_trackingWorker.IsValid())
+	{
+		m_trackingWorker->SetLiveLinkSource(m_liveLinkSource);
+	}
+
+	UE_LOG(LogTemp, Log, TEXT("Publishing Live Link Subject: %s"), *LiveLinkSubjectName.ToString());
+	return true;
+}
+
+
+void UcDataStorageGameInstance::StopLiveLink()
+{
+	if (!m_liveLinkSource.IsValid())
+	{
+		return;
+	}
+
+	// Worker lets go first, then the client shuts the source down
+	if (m_trackingWorker.IsValid())
+	{
+		m_trackingWorker->SetLiveLinkSource(nullptr);
+	}
+
+	IModularFeatures& ModularFeatures = IModularFeatures::Get();
+	if (ModularFeatures.IsModularFeatureAvailable(ILiveLinkClient::ModularFeatureName))
+	{
+		ModularFeatures.GetModularFeature<ILiveLinkClient>(ILiveLinkClient::ModularFeatureName).RemoveSource(m_liveLinkSourceGuid);
+	}
+	m_liveLinkSource.Reset();
+}
+
+
+FName UcDataStorageGameInstance::GetLiveLinkSubjectName(int index) const
+{
+	return FFaceLiveLinkSource::GetSubjectName(LiveLinkSubjectName, index);
+}
+
+
+bool UcDataStorageGameInstance::StartNetworkStream(const FString& destinations, int keyframeInterval)
+{
+	StopNetworkStream();
+
+	TSharedPtr<FFaceNetworkPublisher> Publisher = MakeShared<FFaceNetworkPublisher>(keyframeInterval);
+	if (!Publisher->Open(destinations))
+	{
+		return false;
+	}
+
+	m_networkPublisher = Publisher;
+	if (m_trackingWorker.IsValid())
+	{
+		m_trackingWorker->SetNetworkPublisher(m_networkPublisher);
+	}
+	return true;
+}
+
+
+void UcDataStorageGameInstance::StopNetworkStream()
+{
+	if (!m_networkPublisher.IsValid())
+	{
+		return;
+	}
+
+	// Worker lets go first, then the socket is closed
+	if (m_trackingWorker.IsValid())
+	{
+		m_trackingWorker->SetNetworkPublisher(nullptr);
+	}
+	UE_LOG(LogTemp, Log, TEXT("Stopped Streaming Tracking, Bytes Sent: %lld"), m_networkPublisher->GetBytesSent());
+	m_networkPublisher->Close();
+	m_networkPublisher.Reset();
+}
+
+
+FFaceTrackingFrame* UcDataStorageGameInstance::GetLatestFrame(bool& bIsNewFrame, int tracker)
+{
+	bIsNewFrame = false;
+	FFaceTrackingWorker* Worker = GetWorker(tracker);
+	if (Worker == nullptr)
+	{
+		return nullptr;
+	}
+	return Worker->GetLatestFrame(bIsNewFrame);
+}
+
+
+TSharedPtr<FFaceImagePool, ESPMode::ThreadSafe> UcDataStorageGameInstance::GetImagePool(int tracker) const
+{
+	FFaceTrackingWorker* Worker = GetWorker(tracker);
+	if (Worker == nullptr)
+	{
+		return nullptr;
+	}
+	return Worker->GetImagePool();
+}
+
+
+int32 UcDataStorageGameInstance::GetDroppedFrameCount(int tracker) const
+{
+	FFaceTrackingWorker* Worker = GetWorker(tracker);
+	return Worker != nullptr ? Worker->GetDroppedFrameCount() : 0;
+}
+
+
+int32 UcDataStorageGameInstance::GetDuplicateFrameCount(int tracker) const
+{
+	FFaceTrackingWorker* Worker = GetWorker(tracker);
+	return Worker != nullptr ? Worker->GetDuplicateFrameCount() : 0;
+}
@@ -2,6 +2,27 @@
 
 #include "cDataStorageWrapper.h"
 #include "Misc/Paths.h"
+#include "FacialPoseStats.h"
+
+
+FQuat TransformData::ToUnrealRotation(FVector Up, FVector Forward)
+{
+	// Matrices converting OpenCV axes to Unreal
+	static const FMatrix Mat(FPlane(1, 0, 0, 0), FPlane(0, 0, 1, 0), FPlane(0, -1, 0, 0), FPlane(0, 0, 0, 1));
+	static const FMatrix MatB(FPlane(0, 1, 0, 0), FPlane(0, 0, 1, 0), FPlane(-1, 0, 0, 0), FPlane(0, 0, 0, 1));
+
+	// Build matrix
+	Up = Up.GetSafeNormal();
+	Forward = Forward.GetSafeNormal();
+
+	FMatrix BuiltMatrix = FRotationMatrix::MakeFromYZ(Up, Forward);
+	BuiltMatrix = Mat * BuiltMatrix * MatB;
+
+	// Fix flipped axes - mirror yaw by rotating back twice the yaw about Z, without a round trip through Euler angles
+	FQuat Quat = FTransform(BuiltMatrix).GetRotation();
+	float Yaw = FMath::Atan2(2.f * (Quat.W * Quat.Z + Quat.X * Quat.Y), 1.f - 2.f * (FMath::Square(Quat.Y) + FMath::Square(Quat.Z)));
+	return FQuat(FVector::UpVector, -2.f * Yaw) * Quat;
+}
 
 
 bool UcDataStorageWrapper::ImportDLL(FString FolderName, FString DLLName)
@@ -55,6 +76,49 @@ bool UcDataStorageWrapper::ImportMethods()
 		{
 			return false;
 		}
+		// Optional - older DLLs only export single face Detect
+		ProcName = "DetectFaces";
+		m_funcDetectFaces = (__DetectFaces)FPlatformProcess::GetDllExport(v_dllHandle, *ProcName);
+		if (m_funcDetectFaces == NULL)
+		{
+			UE_LOG(LogTemp, Log, TEXT("DLL has no DetectFaces, tracking a single face"));
+		}
+		// Optional - without it detect ratio is fixed at Init
+		ProcName = "Reconfigure";
+		m_funcReconfigure = (__Reconfigure)FPlatformProcess::GetDllExport(v_dllHandle, *ProcName);
+		if (m_funcReconfigure == NULL)
+		{
+			UE_LOG(LogTemp, Log, TEXT("DLL has no Reconfigure, detect ratio is fixed"));
+		}
+		// Optional - without it images always come as BGRA
+		ProcName = "GetRawImageYUV";
+		m_funcGetRawImageYUV = (__GetImageYUV)FPlatformProcess::GetDllExport(v_dllHandle, *ProcName);
+		if (m_funcGetRawImageYUV == NULL)
+		{
+			UE_LOG(LogTemp, Log, TEXT("DLL has no GetRawImageYUV, images are BGRA"));
+		}
+		// Optional - without them the DLL drives a single global camera
+		m_funcCreateTracker = (__CreateTracker)FPlatformProcess::GetDllExport(v_dllHandle, TEXT("CreateTracker"));
+		m_funcDestroyTracker = (__DestroyTracker)FPlatformProcess::GetDllExport(v_dllHandle, TEXT("DestroyTracker"));
+		m_funcInitTracker = (__InitTracker)FPlatformProcess::GetDllExport(v_dllHandle, TEXT("InitTracker"));
+		m_funcCloseTracker = (__CloseTracker)FPlatformProcess::GetDllExport(v_dllHandle, TEXT("CloseTracker"));
+		m_funcDetectTrackers = (__DetectTrackers)FPlatformProcess::GetDllExport(v_dllHandle, TEXT("DetectTrackers"));
+		m_funcGetTrackerImage = (__GetTrackerImage)FPlatformProcess::GetDllExport(v_dllHandle, TEXT("GetTrackerImage"));
+		m_funcGetTrackerImageYUV = (__GetTrackerImageYUV)FPlatformProcess::GetDllExport(v_dllHandle, TEXT("GetTrackerImageYUV"));
+		m_funcReconfigureTracker = (__ReconfigureTracker)FPlatformProcess::GetDllExport(v_dllHandle, TEXT("ReconfigureTracker"));
+		if (m_funcCreateTracker == NULL || m_funcDestroyTracker == NULL || m_funcInitTracker == NULL ||
+			m_funcCloseTracker == NULL || m_funcDetectTrackers == NULL || m_funcGetTrackerImage == NULL)
+		{
+			UE_LOG(LogTemp, Log, TEXT("DLL has no Tracker Instances, tracking a single camera"));
+			m_funcCreateTracker = NULL;
+		}
+		// Optional - without it the DLL can't process footage offline
+		ProcName = "DetectImages";
+		m_funcDetectImages = (__DetectImages)FPlatformProcess::GetDllExport(v_dllHandle, *ProcName);
+		if (m_funcDetectImages == NULL)
+		{
+			UE_LOG(LogTemp, Log, TEXT("DLL has no DetectImages, offline processing is unavailable"));
+		}
 	}
 	return true;
 }
@@ -70,6 +134,9 @@ int UcDataStorageWrapper::CallInitCV(int& outCameraWidth, int& outCameraHeight,
 		return INT_MIN;
 	}
 
+	SCOPE_CYCLE_COUNTER(STAT_FacialPose_DLLInit);
+	TRACE_CPUPROFILER_EVENT_SCOPE(FacialPose_DLLInit);
+
 	// Calls DLL function to activate camera and neural nets
 	int init = m_funcInit(outCameraWidth,
 		outCameraHeight,
@@ -79,9 +146,14 @@ int UcDataStorageWrapper::CallInitCV(int& outCameraWidth, int& outCameraHeight,
 		draw,
 		lockEyesNose);
 
-	UE_LOG(LogTemp, Error, TEXT("OpenCV Connection Opened %d"), init);
+	if (init == INT_MIN)
+	{
+		UE_LOG(LogTemp, Error, TEXT("OpenCV Connection Failed to Open for Camera %d"), camId);
+		return INT_MIN;
+	}
+	UE_LOG(LogTemp, Log, TEXT("OpenCV Connection Opened %d"), init);
 
-	return 1;
+	return init;
 }
 
 
@@ -94,6 +166,9 @@ int UcDataStorageWrapper::CallCloseCV()
 		return INT_MIN;
 	}
 
+	SCOPE_CYCLE_COUNTER(STAT_FacialPose_DLLClose);
+	TRACE_CPUPROFILER_EVENT_SCOPE(FacialPose_DLLClose);
+
 	// Calls DLL function to shut down camera
 	m_funcClose();
 	UE_LOG(LogTemp, Log, TEXT("OpenCV Connection Close"));
@@ -111,6 +186,9 @@ int UcDataStorageWrapper::CallGetImageCV(unsigned char* Image, int width, int he
 		return INT_MIN;
 	}
 
+	SCOPE_CYCLE_COUNTER(STAT_FacialPose_DLLGetImage);
+	TRACE_CPUPROFILER_EVENT_SCOPE(FacialPose_DLLGetImage);
+
 	// Calls DLL function to get image from OpenCV stream
 	int result = m_funcGetRawImageBytes(Image, width, height);
 
@@ -127,8 +205,220 @@ int UcDataStorageWrapper::CallDetect(TransformData& outTransform, float* outExpr
 		return INT_MIN;
 	}
 
+	SCOPE_CYCLE_COUNTER(STAT_FacialPose_DLLDetect);
+	TRACE_CPUPROFILER_EVENT_SCOPE(FacialPose_DLLDetect);
+
 	// Calls DLL function to exectute facial pose estimation for one frame
 	m_funcDetect(outTransform, outExpression);
 
 	return 1;
 }
+
+
+int UcDataStorageWrapper::CallDetectFaces(FaceBatchData& outFaces)
+{
+	outFaces.Reset();
+
+	// Single face fallback, Detect has no face flag so a transform left at zero depth means it found none
+	if (m_funcDetectFaces == NULL)
+	{
+		outFaces.transforms[0] = TransformData();
+		int Result = CallDetect(outFaces.transforms[0], outFaces.expressions);
+		if (Result == 1 && outFaces.transforms[0].tZ != 0)
+		{
+			outFaces.trackIds[0] = 0;
+			outFaces.numFaces = 1;
+		}
+		return Result;
+	}
+
+	SCOPE_CYCLE_COUNTER(STAT_FacialPose_DLLDetectFaces);
+	TRACE_CPUPROFILER_EVENT_SCOPE(FacialPose_DLLDetectFaces);
+
+	// Calls DLL function to exectute facial pose estimation for all faces in one batch
+	int Result = m_funcDetectFaces(outFaces);
+	outFaces.numFaces = FMath::Clamp(outFaces.numFaces, 0, FACE_BATCH_MAX_FACES);
+	outFaces.numLandmarks = FMath::Clamp(outFaces.numLandmarks, 0, FACE_BATCH_MAX_LANDMARKS);
+
+	return Result;
+}
+
+
+int UcDataStorageWrapper::CallReconfigure(int detectRatio)
+{
+	// Check if DLL function is loaded
+	if (m_funcReconfigure == NULL)
+	{
+		return INT_MIN;
+	}
+
+	SCOPE_CYCLE_COUNTER(STAT_FacialPose_DLLReconfigure);
+	TRACE_CPUPROFILER_EVENT_SCOPE(FacialPose_DLLReconfigure);
+
+	// Calls DLL function to change detection settings in place
+	return m_funcReconfigure(detectRatio);
+}
+
+
+int UcDataStorageWrapper::CallGetImageYUV(unsigned char* image, int width, int height, EFaceImageFormat format)
+{
+	// Check if DLL function is loaded
+	if (m_funcGetRawImageYUV == NULL || format == EFaceImageFormat::BGRA)
+	{
+		return INT_MIN;
+	}
+
+	SCOPE_CYCLE_COUNTER(STAT_FacialPose_DLLGetImage);
+	TRACE_CPUPROFILER_EVENT_SCOPE(FacialPose_DLLGetImageYUV);
+
+	// Calls DLL function to copy camera planes without colour conversion
+	return m_funcGetRawImageYUV(image, width, height, (int)format);
+}
+
+
+void* UcDataStorageWrapper::CallCreateTracker()
+{
+	if (!HasTrackerInstances())
+	{
+		return nullptr;
+	}
+
+	// Networks are loaded with the first instance and shared after
+	return m_funcCreateTracker();
+}
+
+
+void UcDataStorageWrapper::CallDestroyTracker(void* tracker)
+{
+	if (HasTrackerInstances() && tracker != nullptr)
+	{
+		m_funcDestroyTracker(tracker);
+	}
+}
+
+
+int UcDataStorageWrapper::CallInitTracker(void* tracker, int& outCameraWidth, int& outCameraHeight,
+	int detectRatio, int camId, float fovZoom, bool draw, bool lockEyesNose)
+{
+	if (!HasTrackerInstances() || tracker == nullptr)
+	{
+		return INT_MIN;
+	}
+
+	SCOPE_CYCLE_COUNTER(STAT_FacialPose_DLLInit);
+	TRACE_CPUPROFILER_EVENT_SCOPE(FacialPose_DLLInitTracker);
+
+	int Result = m_funcInitTracker(tracker, outCameraWidth, outCameraHeight, detectRatio, camId, fovZoom, draw, lockEyesNose);
+	UE_LOG(LogTemp, Log, TEXT("OpenCV Connection Opened for Camera %d: %d"), camId, Result);
+
+	return Result;
+}
+
+
+int UcDataStorageWrapper::CallCloseTracker(void* tracker)
+{
+	if (!HasTrackerInstances() || tracker == nullptr)
+	{
+		return INT_MIN;
+	}
+
+	SCOPE_CYCLE_COUNTER(STAT_FacialPose_DLLClose);
+	TRACE_CPUPROFILER_EVENT_SCOPE(FacialPose_DLLCloseTracker);
+
+	m_funcCloseTracker(tracker);
+	return 1;
+}
+
+
+int UcDataStorageWrapper::CallDetectTrackers(void** trackers, int count, FaceBatchData* outFaces)
+{
+	for (int i = 0; i < count; i++)
+	{
+		outFaces[i].Reset();
+	}
+	if (!HasTrackerInstances())
+	{
+		return INT_MIN;
+	}
+
+	SCOPE_CYCLE_COUNTER(STAT_FacialPose_DLLDetectFaces);
+	TRACE_CPUPROFILER_EVENT_SCOPE(FacialPose_DLLDetectTrackers);
+
+	// Faces of every camera go through the networks as one batch
+	int Result = m_funcDetectTrackers(trackers, count, outFaces);
+	for (int i = 0; i < count; i++)
+	{
+		outFaces[i].numFaces = FMath::Clamp(outFaces[i].numFaces, 0, FACE_BATCH_MAX_FACES);
+		outFaces[i].numLandmarks = FMath::Clamp(outFaces[i].numLandmarks, 0, FACE_BATCH_MAX_LANDMARKS);
+	}
+
+	return Result;
+}
+
+
+int UcDataStorageWrapper::CallGetTrackerImage(void* tracker, unsigned char* image, int width, int height)
+{
+	if (!HasTrackerInstances() || tracker == nullptr)
+	{
+		return INT_MIN;
+	}
+
+	SCOPE_CYCLE_COUNTER(STAT_FacialPose_DLLGetImage);
+	TRACE_CPUPROFILER_EVENT_SCOPE(FacialPose_DLLGetTrackerImage);
+
+	return m_funcGetTrackerImage(tracker, image, width, height);
+}
+
+
+int UcDataStorageWrapper::CallGetTrackerImageYUV(void* tracker, unsigned char* image, int width, int height, EFaceImageFormat format)
+{
+	if (m_funcGetTrackerImageYUV == NULL || tracker == nullptr || format == EFaceImageFormat::BGRA)
+	{
+		return INT_MIN;
+	}
+
+	SCOPE_CYCLE_COUNTER(STAT_FacialPose_DLLGetImage);
+	TRACE_CPUPROFILER_EVENT_SCOPE(FacialPose_DLLGetTrackerImageYUV);
+
+	return m_funcGetTrackerImageYUV(tracker, image, width, height, (int)format);
+}
+
+
+int UcDataStorageWrapper::CallReconfigureTracker(void* tracker, int detectRatio)
+{
+	if (m_funcReconfigureTracker == NULL || tracker == nullptr)
+	{
+		return INT_MIN;
+	}
+
+	SCOPE_CYCLE_COUNTER(STAT_FacialPose_DLLReconfigure);
+	TRACE_CPUPROFILER_EVENT_SCOPE(FacialPose_DLLReconfigureTracker);
+
+	return m_funcReconfigureTracker(tracker, detectRatio);
+}
+
+
+int UcDataStorageWrapper::CallDetectImages(const unsigned char** images, int count, int width, int height, FaceBatchData* outFaces)
+{
+	for (int i = 0; i < count; i++)
+	{
+		outFaces[i].Reset();
+	}
+	if (m_funcDetectImages == NULL)
+	{
+		return INT_MIN;
+	}
+
+	SCOPE_CYCLE_COUNTER(STAT_FacialPose_DLLDetectFaces);
+	TRACE_CPUPROFILER_EVENT_SCOPE(FacialPose_DLLDetectImages);
+
+	// Frames go through the networks as one batch, tracks carry on across calls
+	int Result = m_funcDetectImages(images, count, width, height, outFaces);
+	for (int i = 0; i < count; i++)
+	{
+		outFaces[i].numFaces = FMath::Clamp(outFaces[i].numFaces, 0, FACE_BATCH_MAX_FACES);
+		outFaces[i].numLandmarks = FMath::Clamp(outFaces[i].numLandmarks, 0, FACE_BATCH_MAX_LANDMARKS);
+	}
+
+	return Result;
+}
@@ -4,9 +4,108 @@
 
 #include "CoreMinimal.h"
 #include "GameFramework/Pawn.h"
+#include "Engine/Texture2D.h"
+#include "FaceImagePool.h"
+#include "FacePoseBackend.h"
+#include "FaceLatencyHistogram.h"
+#include "FaceFilter.h"
+#include "FacePoseHistory.h"
+#include "FaceQualityGovernor.h"
+#include "FaceAnimInstance.h"
+#include "FaceRetarget.h"
+#include "FaceAnimBaker.h"
 #include "ArFaceRig.generated.h"
 
 
+DECLARE_DYNAMIC_MULTICAST_DELEGATE(FOnFaceTrackerReady);
+DECLARE_DYNAMIC_MULTICAST_DELEGATE(FOnFaceTrackerFailed);
+
+
+/** Detection a face was last bound to, in camera image coordinates normalized to 0-1 */
+USTRUCT(BlueprintType)
+struct FACIALPOSEESTIMATION_API FFaceDetection
+{
+	GENERATED_BODY()
+
+	/** Whether the face's track is in view, false while its last pose is held */
+	UPROPERTY(BlueprintReadOnly, Category = "ArFace | Detection")
+	bool bPresent = false;
+
+	/** Detector score, 0 to 1 */
+	UPROPERTY(BlueprintReadOnly, Category = "ArFace | Detection")
+	float Confidence = 0.f;
+
+	/** Bounding box, invalid if the backend gives none */
+	UPROPERTY(BlueprintReadOnly, Category = "ArFace | Detection")
+	FBox2D Box = FBox2D(ForceInit);
+
+	/** 2D landmarks in the 68 point layout, empty if the backend gives none */
+	UPROPERTY(BlueprintReadOnly, Category = "ArFace | Detection")
+	TArray<FVector2D> Landmarks;
+};
+
+
+/** Morph target resolved for one of the DLL's expression outputs, or for a retarget curve */
+struct FArFaceMorphBinding
+{
+	/** Expression output, or retarget curve while retargeting */
+	int32 ExpressionIndex;
+	int32 MorphIndex;
+	FName MorphName;
+};
+
+
+/** One face mesh driven by the rig, bound to a track id from the DLL */
+struct FArFaceInstance
+{
+	class USkeletalMeshComponent* Mesh;
+
+	/** Position in the rig's face pool, also the face's slot in the anim pose source */
+	int32 Index;
+
+	/** Track id this face follows, INDEX_NONE while unbound */
+	int32 TrackId;
+
+	/** Index of this face in the current detection batch, INDEX_NONE if not in view */
+	int32 DetectionIndex;
+
+	/** Platform time the track left view, zero while in view */
+	double LostTime;
+
+	/** Confidence, box and landmarks of the newest detection */
+	FFaceDetection Detection;
+
+	/** Prev frame transforms for blending */
+	FVector PrevPosition;
+	FRotator PrevRotation;
+
+	/** Prev frame blendshapes for blending */
+	float BlendValues[51];
+	float PrevBlendValues[51];
+
+	/** Blendshape values last written to the mesh, one per expression output or retarget curve */
+	TArray<float> AppliedBlendValues;
+
+	/** Transform last written to the mesh, or to the anim pose source */
+	FTransform AppliedTransform;
+
+	/** Whether the face's UFaceAnimInstance poses the mesh, instead of the rig */
+	bool bAnimPose;
+
+	/** Whether the rig writes the mesh's morph weights by index, instead of SetMorphTarget */
+	bool bDirectMorphWeights;
+
+	/** Slot in the world's UFaceSmoothingSubsystem, INDEX_NONE while the rig smooths its own blendshapes */
+	int32 SmoothingSlot;
+
+	/** One Euro or Kalman filter state */
+	FFaceFilterState Filter;
+
+	/** Filtered poses by capture time, sampled at display time */
+	FFacePoseHistory PoseHistory;
+};
+
+
 /**
 * Pawn class which runs AR facial pose estimation on live video stream.
 * Contains a camera, face model, and an image plane.
@@ -26,8 +125,65 @@ public:
 	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "ARFace | Objects")
 	class USkeletalMeshComponent* FaceMesh;
 
-	/** Face blendshapes */
-	TArray<FString> BlendShapeArray;
+	/** Morph target name for each of the DLL's 51 expression outputs, if empty the mesh's morph target order is used */
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "ArFace | Geo")
+	TArray<FName> ExpressionNames;
+
+	/** Maps expression outputs onto the mesh's own curves, instead of one morph target per output */
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "ArFace | Geo")
+	class UFaceRetargetAsset* Retarget;
+
+	/** Compiled Retarget, and the curve values it was last evaluated to */
+	TSharedPtr<const FFaceRetargetMatrix, ESPMode::ThreadSafe> RetargetMatrix;
+	TArray<float, TAlignedHeapAllocator<16>> RetargetValues;
+
+	/** Minimum change in a blendshape value before it is written to the face mesh */
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "ArFace | Geo")
+	float BlendShapeEpsilon;
+
+	/**
+	 * Write morph weights of faces posed on the game thread straight into the mesh by index, skipping SetMorphTarget's name lookups.
+	 * Only for face meshes without an anim instance, as it also turns off their skeleton update, which would rebuild the weights.
+	 */
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "ArFace | Geo")
+	bool bDirectMorphWeights;
+
+	/** Pose faces from UFaceAnimInstance on animation worker threads, instead of moving components on the game thread */
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "ArFace | Geo")
+	bool bApplyPoseInAnimation;
+
+	/** Latest pose of each face, read by the anim instances while bApplyPoseInAnimation */
+	TSharedPtr<FFaceAnimPoseSource, ESPMode::ThreadSafe> AnimPoseSource;
+
+	/** Face blendshapes, resolved once in BeginPlay */
+	TArray<FArFaceMorphBinding> MorphBindings;
+
+	/** Most faces to track at once, extra faces are copies of FaceMesh */
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "ArFace | Geo")
+	int MaxFaces;
+
+	/** Detections below this confidence count as no face */
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "ArFace | Detection", meta = (ClampMin = "0", ClampMax = "1"))
+	float MinFaceConfidence;
+
+	/** Seconds a face holds its last pose after its track leaves view, before it is freed - new tracks may still take it */
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "ArFace | Detection", meta = (ClampMin = "0"))
+	float LostFaceHoldTime;
+
+	/** Seconds over which a held face's blendshapes then ease back to neutral */
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "ArFace | Detection", meta = (ClampMin = "0"))
+	float LostFaceDecayTime;
+
+	/** Confidence, box and landmarks of a face, FaceIndex 0 is FaceMesh - reuses the tracking result, no extra inference */
+	UFUNCTION(BlueprintCallable, Category = "ArFace | Detection")
+	FFaceDetection GetFaceDetection(int32 FaceIndex) const;
+
+	/** Face meshes beyond FaceMesh, created in BeginPlay */
+	UPROPERTY(Transient)
+	TArray<class USkeletalMeshComponent*> PooledFaceMeshes;
+
+	/** Faces available for binding, the first one drives FaceMesh */
+	TArray<FArFaceInstance> Faces;
 
 	/** Custom camera */
 	UPROPERTY(VisibleAnywhere, BlueprintReadOnly, Category = "ARFace | Objects" )
@@ -40,17 +196,53 @@ public:
 	/** Material to override camera stream texture on */
 	class UMaterialInstance* MasterMaterialRef;
 
-	/** Matrix transforms */
-	FMatrix Mat;
-	FMatrix MatB;
+	/** Width of the background image requested from tracking */
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "ArFace | Preview")
+	int PreviewWidth;
 
-	/** Prev frame transforms for blending */
-	FVector PrevPosition;
-	FRotator PrevRotation;
+	/** Derive preview height from the camera resolution, instead of PreviewHeight */
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "ArFace | Preview")
+	bool bMatchCameraAspect;
 
-	/** Prev frame blendshapes for blending */
-	float BlendValues[51];
-	float PrevBlendValues[51];
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "ArFace | Preview")
+	int PreviewHeight;
+
+	/** Pixel layout of the background image, YUV needs YUVViewerMaterial and a backend with YUV images */
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "ArFace | Preview")
+	EFaceImageFormat PreviewFormat;
+
+	/** Material converting YUV planes to RGB, with ViewInputY, ViewInputU, ViewInputV and ViewInputInterleaved parameters */
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "ArFace | Preview")
+	class UMaterialInterface* YUVViewerMaterial;
+
+	/** Persistent camera stream texture, created once and updated in place - Y plane for YUV images */
+	UPROPERTY(Transient)
+	class UTexture2D* BackgroundTexture;
+
+	/** Chroma planes of YUV images, NV12 keeps both in BackgroundUTexture */
+	UPROPERTY(Transient)
+	class UTexture2D* BackgroundUTexture;
+
+	UPROPERTY(Transient)
+	class UTexture2D* BackgroundVTexture;
+
+	/** Persistent material instance displaying the camera stream texture */
+	UPROPERTY(Transient)
+	class UMaterialInstanceDynamic* BackgroundMaterial;
+
+	/** Pool which tracking images are uploaded from */
+	TSharedPtr<FFaceImagePool, ESPMode::ThreadSafe> ImagePool;
+
+	/** Region covering the whole background texture, and its chroma planes */
+	FUpdateTextureRegion2D BackgroundRegion;
+	FUpdateTextureRegion2D BackgroundChromaRegion;
+	int BackgroundWidth;
+	int BackgroundHeight;
+	EFaceImageFormat BackgroundFormat;
+
+	/** Image size tracking was started with, the quality governor scales down from it */
+	int TrackingWidth;
+	int TrackingHeight;
 
 	/** Face scale */
 	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "ArFace | Geo")
@@ -70,6 +262,63 @@ public:
 	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "ArFace | Motion")
 	float BlendShapeBlendMult;
 
+	/** Filter used to smooth transforms and blendshapes, momentum parameters only apply to Momentum */
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "ArFace | Motion")
+	EFaceFilterType FilterType;
+
+	/** Filter tuning of face translation */
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "ArFace | Motion")
+	FFaceFilterSettings TranslationFilter;
+
+	/** Filter tuning of face rotation, One Euro speed is in radians per second */
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "ArFace | Motion")
+	FFaceFilterSettings RotationFilter;
+
+	/** Filter tuning of blendshapes not matched by a group */
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "ArFace | Motion")
+	FFaceFilterSettings ExpressionFilter;
+
+	/** Filter tuning of blendshape groups by name prefix, first match wins */
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "ArFace | Motion")
+	TArray<FFaceFilterGroup> ExpressionFilterGroups;
+
+	/** Per-channel filter parameters, resolved once in BeginPlay */
+	FFaceExpressionFilterParams ExpressionFilterParams;
+	FFaceVectorFilterParams TranslationFilterParams;
+	FFaceVectorFilterParams RotationFilterParams;
+
+	/** Name of each expression output, used to match filter groups */
+	TArray<FName> ExpressionChannelNames;
+
+	/** Capture time of the last frame the filters were run on */
+	double LastCaptureTime;
+
+	/** Smooth blendshapes in one batched pass with every other rig of the world, needs OneEuro or Kalman */
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "ArFace | Motion")
+	bool bBatchSmoothing;
+
+	/** Render the pose predicted for display time instead of the newest detection, needs OneEuro or Kalman */
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "ArFace | Motion")
+	bool bPredictPose;
+
+	/** Seconds from tick until the frame reaches the screen */
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "ArFace | Motion")
+	float DisplayLatency;
+
+	/** Seconds to render behind the prediction, trading latency for interpolation instead of extrapolation */
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "ArFace | Motion")
+	float InterpolationDelay;
+
+	/** Furthest to extrapolate past the newest detection, in seconds */
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "ArFace | Motion")
+	float MaxExtrapolation;
+
+	bool IsPredictingPose() const { return bPredictPose && FilterType != EFaceFilterType::Momentum; }
+
+	/** Publish tracking as Live Link subjects, and pose faces from them instead of the tracking frames */
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "ArFace | Live Link")
+	bool bDriveFromLiveLink;
+
 
 	/** Resolution attained by OpenCV */
 	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "ArFace | OpenCV")
@@ -86,6 +335,10 @@ public:
 	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "ArFace | OpenCV")
 	int CamId;
 
+	/** Tracker instance running the camera, 0 for the main one - give each rig its own to track several cameras at once */
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "ArFace | OpenCV")
+	int TrackerIndex;
+
 	/** Zoom level to use for camera/solve */
 	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "ArFace | OpenCV")
 	float FovZoom;
@@ -98,39 +351,258 @@ public:
 	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "ArFace | OpenCV")
 	bool LockEyesNose;
 
+	/** Let the quality governor tune detect ratio, preview size and inference rate while playing */
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "ArFace | Quality")
+	bool bAdaptiveQuality;
+
+	/** Budget and bounds of the quality governor */
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "ArFace | Quality")
+	FFaceQualitySettings QualitySettings;
+
+	FFaceQualityGovernor QualityGovernor;
+
+	/** Changes the quality governor made, oldest first */
+	UFUNCTION(BlueprintCallable, Category = "ArFace | Quality")
+	TArray<FFaceQualityEvent> GetQualityEvents();
+
+	/** Frame rate, bone and tolerances of takes baked with StartBake */
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "ArFace | Bake")
+	FFaceBakeSettings BakeSettings;
+
+	/** Take being captured, and the face it follows - INDEX_NONE while not baking */
+	FFaceAnimBaker Baker;
+	int32 BakeFaceIndex;
+
+	/** Start capturing a face's pose as it is applied, relative to the rig - FaceIndex 0 is FaceMesh */
+	UFUNCTION(BlueprintCallable, Category = "ArFace | Bake")
+	void StartBake(int32 FaceIndex);
+
+	/** Stop capturing, and bake the take into an animation sequence of FaceMesh's skeleton at AssetPath, eg /Game/Takes/Take_01 - editor only */
+	UFUNCTION(BlueprintCallable, Category = "ArFace | Bake")
+	class UAnimSequence* StopBake(const FString& AssetPath, FFaceBakeStats& Stats);
+
+	/** Frames the tracking worker produced but were never displayed */
+	UPROPERTY(VisibleAnywhere, BlueprintReadOnly, Category = "ArFace | Stats")
+	int DroppedFrames;
+
+	/** Ticks which had no new frame from the tracking worker */
+	UPROPERTY(VisibleAnywhere, BlueprintReadOnly, Category = "ArFace | Stats")
+	int RepeatedFrames;
+
+	/** Detects the tracking worker didn't publish, because the camera hadn't produced a new frame */
+	UPROPERTY(VisibleAnywhere, BlueprintReadOnly, Category = "ArFace | Stats")
+	int DuplicateFrames;
+
+	/** Ticks which skipped the background upload, as the image hadn't changed */
+	UPROPERTY(VisibleAnywhere, BlueprintReadOnly, Category = "ArFace | Stats")
+	int UploadsAvoided;
+
+	/** Rolling windows of backend detect time, and of time from capture until the rig applies the frame */
+	FFaceLatencyHistogram InferenceLatency;
+	FFaceLatencyHistogram CaptureToDisplayLatency;
+
+	/** Inference latency percentiles over the last 256 frames */
+	UFUNCTION(BlueprintCallable, Category = "ArFace | Stats")
+	FFacePoseLatency GetInferenceLatency();
+
+	/** Capture to display latency percentiles over the last 256 frames */
+	UFUNCTION(BlueprintCallable, Category = "ArFace | Stats")
+	FFacePoseLatency GetCaptureToDisplayLatency();
+
+	/** Called once the camera is open, networks are warmed up and tracking has started - until then only the plate shows */
+	UPROPERTY(BlueprintAssignable, Category = "ArFace | Backend")
+	FOnFaceTrackerReady OnTrackerReady;
+
+	/** Called instead of OnTrackerReady if the tracker's camera could not be opened - only the plate shows */
+	UPROPERTY(BlueprintAssignable, Category = "ArFace | Backend")
+	FOnFaceTrackerFailed OnTrackerFailed;
+
+	/** Whether tracking has started */
+	UPROPERTY(VisibleAnywhere, BlueprintReadOnly, Category = "ArFace | Stats")
+	bool bTrackerReady;
+
+	/** Whether the tracker failed to start, tracking never starts then */
+	UPROPERTY(VisibleAnywhere, BlueprintReadOnly, Category = "ArFace | Stats")
+	bool bTrackerFailed;
+
+	/** Seconds from BeginPlay until tracking started, and until the first frame with a face was applied - negative until then */
+	UPROPERTY(VisibleAnywhere, BlueprintReadOnly, Category = "ArFace | Stats")
+	float TimeToTrackerReady;
+
+	UPROPERTY(VisibleAnywhere, BlueprintReadOnly, Category = "ArFace | Stats")
+	float TimeToFirstTrackedFrame;
+
+	/** Platform time of BeginPlay */
+	double BeginPlayTime;
+
 
 protected:
 
 	virtual void BeginPlay() override;
 
+	virtual void EndPlay(const EEndPlayReason::Type EndPlayReason) override;
+
 public:
 
 	virtual void Tick(float DeltaTime) override;
 
 	virtual void SetupPlayerInputComponent(class UInputComponent* PlayerInputComponent) override;
 
+	/**
+	 * Resolve morph target for each expression output - called once from BeginPlay.
+	 */
+	void BindMorphTargets();
+
+	/**
+	 * Resolve filter parameters of each channel from the filter settings - called once from BeginPlay.
+	 */
+	void BuildFilters();
+
+	/**
+	 * Build background texture and material instance - called once from BeginPlay.
+	 * @param Width - Width of images uploaded to the background.
+	 * @param Height - Height of images uploaded to the background.
+	 * @param Format - Pixel layout of images uploaded to the background.
+	 */
+	void CreateBackground(int Width, int Height, EFaceImageFormat Format = EFaceImageFormat::BGRA);
+
+	/**
+	 * Replace background textures with ones of a new size or format - called when the tracking image changes.
+	 * Waits for pending uploads, so it is only meant for rare changes.
+	 * @param Width - Width of images uploaded to the background.
+	 * @param Height - Height of images uploaded to the background.
+	 * @param Format - Pixel layout of images uploaded to the background.
+	 */
+	void ResizeBackground(int Width, int Height, EFaceImageFormat Format);
+
+	/**
+	 * Pass the quality governor's state on to the tracking worker.
+	 */
+	void ApplyQuality();
+
+	/**
+	 * Build face instances and their meshes - called once from BeginPlay.
+	 */
+	void CreateFacePool();
+
+	/**
+	 * Bind face instances to the track ids in a detection batch - called once each tick.
+	 * Faces keep their track id while it stays in view, or is held after leaving it, new ids take free or held faces.
+	 * @param Batch - Detection result for all faces.
+	 */
+	void BindFaces(const struct FaceBatchData& Batch);
+
+	/**
+	 * Copy confidence, box and landmarks of each face in view from a detection batch - called after BindFaces.
+	 * @param Batch - Detection result for all faces.
+	 */
+	void UpdateDetections(const struct FaceBatchData& Batch);
+
+	/**
+	 * Ease a held face's blendshapes back to neutral once LostFaceHoldTime has passed - called once each tick per held face.
+	 * @param Face - Face instance to update.
+	 * @param Now - Platform time.
+	 */
+	void DecayLostFace(FArFaceInstance& Face, double Now);
+
+	/**
+	 * Smooth and apply one detected face - called once each tick per bound face.
+	 * @param Face - Face instance to update.
+	 * @param Transform - Detected transform.
+	 * @param Expression - Array of 51 detected blend values.
+	 * @param DeltaTime - Seconds since the previous detection.
+	 * @param CaptureTime - Platform time the detection was captured.
+	 */
+	void UpdateFace(FArFaceInstance& Face, const struct TransformData& Transform, const float* Expression, float DeltaTime, double CaptureTime);
+
+	/**
+	 * Apply pose sampled from the face's history - called once each tick per bound face while predicting.
+	 * @param Face - Face instance to update.
+	 * @param DisplayTime - Platform time to sample the pose at.
+	 */
+	void ApplyPredictedPose(FArFaceInstance& Face, double DisplayTime);
+
+	/**
+	 * Pose each face from its Live Link subject - called once each tick while driven from Live Link.
+	 * Live Link interpolates subjects by capture time, so the rig's own filters and prediction are skipped.
+	 */
+	void ApplyLiveLinkPose();
+
+	/**
+	 * Filter detected blendshapes into Face.BlendValues - called once each tick.
+	 * @param Face - Face instance to update.
+	 * @param Expression - Array of 51 detected blend values.
+	 * @param DeltaTime - Seconds since the previous detection.
+	 */
+	void SmoothBlendShapes(FArFaceInstance& Face, const float* Expression, float DeltaTime);
+
+	/**
+	 * Take blendshapes filtered by the smoothing subsystem - called once each frame per submitted face, after all actors ticked.
+	 * @param FaceIndex - Face in the pool.
+	 * @param Expression - Array of 51 filtered blend values.
+	 * @param CaptureTime - Platform time the detection was captured.
+	 */
+	void ApplySmoothedBlendShapes(int32 FaceIndex, const float* Expression, double CaptureTime);
+
+	/**
+	 * Add the face's filtered pose to its history, for prediction to sample.
+	 * @param Face - Face instance to update.
+	 * @param CaptureTime - Platform time the detection was captured.
+	 */
+	void AddPoseSample(FArFaceInstance& Face, double CaptureTime);
+
 	/**
 	 * Set blendshapes on face mesh - called once each tick.
+	 * Only values which moved more than BlendShapeEpsilon are written.
+	 * @param Face - Face instance to update.
 	 * @param Blendshapes - Array of 51 blend values.
 	 */
-	void SetBlendShapes(float* Blendshapes);
+	void SetBlendShapes(FArFaceInstance& Face, float* Blendshapes);
+
+	/**
+	 * Set transform of face mesh, or hand it to the face's anim instance - skipped if unchanged.
+	 * @param Face - Face instance to update.
+	 * @param Transform - World transform, scale included.
+	 */
+	void ApplyTransform(FArFaceInstance& Face, const FTransform& Transform);
 
 	/**
-	 * Set transforms of face mesh - called once each tick.
+	 * Filter and set transforms of face mesh - called once each tick, only filters while predicting.
+	 * @param Face - Face instance to update.
 	 * @param Up - Up vector.
 	 * @param Forward - Forward vector.
 	 * @param Translation - Translatin vector.
+	 * @param DeltaTime - Seconds since the previous detection.
+	 */
+	void SetTransforms(FArFaceInstance& Face, FVector Up, FVector Forward, FVector Translation, float DeltaTime);
+
+	/**
+	 * Upload image to background texture - called once each tick.
+	 * Takes ownership of the pooled buffer, which is released once the render thread has read it.
+	 * @param ImageIndex - Index of buffer in the image pool, or INDEX_NONE to keep the current image.
+	 */
+	void SetBackground(int32 ImageIndex);
+
+	/**
+	 * Start tracking once the tracker's camera is open and warmed up, or report its failure - called from BeginPlay or Tick.
+	 * Builds the background at the attained camera resolution, shows the face and fires OnTrackerReady.
+	 * If the camera could not be opened, only fires OnTrackerFailed.
+	 */
+	void BeginTracking();
+
+	/**
+	 * Fit camera FOV and the background plane to OutCameraWidth and OutCameraHeight.
 	 */
-	void SetTransforms(FVector Up, FVector Forward, FVector Translation);
+	void PlaceCamera();
 
 	/**
-	 * Set texture on background plane - called once each tick.
-	 * @param Image - TArray to hold pixel values
+	 * Add latency samples of a new frame and publish percentiles to stats.
+	 * @param Frame - Frame just received from the tracking worker.
 	 */
-	void SetBackground(TArray<unsigned char, TFixedAllocator<512 * 512 * 4>> Image);
+	void UpdateLatency(const struct FFaceTrackingFrame& Frame);
 
 	/**
-	 * Executes whole pose estimation pipeline - called once each tick.
+	 * Applies newest result from the tracking worker - called once each tick.
 	 */
 	void RunDLL();
 };
@@ -0,0 +1,172 @@
+// Copyright 2020 NeuralVFX, Inc. All Rights Reserved.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Kismet/BlueprintFunctionLibrary.h"
+#include "FaceAnimBaker.generated.h"
+
+
+/** How a captured face is resampled and reduced into an animation sequence */
+USTRUCT(BlueprintType)
+struct FACIALPOSEESTIMATION_API FFaceBakeSettings
+{
+	GENERATED_BODY()
+
+	/** Frame rate of the sequence, captured samples are resampled to it */
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "ArFace | Bake", meta = (ClampMin = "1"))
+	float SampleRate = 60.f;
+
+	/** Bone the head transform is baked to, NAME_None for the root */
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "ArFace | Bake")
+	FName BoneName;
+
+	/** Largest error a removed curve key may introduce, in curve units */
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "ArFace | Bake", meta = (ClampMin = "0"))
+	float CurveTolerance = .005f;
+
+	/** Largest head movement, in cm, for position to count as static and keep a single key */
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "ArFace | Bake", meta = (ClampMin = "0"))
+	float PositionTolerance = .01f;
+
+	/** Largest head rotation, in degrees, for rotation to count as static and keep a single key */
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "ArFace | Bake", meta = (ClampMin = "0"))
+	float RotationTolerance = .05f;
+
+	/** Leave out curves which stay within tolerance of zero, as missing curves evaluate to zero */
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "ArFace | Bake")
+	bool bDropStaticCurves = true;
+};
+
+
+/** What a bake kept */
+USTRUCT(BlueprintType)
+struct FACIALPOSEESTIMATION_API FFaceBakeStats
+{
+	GENERATED_BODY()
+
+	UPROPERTY(BlueprintReadOnly, Category = "ArFace | Bake")
+	int32 NumFrames = 0;
+
+	/** Curves written, and curves left out as static at zero */
+	UPROPERTY(BlueprintReadOnly, Category = "ArFace | Bake")
+	int32 NumCurves = 0;
+
+	UPROPERTY(BlueprintReadOnly, Category = "ArFace | Bake")
+	int32 DroppedCurves = 0;
+
+	/** Keys kept over all curves */
+	UPROPERTY(BlueprintReadOnly, Category = "ArFace | Bake")
+	int32 CurveKeys = 0;
+
+	/** Position and rotation keys stored in the raw track, one if static, else one per frame */
+	UPROPERTY(BlueprintReadOnly, Category = "ArFace | Bake")
+	int32 PositionKeys = 0;
+
+	UPROPERTY(BlueprintReadOnly, Category = "ArFace | Bake")
+	int32 RotationKeys = 0;
+};
+
+
+/**
+* Captures a face's pose over time, and bakes it into an animation sequence.
+* Samples may arrive at any rate, they are resampled to the sequence frame rate, then every curve keeps only
+* the keys needed to stay within tolerance. The head goes to a raw track, with one key if static, or every frame.
+*/
+class FACIALPOSEESTIMATION_API FFaceAnimBaker
+{
+public:
+
+	/**
+	* Drop captured samples and start over.
+	* @param InCurveNames - Curve of each of the 51 expression outputs, NAME_None to skip one.
+	* @param InRetarget - Matrix evaluated on every frame before baking, its curves replace the expression curves, may be null.
+	*/
+	void Reset(const TArray<FName>& InCurveNames, TSharedPtr<const class FFaceRetargetMatrix, ESPMode::ThreadSafe> InRetarget = nullptr);
+
+	/**
+	* Capture one sample, samples not later than the previous one are ignored.
+	* @param Time - Seconds, any origin.
+	* @param Transform - Face transform relative to the mesh it will play on, scale included.
+	* @param Expression - Array of 51 blend values.
+	*/
+	void AddSample(double Time, const FTransform& Transform, const float* Expression);
+
+	/**
+	* Capture one track of a session recording.
+	* @param Reader - Open recording.
+	* @param TrackId - Track to capture, frames without it are bridged by interpolation.
+	* @param Scale - Face scale, as the rig's FaceScale.
+	* @return Samples captured.
+	*/
+	int32 AddRecording(const class FFaceSessionReader& Reader, int32 TrackId, float Scale);
+
+	int32 Num() const { return Times.Num(); }
+
+#if WITH_EDITOR
+	/**
+	* Create an animation sequence asset from the captured samples.
+	* @param Skeleton - Skeleton of the face mesh.
+	* @param AssetPath - Long package name, eg /Game/Takes/Take_01.
+	* @param Settings - Frame rate, bone and tolerances.
+	* @param outStats - Keys kept, may be null.
+	* @return The new sequence, or null if there was nothing to bake.
+	*/
+	class UAnimSequence* Bake(class USkeleton* Skeleton, const FString& AssetPath, const FFaceBakeSettings& Settings, FFaceBakeStats* outStats = nullptr) const;
+#endif
+
+	/**
+	* Keys needed to follow a channel within tolerance, by recursive subdivision at the worst frame.
+	* A channel within tolerance of its first frame keeps only that key.
+	* @param NumFrames - Frames of the channel.
+	* @param Tolerance - Largest error allowed.
+	* @param Error - Error at a frame, when interpolating linearly between two keys, called as Error(First, Last, Frame).
+	* @param outKeys - Frames to keep, in order.
+	*/
+	static void ReduceKeys(int32 NumFrames, float Tolerance, TFunctionRef<float(int32, int32, int32)> Error, TArray<int32>& outKeys);
+
+private:
+
+	TArray<FName> CurveNames;
+	TSharedPtr<const class FFaceRetargetMatrix, ESPMode::ThreadSafe> Retarget;
+
+	/** Captured samples, 51 expression values each */
+	TArray<double> Times;
+	TArray<FTransform> Transforms;
+	TArray<float> Expressions;
+};
+
+
+/** Bakes session recordings to animation sequences, editor only */
+UCLASS()
+class FACIALPOSEESTIMATION_API UFaceAnimBakeLibrary : public UBlueprintFunctionLibrary
+{
+	GENERATED_BODY()
+
+public:
+
+	/**
+	* Bake one track of a session recording.
+	* @param RecordingPath - Recording file.
+	* @param TrackId - Track to bake.
+	* @param Mesh - Face mesh the sequence is for.
+	* @param ExpressionNames - Curve of each expression output, if empty the mesh's morph target order is used.
+	* @param Retarget - Maps expression outputs onto the mesh's own curves, may be null.
+	* @param FaceScale - Face scale, as the rig's FaceScale.
+	* @param AssetPath - Long package name, eg /Game/Takes/Take_01.
+	* @param Settings - Frame rate, bone and tolerances.
+	* @param Stats - Keys kept.
+	* @return The new sequence, or null if it failed.
+	*/
+	UFUNCTION(BlueprintCallable, Category = "ArFace | Bake")
+	static class UAnimSequence* BakeRecording(const FString& RecordingPath, int32 TrackId, class USkeletalMesh* Mesh, const TArray<FName>& ExpressionNames,
+		class UFaceRetargetAsset* Retarget, float FaceScale, const FString& AssetPath, const FFaceBakeSettings& Settings, FFaceBakeStats& Stats);
+
+	/**
+	* Curve name of each expression output, as the rig binds them.
+	* @param Mesh - Face mesh.
+	* @param ExpressionNames - Names set on the rig, if empty the mesh's morph target order is used.
+	* @return 51 names, NAME_None where there is none.
+	*/
+	static TArray<FName> GetExpressionCurveNames(class USkeletalMesh* Mesh, const TArray<FName>& ExpressionNames);
+};
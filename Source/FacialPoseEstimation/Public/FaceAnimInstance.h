@@ -0,0 +1,156 @@
+// Copyright 2020 NeuralVFX, Inc. All Rights Reserved.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Animation/AnimInstance.h"
+#include "Animation/AnimInstanceProxy.h"
+#include "Animation/SmartName.h"
+#include "cDataStorageWrapper.h"
+#include "FaceRetarget.h"
+#include "FaceAnimInstance.generated.h"
+
+
+/** Pose of one face as the rig wants it rendered */
+struct FFaceAnimPose
+{
+	FFaceAnimPose() :
+		Transform(FTransform::Identity), bHasTransform(false)
+	{
+		FMemory::Memzero(BlendValues);
+	}
+
+	/** World transform of the face, scale included */
+	FTransform Transform;
+	bool bHasTransform;
+
+	float BlendValues[51];
+};
+
+
+/**
+* Latest filtered pose of every face in a rig, written on the game thread and read by animation worker threads.
+* Writes are small copies under a lock, so the game thread never touches the face components.
+*/
+class FACIALPOSEESTIMATION_API FFaceAnimPoseSource
+{
+public:
+
+	FFaceAnimPoseSource();
+
+	/**
+	* Curve each expression drives, eg the face mesh's morph targets.
+	* @param InCurveNames - Name per expression output, or per retarget curve, NAME_None to skip one.
+	* @param InRetarget - Matrix readers map expressions to curves with, null for one curve per expression.
+	*/
+	void SetCurveNames(const TArray<FName>& InCurveNames, TSharedPtr<const FFaceRetargetMatrix, ESPMode::ThreadSafe> InRetarget = nullptr);
+
+	/**
+	* Copy curve names if they changed, so readers only resolve them again when needed.
+	* @param InOutVersion - Version the reader has, updated to the current one.
+	* @param outCurveNames - Array names are copied to.
+	* @param outRetarget - Retarget matrix, if any.
+	* @return Whether names were copied.
+	*/
+	bool GetCurveNames(uint32& InOutVersion, TArray<FName>& outCurveNames, TSharedPtr<const FFaceRetargetMatrix, ESPMode::ThreadSafe>& outRetarget) const;
+
+	/**
+	* @param Face - Face slot of the rig.
+	* @param Transform - World transform of the face.
+	*/
+	void SetTransform(int32 Face, const FTransform& Transform);
+
+	/**
+	* @param Face - Face slot of the rig.
+	* @param BlendValues - 51 expression values.
+	*/
+	void SetBlendValues(int32 Face, const float* BlendValues);
+
+	/**
+	* Copy the pose of a face.
+	* @param Face - Face slot of the rig.
+	* @param outPose - Pose written here.
+	* @return Whether the face slot exists.
+	*/
+	bool GetPose(int32 Face, FFaceAnimPose& outPose) const;
+
+private:
+
+	mutable FCriticalSection Lock;
+	FFaceAnimPose Poses[FACE_BATCH_MAX_FACES];
+
+	TArray<FName> CurveNames;
+	TSharedPtr<const FFaceRetargetMatrix, ESPMode::ThreadSafe> Retarget;
+	uint32 CurveNamesVersion;
+};
+
+
+/** Animation proxy which poses one face from a pose source, on animation worker threads */
+struct FACIALPOSEESTIMATION_API FFaceAnimInstanceProxy : public FAnimInstanceProxy
+{
+	FFaceAnimInstanceProxy() {}
+	FFaceAnimInstanceProxy(UAnimInstance* InAnimInstance) : FAnimInstanceProxy(InAnimInstance) {}
+
+	/** FAnimInstanceProxy - PreUpdate runs on the game thread, Update and Evaluate on animation workers */
+	virtual void PreUpdate(UAnimInstance* InAnimInstance, float DeltaSeconds) override;
+	virtual void Update(float DeltaSeconds) override;
+	virtual bool Evaluate(FPoseContext& Output) override;
+
+private:
+
+	/** Copied from the anim instance each PreUpdate */
+	TSharedPtr<FFaceAnimPoseSource, ESPMode::ThreadSafe> Source;
+	int32 FaceIndex = 0;
+	FName HeadBoneName;
+
+	/** Pose read in Update, used by Evaluate */
+	FFaceAnimPose Pose;
+
+	/** Curve of each expression, resolved on the game thread when the source's names change */
+	TArray<SmartName::UID_Type> CurveUIDs;
+	uint32 CurveNamesVersion = 0;
+
+	/** Retarget run during evaluation, and the curve values it produced */
+	TSharedPtr<const FFaceRetargetMatrix, ESPMode::ThreadSafe> Retarget;
+	TArray<float, TAlignedHeapAllocator<16>> RetargetValues;
+};
+
+
+/**
+* Anim instance which writes a rig's face pose as the head bone transform and expression curves.
+* Update and evaluation run with the rest of the animation work, off the game thread,
+* so the rig never moves components or sets morph targets itself.
+* Expression curves drive morph targets of the same name, the skeleton's curves need the morph target flag.
+*/
+UCLASS(Transient)
+class FACIALPOSEESTIMATION_API UFaceAnimInstance : public UAnimInstance
+{
+	GENERATED_BODY()
+
+	friend struct FFaceAnimInstanceProxy;
+
+public:
+
+	UFaceAnimInstance();
+
+	/** Bone carrying the face transform, the root bone if None or not in the skeleton */
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "ArFace | Animation")
+	FName HeadBoneName;
+
+	/**
+	* Pose this face from a source.
+	* @param InSource - Source the rig writes to.
+	* @param InFaceIndex - Face slot of the rig.
+	*/
+	void SetPoseSource(TSharedPtr<FFaceAnimPoseSource, ESPMode::ThreadSafe> InSource, int32 InFaceIndex);
+
+protected:
+
+	/** UAnimInstance */
+	virtual FAnimInstanceProxy* CreateAnimInstanceProxy() override;
+
+private:
+
+	TSharedPtr<FFaceAnimPoseSource, ESPMode::ThreadSafe> Source;
+	int32 FaceIndex;
+};
@@ -0,0 +1,220 @@
+// Copyright 2020 NeuralVFX, Inc. All Rights Reserved.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "FaceFilter.generated.h"
+
+
+/** How tracked transforms and blendshapes are smoothed */
+UENUM(BlueprintType)
+enum class EFaceFilterType : uint8
+{
+	/** Original momentum prediction blended with a fixed Lerp */
+	Momentum,
+
+	/** One Euro filter - cutoff rises with speed, so still faces are steady and fast motion has little lag */
+	OneEuro,
+
+	/** Constant velocity Kalman filter */
+	Kalman
+};
+
+
+/** Tuning of the One Euro and Kalman filters for a set of channels */
+USTRUCT(BlueprintType)
+struct FACIALPOSEESTIMATION_API FFaceFilterSettings
+{
+	GENERATED_BODY()
+
+	/** One Euro - cutoff in Hz while still, lower removes more jitter */
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "ArFace | Filter")
+	float MinCutoff = 1.f;
+
+	/** One Euro - cutoff increase per unit of speed, higher removes more lag */
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "ArFace | Filter")
+	float Beta = .5f;
+
+	/** One Euro - cutoff in Hz of the speed estimate */
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "ArFace | Filter")
+	float DerivativeCutoff = 1.f;
+
+	/** Kalman - how much velocity may change, higher follows faster */
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "ArFace | Filter")
+	float ProcessNoise = 50.f;
+
+	/** Kalman - how noisy measurements are, higher smooths more */
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "ArFace | Filter")
+	float MeasurementNoise = .01f;
+};
+
+
+/** Filter settings for every expression channel whose name starts with a prefix */
+USTRUCT(BlueprintType)
+struct FACIALPOSEESTIMATION_API FFaceFilterGroup
+{
+	GENERATED_BODY()
+
+	/** Case insensitive prefix of expression names, eg "eye" or "jaw" */
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "ArFace | Filter")
+	FString NamePrefix;
+
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "ArFace | Filter")
+	FFaceFilterSettings Settings;
+};
+
+
+/** Per-channel filter parameters, struct-of-arrays so channels are filtered four at a time */
+template<int32 NumChannels>
+struct TFaceFilterParams
+{
+	static_assert(NumChannels % 4 == 0, "Channels must fill whole SIMD registers");
+
+	alignas(16) float MinCutoff[NumChannels];
+	alignas(16) float Beta[NumChannels];
+	alignas(16) float DerivativeCutoff[NumChannels];
+	alignas(16) float ProcessNoise[NumChannels];
+	alignas(16) float MeasurementNoise[NumChannels];
+
+	TFaceFilterParams()
+	{
+		SetAll(FFaceFilterSettings());
+	}
+
+	void Set(int32 Channel, const FFaceFilterSettings& Settings)
+	{
+		MinCutoff[Channel] = Settings.MinCutoff;
+		Beta[Channel] = Settings.Beta;
+		DerivativeCutoff[Channel] = Settings.DerivativeCutoff;
+		ProcessNoise[Channel] = Settings.ProcessNoise;
+		MeasurementNoise[Channel] = Settings.MeasurementNoise;
+	}
+
+	void SetAll(const FFaceFilterSettings& Settings)
+	{
+		for (int32 i = 0; i < NumChannels; i++)
+		{
+			Set(i, Settings);
+		}
+	}
+};
+
+
+/** Per-channel filter state, struct-of-arrays like the parameters */
+template<int32 NumChannels>
+struct TFaceFilterState
+{
+	static_assert(NumChannels % 4 == 0, "Channels must fill whole SIMD registers");
+
+	/** Filtered value, the filter's output */
+	alignas(16) float Value[NumChannels];
+
+	/** One Euro speed estimate, or Kalman velocity */
+	alignas(16) float Derivative[NumChannels];
+
+	/** Kalman covariance */
+	alignas(16) float P00[NumChannels];
+	alignas(16) float P01[NumChannels];
+	alignas(16) float P11[NumChannels];
+
+	bool bInitialized;
+
+	TFaceFilterState()
+	{
+		Reset();
+	}
+
+	void Reset()
+	{
+		FMemory::Memzero(*this);
+		bInitialized = false;
+	}
+};
+
+
+/** Blendshape channels, 51 padded to a whole number of SIMD registers */
+#define FACE_FILTER_EXPRESSION_CHANNELS 52
+
+typedef TFaceFilterParams<FACE_FILTER_EXPRESSION_CHANNELS> FFaceExpressionFilterParams;
+typedef TFaceFilterState<FACE_FILTER_EXPRESSION_CHANNELS> FFaceExpressionFilterState;
+
+/** Translation, or rotation error, in three channels padded to four */
+typedef TFaceFilterParams<4> FFaceVectorFilterParams;
+typedef TFaceFilterState<4> FFaceVectorFilterState;
+
+
+/** Filter state of one tracked face */
+struct FFaceFilterState
+{
+	FFaceExpressionFilterState Expression;
+	FFaceVectorFilterState Translation;
+
+	/** Filtered rotation, and the One Euro speed estimate or Kalman error state */
+	FQuat Rotation;
+	float RotationSpeed;
+	FFaceVectorFilterState RotationError;
+
+	bool bRotationInitialized;
+
+	FFaceFilterState()
+	{
+		Reset();
+	}
+
+	void Reset()
+	{
+		Expression.Reset();
+		Translation.Reset();
+		RotationError.Reset();
+		Rotation = FQuat::Identity;
+		RotationSpeed = 0;
+		bRotationInitialized = false;
+	}
+};
+
+
+/** SIMD filter kernels - output is left in State.Value */
+class FACIALPOSEESTIMATION_API FFaceFilter
+{
+public:
+
+	template<int32 NumChannels>
+	static void OneEuro(const TFaceFilterParams<NumChannels>& Params, TFaceFilterState<NumChannels>& State, const float* In, float DeltaTime)
+	{
+		OneEuro(Params.MinCutoff, Params.Beta, Params.DerivativeCutoff,
+			State.Value, State.Derivative, State.bInitialized, In, NumChannels, DeltaTime);
+	}
+
+	template<int32 NumChannels>
+	static void Kalman(const TFaceFilterParams<NumChannels>& Params, TFaceFilterState<NumChannels>& State, const float* In, float DeltaTime)
+	{
+		Kalman(Params.ProcessNoise, Params.MeasurementNoise,
+			State.Value, State.Derivative, State.P00, State.P01, State.P11, State.bInitialized, In, NumChannels, DeltaTime);
+	}
+
+	/**
+	* Filter a rotation with One Euro - cutoff follows angular speed, blending with Slerp.
+	* @param Settings - Filter tuning.
+	* @param State - Face filter state, Rotation holds the result.
+	* @param Measured - Measured rotation.
+	* @param DeltaTime - Seconds since last measurement.
+	*/
+	static void OneEuroRotation(const FFaceFilterSettings& Settings, FFaceFilterState& State, const FQuat& Measured, float DeltaTime);
+
+	/**
+	* Filter a rotation with a constant velocity Kalman filter on the rotation error.
+	* @param Params - Filter tuning of the three axes.
+	* @param State - Face filter state, Rotation holds the result.
+	* @param Measured - Measured rotation.
+	* @param DeltaTime - Seconds since last measurement.
+	*/
+	static void KalmanRotation(const FFaceVectorFilterParams& Params, FFaceFilterState& State, const FQuat& Measured, float DeltaTime);
+
+	/** Kernels over any run of NumChannels contiguous channels - a multiple of 4, with 16 byte aligned arrays */
+	static void OneEuro(const float* MinCutoff, const float* Beta, const float* DerivativeCutoff,
+		float* Value, float* Derivative, bool& bInitialized, const float* In, int32 NumChannels, float DeltaTime);
+
+	static void Kalman(const float* ProcessNoise, const float* MeasurementNoise,
+		float* Value, float* Velocity, float* P00, float* P01, float* P11, bool& bInitialized,
+		const float* In, int32 NumChannels, float DeltaTime);
+};
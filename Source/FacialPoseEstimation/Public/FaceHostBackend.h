@@ -0,0 +1,127 @@
+// Copyright 2020 NeuralVFX, Inc. All Rights Reserved.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "UObject/NoExportTypes.h"
+#include "HAL/PlatformMemory.h"
+#include "HAL/PlatformProcess.h"
+#include "HAL/ThreadSafeCounter.h"
+#include "FacePoseBackend.h"
+#include "cDataStorageWrapper.h"
+#include "FaceHostBackend.generated.h"
+
+
+struct FaceTrackerShared;
+struct FaceTrackerSlot;
+
+
+/**
+* Backend which runs the tracking library in FaceTrackerHost, a separate process.
+* Results come back through a shared memory ring, and a host which crashes or stalls is restarted.
+*/
+UCLASS()
+class FACIALPOSEESTIMATION_API UFaceHostBackend : public UObject, public IFacePoseBackend
+{
+	GENERATED_BODY()
+
+public:
+
+	UFaceHostBackend();
+
+	/** Host executable */
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "ArFace | Host")
+	FString HostPath;
+
+	/** Tracking library the host loads */
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "ArFace | Host")
+	FString LibraryPath;
+
+	/** Cores the host may run on as a bit mask, zero for any */
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "ArFace | Host")
+	int64 AffinityMask;
+
+	/** Seconds without a result or heartbeat before a host which already published a result is treated as hung */
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "ArFace | Host")
+	float HostTimeout;
+
+	/** Whether to restart a host which exited or hung, and init it again */
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "ArFace | Host")
+	bool bRestartHost;
+
+	/** Number of times the host was restarted */
+	int32 GetRestartCount() const { return RestartCount.GetValue(); }
+
+	/** Kill the host as if it crashed inside Publish, leaving a half written slot - restart tests only */
+	void SimulateHostCrash();
+
+	virtual void BeginDestroy() override;
+
+	/** IFacePoseBackend implementation */
+	virtual int CallInitCV(int& outCameraWidth, int& outCameraHeight, int detectRatio,
+		int camId, float fovZoom, bool draw, bool lockEyesNose) override;
+	virtual int CallCloseCV() override;
+	virtual int CallDetect(TransformData& outTransform, float* outExpression) override;
+	virtual int CallDetectFaces(FaceBatchData& outFaces) override;
+	virtual int CallReconfigure(int detectRatio) override;
+	virtual int CallGetImageCV(unsigned char* image, int width, int height) override;
+	virtual int CallGetImageYUV(unsigned char* image, int width, int height, EFaceImageFormat format) override;
+
+private:
+
+	/**
+	* Create the shared region if needed, launch the host and wait until it has loaded the library.
+	* @return Whether the host is ready for commands.
+	*/
+	bool StartHost();
+
+	/** Ask the host to quit, and kill it if it doesn't */
+	void StopHost();
+
+	/** Kill and start the host, and send Init again if it had been */
+	bool RestartHost();
+
+	/**
+	* Send a command and wait for the host to finish it.
+	* @param Command - FaceTrackerCommand.
+	* @param Timeout - Seconds to wait.
+	* @return Host's result, INT_MIN if it didn't answer.
+	*/
+	int SendCommand(uint32 Command, float Timeout);
+
+	/** Whether the host process runs and its heartbeat or results moved within HostTimeout, or a longer timeout before its first result */
+	bool IsHostAlive();
+
+	/**
+	* Copy the image of the last read slot, if it is still intact and of the requested size and layout.
+	* @return Whether the image was copied.
+	*/
+	bool CopyImage(unsigned char* image, int width, int height, uint32 format);
+
+	FPlatformMemory::FSharedMemoryRegion* Region;
+	FaceTrackerShared* Shared;
+	FProcHandle HostProcess;
+
+	/** Results read so far, and slot of the newest with its sequence */
+	uint64 ReadCount;
+	FaceTrackerSlot* ReadSlot;
+	uint64 ReadSequence;
+
+	/** Host heartbeat and result count last seen, and when either changed */
+	uint64 LastHostHeartbeat;
+	uint64 LastHostWriteCount;
+	double LastHostHeartbeatTime;
+	double LastRestartTime;
+
+	/** Init arguments, kept to init a restarted host */
+	bool bInitialized;
+	int CameraWidth;
+	int CameraHeight;
+	int DetectRatio;
+	int CamId;
+	float FovZoom;
+	bool bDraw;
+	bool bLockEyesNose;
+
+	FThreadSafeCounter RestartCount;
+};
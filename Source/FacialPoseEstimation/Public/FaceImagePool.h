@@ -0,0 +1,53 @@
+// Copyright 2020 NeuralVFX, Inc. All Rights Reserved.
+
+#pragma once
+
+#include "CoreMinimal.h"
+
+
+/**
+* Fixed pool of reusable, aligned image buffers.
+* Buffers are handed around by index - whoever acquired an index owns that buffer until it is released.
+* Acquire and Release are lock-free and may be called from any thread.
+*/
+class FACIALPOSEESTIMATION_API FFaceImagePool
+{
+public:
+
+	/**
+	* @param InNumBuffers - Number of buffers, at most 32.
+	* @param InBufferSize - Size in bytes of each buffer.
+	*/
+	FFaceImagePool(int32 InNumBuffers, int32 InBufferSize);
+
+	~FFaceImagePool();
+
+	/**
+	* Take ownership of a free buffer.
+	* @return Index of buffer, or INDEX_NONE if every buffer is in use.
+	*/
+	int32 Acquire();
+
+	/**
+	* Return ownership of a buffer to the pool.
+	* @param Index - Index returned by Acquire.
+	*/
+	void Release(int32 Index);
+
+	/** Memory of buffer at index */
+	uint8* GetData(int32 Index) const { return Buffers[Index]; }
+
+	/** Size in bytes of each buffer */
+	int32 GetBufferSize() const { return BufferSize; }
+
+	/** Number of buffers currently owned by someone */
+	int32 GetNumInUse() const;
+
+private:
+
+	TArray<uint8*> Buffers;
+	int32 BufferSize;
+
+	/** One bit per buffer, set while the buffer is free */
+	volatile int32 FreeMask;
+};
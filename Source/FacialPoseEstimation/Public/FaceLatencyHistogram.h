@@ -0,0 +1,52 @@
+// Copyright 2020 NeuralVFX, Inc. All Rights Reserved.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "FaceLatencyHistogram.generated.h"
+
+
+/** Percentiles of a rolling latency window, in milliseconds */
+USTRUCT(BlueprintType)
+struct FACIALPOSEESTIMATION_API FFacePoseLatency
+{
+	GENERATED_BODY()
+
+	UPROPERTY(BlueprintReadOnly, Category = "ArFace | Stats")
+	float P50 = 0;
+
+	UPROPERTY(BlueprintReadOnly, Category = "ArFace | Stats")
+	float P95 = 0;
+
+	UPROPERTY(BlueprintReadOnly, Category = "ArFace | Stats")
+	float P99 = 0;
+};
+
+
+/** Rolling window of latency samples - game thread only */
+class FACIALPOSEESTIMATION_API FFaceLatencyHistogram
+{
+public:
+
+	/** @param InWindowSize - Number of most recent samples kept. */
+	FFaceLatencyHistogram(int32 InWindowSize = 256);
+
+	/**
+	* Add a sample, replacing the oldest once the window is full.
+	* @param Ms - Latency in milliseconds.
+	*/
+	void AddSample(float Ms);
+
+	/** Percentiles over the current window, cached until the next sample */
+	const FFacePoseLatency& GetPercentiles();
+
+private:
+
+	TArray<float> Samples;
+	TArray<float> Sorted;
+	int32 WindowSize;
+	int32 NextSample;
+
+	FFacePoseLatency Cached;
+	bool bDirty;
+};
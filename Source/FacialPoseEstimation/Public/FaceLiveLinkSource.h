@@ -0,0 +1,67 @@
+// Copyright 2020 NeuralVFX, Inc. All Rights Reserved.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "HAL/ThreadSafeCounter.h"
+#include "ILiveLinkSource.h"
+#include "cDataStorageWrapper.h"
+
+
+/**
+* Live Link source publishing tracking results, one animation subject per face.
+* Each subject has a single "head" bone and one curve per expression output.
+* Frames are pushed from the tracking worker thread, stamped with their capture time.
+*/
+class FACIALPOSEESTIMATION_API FFaceLiveLinkSource : public ILiveLinkSource
+{
+public:
+
+	/** Name of the bone carrying the head transform */
+	static const FName HeadBoneName;
+
+	/**
+	* @param InSubjectName - Subject of the first face, further faces add their index.
+	* @param InCurveNames - Curve name of each of the 51 expression outputs, missing names are generated.
+	* @param InMaxSubjects - Faces to publish.
+	*/
+	FFaceLiveLinkSource(FName InSubjectName, const TArray<FName>& InCurveNames, int32 InMaxSubjects);
+
+	/**
+	* Subject name of a face.
+	* @param BaseName - Subject of the first face.
+	* @param Index - Face index in the detection batch.
+	* @return BaseName for the first face, BaseName_Index after.
+	*/
+	static FName GetSubjectName(FName BaseName, int32 Index);
+
+	/**
+	* Publish one tracking result - safe to call from any thread.
+	* @param Faces - Detection result for all faces.
+	* @param CaptureTime - Platform time the camera frame was captured.
+	* @param FrameId - Camera frame id.
+	*/
+	void PushFrame(const FaceBatchData& Faces, double CaptureTime, uint64 FrameId);
+
+	/** ILiveLinkSource */
+	virtual void ReceiveClient(ILiveLinkClient* InClient, FGuid InSourceGuid) override;
+	virtual bool IsSourceStillValid() const override;
+	virtual bool RequestSourceShutdown() override;
+	virtual FText GetSourceType() const override;
+	virtual FText GetSourceMachineName() const override;
+	virtual FText GetSourceStatus() const override;
+
+private:
+
+	/** Guards Client, which is set and cleared on the game thread while the worker pushes */
+	mutable FCriticalSection ClientLock;
+	ILiveLinkClient* Client;
+	FGuid SourceGuid;
+
+	FName SubjectName;
+	TArray<FName> CurveNames;
+	int32 MaxSubjects;
+
+	/** Frames pushed, shown as status */
+	FThreadSafeCounter NumFramesPushed;
+};
@@ -0,0 +1,62 @@
+// Copyright 2020 NeuralVFX, Inc. All Rights Reserved.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "UObject/NoExportTypes.h"
+#include "FacePoseBackend.h"
+#include "FaceNetworkStream.h"
+#include "FaceNetworkBackend.generated.h"
+
+
+/**
+* Backend which receives tracking results streamed by another machine's FFaceNetworkPublisher.
+* Has no camera image, the background is left grey.
+*/
+UCLASS()
+class FACIALPOSEESTIMATION_API UFaceNetworkBackend : public UObject, public IFacePoseBackend
+{
+	GENERATED_BODY()
+
+public:
+
+	UFaceNetworkBackend();
+
+	/** UDP port to listen on */
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "ArFace | Network")
+	int32 Port;
+
+	/** Seconds each detect waits for a packet before returning the last result again */
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "ArFace | Network")
+	float ReceiveTimeout;
+
+	/** Packets missing from the stream so far */
+	uint32 GetNumLost() const { return Decoder.GetNumLost(); }
+
+	virtual void BeginDestroy() override;
+
+	/** IFacePoseBackend implementation */
+	virtual int CallInitCV(int& outCameraWidth, int& outCameraHeight, int detectRatio,
+		int camId, float fovZoom, bool draw, bool lockEyesNose) override;
+	virtual int CallCloseCV() override;
+	virtual int CallDetect(TransformData& outTransform, float* outExpression) override;
+	virtual int CallDetectFaces(FaceBatchData& outFaces) override;
+	virtual int CallReconfigure(int detectRatio) override;
+	virtual int CallGetImageCV(unsigned char* image, int width, int height) override;
+	virtual int CallGetImageYUV(unsigned char* image, int width, int height, EFaceImageFormat format) override;
+
+private:
+
+	class FSocket* Socket;
+
+	/** Reused for every packet, so receiving never allocates */
+	TSharedPtr<class FInternetAddr> Sender;
+	uint8 Packet[FACE_STREAM_MAX_PACKET];
+
+	FFaceStreamDecoder Decoder;
+
+	/** Newest decoded result, its header and local time it arrived */
+	FaceBatchData Latest;
+	FFaceStreamHeader LatestHeader;
+	double LatestReceiveTime;
+};
@@ -0,0 +1,180 @@
+// Copyright 2020 NeuralVFX, Inc. All Rights Reserved.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "cDataStorageWrapper.h"
+
+
+/**
+* Tracking results as UDP packets.
+* Each face is 60 fixed-point channels - translation, forward and up vectors, and 51 expressions.
+* Keyframes carry every channel, other packets carry zigzag varint deltas against the last keyframe
+* for the channels which changed, so a lost packet never breaks the packets after it.
+*/
+
+/** Identifies a stream packet - "FPNS" */
+#define FACE_STREAM_MAGIC 0x534E5046
+
+#define FACE_STREAM_VERSION 2
+
+/** Packet carries every channel and starts a new reference */
+#define FACE_STREAM_KEYFRAME 0x1
+
+/** Translation, forward, up and expressions */
+#define FACE_STREAM_CHANNELS 60
+
+/** Largest packet, eight faces of keyframe */
+#define FACE_STREAM_MAX_PACKET 4096
+
+
+/** Fixed part of every packet */
+struct FFaceStreamHeader
+{
+	uint32 Magic;
+	uint8 Version;
+	uint8 Flags;
+	uint8 NumFaces;
+	uint8 Reserved;
+
+	/** Packet counter, and the keyframe this packet is a delta of */
+	uint32 Sequence;
+	uint32 KeyframeSequence;
+
+	/** Random per encoder, a new one means the sender restarted and its sequence started over */
+	uint32 SessionId;
+
+	/** Camera frame id */
+	uint64 FrameId;
+
+	/** Sender's platform time of the capture, and how old the capture was when sent */
+	double CaptureTime;
+	float CaptureAge;
+};
+
+
+/** Turns tracking results into packets, keeping the keyframe deltas refer to */
+class FACIALPOSEESTIMATION_API FFaceStreamEncoder
+{
+public:
+
+	/**
+	* @param InKeyframeInterval - Packets between keyframes, at least one.
+	*/
+	FFaceStreamEncoder(int32 InKeyframeInterval = 30);
+
+	/**
+	* Encode one tracking result.
+	* @param Faces - Detection result for all faces.
+	* @param CaptureTime - Platform time the camera frame was captured.
+	* @param FrameId - Camera frame id.
+	* @param outPacket - Buffer of FACE_STREAM_MAX_PACKET bytes.
+	* @return Bytes written.
+	*/
+	int32 Encode(const FaceBatchData& Faces, double CaptureTime, uint64 FrameId, uint8* outPacket);
+
+	/** Send a keyframe next, eg when a receiver joins */
+	void ForceKeyframe() { PacketsSinceKeyframe = KeyframeInterval; }
+
+private:
+
+	int32 KeyframeInterval;
+	int32 PacketsSinceKeyframe;
+	uint32 NextSequence;
+	uint32 SessionId;
+
+	/** Keyframe deltas are taken against */
+	uint32 KeyframeSequence;
+	int32 KeyframeNumFaces;
+	int32 KeyframeTrackIds[FACE_BATCH_MAX_FACES];
+	int32 KeyframeChannels[FACE_BATCH_MAX_FACES][FACE_STREAM_CHANNELS];
+};
+
+
+/** Turns packets back into tracking results, with no allocations */
+class FACIALPOSEESTIMATION_API FFaceStreamDecoder
+{
+public:
+
+	FFaceStreamDecoder();
+
+	/**
+	* Decode one packet - older packets than the last decoded, and deltas of a keyframe which was lost, are dropped.
+	* A packet of another session starts over, as its sender restarted.
+	* @param Packet - Packet data.
+	* @param Size - Packet size.
+	* @param outFaces - Struct where faces are written to, only if the packet is decoded.
+	* @param outHeader - Packet header, with timestamps.
+	* @return Whether outFaces holds a new result.
+	*/
+	bool Decode(const uint8* Packet, int32 Size, FaceBatchData& outFaces, FFaceStreamHeader& outHeader);
+
+	/** Packets missing from the sequence so far */
+	uint32 GetNumLost() const { return NumLost; }
+
+	/** Packets dropped because their keyframe never arrived */
+	uint32 GetNumUndecodable() const { return NumUndecodable; }
+
+private:
+
+	bool bHasKeyframe;
+	bool bHasPacket;
+	uint32 SessionId;
+	uint32 LastSequence;
+	uint32 NumLost;
+	uint32 NumUndecodable;
+
+	uint32 KeyframeSequence;
+	int32 KeyframeNumFaces;
+	int32 KeyframeTrackIds[FACE_BATCH_MAX_FACES];
+	int32 KeyframeChannels[FACE_BATCH_MAX_FACES][FACE_STREAM_CHANNELS];
+
+	/** Channels of the packet being decoded, only kept once it is whole */
+	int32 Channels[FACE_BATCH_MAX_FACES][FACE_STREAM_CHANNELS];
+};
+
+
+/**
+* Sends every tracking result to one or more UDP endpoints.
+* Frames are pushed from the tracking worker thread.
+*/
+class FACIALPOSEESTIMATION_API FFaceNetworkPublisher
+{
+public:
+
+	/**
+	* @param InKeyframeInterval - Packets between keyframes.
+	*/
+	FFaceNetworkPublisher(int32 InKeyframeInterval = 30);
+	~FFaceNetworkPublisher();
+
+	/**
+	* Create socket and resolve endpoints.
+	* @param Destinations - Comma separated IP:Port list, eg "10.0.0.2:7830,10.0.0.3:7830".
+	* @return Whether at least one endpoint is valid.
+	*/
+	bool Open(const FString& Destinations);
+
+	/** Close socket */
+	void Close();
+
+	/**
+	* Send one tracking result to every endpoint.
+	* @param Faces - Detection result for all faces.
+	* @param CaptureTime - Platform time the camera frame was captured.
+	* @param FrameId - Camera frame id.
+	*/
+	void PushFrame(const FaceBatchData& Faces, double CaptureTime, uint64 FrameId);
+
+	/** Bytes sent to each endpoint so far */
+	int64 GetBytesSent() const { return BytesSent; }
+
+private:
+
+	class FSocket* Socket;
+	TArray<TSharedRef<class FInternetAddr>> Endpoints;
+
+	FFaceStreamEncoder Encoder;
+	uint8 Packet[FACE_STREAM_MAX_PACKET];
+	int64 BytesSent;
+};
@@ -0,0 +1,123 @@
+// Copyright 2020 NeuralVFX, Inc. All Rights Reserved.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "UObject/Interface.h"
+#include "FacePoseBackend.generated.h"
+
+
+struct TransformData;
+struct FaceBatchData;
+
+
+/** Which backend the game instance runs the tracking pipeline on */
+UENUM(BlueprintType)
+enum class EFacePoseBackendType : uint8
+{
+	/** Native tracking library - DLL on Windows, shared object on Linux */
+	Library,
+
+	/** In-process deterministic generator, needs no camera or LibTorch */
+	Synthetic,
+
+	/** Playback of a recorded tracking session */
+	Replay,
+
+	/** Tracking library run in the FaceTrackerHost process */
+	Host,
+
+	/** Results streamed over UDP from another machine */
+	Network
+};
+
+
+/** Pixel layout of camera images handed to Unreal */
+UENUM(BlueprintType)
+enum class EFaceImageFormat : uint8
+{
+	/** 4 bytes per pixel, converted by the backend */
+	BGRA,
+
+	/** Full size Y plane, then half size interleaved UV plane - 1.5 bytes per pixel */
+	NV12,
+
+	/** Full size Y plane, then half size U and V planes - 1.5 bytes per pixel */
+	I420
+};
+
+
+UINTERFACE(MinimalAPI, meta = (CannotImplementInterfaceInBlueprint))
+class UFacePoseBackend : public UInterface
+{
+	GENERATED_BODY()
+};
+
+
+/** Source of tracking results - the same calls the DLL exposes */
+class FACIALPOSEESTIMATION_API IFacePoseBackend
+{
+	GENERATED_BODY()
+
+public:
+
+	/**
+	* Initiate camera stream and Neural Networks.
+	* @param outCameraWidth - Width which the backend used for camera stream.
+	* @param outCameraHeight - Height which the backend used for camera stream.
+	* @param detectRatio - ratio to scale image by for initial face detection
+	* @param camId - Which camera id to try to use.
+	* @param inFovZoom - Zoom amount for pinhole camera, to match Unreal.
+	* @param draw - Wheher or not to draw technical indicators over frame.
+	* @param lockEyesNose - Whether to lock eye and nose points for PnP solve.
+	* @return Whether operation is succesful.
+	*/
+	virtual int CallInitCV(int& outCameraWidth, int& outCameraHeight, int detectRatio,
+		int camId, float fovZoom, bool draw, bool lockEyesNose) = 0;
+
+	/**
+	* Close connection to camera.
+	*/
+	virtual int CallCloseCV() = 0;
+
+	/**
+	* Exectute whole facial pose estimation pipeline for a single face.
+	* @param outTransform - Pointer where result transform is copied to.
+	* @param outExpression - Pointer where result blendshapes are copied to.
+	*/
+	virtual int CallDetect(TransformData& outTransform, float* outExpression) = 0;
+
+	/**
+	* Execute facial pose estimation for every face in view.
+	* @param outFaces - Struct where result for all faces is copied to.
+	* @return Whether operation is succesful.
+	*/
+	virtual int CallDetectFaces(FaceBatchData& outFaces) = 0;
+
+	/**
+	* Change detection settings of a running backend, without a Close and Init cycle.
+	* Only called from the thread which calls detect.
+	* @param detectRatio - ratio to scale image by for initial face detection
+	* @return Whether operation is succesful, INT_MIN if the backend can't reconfigure.
+	*/
+	virtual int CallReconfigure(int detectRatio) = 0;
+
+	/**
+	* Get single frame from camera stream, resized and reformatted for Unreal.
+	* @param image - Pointer to write image to.
+	* @param width - Resize width.
+	* @param height - Resize height.
+	* @return Whether operation is succesful.
+	*/
+	virtual int CallGetImageCV(unsigned char* image, int width, int height) = 0;
+
+	/**
+	* Get single frame from camera stream as YUV planes, skipping the conversion to BGRA.
+	* @param image - Pointer to write planes to, width * height * 3 / 2 bytes.
+	* @param width - Resize width, even.
+	* @param height - Resize height, even.
+	* @param format - NV12 or I420.
+	* @return Whether operation is succesful, INT_MIN if the backend only has BGRA.
+	*/
+	virtual int CallGetImageYUV(unsigned char* image, int width, int height, EFaceImageFormat format) = 0;
+};
@@ -0,0 +1,63 @@
+// Copyright 2020 NeuralVFX, Inc. All Rights Reserved.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Commandlets/Commandlet.h"
+#include "FacePoseBenchmarkCommandlet.generated.h"
+
+
+/**
+* Headless benchmark of the per-frame rig pipeline, driven by the synthetic backend.
+* Times each stage for several rig counts and image sizes, and writes the result as JSON.
+* Run with: UE4Editor-Cmd <Project> -run=FacePoseBenchmark [-output=<file>] [-frames=300] [-rigs=1,10,100] [-sizes=256,512,1024] [-curves=51,256,1024] [-smoothing=1,10,100,1000]
+* With -host=<FaceTrackerHost> -lib=<library> [-camera=0] it also crashes and restarts the tracker host mid run.
+*/
+UCLASS()
+class FACIALPOSEESTIMATION_API UFacePoseBenchmarkCommandlet : public UCommandlet
+{
+	GENERATED_BODY()
+
+public:
+
+	UFacePoseBenchmarkCommandlet();
+
+	virtual int32 Main(const FString& Params) override;
+
+private:
+
+	/**
+	* Drive a set of rigs for a number of frames and time each stage.
+	* @param NumRigs - Rigs to spawn.
+	* @param ImageSize - Width and height of the background image.
+	* @param NumFrames - Frames to run.
+	* @return Scenario result.
+	*/
+	TSharedPtr<class FJsonObject> RunScenario(int NumRigs, int ImageSize, int NumFrames);
+
+	/**
+	* Time retarget matrix evaluation for a number of target curves.
+	* @param NumCurves - Target curves, each mixing a few expression outputs.
+	* @param NumFrames - Evaluations to run.
+	* @return Retarget result.
+	*/
+	TSharedPtr<class FJsonObject> RunRetarget(int NumCurves, int NumFrames);
+
+	/**
+	* Time blendshape smoothing of many rigs, one by one against the batched subsystem pass.
+	* @param NumRigs - Faces to smooth.
+	* @param NumFrames - Frames to run.
+	* @return Smoothing result.
+	*/
+	TSharedPtr<class FJsonObject> RunSmoothing(int NumRigs, int NumFrames);
+
+	/**
+	* Detect through the tracker host, crash it halfway, and check detects resume once it is restarted.
+	* @param HostPath - FaceTrackerHost executable.
+	* @param LibraryPath - Tracking library the host loads.
+	* @param CamId - Camera the host opens.
+	* @param NumFrames - Detects to run, half before and half after the crash.
+	* @return Restart result.
+	*/
+	TSharedPtr<class FJsonObject> RunHostRestart(const FString& HostPath, const FString& LibraryPath, int CamId, int NumFrames);
+};
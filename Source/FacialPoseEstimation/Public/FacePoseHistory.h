@@ -0,0 +1,69 @@
+// Copyright 2020 NeuralVFX, Inc. All Rights Reserved.
+
+#pragma once
+
+#include "CoreMinimal.h"
+
+
+/** Filtered pose of one face at one capture time */
+struct FFacePoseSample
+{
+	/** Platform time the camera frame was captured */
+	double Time;
+
+	FVector Translation;
+	FQuat Rotation;
+	float BlendValues[51];
+};
+
+
+/**
+* Short history of filtered poses, sampled at an arbitrary time.
+* Lets the rig render the pose for when the frame is displayed, instead of when the camera saw it.
+*/
+class FACIALPOSEESTIMATION_API FFacePoseHistory
+{
+public:
+
+	/** Samples kept, enough to bracket display time behind a small interpolation delay */
+	static const int32 MaxSamples = 4;
+
+	FFacePoseHistory();
+
+	void Reset();
+
+	/**
+	* Add newest pose, samples older than the newest are ignored.
+	* @param Sample - Pose and its capture time.
+	*/
+	void Add(const FFacePoseSample& Sample);
+
+	/**
+	* Pose at a time - interpolated between samples, or extrapolated from the newest two.
+	* @param Time - Platform time to sample at.
+	* @param MaxExtrapolation - Furthest to extrapolate past the newest sample, in seconds.
+	* @param outSample - Pose written here.
+	* @return Whether the history has any sample.
+	*/
+	bool Sample(double Time, float MaxExtrapolation, FFacePoseSample& outSample) const;
+
+	int32 Num() const { return NumSamples; }
+
+private:
+
+	/** Sample by age, zero is the newest */
+	const FFacePoseSample& GetByAge(int32 Age) const { return Samples[(Newest - Age + MaxSamples) % MaxSamples]; }
+
+	/**
+	* Blend two samples, Alpha outside 0-1 extrapolates.
+	* @param A - Older sample.
+	* @param B - Newer sample.
+	* @param Alpha - Blend factor.
+	* @param outSample - Pose written here.
+	*/
+	static void Blend(const FFacePoseSample& A, const FFacePoseSample& B, float Alpha, FFacePoseSample& outSample);
+
+	FFacePoseSample Samples[MaxSamples];
+	int32 Newest;
+	int32 NumSamples;
+};
@@ -0,0 +1,28 @@
+// Copyright 2020 NeuralVFX, Inc. All Rights Reserved.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Commandlets/Commandlet.h"
+#include "FacePoseProcessCommandlet.generated.h"
+
+
+/**
+* Offline tracking of an image sequence, as fast as the machine allows.
+* Decode, batched inference and pose filtering run as a three stage pipeline, a batch of frames per stage,
+* and write a session recording (and optionally CSV curves) timestamped from the sequence frame rate.
+* Needs a DLL exporting DetectImages.
+* Run with: UE4Editor-Cmd <Project> -run=FacePoseProcess -input=<folder or pattern> -output=<file> [-fps=30] [-batch=8]
+*     [-filter=OneEuro|Kalman|None] [-csv=<file>] [-report=<file>] [-preview=0] [-previewsize=256] [-detectratio=1] [-fovzoom=1]
+*/
+UCLASS()
+class FACIALPOSEESTIMATION_API UFacePoseProcessCommandlet : public UCommandlet
+{
+	GENERATED_BODY()
+
+public:
+
+	UFacePoseProcessCommandlet();
+
+	virtual int32 Main(const FString& Params) override;
+};
@@ -0,0 +1,149 @@
+// Copyright 2020 NeuralVFX, Inc. All Rights Reserved.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "FaceQualityGovernor.generated.h"
+
+
+/** Budget and bounds the quality governor works within */
+USTRUCT(BlueprintType)
+struct FACIALPOSEESTIMATION_API FFaceQualitySettings
+{
+	GENERATED_BODY()
+
+	/** Game frame time to stay under */
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "ArFace | Quality")
+	float TargetFrameMs = 16.6f;
+
+	/** Backend detect time to stay under */
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "ArFace | Quality")
+	float InferenceBudgetMs = 33.f;
+
+	/** Fraction either side of a budget where nothing changes, stops the governor flipping back and forth */
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "ArFace | Quality")
+	float Hysteresis = .15f;
+
+	/** Seconds of measurements behind each decision, at most one change per interval */
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "ArFace | Quality")
+	float EvaluationInterval = 1.f;
+
+	/** Detect ratio bounds, higher detects on a smaller image */
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "ArFace | Quality")
+	int MinDetectRatio = 1;
+
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "ArFace | Quality")
+	int MaxDetectRatio = 4;
+
+	/** Smallest background image, as a fraction of full size */
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "ArFace | Quality")
+	float MinPreviewScale = .5f;
+
+	/** Inference rate bounds, in detects per second */
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "ArFace | Quality")
+	float MinInferenceRate = 15.f;
+
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "ArFace | Quality")
+	float MaxInferenceRate = 60.f;
+};
+
+
+/** One change made by the quality governor */
+USTRUCT(BlueprintType)
+struct FACIALPOSEESTIMATION_API FFaceQualityEvent
+{
+	GENERATED_BODY()
+
+	/** Real seconds since play started, ignoring pause and time dilation */
+	UPROPERTY(VisibleAnywhere, BlueprintReadOnly, Category = "ArFace | Quality")
+	float Time = 0;
+
+	/** DetectRatio, PreviewScale or MaxInferenceRate */
+	UPROPERTY(VisibleAnywhere, BlueprintReadOnly, Category = "ArFace | Quality")
+	FName Setting;
+
+	UPROPERTY(VisibleAnywhere, BlueprintReadOnly, Category = "ArFace | Quality")
+	float OldValue = 0;
+
+	UPROPERTY(VisibleAnywhere, BlueprintReadOnly, Category = "ArFace | Quality")
+	float NewValue = 0;
+
+	/** Average frame and detect time which led to the change */
+	UPROPERTY(VisibleAnywhere, BlueprintReadOnly, Category = "ArFace | Quality")
+	float FrameMs = 0;
+
+	UPROPERTY(VisibleAnywhere, BlueprintReadOnly, Category = "ArFace | Quality")
+	float InferenceMs = 0;
+};
+
+
+/** Tracking quality picked by the governor */
+struct FFaceQualityState
+{
+	int DetectRatio;
+	float PreviewScale;
+	float MaxInferenceRate;
+};
+
+
+/**
+* Watches frame and inference times, and steps tracking quality to stay within budget.
+* Over budget it raises detect ratio, then shrinks the preview, then lowers inference rate.
+* Under budget it undoes the same steps in reverse.
+*/
+class FACIALPOSEESTIMATION_API FFaceQualityGovernor
+{
+public:
+
+	/** Events kept for inspection, older ones are dropped */
+	static const int32 MaxEvents = 128;
+
+	FFaceQualityGovernor();
+
+	/**
+	* Start governing from a known state.
+	* @param InSettings - Budget and bounds.
+	* @param InitialState - Quality tracking started with, clamped to the bounds.
+	*/
+	void Reset(const FFaceQualitySettings& InSettings, const FFaceQualityState& InitialState);
+
+	/** Add one game frame time */
+	void AddFrame(float FrameMs);
+
+	/** Add one backend detect time */
+	void AddInference(float InferenceMs);
+
+	/**
+	* Make a decision once enough time passed.
+	* @param Time - Real seconds since play started, ignoring pause and time dilation.
+	* @return Whether the state changed.
+	*/
+	bool Update(float Time);
+
+	const FFaceQualityState& GetState() const { return State; }
+
+	const TArray<FFaceQualityEvent>& GetEvents() const { return Events; }
+
+private:
+
+	/** Step quality down, returns whether anything was left to lower */
+	bool Degrade(float Time, float FrameMs, float InferenceMs, bool bInferenceOnly);
+
+	/** Step quality up, returns whether anything was left to raise */
+	bool Improve(float Time, float FrameMs, float InferenceMs);
+
+	/** Log and keep one change */
+	void AddEvent(float Time, FName Setting, float OldValue, float NewValue, float FrameMs, float InferenceMs);
+
+	FFaceQualitySettings Settings;
+	FFaceQualityState State;
+
+	/** Measurements since the last decision */
+	double FrameMsSum;
+	int32 NumFrames;
+	double InferenceMsSum;
+	int32 NumInferences;
+	float LastDecisionTime;
+
+	TArray<FFaceQualityEvent> Events;
+};
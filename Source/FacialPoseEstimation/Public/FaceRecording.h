@@ -0,0 +1,143 @@
+// Copyright 2020 NeuralVFX, Inc. All Rights Reserved.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "cDataStorageWrapper.h"
+
+
+/**
+* On-disk header of a tracking session recording.
+* The file is the header followed by fixed-size chunks, so any frame is found by arithmetic alone.
+* Each chunk holds FramesPerChunk frame records, then one preview image per PreviewInterval frames.
+*/
+struct FFaceRecordingHeader
+{
+	uint32 Magic;
+	uint32 Version;
+	uint32 Flags;
+	uint32 MaxFaces;
+	uint32 FramesPerChunk;
+	uint32 PreviewInterval;
+	uint32 PreviewWidth;
+	uint32 PreviewHeight;
+	uint32 RecordSize;
+	uint32 ChunkSize;
+
+	/** Frames written, updated after each chunk */
+	uint64 NumFrames;
+};
+
+/** Identifies a recording file - "FPRC" */
+#define FACE_RECORDING_MAGIC 0x43525046
+
+#define FACE_RECORDING_VERSION 1
+
+/** Expressions are stored as 16-bit fixed point instead of float */
+#define FACE_RECORDING_QUANTIZED 0x1
+
+
+/**
+* Streams tracking results into an append-only chunked recording.
+* Frames are collected into a chunk in memory and written once the chunk is full.
+*/
+class FACIALPOSEESTIMATION_API FFaceSessionRecorder
+{
+public:
+
+	FFaceSessionRecorder();
+	~FFaceSessionRecorder();
+
+	/**
+	* Create recording file.
+	* @param Path - File to write, replaced if it exists.
+	* @param InMaxFaces - Faces stored per frame.
+	* @param bQuantize - Whether to store expressions as 16-bit.
+	* @param InPreviewInterval - Store a preview image every this many frames, zero for none.
+	* @param InPreviewSize - Width and height of preview images.
+	* @return Whether the operation is succesfull.
+	*/
+	bool Open(const FString& Path, int InMaxFaces, bool bQuantize, int InPreviewInterval, int InPreviewSize);
+
+	/**
+	* Append one frame.
+	* @param Time - Seconds since recording started.
+	* @param Faces - Tracking result.
+	* @param Image - Camera image to take a preview from, may be null.
+	* @param Width - Image width.
+	* @param Height - Image height.
+	* @param Format - Pixel layout of the image, YUV images give grey previews from the Y plane.
+	*/
+	void WriteFrame(double Time, const FaceBatchData& Faces, const uint8* Image, int Width, int Height,
+		EFaceImageFormat Format = EFaceImageFormat::BGRA);
+
+	/** Write partial chunk and close file */
+	void Close();
+
+	bool IsOpen() const { return File != nullptr; }
+
+private:
+
+	/** Write current chunk and update frame count in the header */
+	void FlushChunk();
+
+	class IFileHandle* File;
+	FFaceRecordingHeader Header;
+
+	/** Chunk being filled */
+	TArray<uint8> Chunk;
+	uint32 FramesInChunk;
+};
+
+
+/**
+* Memory-mapped reader for a session recording.
+* Frames are decoded straight from the mapping, with no parsing up front.
+*/
+class FACIALPOSEESTIMATION_API FFaceSessionReader
+{
+public:
+
+	FFaceSessionReader();
+	~FFaceSessionReader();
+
+	/**
+	* Map recording file.
+	* @param Path - File to read.
+	* @return Whether the operation is succesfull.
+	*/
+	bool Open(const FString& Path);
+
+	void Close();
+
+	int64 GetNumFrames() const { return NumFrames; }
+
+	const FFaceRecordingHeader& GetHeader() const { return Header; }
+
+	/**
+	* Decode one frame.
+	* @param Index - Frame index, below GetNumFrames.
+	* @param outFaces - Struct where faces are copied to.
+	* @return Seconds since recording started.
+	*/
+	double ReadFrame(int64 Index, FaceBatchData& outFaces) const;
+
+	/**
+	* Preview image closest at or before a frame.
+	* @param Index - Frame index, below GetNumFrames.
+	* @return BGRA preview of PreviewWidth * PreviewHeight, or null if the recording has none.
+	*/
+	const uint8* GetPreview(int64 Index) const;
+
+private:
+
+	/** Start of the record for a frame */
+	const uint8* GetRecord(int64 Index) const;
+
+	class IMappedFileHandle* MappedFile;
+	class IMappedFileRegion* MappedRegion;
+	const uint8* Data;
+
+	FFaceRecordingHeader Header;
+	int64 NumFrames;
+};
@@ -0,0 +1,66 @@
+// Copyright 2020 NeuralVFX, Inc. All Rights Reserved.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "UObject/NoExportTypes.h"
+#include "FacePoseBackend.h"
+#include "FaceRecording.h"
+#include "FaceReplayBackend.generated.h"
+
+
+/** Backend which plays back a memory-mapped session recording */
+UCLASS()
+class FACIALPOSEESTIMATION_API UFaceReplayBackend : public UObject, public IFacePoseBackend
+{
+	GENERATED_BODY()
+
+public:
+
+	UFaceReplayBackend();
+
+	/** Recording to play */
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "ArFace | Replay")
+	FString FilePath;
+
+	/** Playback rate, one for original timing, zero for as fast as possible */
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "ArFace | Replay")
+	float Speed;
+
+	/** Whether to start over at the end, otherwise the last frame is held, returned again at 30 Hz until a seek */
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "ArFace | Replay")
+	bool bLoop;
+
+	/**
+	* Jump to a frame - safe to call while tracking runs.
+	* @param Index - Frame index.
+	*/
+	void SeekToFrame(int64 Index);
+
+	int64 GetNumFrames() const { return Reader.GetNumFrames(); }
+
+	/** IFacePoseBackend implementation */
+	virtual int CallInitCV(int& outCameraWidth, int& outCameraHeight, int detectRatio,
+		int camId, float fovZoom, bool draw, bool lockEyesNose) override;
+	virtual int CallCloseCV() override;
+	virtual int CallDetect(TransformData& outTransform, float* outExpression) override;
+	virtual int CallDetectFaces(FaceBatchData& outFaces) override;
+	virtual int CallReconfigure(int detectRatio) override;
+	virtual int CallGetImageCV(unsigned char* image, int width, int height) override;
+	virtual int CallGetImageYUV(unsigned char* image, int width, int height, EFaceImageFormat format) override;
+
+private:
+
+	FFaceSessionReader Reader;
+
+	/** Next frame to play, and frame last played */
+	int64 FrameIndex;
+	int64 CurrentFrame;
+
+	/** Seek requested from another thread, INDEX_NONE if none */
+	volatile int64 PendingSeek;
+
+	/** Wall clock and recording time playback is timed from */
+	double StartWallTime;
+	double StartFrameTime;
+};
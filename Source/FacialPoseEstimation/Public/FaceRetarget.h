@@ -0,0 +1,131 @@
+// Copyright 2020 NeuralVFX, Inc. All Rights Reserved.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Engine/DataAsset.h"
+#include "FaceRetarget.generated.h"
+
+
+/** Contribution of one of the DLL's expression outputs to a target curve */
+USTRUCT(BlueprintType)
+struct FACIALPOSEESTIMATION_API FFaceRetargetWeight
+{
+	GENERATED_BODY()
+
+	/** Expression output of the DLL, 0 to 50 */
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "ArFace | Retarget", meta = (ClampMin = "0", ClampMax = "50"))
+	int32 Source = 0;
+
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "ArFace | Retarget")
+	float Weight = 1.f;
+};
+
+
+/** One curve of the target rig, a weighted sum of expression outputs - Clamp(Gain * Sum + Offset, Min, Max) */
+USTRUCT(BlueprintType)
+struct FACIALPOSEESTIMATION_API FFaceRetargetCurve
+{
+	GENERATED_BODY()
+
+	/** Morph target, or curve, of the target rig */
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "ArFace | Retarget")
+	FName Name;
+
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "ArFace | Retarget")
+	TArray<FFaceRetargetWeight> Weights;
+
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "ArFace | Retarget")
+	float Gain = 1.f;
+
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "ArFace | Retarget")
+	float Offset = 0.f;
+
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "ArFace | Retarget")
+	float Min = 0.f;
+
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "ArFace | Retarget")
+	float Max = 1.f;
+};
+
+
+/**
+* Sparse weight matrix from the 51 expression outputs to any number of target curves.
+* Rows are stored compressed (CSR), each padded to whole SIMD registers, so a row costs one
+* multiply-add per four weights, and gain, offset and clamp run four curves at a time.
+* Immutable once compiled, so any thread may evaluate it.
+*/
+class FACIALPOSEESTIMATION_API FFaceRetargetMatrix
+{
+public:
+
+	/**
+	* Build the matrix - weights on the same source are summed, zero weights dropped.
+	* @param Curves - Target curves.
+	*/
+	void Compile(const TArray<FFaceRetargetCurve>& Curves);
+
+	/**
+	* Evaluate every target curve.
+	* @param Source - 51 expression values.
+	* @param outValues - 16 byte aligned, GetNumPaddedTargets values.
+	*/
+	void Evaluate(const float* Source, float* outValues) const;
+
+	/** Target curve count, and the count rounded up to whole SIMD registers */
+	int32 GetNumTargets() const { return Names.Num(); }
+	int32 GetNumPaddedTargets() const { return Gain.Num(); }
+
+	/** Weights kept after compiling, padding included */
+	int32 GetNumWeights() const { return Weights.Num(); }
+
+	const TArray<FName>& GetNames() const { return Names; }
+
+private:
+
+	TArray<FName> Names;
+
+	/** Row i owns Columns and Weights from RowStart[i] to RowStart[i + 1], always a multiple of 4 */
+	TArray<int32> RowStart;
+	TArray<int32> Columns;
+	TArray<float, TAlignedHeapAllocator<16>> Weights;
+
+	/** Per target, padded with identity rows */
+	TArray<float, TAlignedHeapAllocator<16>> Gain;
+	TArray<float, TAlignedHeapAllocator<16>> Offset;
+	TArray<float, TAlignedHeapAllocator<16>> Min;
+	TArray<float, TAlignedHeapAllocator<16>> Max;
+};
+
+
+/**
+* Maps the DLL's 51 expression outputs onto the curves of another face rig.
+* Compiled into an FFaceRetargetMatrix when loaded, and again whenever it is edited.
+*/
+UCLASS(BlueprintType)
+class FACIALPOSEESTIMATION_API UFaceRetargetAsset : public UDataAsset
+{
+	GENERATED_BODY()
+
+public:
+
+	/** Curves of the target rig */
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "ArFace | Retarget")
+	TArray<FFaceRetargetCurve> Curves;
+
+	/** Compiled matrix, built on first use for assets made at runtime */
+	TSharedPtr<const FFaceRetargetMatrix, ESPMode::ThreadSafe> GetMatrix();
+
+	/** Rebuild the matrix - readers holding the previous one keep it */
+	void Compile();
+
+	virtual void PostLoad() override;
+
+#if WITH_EDITOR
+	virtual void PostEditChangeProperty(FPropertyChangedEvent& PropertyChangedEvent) override;
+#endif
+
+private:
+
+	TSharedPtr<const FFaceRetargetMatrix, ESPMode::ThreadSafe> Matrix;
+};
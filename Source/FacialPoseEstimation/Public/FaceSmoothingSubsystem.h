@@ -0,0 +1,162 @@
+// Copyright 2020 NeuralVFX, Inc. All Rights Reserved.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Subsystems/WorldSubsystem.h"
+#include "Engine/EngineBaseTypes.h"
+#include "FaceFilter.h"
+#include "FaceSmoothingSubsystem.generated.h"
+
+
+/**
+* Blendshape filter state of many faces, struct-of-arrays over every face.
+* Each face owns a slot of FACE_FILTER_EXPRESSION_CHANNELS channels in shared arrays, so one pass
+* walks contiguous memory, and neighbouring faces stepping by the same time share one kernel call.
+*/
+class FACIALPOSEESTIMATION_API FFaceBatchFilter
+{
+public:
+
+	/**
+	* Take a slot, reusing freed ones first.
+	* @param Type - OneEuro or Kalman.
+	* @param Params - Per-channel filter parameters.
+	* @return Slot index.
+	*/
+	int32 Add(EFaceFilterType Type, const FFaceExpressionFilterParams& Params);
+
+	/** Free a slot */
+	void Remove(int32 Slot);
+
+	/** Restart filtering of a slot, so its next input passes straight through */
+	void Reset(int32 Slot);
+
+	/**
+	* Queue a new measurement for the next pass.
+	* @param Slot - Slot index.
+	* @param Expression - Array of 51 detected blend values.
+	* @param DeltaTime - Seconds since the slot's previous measurement.
+	*/
+	void Submit(int32 Slot, const float* Expression, float DeltaTime);
+
+	/**
+	* Filter every slot with a queued measurement.
+	* @param bParallel - Spread slots over task graph workers.
+	* @param SlotsPerChunk - Slots each worker takes at a time.
+	*/
+	void Filter(bool bParallel, int32 SlotsPerChunk);
+
+	/** Slots filtered by the last pass, in slot order */
+	const TArray<int32>& GetFiltered() const { return Filtered; }
+
+	/** Filtered blendshapes of a slot */
+	const float* GetValue(int32 Slot) const { return Value.GetData() + Slot * FACE_FILTER_EXPRESSION_CHANNELS; }
+
+	/** Slots in use */
+	int32 Num() const { return Slots.Num() - FreeSlots.Num(); }
+
+private:
+
+	/** Filter Filtered[Begin] to Filtered[End - 1] */
+	void FilterRange(int32 Begin, int32 End);
+
+	struct FSlot
+	{
+		EFaceFilterType Type;
+		float DeltaTime;
+		bool bInitialized;
+		bool bPending;
+	};
+
+	TArray<FSlot> Slots;
+	TArray<int32> FreeSlots;
+	TArray<int32> Filtered;
+
+	/** Parameters, FACE_FILTER_EXPRESSION_CHANNELS per slot */
+	TArray<float, TAlignedHeapAllocator<16>> MinCutoff;
+	TArray<float, TAlignedHeapAllocator<16>> Beta;
+	TArray<float, TAlignedHeapAllocator<16>> DerivativeCutoff;
+	TArray<float, TAlignedHeapAllocator<16>> ProcessNoise;
+	TArray<float, TAlignedHeapAllocator<16>> MeasurementNoise;
+
+	/** Queued measurements and filter state, FACE_FILTER_EXPRESSION_CHANNELS per slot */
+	TArray<float, TAlignedHeapAllocator<16>> Input;
+	TArray<float, TAlignedHeapAllocator<16>> Value;
+	TArray<float, TAlignedHeapAllocator<16>> Derivative;
+	TArray<float, TAlignedHeapAllocator<16>> P00;
+	TArray<float, TAlignedHeapAllocator<16>> P01;
+	TArray<float, TAlignedHeapAllocator<16>> P11;
+};
+
+
+/**
+* Smooths blendshapes of every rig in the world in one batched pass.
+* Rigs with BatchSmoothing submit detections as they tick, the pass runs once all actors have ticked,
+* then each face gets its filtered blendshapes back on the game thread.
+*/
+UCLASS()
+class FACIALPOSEESTIMATION_API UFaceSmoothingSubsystem : public UWorldSubsystem
+{
+	GENERATED_BODY()
+
+public:
+
+	UFaceSmoothingSubsystem();
+
+	/** Spread the pass over task graph workers */
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "ArFace | Motion")
+	bool bParallel;
+
+	/** Faces each worker filters at a time */
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "ArFace | Motion")
+	int32 SlotsPerChunk;
+
+	virtual void Initialize(FSubsystemCollectionBase& Collection) override;
+	virtual void Deinitialize() override;
+
+	/**
+	* Smooth a face of a rig in the batch.
+	* @param Rig - Rig owning the face.
+	* @param FaceIndex - Face in the rig's pool.
+	* @param Type - OneEuro or Kalman.
+	* @param Params - Per-channel filter parameters.
+	* @return Slot of the face.
+	*/
+	int32 AddFace(class AArFaceRig* Rig, int32 FaceIndex, EFaceFilterType Type, const FFaceExpressionFilterParams& Params);
+
+	/** Stop smoothing a face */
+	void RemoveFace(int32 Slot);
+
+	/** Restart filtering of a face, eg when it binds to a new track */
+	void ResetFace(int32 Slot);
+
+	/**
+	* Queue a detection for this frame's pass.
+	* @param Slot - Slot of the face.
+	* @param Expression - Array of 51 detected blend values.
+	* @param DeltaTime - Seconds since the previous detection.
+	* @param CaptureTime - Platform time the detection was captured.
+	*/
+	void Submit(int32 Slot, const float* Expression, float DeltaTime, double CaptureTime);
+
+	/** Filter queued detections and hand results back to their rigs */
+	void Update();
+
+private:
+
+	void OnWorldPostActorTick(UWorld* InWorld, ELevelTick TickType, float DeltaSeconds);
+
+	/** Face each slot belongs to */
+	struct FOwner
+	{
+		TWeakObjectPtr<class AArFaceRig> Rig;
+		int32 FaceIndex;
+		double CaptureTime;
+	};
+
+	FFaceBatchFilter Batch;
+	TArray<FOwner> Owners;
+
+	FDelegateHandle PostActorTickHandle;
+};
@@ -0,0 +1,67 @@
+// Copyright 2020 NeuralVFX, Inc. All Rights Reserved.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "UObject/NoExportTypes.h"
+#include "FacePoseBackend.h"
+#include "cDataStorageWrapper.h"
+#include "FaceSyntheticBackend.generated.h"
+
+
+/**
+* Backend which produces deterministic poses, expressions and images in process.
+* Lets the rig pipeline run headless, without a camera, DLL or LibTorch.
+*/
+UCLASS()
+class FACIALPOSEESTIMATION_API UFaceSyntheticBackend : public UObject, public IFacePoseBackend
+{
+	GENERATED_BODY()
+
+public:
+
+	UFaceSyntheticBackend();
+
+	/** Frames produced per second, zero for as fast as possible */
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "ArFace | Synthetic")
+	float FrameRate;
+
+	/** Time each detect busy-waits at detect ratio 1, to stand in for inference cost */
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "ArFace | Synthetic")
+	float DetectCostMs;
+
+	/** Number of faces reported each frame */
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "ArFace | Synthetic")
+	int NumFaces;
+
+	/** IFacePoseBackend implementation */
+	virtual int CallInitCV(int& outCameraWidth, int& outCameraHeight, int detectRatio,
+		int camId, float fovZoom, bool draw, bool lockEyesNose) override;
+	virtual int CallCloseCV() override;
+	virtual int CallDetect(TransformData& outTransform, float* outExpression) override;
+	virtual int CallDetectFaces(FaceBatchData& outFaces) override;
+	virtual int CallReconfigure(int detectRatio) override;
+	virtual int CallGetImageCV(unsigned char* image, int width, int height) override;
+	virtual int CallGetImageYUV(unsigned char* image, int width, int height, EFaceImageFormat format) override;
+
+private:
+
+	/**
+	* Fill pose and expression of one face for a frame.
+	* @param Face - Index of face, offsets the motion.
+	* @param outTransform - Transform to fill.
+	* @param outExpression - 51 blendshapes to fill.
+	*/
+	void BuildFace(int Face, TransformData& outTransform, float* outExpression) const;
+
+	/** Wait for next frame slot, then spend the configured detect cost */
+	void Throttle();
+
+	/** Frame counter, drives all generated values */
+	uint64 FrameIndex;
+
+	/** Detect cost scales with the pixels detection runs on */
+	int DetectRatio;
+
+	double NextFrameTime;
+};
@@ -0,0 +1,145 @@
+// Copyright 2020 NeuralVFX, Inc. All Rights Reserved.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "UObject/NoExportTypes.h"
+#include "HAL/CriticalSection.h"
+#include "FacePoseBackend.h"
+#include "cDataStorageWrapper.h"
+#include "FaceTrackerInstance.generated.h"
+
+
+/** Most tracker instances a game instance runs at once */
+#define FACE_MAX_TRACKERS 8
+
+
+/**
+* Gathers detects of every tracker instance into batched DLL calls.
+* The first worker to ask waits up to BatchWindowMs for the other cameras, then runs one
+* inference for all of them, and the others pick up their results. Calls into the DLL are
+* serialized, so requests arriving during an inference form the next batch.
+*/
+class FACIALPOSEESTIMATION_API FFaceDetectScheduler
+{
+public:
+
+	/**
+	* @param InLibrary - Loaded DLL with tracker instances, must outlive the scheduler.
+	* @param InBatchWindowMs - Longest wait for other cameras before a batch runs.
+	*/
+	FFaceDetectScheduler(UcDataStorageWrapper* InLibrary, float InBatchWindowMs = 4.f);
+
+	/** Make room in batches for an open tracker, which may detect from now on */
+	void AddTracker(void* Tracker);
+
+	/** Tracker's camera was closed */
+	void RemoveTracker(void* Tracker);
+
+	/**
+	* Count a tracker in while a worker detects on it every frame, so batches wait for it.
+	* Open trackers which aren't tracking still batch, but nobody waits for them.
+	* @param Tracker - Tracker handle.
+	* @param bTracking - Whether a worker started or stopped on it.
+	*/
+	void SetTrackerTracking(void* Tracker, bool bTracking);
+
+	/**
+	* Detect faces on the newest frame of a tracker, batched with other trackers - blocks until done.
+	* @param Tracker - Tracker handle.
+	* @param outFaces - Struct where faces are copied to.
+	* @return Result of the DLL call.
+	*/
+	int Detect(void* Tracker, FaceBatchData& outFaces);
+
+	/** Trackers in the last batch */
+	int32 GetLastBatchSize() const { return LastBatchSize; }
+
+private:
+
+	/** Detect waiting for a batch, lives on the caller's stack */
+	struct FRequest
+	{
+		void* Tracker;
+		FaceBatchData* Faces;
+		int Result;
+
+		/** Triggered once Faces and Result are written */
+		FEvent* Done;
+	};
+
+	UcDataStorageWrapper* Library;
+	float BatchWindowMs;
+
+	/** Guards Pending, NumTrackers, NumTracking and bHasLeader */
+	FCriticalSection Lock;
+	TArray<FRequest*> Pending;
+	int32 NumTrackers;
+	int32 NumTracking;
+	bool bHasLeader;
+
+	/** One batch in the DLL at a time */
+	FCriticalSection InferenceLock;
+
+	/** Handles and results of the batch in flight, sized once for every tracker */
+	TArray<FRequest*> Batch;
+	TArray<void*> BatchTrackers;
+	TArray<FaceBatchData> BatchFaces;
+	int32 LastBatchSize;
+};
+
+
+/**
+* Backend for one camera of a DLL with tracker instances.
+* Several instances run at once, each on its own tracking worker, sharing the DLL's networks.
+*/
+UCLASS()
+class FACIALPOSEESTIMATION_API UFaceTrackerInstance : public UObject, public IFacePoseBackend
+{
+	GENERATED_BODY()
+
+public:
+
+	UFaceTrackerInstance();
+
+	/**
+	* Create the DLL tracker.
+	* @param InLibrary - Loaded DLL with tracker instances.
+	* @param InScheduler - Scheduler shared by every instance of the DLL.
+	* @return Whether the operation is succesfull.
+	*/
+	bool Create(UcDataStorageWrapper* InLibrary, TSharedPtr<FFaceDetectScheduler, ESPMode::ThreadSafe> InScheduler);
+
+	virtual void BeginDestroy() override;
+
+	/**
+	* Tell the scheduler whether a worker detects on this camera every frame, so batches wait for it.
+	* @param bInTracking - Whether tracking started or stopped.
+	*/
+	void SetTracking(bool bInTracking);
+
+	/** IFacePoseBackend implementation */
+	virtual int CallInitCV(int& outCameraWidth, int& outCameraHeight, int detectRatio,
+		int camId, float fovZoom, bool draw, bool lockEyesNose) override;
+	virtual int CallCloseCV() override;
+	virtual int CallDetect(TransformData& outTransform, float* outExpression) override;
+	virtual int CallDetectFaces(FaceBatchData& outFaces) override;
+	virtual int CallReconfigure(int detectRatio) override;
+	virtual int CallGetImageCV(unsigned char* image, int width, int height) override;
+	virtual int CallGetImageYUV(unsigned char* image, int width, int height, EFaceImageFormat format) override;
+
+private:
+
+	/** Destroy the DLL tracker */
+	void Destroy();
+
+	UPROPERTY()
+	UcDataStorageWrapper* Library;
+
+	TSharedPtr<FFaceDetectScheduler, ESPMode::ThreadSafe> Scheduler;
+
+	/** DLL tracker handle, whether its camera is open, and whether a worker tracks it */
+	void* Tracker;
+	bool bOpen;
+	bool bTracking;
+};
@@ -0,0 +1,222 @@
+// Copyright 2020 NeuralVFX, Inc. All Rights Reserved.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "HAL/Runnable.h"
+#include "HAL/ThreadSafeBool.h"
+#include "HAL/ThreadSafeCounter.h"
+#include "cDataStorageWrapper.h"
+#include "FaceImagePool.h"
+#include "FaceRecording.h"
+#include "FaceLiveLinkSource.h"
+#include "FaceNetworkStream.h"
+
+
+/** Single tracking result published by the worker thread */
+struct FFaceTrackingFrame
+{
+	FFaceTrackingFrame() :
+		ImageIndex(INDEX_NONE), ImageWidth(0), ImageHeight(0), ImageFormat(EFaceImageFormat::BGRA), Sequence(0), FrameId(0), CaptureTime(0), InferenceMs(0) {}
+
+	/** Transforms, blendshapes and track ids of every face in view */
+	FaceBatchData Faces;
+
+	/** Pooled image buffer owned by this frame, INDEX_NONE once taken by the consumer */
+	int32 ImageIndex;
+
+	/** Size of the image, at most the size the worker was created with */
+	int32 ImageWidth;
+	int32 ImageHeight;
+
+	/** Pixel layout of the image */
+	EFaceImageFormat ImageFormat;
+
+	/** Publish counter of the worker, zero until the first frame */
+	uint64 Sequence;
+
+	/** Camera frame counter reported by the backend, or Sequence if the backend has none */
+	uint64 FrameId;
+
+	/** Platform time the camera frame was captured, or when the worker asked for it if the backend can't tell */
+	double CaptureTime;
+
+	/** Time the backend spent detecting */
+	float InferenceMs;
+};
+
+
+/**
+* Lock-free triple buffer with one producer and one consumer.
+* The writer always owns one slot, the reader always owns one slot,
+* and the third slot is swapped between them with a single atomic exchange.
+*/
+class FACIALPOSEESTIMATION_API FFaceTripleBuffer
+{
+public:
+
+	FFaceTripleBuffer();
+
+	/** Slot currently owned by the writer */
+	FFaceTrackingFrame& GetWriteSlot() { return Slots[WriteIndex]; }
+
+	/** Slot currently owned by the reader */
+	FFaceTrackingFrame& GetReadSlot() { return Slots[ReadIndex]; }
+
+	/**
+	* Hand the write slot over to the reader.
+	* @return Whether an unread frame was overwritten.
+	*/
+	bool Publish();
+
+	/**
+	* Grab the newest published slot, if any.
+	* @return Whether the read slot now holds a new frame.
+	*/
+	bool Consume();
+
+private:
+
+	/** Bit set on the shared index while it holds an unread frame */
+	static const int32 DirtyBit = 0x4;
+
+	FFaceTrackingFrame Slots[3];
+
+	int32 WriteIndex;
+	int32 ReadIndex;
+
+	/** Index of the middle slot, plus DirtyBit */
+	volatile int32 SharedIndex;
+};
+
+
+/** Worker thread which loops on the backend and publishes results into a triple buffer */
+class FACIALPOSEESTIMATION_API FFaceTrackingWorker : public FRunnable
+{
+public:
+
+	/**
+	* @param InBackend - Initialized backend, must outlive the worker.
+	* @param InImageWidth - Width of image requested from the backend.
+	* @param InImageHeight - Height of image requested from the backend.
+	* @param InImageFormat - Pixel layout to request, falls back to BGRA if the backend has no YUV.
+	*/
+	FFaceTrackingWorker(class IFacePoseBackend* InBackend, int InImageWidth, int InImageHeight,
+		EFaceImageFormat InImageFormat = EFaceImageFormat::BGRA);
+
+	virtual ~FFaceTrackingWorker();
+
+	/** Spawn the thread */
+	void Start();
+
+	/** FRunnable implementation */
+	virtual uint32 Run() override;
+	virtual void Stop() override;
+
+	/**
+	* Get newest completed frame - game thread only.
+	* The caller may take ownership of the frame's image by clearing ImageIndex.
+	* @param bIsNewFrame - Whether the frame was published since the last call.
+	* @return Latest frame, or nullptr if nothing has been published yet.
+	*/
+	FFaceTrackingFrame* GetLatestFrame(bool& bIsNewFrame);
+
+	/** Pool which frame images live in */
+	TSharedPtr<FFaceImagePool, ESPMode::ThreadSafe> GetImagePool() const { return ImagePool; }
+
+	/**
+	* Record every result from now on - safe to call while the worker runs.
+	* @param InRecorder - Open recorder, or null to stop recording.
+	*/
+	void SetRecorder(TSharedPtr<FFaceSessionRecorder> InRecorder);
+
+	/**
+	* Publish every result to Live Link from now on - safe to call while the worker runs.
+	* @param InSource - Source added to the Live Link client, or null to stop publishing.
+	*/
+	void SetLiveLinkSource(TSharedPtr<FFaceLiveLinkSource> InSource);
+
+	/**
+	* Stream every result over UDP from now on - safe to call while the worker runs.
+	* @param InPublisher - Open publisher, or null to stop streaming.
+	*/
+	void SetNetworkPublisher(TSharedPtr<FFaceNetworkPublisher> InPublisher);
+
+	/**
+	* Change size of images requested from the backend - safe to call while the worker runs.
+	* Rounded down to even sizes, which YUV planes need.
+	* @param Width - Image width, clamped to the width the worker was created with.
+	* @param Height - Image height, clamped to the height the worker was created with.
+	*/
+	void SetImageSize(int Width, int Height);
+
+	/**
+	* Change detect ratio, applied by the worker before its next detect - safe to call while the worker runs.
+	* @param DetectRatio - ratio to scale image by for initial face detection
+	*/
+	void SetDetectRatio(int DetectRatio);
+
+	/**
+	* Cap detects per second - safe to call while the worker runs.
+	* @param Rate - Most detects per second, zero for no cap.
+	*/
+	void SetMaxInferenceRate(float Rate);
+
+	/** Number of frames the worker overwrote before they were read */
+	int32 GetDroppedFrameCount() const { return DroppedFrames.GetValue(); }
+
+	/** Number of detects which returned the camera frame already published, and were not published again */
+	int32 GetDuplicateFrameCount() const { return DuplicateFrames.GetValue(); }
+
+private:
+
+	class IFacePoseBackend* Backend;
+	FRunnableThread* Thread;
+
+	FFaceTripleBuffer Buffer;
+
+	/** Shared with texture uploads, which release buffers from the render thread */
+	TSharedPtr<FFaceImagePool, ESPMode::ThreadSafe> ImagePool;
+
+	/** Largest image size, which pool buffers are sized for */
+	int ImageWidth;
+	int ImageHeight;
+
+	/** Pixel layout requested, only changed by the worker thread */
+	EFaceImageFormat ImageFormat;
+
+	/** Settings changed from the game thread - width and height packed in 16 bits each, pending ratio or zero, and detect interval */
+	FThreadSafeCounter RequestedImageSize;
+	FThreadSafeCounter PendingDetectRatio;
+	FThreadSafeCounter MinDetectIntervalUs;
+
+	FThreadSafeBool bStopRequested;
+	FThreadSafeCounter DroppedFrames;
+	FThreadSafeCounter DuplicateFrames;
+
+	/**
+	* Whether a detect result is the same camera frame as the last one published.
+	* Uses the backend's frame id, or a hash of the faces if the backend has none.
+	* @param Faces - Detect result.
+	*/
+	bool IsDuplicateFrame(const FaceBatchData& Faces);
+
+	/** Frame id and face hash of the last published frame */
+	long long LastFrameId;
+	uint32 LastFaceHash;
+
+	uint64 NextSequence;
+
+	/** Optional recorder, written from the worker thread */
+	TSharedPtr<FFaceSessionRecorder> Recorder;
+	FCriticalSection RecorderLock;
+	double StartTime;
+
+	/** Optional Live Link source, pushed to from the worker thread */
+	TSharedPtr<FFaceLiveLinkSource> LiveLinkSource;
+	FCriticalSection LiveLinkLock;
+
+	/** Optional network publisher, sent from the worker thread */
+	TSharedPtr<FFaceNetworkPublisher> NetworkPublisher;
+	FCriticalSection NetworkLock;
+};
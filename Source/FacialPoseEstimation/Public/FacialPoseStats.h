@@ -0,0 +1,86 @@
+// Copyright 2020 NeuralVFX, Inc. All Rights Reserved.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Stats/Stats.h"
+#include "ProfilingDebugging/CpuProfilerTrace.h"
+
+
+/** Stat group for the facial pose pipeline - view with "stat FacialPose", stages also show in Unreal Insights */
+DECLARE_STATS_GROUP(TEXT("FacialPose"), STATGROUP_FacialPose, STATCAT_Advanced);
+
+/** DLL wrapper calls */
+DECLARE_CYCLE_STAT_EXTERN(TEXT("DLL Init"), STAT_FacialPose_DLLInit, STATGROUP_FacialPose, FACIALPOSEESTIMATION_API);
+DECLARE_CYCLE_STAT_EXTERN(TEXT("DLL Close"), STAT_FacialPose_DLLClose, STATGROUP_FacialPose, FACIALPOSEESTIMATION_API);
+DECLARE_CYCLE_STAT_EXTERN(TEXT("DLL Detect"), STAT_FacialPose_DLLDetect, STATGROUP_FacialPose, FACIALPOSEESTIMATION_API);
+DECLARE_CYCLE_STAT_EXTERN(TEXT("DLL Detect Faces"), STAT_FacialPose_DLLDetectFaces, STATGROUP_FacialPose, FACIALPOSEESTIMATION_API);
+DECLARE_CYCLE_STAT_EXTERN(TEXT("DLL Get Image"), STAT_FacialPose_DLLGetImage, STATGROUP_FacialPose, FACIALPOSEESTIMATION_API);
+DECLARE_CYCLE_STAT_EXTERN(TEXT("DLL Reconfigure"), STAT_FacialPose_DLLReconfigure, STATGROUP_FacialPose, FACIALPOSEESTIMATION_API);
+
+/** Tracking worker */
+DECLARE_CYCLE_STAT_EXTERN(TEXT("Detect"), STAT_FacialPose_Detect, STATGROUP_FacialPose, FACIALPOSEESTIMATION_API);
+DECLARE_DWORD_ACCUMULATOR_STAT_EXTERN(TEXT("Faces Per Detect"), STAT_FacialPose_NumFaces, STATGROUP_FacialPose, FACIALPOSEESTIMATION_API);
+DECLARE_FLOAT_ACCUMULATOR_STAT_EXTERN(TEXT("Detect Time Per Face (ms)"), STAT_FacialPose_DetectPerFace, STATGROUP_FacialPose, FACIALPOSEESTIMATION_API);
+DECLARE_DWORD_COUNTER_STAT_EXTERN(TEXT("Duplicate Frames Skipped"), STAT_FacialPose_DuplicateFrames, STATGROUP_FacialPose, FACIALPOSEESTIMATION_API);
+DECLARE_DWORD_ACCUMULATOR_STAT_EXTERN(TEXT("Trackers Per Batch"), STAT_FacialPose_TrackersPerBatch, STATGROUP_FacialPose, FACIALPOSEESTIMATION_API);
+
+/** Rig stages */
+DECLARE_CYCLE_STAT_EXTERN(TEXT("Rig Update"), STAT_FacialPose_RigUpdate, STATGROUP_FacialPose, FACIALPOSEESTIMATION_API);
+DECLARE_CYCLE_STAT_EXTERN(TEXT("Bind Faces"), STAT_FacialPose_BindFaces, STATGROUP_FacialPose, FACIALPOSEESTIMATION_API);
+DECLARE_CYCLE_STAT_EXTERN(TEXT("Smooth Blend Shapes"), STAT_FacialPose_SmoothBlendShapes, STATGROUP_FacialPose, FACIALPOSEESTIMATION_API);
+DECLARE_CYCLE_STAT_EXTERN(TEXT("Set Transforms"), STAT_FacialPose_SetTransforms, STATGROUP_FacialPose, FACIALPOSEESTIMATION_API);
+DECLARE_CYCLE_STAT_EXTERN(TEXT("Set Blend Shapes"), STAT_FacialPose_SetBlendShapes, STATGROUP_FacialPose, FACIALPOSEESTIMATION_API);
+DECLARE_CYCLE_STAT_EXTERN(TEXT("Predict Pose"), STAT_FacialPose_PredictPose, STATGROUP_FacialPose, FACIALPOSEESTIMATION_API);
+DECLARE_DWORD_COUNTER_STAT_EXTERN(TEXT("Transform Writes Skipped"), STAT_FacialPose_TransformWritesSkipped, STATGROUP_FacialPose, FACIALPOSEESTIMATION_API);
+DECLARE_FLOAT_ACCUMULATOR_STAT_EXTERN(TEXT("Pose Prediction (ms)"), STAT_FacialPose_PredictionMs, STATGROUP_FacialPose, FACIALPOSEESTIMATION_API);
+
+/** Rolling latency percentiles */
+DECLARE_FLOAT_ACCUMULATOR_STAT_EXTERN(TEXT("Inference p50 (ms)"), STAT_FacialPose_InferenceP50, STATGROUP_FacialPose, FACIALPOSEESTIMATION_API);
+DECLARE_FLOAT_ACCUMULATOR_STAT_EXTERN(TEXT("Inference p95 (ms)"), STAT_FacialPose_InferenceP95, STATGROUP_FacialPose, FACIALPOSEESTIMATION_API);
+DECLARE_FLOAT_ACCUMULATOR_STAT_EXTERN(TEXT("Inference p99 (ms)"), STAT_FacialPose_InferenceP99, STATGROUP_FacialPose, FACIALPOSEESTIMATION_API);
+DECLARE_FLOAT_ACCUMULATOR_STAT_EXTERN(TEXT("Capture To Display p50 (ms)"), STAT_FacialPose_CaptureToDisplayP50, STATGROUP_FacialPose, FACIALPOSEESTIMATION_API);
+DECLARE_FLOAT_ACCUMULATOR_STAT_EXTERN(TEXT("Capture To Display p95 (ms)"), STAT_FacialPose_CaptureToDisplayP95, STATGROUP_FacialPose, FACIALPOSEESTIMATION_API);
+DECLARE_FLOAT_ACCUMULATOR_STAT_EXTERN(TEXT("Capture To Display p99 (ms)"), STAT_FacialPose_CaptureToDisplayP99, STATGROUP_FacialPose, FACIALPOSEESTIMATION_API);
+
+/** Live Link */
+DECLARE_CYCLE_STAT_EXTERN(TEXT("Live Link Push"), STAT_FacialPose_LiveLinkPush, STATGROUP_FacialPose, FACIALPOSEESTIMATION_API);
+DECLARE_CYCLE_STAT_EXTERN(TEXT("Live Link Evaluate"), STAT_FacialPose_LiveLinkEvaluate, STATGROUP_FacialPose, FACIALPOSEESTIMATION_API);
+
+/** Network stream */
+DECLARE_CYCLE_STAT_EXTERN(TEXT("Network Send"), STAT_FacialPose_NetworkSend, STATGROUP_FacialPose, FACIALPOSEESTIMATION_API);
+DECLARE_CYCLE_STAT_EXTERN(TEXT("Network Receive"), STAT_FacialPose_NetworkReceive, STATGROUP_FacialPose, FACIALPOSEESTIMATION_API);
+DECLARE_DWORD_COUNTER_STAT_EXTERN(TEXT("Network Bytes Sent"), STAT_FacialPose_NetworkBytesSent, STATGROUP_FacialPose, FACIALPOSEESTIMATION_API);
+DECLARE_DWORD_COUNTER_STAT_EXTERN(TEXT("Network Packets Lost"), STAT_FacialPose_NetworkPacketsLost, STATGROUP_FacialPose, FACIALPOSEESTIMATION_API);
+
+/** Batched smoothing of every rig in a world */
+DECLARE_CYCLE_STAT_EXTERN(TEXT("Batch Smoothing"), STAT_FacialPose_BatchSmoothing, STATGROUP_FacialPose, FACIALPOSEESTIMATION_API);
+DECLARE_CYCLE_STAT_EXTERN(TEXT("Batch Scatter"), STAT_FacialPose_BatchScatter, STATGROUP_FacialPose, FACIALPOSEESTIMATION_API);
+DECLARE_DWORD_ACCUMULATOR_STAT_EXTERN(TEXT("Batched Faces"), STAT_FacialPose_BatchedFaces, STATGROUP_FacialPose, FACIALPOSEESTIMATION_API);
+
+/** Retarget matrix evaluation, on the game thread or animation workers */
+DECLARE_CYCLE_STAT_EXTERN(TEXT("Retarget"), STAT_FacialPose_Retarget, STATGROUP_FacialPose, FACIALPOSEESTIMATION_API);
+
+/** Startup, from rig BeginPlay */
+DECLARE_FLOAT_ACCUMULATOR_STAT_EXTERN(TEXT("Time To Tracker Ready (ms)"), STAT_FacialPose_TimeToTrackerReady, STATGROUP_FacialPose, FACIALPOSEESTIMATION_API);
+DECLARE_FLOAT_ACCUMULATOR_STAT_EXTERN(TEXT("Time To First Tracked Frame (ms)"), STAT_FacialPose_TimeToFirstTrackedFrame, STATGROUP_FacialPose, FACIALPOSEESTIMATION_API);
+
+/** Baking takes to animation sequences */
+DECLARE_CYCLE_STAT_EXTERN(TEXT("Bake"), STAT_FacialPose_Bake, STATGROUP_FacialPose, FACIALPOSEESTIMATION_API);
+
+/** Face anim instance, on animation workers */
+DECLARE_CYCLE_STAT_EXTERN(TEXT("Anim Update"), STAT_FacialPose_AnimUpdate, STATGROUP_FacialPose, FACIALPOSEESTIMATION_API);
+DECLARE_CYCLE_STAT_EXTERN(TEXT("Anim Evaluate"), STAT_FacialPose_AnimEvaluate, STATGROUP_FacialPose, FACIALPOSEESTIMATION_API);
+
+/** Background plate */
+DECLARE_CYCLE_STAT_EXTERN(TEXT("Background Upload"), STAT_FacialPose_BackgroundUpload, STATGROUP_FacialPose, FACIALPOSEESTIMATION_API);
+DECLARE_DWORD_COUNTER_STAT_EXTERN(TEXT("Background Uploads Skipped"), STAT_FacialPose_UploadsSkipped, STATGROUP_FacialPose, FACIALPOSEESTIMATION_API);
+
+/** Image buffer pool */
+DECLARE_MEMORY_STAT_EXTERN(TEXT("Image Pool Memory"), STAT_FacialPose_ImagePoolMemory, STATGROUP_FacialPose, FACIALPOSEESTIMATION_API);
+DECLARE_DWORD_ACCUMULATOR_STAT_EXTERN(TEXT("Image Buffer Allocations"), STAT_FacialPose_ImageAllocations, STATGROUP_FacialPose, FACIALPOSEESTIMATION_API);
+DECLARE_DWORD_ACCUMULATOR_STAT_EXTERN(TEXT("Image Buffers In Use"), STAT_FacialPose_ImageBuffersInUse, STATGROUP_FacialPose, FACIALPOSEESTIMATION_API);
+DECLARE_DWORD_COUNTER_STAT_EXTERN(TEXT("Image Fetches Skipped"), STAT_FacialPose_ImageFetchesSkipped, STATGROUP_FacialPose, FACIALPOSEESTIMATION_API);
+
+/** Garbage collection pressure */
+DECLARE_DWORD_COUNTER_STAT_EXTERN(TEXT("UObject Count"), STAT_FacialPose_UObjectCount, STATGROUP_FacialPose, FACIALPOSEESTIMATION_API);
@@ -5,6 +5,11 @@
 #include "CoreMinimal.h"
 #include "Engine/GameInstance.h"
 #include "cDataStorageWrapper.h"
+#include "FacePoseBackend.h"
+#include "FaceTrackingWorker.h"
+#include "FaceTrackerInstance.h"
+#include "Async/Future.h"
+#include "HAL/ThreadSafeBool.h"
 #include "cDataStorageGameInstance.generated.h"
 
 /** Struct to hold attribute data needed to initialize DLL */
@@ -16,7 +21,27 @@ struct AttributeData
 };
 
 
-/** Game Instance which is responsible for loading and calling DLL wrapper */
+/** Camera open and warmup of one tracker, run off the game thread */
+struct FFaceTrackerStartup
+{
+	TFuture<void> Task;
+
+	/** Set once the camera is open and warmed up, the fields below are final from then on */
+	FThreadSafeBool bReady;
+
+	/** Set instead of bReady if the camera could not be opened */
+	FThreadSafeBool bFailed;
+
+	/** Requested resolution, then the one the camera attained */
+	int CameraWidth;
+	int CameraHeight;
+
+	double StartTime;
+	double ReadyTime;
+};
+
+
+/** Game Instance which is responsible for loading and calling the tracking backend */
 UCLASS()
 class FACIALPOSEESTIMATION_API UcDataStorageGameInstance : public UGameInstance
 {
@@ -28,6 +53,116 @@ private:
 	UPROPERTY()
 	class UcDataStorageWrapper* m_refDataStorageUtil;
 
+	/** Backend every call goes through, either the DLL wrapper or a synthetic source */
+	UPROPERTY()
+	TScriptInterface<IFacePoseBackend> m_backend;
+
+	/** Worker thread running the backend pipeline */
+	TUniquePtr<FFaceTrackingWorker> m_trackingWorker;
+
+	/** Whether backend is created and ready for calls */
+	bool m_bBackendReady;
+
+	/**
+	* Create the synthetic backend, with settings from this object or the command line.
+	* @return Whether the operation is succesfull.
+	*/
+	bool CreateSyntheticBackend();
+
+	/**
+	* Create the replay backend, with settings from this object or the command line.
+	* @return Whether the operation is succesfull.
+	*/
+	bool CreateReplayBackend();
+
+	/**
+	* Create the host backend, which runs the tracking library out of process.
+	* @return Whether the operation is succesfull.
+	*/
+	bool CreateHostBackend();
+
+	/**
+	* Create the network backend, which receives results streamed by another machine.
+	* @return Whether the operation is succesfull.
+	*/
+	bool CreateNetworkBackend();
+
+	/** Recorder shared with the tracking worker, while recording */
+	TSharedPtr<FFaceSessionRecorder> m_recorder;
+
+	/** Live Link source fed by the tracking worker, and its id in the Live Link client */
+	TSharedPtr<FFaceLiveLinkSource> m_liveLinkSource;
+	FGuid m_liveLinkSourceGuid;
+
+	/** Tracker instances after the main one, tracker 1 is at index 0 */
+	UPROPERTY()
+	TArray<UFaceTrackerInstance*> m_extraTrackers;
+
+	/** Workers of the extra trackers, same index */
+	TArray<TUniquePtr<FFaceTrackingWorker>> m_extraWorkers;
+
+	/** Batches detects of every tracker instance, only if the DLL has them */
+	TSharedPtr<FFaceDetectScheduler, ESPMode::ThreadSafe> m_detectScheduler;
+
+	/**
+	* Create a tracker instance of the DLL, batched with every other one.
+	* @return Instance, or null if the DLL has no tracker instances.
+	*/
+	UFaceTrackerInstance* CreateTrackerInstance();
+
+	/**
+	* Worker of a tracker.
+	* @param tracker - Tracker instance, 0 for the main one.
+	* @return Worker, or null if the tracker isn't tracking.
+	*/
+	FFaceTrackingWorker* GetWorker(int tracker) const;
+
+	/**
+	* Tracker instance of a tracker.
+	* @param tracker - Tracker instance, 0 for the main one.
+	* @return Instance, or null if the tracker runs on another backend.
+	*/
+	UFaceTrackerInstance* GetTrackerInstance(int tracker) const;
+
+	/** Publisher shared with the tracking worker, while streaming */
+	TSharedPtr<FFaceNetworkPublisher> m_networkPublisher;
+
+	/** Network loading started from Init, trackers open their camera once it is done */
+	TFuture<void> m_preloadTask;
+
+	/** Whether the preload's networks-only Init is open and still needs its Close */
+	FThreadSafeBool m_bPreloadOpen;
+
+	/**
+	* Wait for the network preload, and close its Init before the library's own camera Init, or at shutdown if tracker instances open the cameras.
+	* @param backend - Backend about to open its camera, null at shutdown once the backends are closed.
+	*/
+	void WaitForPreload(IFacePoseBackend* backend);
+
+	/** Startup of each tracker, by tracker index */
+	TArray<TSharedPtr<FFaceTrackerStartup, ESPMode::ThreadSafe>> m_trackerStartups;
+
+	/**
+	* Backend of a tracker, creating its tracker instance if needed - game thread only.
+	* @param tracker - Tracker instance, 0 for the main one.
+	* @return Backend, or null if the tracker can't exist.
+	*/
+	IFacePoseBackend* GetOrCreateBackend(int tracker);
+
+	/**
+	* Open the camera of a tracker and run warmup detects, blocks until done.
+	* @param backend - Backend of the tracker.
+	* @param startup - Startup state, camera size in and out.
+	* @param detectRatio - ratio to scale image by for initial face detection
+	* @param camId - Which camera id OpenCV should try to use.
+	* @param fovZoom - Zoom amount for pinhole camera, to match Unreal.
+	* @param draw - Wheher or not to draw technical indicators over frame.
+	* @param lockEyesNose - Whether to lock eye and nose points for PnP solve.
+	* @param warmups - Detects to run and discard, so first-inference costs are paid before tracking.
+	*/
+	void RunTrackerStartup(IFacePoseBackend* backend, FFaceTrackerStartup& startup, int detectRatio, int camId, float fovZoom, bool draw,
+		bool lockEyesNose, int warmups);
+
 	/**
 	* Attempt to import DLL and all of its functions.
 	* @return Whether the operation is succesfull.
@@ -36,8 +171,82 @@ private:
 
 public:
 
+	UcDataStorageGameInstance();
+
+	/** Which backend to run tracking on, overridden by -FacePoseBackend=Library|Synthetic|Replay|Host|Network */
+	UPROPERTY(EditAnywhere, BlueprintReadOnly, Category = "ArFace | Backend")
+	EFacePoseBackendType BackendType;
+
+	/** Synthetic backend frames per second, overridden by -FacePoseRate= */
+	UPROPERTY(EditAnywhere, BlueprintReadOnly, Category = "ArFace | Backend")
+	float SyntheticFrameRate;
+
+	/** Synthetic backend inference cost, overridden by -FacePoseCostMs= */
+	UPROPERTY(EditAnywhere, BlueprintReadOnly, Category = "ArFace | Backend")
+	float SyntheticDetectCostMs;
+
+	/** Synthetic backend faces per frame, overridden by -FacePoseFaces= */
+	UPROPERTY(EditAnywhere, BlueprintReadOnly, Category = "ArFace | Backend")
+	int SyntheticNumFaces;
+
+	/** Recording played by the replay backend, overridden by -FacePoseReplay= */
+	UPROPERTY(EditAnywhere, BlueprintReadOnly, Category = "ArFace | Backend")
+	FString ReplayPath;
+
+	/** Replay playback rate, zero for as fast as possible, overridden by -FacePoseReplaySpeed= */
+	UPROPERTY(EditAnywhere, BlueprintReadOnly, Category = "ArFace | Backend")
+	float ReplaySpeed;
+
+	/** Cores the tracker host may run on as a bit mask, zero for any, overridden by -FacePoseHostAffinity= */
+	UPROPERTY(EditAnywhere, BlueprintReadOnly, Category = "ArFace | Backend")
+	int64 HostAffinityMask;
+
+	/** UDP port the network backend listens on, overridden by -FacePoseListen= */
+	UPROPERTY(EditAnywhere, BlueprintReadOnly, Category = "ArFace | Backend")
+	int32 NetworkListenPort;
+
+	/** Comma separated IP:Port list to stream results to once tracking starts, overridden by -FacePoseStream= */
+	UPROPERTY(EditAnywhere, BlueprintReadOnly, Category = "ArFace | Network")
+	FString NetworkStreamDestinations;
+
+	/** Packets between full keyframes, a lost keyframe is recovered after this many */
+	UPROPERTY(EditAnywhere, BlueprintReadOnly, Category = "ArFace | Network")
+	int32 NetworkKeyframeInterval;
+
+	/** Longest a camera's detect waits for the other cameras, to share one inference */
+	UPROPERTY(EditAnywhere, BlueprintReadOnly, Category = "ArFace | Backend")
+	float TrackerBatchWindowMs;
+
+	/** Publish tracking results as Live Link subjects, also turned on by -FacePoseLiveLink */
+	UPROPERTY(EditAnywhere, BlueprintReadOnly, Category = "ArFace | Live Link")
+	bool bPublishLiveLink;
+
+	/** Subject of the first face, further faces are SubjectName_1, SubjectName_2 and so on */
+	UPROPERTY(EditAnywhere, BlueprintReadOnly, Category = "ArFace | Live Link")
+	FName LiveLinkSubjectName;
+
+	/** Load networks from Init and open cameras on background tasks, turned off by -FacePoseSyncInit */
+	UPROPERTY(EditAnywhere, BlueprintReadOnly, Category = "ArFace | Backend")
+	bool bAsyncInit;
+
+	/** Detects run and discarded once a camera opens, before the tracker reports ready, overridden by -FacePoseWarmup= */
+	UPROPERTY(EditAnywhere, BlueprintReadOnly, Category = "ArFace | Backend")
+	int WarmupInferences;
+
 	virtual void Init() override;
 
+	/**
+	* Backend the tracking pipeline runs on.
+	* @param tracker - Tracker instance, 0 for the main one.
+	* @return Backend, or nullptr if it failed to load.
+	*/
+	IFacePoseBackend* GetBackend(int tracker = 0) const;
+
+	/**
+	* Number of trackers which can run at once, more than one if the DLL has tracker instances.
+	*/
+	int GetMaxTrackers() const;
+
 	/**
 	* Call DLL Wrapper - Initiate OpenCV camera stream and Neural Networks.
 	* @param outCameraWidth - Width which OpenCV used for camera stream.
@@ -47,14 +256,146 @@ public:
 	* @param inFovZoom - Zoom amount for pinhole camera, to match Unreal.
 	* @param draw - Wheher or not to draw technical indicators over frame.
 	* @param lockEyesNose - Whether to lock eye and nose points for PnP solve.
+	* @param tracker - Tracker instance to open the camera on, 0 for the main one, created if needed.
+	*/
+	void CustomStart(int& outCameraWidth, int& outCameraHeight, int detectRatio, int camId, float fovZoom, bool draw, bool lockEyesNose,
+		int tracker = 0);
+
+	/**
+	* Open a tracker's camera and warm it up on a background task, or right away without AsyncInit.
+	* Poll IsTrackerReady for the camera resolution, then start tracking.
+	* A tracker already starting, started or failed is left alone, so every rig on it polls the same startup.
+	* @param cameraWidth - Width to request from the camera.
+	* @param cameraHeight - Height to request from the camera.
+	* @param detectRatio - ratio to scale image by for initial face detection
+	* @param camId - Which camera id OpenCV should try to use.
+	* @param fovZoom - Zoom amount for pinhole camera, to match Unreal.
+	* @param draw - Wheher or not to draw technical indicators over frame.
+	* @param lockEyesNose - Whether to lock eye and nose points for PnP solve.
+	* @param tracker - Tracker instance to open the camera on, 0 for the main one, created if needed.
 	*/
-	void CustomStart(int& outCameraWidth, int& outCameraHeight, int detectRatio, int camId, float fovZoom, bool draw, bool lockEyesNose);
+	void CustomStartAsync(int cameraWidth, int cameraHeight, int detectRatio, int camId, float fovZoom, bool draw, bool lockEyesNose,
+		int tracker = 0);
+
+	/**
+	* Whether a tracker started with CustomStartAsync is ready to track, never true once it failed.
+	* @param tracker - Tracker instance, 0 for the main one.
+	* @param outCameraWidth - Width the camera attained, only set once ready.
+	* @param outCameraHeight - Height the camera attained, only set once ready.
+	*/
+	bool IsTrackerReady(int tracker, int& outCameraWidth, int& outCameraHeight) const;
+
+	/**
+	* Whether a tracker started with CustomStartAsync could not open its camera.
+	* @param tracker - Tracker instance, 0 for the main one.
+	*/
+	bool IsTrackerFailed(int tracker) const;
 
 	/**
 	* Call DLL Wrapper - Close OpenCV connection to camera.
 	*/
 	virtual void Shutdown() override;
 
+	/**
+	* Start tracking worker thread, which loops on the DLL pipeline.
+	* @param width - Width of image to request from the DLL.
+	* @param height - Height of image to request from the DLL.
+	* @param format - Pixel layout to request from the DLL.
+	* @param tracker - Tracker instance, 0 for the main one, which is also recorded and published.
+	*/
+	void StartTracking(int width, int height, EFaceImageFormat format = EFaceImageFormat::BGRA, int tracker = 0);
+
+	/**
+	* Stop tracking worker thread, blocks until the thread exits.
+	* @param tracker - Tracker instance, 0 for the main one.
+	*/
+	void StopTracking(int tracker = 0);
+
+	/**
+	* Get newest frame completed by the tracking worker.
+	* @param bIsNewFrame - Whether the frame was published since the last call.
+	* @param tracker - Tracker instance, 0 for the main one.
+	* @return Latest frame, or nullptr if tracking hasn't produced one yet.
+	*/
+	FFaceTrackingFrame* GetLatestFrame(bool& bIsNewFrame, int tracker = 0);
+
+	/**
+	* Pool which the tracking worker writes images into.
+	* @param tracker - Tracker instance, 0 for the main one.
+	* @return Pool, or null if tracking hasn't started.
+	*/
+	TSharedPtr<FFaceImagePool, ESPMode::ThreadSafe> GetImagePool(int tracker = 0) const;
+
+	/**
+	* Change tracking quality while the worker runs, without reopening the camera.
+	* @param detectRatio - ratio to scale image by for initial face detection
+	* @param width - Width of image to request, at most the width tracking started with.
+	* @param height - Height of image to request, at most the height tracking started with.
+	* @param maxInferenceRate - Most detects per second, zero for no cap.
+	* @param tracker - Tracker instance, 0 for the main one.
+	*/
+	void ReconfigureTracking(int detectRatio, int width, int height, float maxInferenceRate, int tracker = 0);
+
+	/**
+	* Start recording every tracking result to a file, also started by -FacePoseRecord=.
+	* @param path - File to write.
+	* @param bQuantize - Whether to store expressions as 16-bit.
+	* @param previewInterval - Store a preview image every this many frames, zero for none.
+	* @param previewSize - Width and height of preview images.
+	* @param maxFaces - Faces stored per frame.
+	* @return Whether the operation is succesfull.
+	*/
+	bool StartRecording(const FString& path, bool bQuantize = true, int previewInterval = 30, int previewSize = 64, int maxFaces = 1);
+
+	/**
+	* Stop recording and close the file.
+	*/
+	void StopRecording();
+
+	/**
+	* Add a Live Link source publishing every tracking result, needs the Live Link plugin.
+	* @param curveNames - Curve name of each expression output, eg the face mesh's morph targets.
+	* @param maxSubjects - Faces to publish.
+	* @return Whether the operation is succesfull.
+	*/
+	bool StartLiveLink(const TArray<FName>& curveNames, int maxSubjects = 1);
+
+	/**
+	* Remove the Live Link source.
+	*/
+	void StopLiveLink();
+
+	/**
+	* Live Link subject of a face.
+	* @param index - Face index in the detection batch.
+	*/
+	FName GetLiveLinkSubjectName(int index) const;
+
+	/**
+	* Stream every tracking result over UDP, to be received by the network backend on other machines.
+	* @param destinations - Comma separated IP:Port list.
+	* @param keyframeInterval - Packets between full keyframes.
+	* @return Whether the operation is succesfull.
+	*/
+	bool StartNetworkStream(const FString& destinations, int keyframeInterval = 30);
+
+	/**
+	* Stop streaming and close the socket.
+	*/
+	void StopNetworkStream();
+
+	/**
+	* Number of frames the tracking worker overwrote before they were read.
+	* @param tracker - Tracker instance, 0 for the main one.
+	*/
+	int32 GetDroppedFrameCount(int tracker = 0) const;
+
+	/**
+	* Number of detects which returned an already published camera frame.
+	* @param tracker - Tracker instance, 0 for the main one.
+	*/
+	int32 GetDuplicateFrameCount(int tracker = 0) const;
+
 	/**
 	* Call DLL Wrapper - Get single frame from OpenCV camera stream, resize and reformat for Unreal.
 	* @param image - Pointer to write OpenCV image to.
@@ -64,10 +405,11 @@ public:
 	void GetImage(unsigned char* image, int width, int height);
 
 	/**
-	* Call DLL Wrapper - Exectute whole facial pose estimation pipeline, and return result.
+	* Call DLL Wrapper - Exectute whole facial pose estimation pipeline, and return the first face.
 	* @param outTransform - Pointer where result transform is copied to.
 	* @param outExpression - Pointer where result blendshapes are copied to.
+	* @return Whether a face was found, outputs are left untouched if not.
 	*/
-	void GetTransform(TransformData& outTransform, float* outExpression);
+	bool GetTransform(TransformData& outTransform, float* outExpression);
 
 };
@@ -4,12 +4,16 @@
 
 #include "CoreMinimal.h"
 #include "UObject/NoExportTypes.h"
+#include "FacePoseBackend.h"
 #include "cDataStorageWrapper.generated.h"
 
 
 /**  Struct to pass transform datafrom DLL  */
 struct TransformData
 {
+	TransformData() :
+		TransformData(0, 0, 0, 0, 0, 0, 0, 0, 0) {}
+
 	TransformData(float tx, float ty, float tz, float rfx, float rfy,
 		float rfz, float rux, float ruy, float ruz) :
 		tX(tx), tY(ty), tZ(tz), rfX(rfx), rfY(rfy),
@@ -18,6 +22,91 @@ struct TransformData
 	float tX, tY, tZ;
 	float rfX, rfY, rfZ;
 	float ruX, ruY, ruZ;
+
+	/** Translation in Unreal axes */
+	FVector GetTranslation() const { return FVector(tZ, tX, -tY); }
+
+	/** Rotation in Unreal axes */
+	FQuat GetRotation() const { return ToUnrealRotation(FVector(ruX, ruY, ruZ), FVector(rfX, rfY, rfZ)); }
+
+	/**
+	* Convert OpenCV head axes to an Unreal rotation, yaw mirrored to match the camera image.
+	* @param Up - Up vector.
+	* @param Forward - Forward vector.
+	* @return Rotation of the face mesh.
+	*/
+	static FQuat ToUnrealRotation(FVector Up, FVector Forward);
+};
+
+
+/** Layout version of FaceBatchData, checked by the DLL - version 2 appends captureAge and frameId, version 3 the detection of each face */
+#define FACE_BATCH_VERSION 3
+
+/** Most faces returned by a single DetectFaces call */
+#define FACE_BATCH_MAX_FACES 8
+
+/** Landmark slots per face, the 68 point layout */
+#define FACE_BATCH_MAX_LANDMARKS 68
+
+
+/**  Struct-of-arrays result for every face found in one frame  */
+struct FaceBatchData
+{
+	FaceBatchData()
+	{
+		FMemory::Memzero(trackIds);
+		FMemory::Memzero(expressions);
+		FMemory::Memzero(landmarks);
+		Reset();
+	}
+
+	/**
+	* Clear the result before a detect.
+	* Faces default to full confidence without box or landmarks, which DLLs older than version 3 leave untouched.
+	*/
+	void Reset()
+	{
+		version = FACE_BATCH_VERSION;
+		maxFaces = FACE_BATCH_MAX_FACES;
+		numFaces = 0;
+		captureAge = -1;
+		frameId = 0;
+		numLandmarks = 0;
+		for (float& Confidence : confidence)
+		{
+			Confidence = 1.f;
+		}
+		FMemory::Memzero(boxes);
+	}
+
+	int version;
+	int maxFaces;
+	int numFaces;
+
+	/** Stable id per face, persists while the face stays in view */
+	int trackIds[FACE_BATCH_MAX_FACES];
+	TransformData transforms[FACE_BATCH_MAX_FACES];
+
+	/** 51 blendshapes per face, face after face */
+	float expressions[FACE_BATCH_MAX_FACES * 51];
+
+	/** Seconds from camera capture until DetectFaces returned, negative if unknown */
+	double captureAge;
+
+	/** Camera frame counter, zero if unknown */
+	long long frameId;
+
+	/** Detector score of each face, 0 to 1 */
+	float confidence[FACE_BATCH_MAX_FACES];
+
+	/** Bounding box of each face as x, y, width, height, normalized to the camera image */
+	float boxes[FACE_BATCH_MAX_FACES * 4];
+
+	/** Landmarks filled per face, zero if the DLL gives none */
+	int numLandmarks;
+
+	/** 2D landmarks as x, y pairs normalized to the camera image, FACE_BATCH_MAX_LANDMARKS slots per face */
+	float landmarks[FACE_BATCH_MAX_FACES * FACE_BATCH_MAX_LANDMARKS * 2];
 };
 
 
@@ -27,11 +116,31 @@ typedef int(*__Init)(int& outCameraWidth, int& outCameraHeight, int detectRatio,
 typedef void(*__Close)();
 typedef int(*__GetImage)(unsigned char* data, int width, int height);
 typedef void(*__Detect)(TransformData& outFaces, float* outExpression);
+typedef int(*__DetectFaces)(FaceBatchData& outFaces);
+typedef int(*__Reconfigure)(int detectRatio);
+typedef int(*__GetImageYUV)(unsigned char* data, int width, int height, int format);
+
+/** DLL tracker instance functions, each camera gets its own handle while networks are loaded once */
+typedef void*(*__CreateTracker)();
+typedef void(*__DestroyTracker)(void* tracker);
+typedef int(*__InitTracker)(void* tracker, int& outCameraWidth, int& outCameraHeight, int detectRatio,
+	int camId, float fovZoom, bool draw, bool lockEyesNose);
+typedef void(*__CloseTracker)(void* tracker);
+typedef int(*__DetectTrackers)(void** trackers, int count, FaceBatchData* outFaces);
+typedef int(*__GetTrackerImage)(void* tracker, unsigned char* data, int width, int height);
+typedef int(*__GetTrackerImageYUV)(void* tracker, unsigned char* data, int width, int height, int format);
+typedef int(*__ReconfigureTracker)(void* tracker, int detectRatio);
+
+/** DLL offline function, detects on BGRA images handed over instead of the camera - Init with camId -1 loads networks only */
+typedef int(*__DetectImages)(const unsigned char** images, int count, int width, int height, FaceBatchData* outFaces);
 
 
-/** Wrapper for external DLL, executes pose estimation pipeline and passes the data back to Unreal */
+/**
+* Wrapper for external DLL, executes pose estimation pipeline and passes the data back to Unreal.
+* Loads the same exports from a shared object on Linux.
+*/
 UCLASS()
-class FACIALPOSEESTIMATION_API UcDataStorageWrapper : public UObject
+class FACIALPOSEESTIMATION_API UcDataStorageWrapper : public UObject, public IFacePoseBackend
 {
 	GENERATED_BODY()
 private:
@@ -44,6 +153,22 @@ private:
 	__Close m_funcClose;
 	__GetImage m_funcGetRawImageBytes;
 	__Detect m_funcDetect;
+	__DetectFaces m_funcDetectFaces;
+	__Reconfigure m_funcReconfigure;
+	__GetImageYUV m_funcGetRawImageYUV;
+
+	/** DLL tracker instance functions, all null if the DLL only has the global tracker */
+	__CreateTracker m_funcCreateTracker;
+	__DestroyTracker m_funcDestroyTracker;
+	__InitTracker m_funcInitTracker;
+	__CloseTracker m_funcCloseTracker;
+	__DetectTrackers m_funcDetectTrackers;
+	__GetTrackerImage m_funcGetTrackerImage;
+	__GetTrackerImageYUV m_funcGetTrackerImageYUV;
+	__ReconfigureTracker m_funcReconfigureTracker;
+
+	/** DLL offline function, null if the DLL only reads cameras */
+	__DetectImages m_funcDetectImages;
 
 public:
 
@@ -72,20 +197,47 @@ public:
 	* @param lockEyesNose - Whether to lock eye and nose points for PnP solve.
 	* @return Whether operation is succesful.
 	*/
-	int CallInitCV(int& outCameraWidth, int& outCameraHeight, int detectRatio,
-		int camId, float fovZoom, bool draw, bool lockEyesNose);
+	virtual int CallInitCV(int& outCameraWidth, int& outCameraHeight, int detectRatio,
+		int camId, float fovZoom, bool draw, bool lockEyesNose) override;
 
 	/**
 	* Call DLL - Close OpenCV connection to camera.
 	*/
-	int CallCloseCV();
+	virtual int CallCloseCV() override;
 
 	/**
 	* Call DLL - Exectute whole facial pose estimation pipeline, and return result.
 	* @param out_transform - Pointer where result transform is copied to.
 	* @param out_expression - Pointer where result blendshapes are copied to.
 	*/
-	int CallDetect(TransformData& outTransform, float* outExpression);
+	virtual int CallDetect(TransformData& outTransform, float* outExpression) override;
+
+	/**
+	* Call DLL - Execute facial pose estimation for every face in view, batched in one inference.
+	* Falls back to single face Detect if the DLL doesn't export DetectFaces.
+	* @param outFaces - Struct where result for all faces is copied to.
+	* @return Whether operation is succesful.
+	*/
+	virtual int CallDetectFaces(FaceBatchData& outFaces) override;
+
+	/**
+	* Call DLL - Change detect ratio without reopening the camera.
+	* Only available if the DLL exports Reconfigure.
+	* @param detectRatio - ratio to scale image by for initial face detection
+	* @return Whether operation is succesful.
+	*/
+	virtual int CallReconfigure(int detectRatio) override;
+
+	/**
+	* Call DLL - Get single frame as YUV planes, without BGRA conversion.
+	* Only available if the DLL exports GetRawImageYUV, which takes 1 for NV12 and 2 for I420.
+	* @param image - Pointer to write planes to.
+	* @param width - Resize width.
+	* @param height - Resize height.
+	* @param format - NV12 or I420.
+	* @return Whether operation is succesful.
+	*/
+	virtual int CallGetImageYUV(unsigned char* image, int width, int height, EFaceImageFormat format) override;
 
 	/**
 	* Call DLL - Get single frame from OpenCV camera stream, resize and reformat for Unreal.
@@ -94,7 +246,79 @@ public:
 	* @param height - Resize height.
 	* @return Whether operation is succesful.
 	*/
-	int CallGetImageCV(unsigned char* image, int width, int height);
+	virtual int CallGetImageCV(unsigned char* image, int width, int height) override;
+
+	/**
+	* Whether the DLL exports tracker instances, so several cameras can run at once.
+	*/
+	bool HasTrackerInstances() const { return m_funcCreateTracker != NULL; }
+
+	/**
+	* Call DLL - Create a tracker instance, sharing networks with every other instance.
+	* @return Tracker handle, or null if the DLL has no tracker instances.
+	*/
+	void* CallCreateTracker();
+
+	/**
+	* Call DLL - Destroy a tracker instance, closing its camera.
+	* @param tracker - Tracker handle.
+	*/
+	void CallDestroyTracker(void* tracker);
+
+	/**
+	* Call DLL - Open camera of a tracker instance, same arguments as CallInitCV.
+	* @param tracker - Tracker handle.
+	* @return Whether operation is succesful.
+	*/
+	int CallInitTracker(void* tracker, int& outCameraWidth, int& outCameraHeight, int detectRatio,
+		int camId, float fovZoom, bool draw, bool lockEyesNose);
+
+	/**
+	* Call DLL - Close camera of a tracker instance.
+	* @param tracker - Tracker handle.
+	*/
+	int CallCloseTracker(void* tracker);
+
+	/**
+	* Call DLL - Detect faces on the newest frame of several tracker instances, in one batched inference.
+	* @param trackers - Tracker handles.
+	* @param count - Number of trackers.
+	* @param outFaces - Struct per tracker where its faces are copied to.
+	* @return Whether operation is succesful.
+	*/
+	int CallDetectTrackers(void** trackers, int count, FaceBatchData* outFaces);
+
+	/**
+	* Call DLL - Get image of a tracker instance, see CallGetImageCV and CallGetImageYUV.
+	* @param tracker - Tracker handle.
+	* @return Whether operation is succesful.
+	*/
+	int CallGetTrackerImage(void* tracker, unsigned char* image, int width, int height);
+	int CallGetTrackerImageYUV(void* tracker, unsigned char* image, int width, int height, EFaceImageFormat format);
+
+	/**
+	* Call DLL - Change detect ratio of a tracker instance.
+	* @param tracker - Tracker handle.
+	* @return Whether operation is succesful.
+	*/
+	int CallReconfigureTracker(void* tracker, int detectRatio);
+
+	/**
+	* Whether the DLL can detect on images handed over, for offline processing.
+	*/
+	bool HasDetectImages() const { return m_funcDetectImages != NULL; }
+
+	/**
+	* Call DLL - Detect faces on consecutive frames of one sequence, in one batched inference.
+	* Needs CallInitCV with camId -1 first, which loads networks without opening a camera.
+	* @param images - BGRA images, oldest first.
+	* @param count - Number of images.
+	* @param width - Width of every image.
+	* @param height - Height of every image.
+	* @param outFaces - Struct per image where its faces are copied to.
+	* @return Whether operation is succesful.
+	*/
+	int CallDetectImages(const unsigned char** images, int count, int width, int height, FaceBatchData* outFaces);
 };
 
 